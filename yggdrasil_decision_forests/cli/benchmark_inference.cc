@@ -31,7 +31,20 @@
 //
 // The benchmark measures one copy of the dataset (from the best possible
 // existing format; a simple memory copy in the best case) and one run of the
-// engine.
+// engine. The latency of each batch is recorded and reported as percentiles.
+//
+// The "[zero-copy]" results measure the same engines on example set views
+// over an external buffer of examples (see "FastEngine::WrapExamples"), that
+// is, without the copy. The difference with the "[virtual interface]" results
+// is the cost of the copy.
+//
+// With --num_threads=N (N>1), each fast engine is additionally shared by N
+// threads running the benchmark concurrently. The aggregated throughput is
+// reported along with the scaling efficiency i.e. the ratio between the
+// multi-threaded throughput and N times the single-threaded throughput.
+//
+// With --report=<path>, the results are also exported in a machine-readable
+// format (see --report_format) e.g. to track regressions across releases.
 //
 // Usage example:
 //
@@ -43,18 +56,66 @@
 // Result:
 //
 //   batch_size : 100  num_runs : 20
-//   time/example(µs)  time/batch(µs)  method
+//   num_trees : 300  max_leaves/tree : 64  mean_leaves/tree : 53.2
+//
+//   num_threads : 1
+//   time/example(us)  time/batch(us)     p50(us)     p90(us)     p99(us)   p99.9(us)  method
 //   ----------------------------------------
-//   0.79025         79.025  GradientBoostedTreesQuickScorerExtended
-//   9.179           917.9   GradientBoostedTreesGeneric
-//   21.547          2154.8  Generic slow engine
+//            0.79025          79.025      78.429      80.149      87.576      441.98  GradientBoostedTreesQuickScorerExtended
+//              9.179           917.9      905.38       969.7      1198.4        2714  GradientBoostedTreesGeneric
+//             21.547          2154.8      2138.7      2224.2      2538.6      3942.2  Generic slow engine
 //   ----------------------------------------
 //
+// The tail latencies (p99, p99.9) are typically dominated by interruptions
+// (e.g. preemption, page faults) rather than by the engine itself.
+//
+// With --benchmark_categorical_strings, the "[categorical strings]" results
+// measure the setting of the string categorical features in the example set,
+// without running the engine.
+//
+// With --benchmark_example_parsing, the "[example parsing]" results measure the
+// parsing of proto::Examples and tf.Examples in the example set, without
+// running the engine.
+//
+// The relative speed of the engines depends on the structure of the model. For
+// example, the cost of the QuickScorer engine grows with the number of leaves
+// per tree (trees with more than 64 leaves use a multi-word leaf bitmap) while
+// the cost of the flat node engines (e.g. GradientBoostedTreesGeneric) grows
+// with the depth of the trees. Benchmarking models trained with different
+// "max_depth" shows where the engines cross over.
+//
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/barrier.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/example/example.pb.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/dataset/example.pb.h"
 #include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
 #include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
 #include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/example_set.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
 
 ABSL_FLAG(std::string, model, "", "Path to model.");
@@ -73,6 +134,29 @@ ABSL_FLAG(bool, generic, true,
           "Evaluates the slow engine i.e. model->predict(). The "
           "generic engine is slow and mostly a reference. Disable it if the "
           "benchmark runs for too long.");
+ABSL_FLAG(int, num_threads, 1,
+          "If greater than 1, each fast engine is also evaluated with "
+          "\"num_threads\" threads sharing the same engine. Each thread runs "
+          "the entire benchmark (i.e. \"num_runs\" runs on the dataset) with "
+          "its own buffers.");
+ABSL_FLAG(std::string, report, "",
+          "If set, path to a file where the results are exported in the "
+          "format specified by --report_format.");
+ABSL_FLAG(std::string, report_format, "csv",
+          "Format of the --report file. Can be \"csv\" or \"json\".");
+ABSL_FLAG(bool, benchmark_categorical_strings, false,
+          "If true, also benchmarks the setting of the categorical features "
+          "from their string representation (e.g. when preprocessing a "
+          "request) in the example set of the first fast engine: With a "
+          "lookup in the dataspec, with \"SetCategorical\", and with "
+          "\"SetCategoricalColumn\".");
+
+ABSL_FLAG(bool, benchmark_example_parsing, false,
+          "If true, also benchmarks the parsing of proto::Examples and "
+          "tf.Examples in the example set of the first fast engine: One "
+          "example at a time (\"FromProtoExample\", "
+          "\"FromTensorflowExample\"), and by batch (\"FromProtoExamples\", "
+          "\"FromTensorflowExamples\") with one and --num_threads threads.");
 
 constexpr char kUsageMessage[] =
     "Benchmarks the inference time of a model with the available inference "
@@ -80,10 +164,23 @@ constexpr char kUsageMessage[] =
 
 namespace yggdrasil_decision_forests {
 
+// Reported percentiles of the batch latency.
+constexpr double kLatencyPercentiles[] = {50., 90., 99., 99.9};
+constexpr int kNumLatencyPercentiles =
+    sizeof(kLatencyPercentiles) / sizeof(kLatencyPercentiles[0]);
+
 // Result from a single run.
 struct Result {
   std::string name;
+  int num_threads = 1;
+  // Wall time divided by the total number of examples processed by all the
+  // threads i.e. the inverse of the throughput.
   absl::Duration avg_inference_duration;
+  // Latency of a batch of examples, for each of "kLatencyPercentiles".
+  std::vector<absl::Duration> batch_latency_percentiles;
+  // Ratio between the throughput and "num_threads" times the single thread
+  // throughput of the same engine. -1 if not available.
+  double scaling_efficiency = -1;
 };
 
 // How to run the benchmark.
@@ -93,84 +190,367 @@ struct RunOptions {
   int warmup_runs;
 };
 
+// Structure of the model impacting the inference speed.
+struct ModelStructure {
+  // Number of trees. -1 if the model is not a decision forest.
+  int64_t num_trees = -1;
+  int64_t max_num_leaves_per_tree = 0;
+  double mean_num_leaves_per_tree = 0;
+};
+
+// Runs the inference on the examples [begin_example_idx, end_example_idx).
+// A "BatchRunner" is only used by a single thread.
+using BatchRunner =
+    std::function<void(int64_t begin_example_idx, int64_t end_example_idx)>;
+
+template <typename Trees>
+ModelStructure ComputeForestStructure(const Trees& trees) {
+  ModelStructure structure;
+  structure.num_trees = trees.size();
+  int64_t num_leaves = 0;
+  for (const auto& tree : trees) {
+    const int64_t num_leaves_in_tree = tree->NumLeafs();
+    num_leaves += num_leaves_in_tree;
+    structure.max_num_leaves_per_tree =
+        std::max(structure.max_num_leaves_per_tree, num_leaves_in_tree);
+  }
+  if (!trees.empty()) {
+    structure.mean_num_leaves_per_tree =
+        static_cast<double>(num_leaves) / trees.size();
+  }
+  return structure;
+}
+
+ModelStructure ComputeModelStructure(const model::AbstractModel& model) {
+  const auto* gbt_model = dynamic_cast<
+      const model::gradient_boosted_trees::GradientBoostedTreesModel*>(&model);
+  if (gbt_model) {
+    return ComputeForestStructure(gbt_model->decision_trees());
+  }
+  const auto* rf_model =
+      dynamic_cast<const model::random_forest::RandomForestModel*>(&model);
+  if (rf_model) {
+    return ComputeForestStructure(rf_model->decision_trees());
+  }
+  return {};
+}
+
+// Computes the "kLatencyPercentiles" (nearest-rank method) of a set of
+// latencies.
+std::vector<absl::Duration> ComputeLatencyPercentiles(
+    std::vector<absl::Duration> latencies) {
+  std::vector<absl::Duration> percentiles(kNumLatencyPercentiles);
+  if (latencies.empty()) {
+    return percentiles;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  for (int percentile_idx = 0; percentile_idx < kNumLatencyPercentiles;
+       percentile_idx++) {
+    const auto rank = static_cast<int64_t>(std::ceil(
+        kLatencyPercentiles[percentile_idx] / 100. * latencies.size()));
+    percentiles[percentile_idx] = latencies[std::min<int64_t>(
+        std::max<int64_t>(rank - 1, 0), latencies.size() - 1)];
+  }
+  return percentiles;
+}
+
+// Runs the benchmark with "num_threads" threads. Each thread creates its own
+// "BatchRunner" with "create_runner", and runs "options.warmup_runs" warmup
+// runs and "options.num_runs" timed runs on the entire dataset.
+//
+// The threads start the timed runs at the same time. The throughput is
+// measured from the start of the first timed run to the end of the last one.
+Result RunBenchmark(const RunOptions& options, const int64_t num_examples,
+                    const int num_threads,
+                    const std::function<BatchRunner()>& create_runner) {
+  const int64_t num_batches =
+      (num_examples + options.batch_size - 1) / options.batch_size;
+
+  std::vector<std::vector<absl::Duration>> latencies_per_thread(num_threads);
+  std::vector<absl::Time> start_times(num_threads);
+  std::vector<absl::Time> end_times(num_threads);
+  absl::Barrier start_barrier(num_threads);
+
+  const auto run_thread = [&](const int thread_idx) {
+    auto runner = create_runner();
+    auto& latencies = latencies_per_thread[thread_idx];
+    latencies.reserve(num_batches * options.num_runs);
+
+    const auto run_once = [&](const bool record_latency) {
+      for (int64_t batch_idx = 0; batch_idx < num_batches; batch_idx++) {
+        const int64_t begin_example_idx = batch_idx * options.batch_size;
+        const int64_t end_example_idx =
+            std::min(begin_example_idx + options.batch_size, num_examples);
+        const auto begin_batch_time = absl::Now();
+        runner(begin_example_idx, end_example_idx);
+        if (record_latency) {
+          latencies.push_back(absl::Now() - begin_batch_time);
+        }
+      }
+    };
+
+    // Warming up.
+    for (int run_idx = 0; run_idx < options.warmup_runs; run_idx++) {
+      run_once(false);
+    }
+
+    // Run benchmark.
+    start_barrier.Block();
+    start_times[thread_idx] = absl::Now();
+    for (int run_idx = 0; run_idx < options.num_runs; run_idx++) {
+      run_once(true);
+    }
+    end_times[thread_idx] = absl::Now();
+  };
+
+  if (num_threads == 1) {
+    run_thread(0);
+  } else {
+    utils::concurrency::ThreadPool pool("benchmark", num_threads);
+    pool.StartWorkers();
+    for (int thread_idx = 0; thread_idx < num_threads; thread_idx++) {
+      pool.Schedule([&run_thread, thread_idx]() { run_thread(thread_idx); });
+    }
+  }
+
+  std::vector<absl::Duration> latencies;
+  for (const auto& thread_latencies : latencies_per_thread) {
+    latencies.insert(latencies.end(), thread_latencies.begin(),
+                     thread_latencies.end());
+  }
+
+  Result result;
+  result.num_threads = num_threads;
+  result.avg_inference_duration =
+      (*std::max_element(end_times.begin(), end_times.end()) -
+       *std::min_element(start_times.begin(), start_times.end())) /
+      (static_cast<int64_t>(options.num_runs) * num_examples * num_threads);
+  result.batch_latency_percentiles =
+      ComputeLatencyPercentiles(std::move(latencies));
+  return result;
+}
+
+// Name of the percentile columns e.g. "p99.9".
+std::vector<std::string> LatencyPercentileNames() {
+  std::vector<std::string> names;
+  for (const double percentile : kLatencyPercentiles) {
+    names.push_back(absl::StrCat("p", percentile));
+  }
+  return names;
+}
+
 std::string ResultsToString(const RunOptions& options,
+                            const ModelStructure& structure,
                             std::vector<Result> results) {
   std::string report;
 
   // Sort the result from the fastest to the slowest.
-  std::sort(results.begin(), results.end(), [](const auto& a, const auto& b) {
-    return a.avg_inference_duration < b.avg_inference_duration;
-  });
+  std::stable_sort(results.begin(), results.end(),
+                   [](const auto& a, const auto& b) {
+                     if (a.num_threads != b.num_threads) {
+                       return a.num_threads < b.num_threads;
+                     }
+                     return a.avg_inference_duration <
+                            b.avg_inference_duration;
+                   });
 
   absl::StrAppendFormat(&report, "batch_size : %d  num_runs : %d\n",
                         options.batch_size, options.num_runs);
-  absl::StrAppendFormat(&report, "time/example(us)  time/batch(us)  method\n");
-  absl::StrAppendFormat(&report, "----------------------------------------\n");
+  if (structure.num_trees >= 0) {
+    absl::StrAppendFormat(
+        &report,
+        "num_trees : %d  max_leaves/tree : %d  mean_leaves/tree : %.1f\n",
+        structure.num_trees, structure.max_num_leaves_per_tree,
+        structure.mean_num_leaves_per_tree);
+  }
+
+  std::string percentile_header;
+  for (const auto& name : LatencyPercentileNames()) {
+    absl::StrAppendFormat(&percentile_header, "  %10s",
+                          absl::StrCat(name, "(us)"));
+  }
+
+  int current_num_threads = 0;
   for (const auto& result : results) {
+    if (result.num_threads != current_num_threads) {
+      // New table.
+      if (current_num_threads != 0) {
+        absl::StrAppendFormat(&report,
+                              "----------------------------------------\n");
+      }
+      current_num_threads = result.num_threads;
+      absl::StrAppendFormat(&report, "\nnum_threads : %d\n",
+                            current_num_threads);
+      absl::StrAppendFormat(&report, "time/example(us)  time/batch(us)%s",
+                            percentile_header);
+      if (current_num_threads > 1) {
+        absl::StrAppendFormat(&report, "  scaling");
+      }
+      absl::StrAppendFormat(&report, "  method\n");
+      absl::StrAppendFormat(&report,
+                            "----------------------------------------\n");
+    }
+
     absl::StrAppendFormat(
-        &report, "%16.5g  %14.5g  %s\n",
+        &report, "%16.5g  %14.5g",
         absl::ToDoubleMicroseconds(result.avg_inference_duration),
         absl::ToDoubleMicroseconds(result.avg_inference_duration *
-                                   options.batch_size),
-        result.name);
+                                   options.batch_size));
+    for (const auto latency : result.batch_latency_percentiles) {
+      absl::StrAppendFormat(&report, "  %10.5g",
+                            absl::ToDoubleMicroseconds(latency));
+    }
+    if (current_num_threads > 1) {
+      absl::StrAppendFormat(&report, "  %7.3f", result.scaling_efficiency);
+    }
+    absl::StrAppendFormat(&report, "  %s\n", result.name);
   }
   absl::StrAppendFormat(&report, "----------------------------------------\n");
   return report;
 }
 
+// Exports the results as a CSV file with one row per result.
+std::string ResultsToCsv(const RunOptions& options,
+                         const std::vector<Result>& results) {
+  std::vector<std::string> header = {"method",
+                                     "num_threads",
+                                     "batch_size",
+                                     "num_runs",
+                                     "time_per_example_us",
+                                     "throughput_examples_per_second",
+                                     "scaling_efficiency"};
+  for (const auto& name : LatencyPercentileNames()) {
+    header.push_back(absl::StrCat("batch_latency_", name, "_us"));
+  }
+  std::string report = absl::StrCat(absl::StrJoin(header, ","), "\n");
+
+  for (const auto& result : results) {
+    std::vector<std::string> row = {
+        absl::StrCat("\"", result.name, "\""),
+        absl::StrCat(result.num_threads),
+        absl::StrCat(options.batch_size),
+        absl::StrCat(options.num_runs),
+        absl::StrCat(absl::ToDoubleMicroseconds(result.avg_inference_duration)),
+        absl::StrCat(1. / absl::ToDoubleSeconds(result.avg_inference_duration)),
+        absl::StrCat(result.scaling_efficiency)};
+    for (const auto latency : result.batch_latency_percentiles) {
+      row.push_back(absl::StrCat(absl::ToDoubleMicroseconds(latency)));
+    }
+    absl::StrAppend(&report, absl::StrJoin(row, ","), "\n");
+  }
+  return report;
+}
+
+// Exports the results as a JSON object.
+std::string ResultsToJson(const RunOptions& options,
+                          const ModelStructure& structure,
+                          const std::vector<Result>& results) {
+  std::string report;
+  absl::StrAppendFormat(&report,
+                        "{\n  \"batch_size\": %d,\n  \"num_runs\": %d,\n",
+                        options.batch_size, options.num_runs);
+  if (structure.num_trees >= 0) {
+    absl::StrAppendFormat(&report,
+                          "  \"num_trees\": %d,\n  \"max_leaves_per_tree\": "
+                          "%d,\n  \"mean_leaves_per_tree\": %g,\n",
+                          structure.num_trees,
+                          structure.max_num_leaves_per_tree,
+                          structure.mean_num_leaves_per_tree);
+  }
+  absl::StrAppend(&report, "  \"results\": [");
+  const auto percentile_names = LatencyPercentileNames();
+  for (int result_idx = 0; result_idx < results.size(); result_idx++) {
+    const auto& result = results[result_idx];
+    std::vector<std::string> latencies;
+    for (int percentile_idx = 0; percentile_idx < kNumLatencyPercentiles;
+         percentile_idx++) {
+      latencies.push_back(absl::StrFormat(
+          "\"%s\": %g", percentile_names[percentile_idx],
+          absl::ToDoubleMicroseconds(
+              result.batch_latency_percentiles[percentile_idx])));
+    }
+    absl::StrAppendFormat(
+        &report,
+        "%s\n    {\"method\": \"%s\", \"num_threads\": %d, "
+        "\"time_per_example_us\": %g, \"throughput_examples_per_second\": %g, "
+        "\"scaling_efficiency\": %g, \"batch_latency_us\": {%s}}",
+        result_idx == 0 ? "" : ",", result.name, result.num_threads,
+        absl::ToDoubleMicroseconds(result.avg_inference_duration),
+        1. / absl::ToDoubleSeconds(result.avg_inference_duration),
+        result.scaling_efficiency, absl::StrJoin(latencies, ", "));
+  }
+  absl::StrAppend(&report, "\n  ]\n}\n");
+  return report;
+}
+
 absl::Status BenchmarkGenericSlowEngine(const RunOptions& options,
                                         const model::AbstractModel& model,
                                         const dataset::VerticalDataset& dataset,
                                         std::vector<Result>* results) {
   std::vector<float> predictions(dataset.nrow());
 
-  auto run_once = [&]() {
-    model::proto::Prediction prediction;
-    for (dataset::VerticalDataset::row_t example_idx = 0;
-         example_idx < dataset.nrow(); example_idx++) {
-      model.Predict(dataset, example_idx, &prediction);
-      switch (prediction.type_case()) {
-        case model::proto::Prediction::kClassification:
-          predictions[example_idx] =
-              prediction.classification().distribution().counts(2) /
-              prediction.classification().distribution().sum();
-          break;
-        case model::proto::Prediction::kRegression:
-          predictions[example_idx] = prediction.regression().value();
-          break;
-        case model::proto::Prediction::kRanking:
-          predictions[example_idx] = prediction.ranking().relevance();
-          break;
-        default:
-          LOG(INFO) << "Non supported task";
+  const auto create_runner = [&]() -> BatchRunner {
+    return [&](const int64_t begin_example_idx, const int64_t end_example_idx) {
+      model::proto::Prediction prediction;
+      for (dataset::VerticalDataset::row_t example_idx = begin_example_idx;
+           example_idx < end_example_idx; example_idx++) {
+        model.Predict(dataset, example_idx, &prediction);
+        switch (prediction.type_case()) {
+          case model::proto::Prediction::kClassification:
+            predictions[example_idx] =
+                prediction.classification().distribution().counts(2) /
+                prediction.classification().distribution().sum();
+            break;
+          case model::proto::Prediction::kRegression:
+            predictions[example_idx] = prediction.regression().value();
+            break;
+          case model::proto::Prediction::kRanking:
+            predictions[example_idx] = prediction.ranking().relevance();
+            break;
+          default:
+            LOG(INFO) << "Non supported task";
+        }
       }
-    }
+    };
   };
 
-  // Warming up.
-  for (int run_idx = 0; run_idx < options.warmup_runs; run_idx++) {
-    run_once();
-  }
+  auto result = RunBenchmark(options, dataset.nrow(), /*num_threads=*/1,
+                             create_runner);
+  result.name = "Generic slow engine";
+  results->push_back(std::move(result));
+  return absl::OkStatus();
+}
 
-  // Run benchmark.
-  const auto start_time = absl::Now();
-  for (int run_idx = 0; run_idx < options.num_runs; run_idx++) {
-    run_once();
+// Runs "RunBenchmark" with one thread and, if "num_threads > 1", with
+// "num_threads" threads. The multi-threaded result is reported first, along
+// with its scaling efficiency.
+void RunSingleAndMultiThreadedBenchmarks(
+    const RunOptions& options, const std::string& name,
+    const int64_t num_examples, const int num_threads,
+    const std::function<BatchRunner()>& create_runner,
+    std::vector<Result>* results) {
+  auto single_thread_result =
+      RunBenchmark(options, num_examples, /*num_threads=*/1, create_runner);
+  single_thread_result.name = name;
+
+  if (num_threads > 1) {
+    auto multi_thread_result =
+        RunBenchmark(options, num_examples, num_threads, create_runner);
+    multi_thread_result.name = name;
+    multi_thread_result.scaling_efficiency =
+        absl::FDivDuration(single_thread_result.avg_inference_duration,
+                           multi_thread_result.avg_inference_duration) /
+        num_threads;
+    results->push_back(std::move(multi_thread_result));
   }
-  const auto end_time = absl::Now();
 
-  // Save results.
-  results->push_back(
-      {/*.name =*/"Generic slow engine",
-       /*.avg_inference_duration =*/
-       (end_time - start_time) / (options.num_runs * dataset.nrow())});
-  return absl::OkStatus();
+  results->push_back(std::move(single_thread_result));
 }
 
 absl::Status BenchmarkFastEngineWithVirtualInterface(
     const RunOptions& options, const model::FastEngineFactory& engine_factory,
     const model::AbstractModel& model, const dataset::VerticalDataset& dataset,
-    std::vector<Result>* results) {
+    const int num_threads, std::vector<Result>* results) {
   // Compile the model.
   ASSIGN_OR_RETURN(const auto engine, engine_factory.CreateEngine(&model));
   const auto& engine_features = engine->features();
@@ -183,44 +563,333 @@ absl::Status BenchmarkFastEngineWithVirtualInterface(
       /*begin_example_idx=*/0,
       /*end_example_idx=*/total_num_examples, engine_features, examples.get()));
 
-  // Allocate a batch of examples.
-  auto batch_of_examples = engine->AllocateExamples(options.batch_size);
-  const int64_t num_batches =
-      (total_num_examples + options.batch_size - 1) / options.batch_size;
-
-  std::vector<float> predictions(dataset.nrow());
-
-  auto run_once = [&]() {
-    for (int64_t batch_idx = 0; batch_idx < num_batches; batch_idx++) {
-      const int64_t begin_example_idx = batch_idx * options.batch_size;
-      const int64_t end_example_idx =
-          std::min(begin_example_idx + options.batch_size, total_num_examples);
+  // Each runner has its own batch of examples and predictions, while the
+  // engine is shared.
+  const auto create_runner = [&]() -> BatchRunner {
+    std::shared_ptr<serving::AbstractExampleSet> batch_of_examples =
+        engine->AllocateExamples(options.batch_size);
+    auto predictions = std::make_shared<std::vector<float>>();
+    return [&, batch_of_examples, predictions](
+               const int64_t begin_example_idx, const int64_t end_example_idx) {
       // Copy the examples.
       CHECK_OK(examples->Copy(begin_example_idx, end_example_idx,
                               engine_features, batch_of_examples.get()));
       // Runs the engine.
       engine->Predict(*batch_of_examples, end_example_idx - begin_example_idx,
-                      &predictions);
+                      predictions.get());
+    };
+  };
+
+  RunSingleAndMultiThreadedBenchmarks(
+      options, absl::StrCat(engine_factory.name(), " [virtual interface]"),
+      total_num_examples, num_threads, create_runner, results);
+  return absl::OkStatus();
+}
+
+// Benchmarks an engine on views over an external buffer of examples, that is,
+// without copying the examples into the engine's example set. The buffer is
+// filled once (e.g. as a feature service would) with consecutive batches of
+// "options.batch_size" examples, each batch in the layout expected by the
+// engine, so that each batch is viewed without copy.
+absl::Status BenchmarkFastEngineWithZeroCopy(
+    const RunOptions& options, const model::FastEngineFactory& engine_factory,
+    const model::AbstractModel& model, const dataset::VerticalDataset& dataset,
+    const int num_threads, std::vector<Result>* results) {
+  ASSIGN_OR_RETURN(const auto engine, engine_factory.CreateEngine(&model));
+  const auto& engine_features = engine->features();
+  if (!engine_features.categorical_set_features().empty()) {
+    // Categorical-set values are not stored in the fixed-length buffer.
+    LOG(INFO) << "Engine " << engine_factory.name()
+              << " consumes categorical-set features. Zero-copy skipped.";
+    return absl::OkStatus();
+  }
+
+  // Find the example format of the engine.
+  const int64_t total_num_examples = dataset.nrow();
+  const int num_features = engine_features.fixed_length_features().size();
+  const std::vector<serving::NumericalOrCategoricalValue> probe(num_features);
+  absl::optional<serving::ExampleFormat> format;
+  for (const auto candidate_format :
+       {serving::ExampleFormat::FORMAT_EXAMPLE_MAJOR,
+        serving::ExampleFormat::FORMAT_FEATURE_MAJOR}) {
+    if (engine->WrapExamples(probe, /*num_examples=*/1, candidate_format)
+            .ok()) {
+      format = candidate_format;
+      break;
     }
+  }
+  if (!format.has_value()) {
+    LOG(INFO) << "Engine " << engine_factory.name()
+              << " does not support views over external examples. Zero-copy "
+                 "skipped.";
+    return absl::OkStatus();
+  }
+
+  std::vector<serving::NumericalOrCategoricalValue> buffer;
+  buffer.reserve(total_num_examples * num_features);
+  std::vector<serving::NumericalOrCategoricalValue> batch;
+  for (int64_t begin_example_idx = 0; begin_example_idx < total_num_examples;
+       begin_example_idx += options.batch_size) {
+    const int64_t end_example_idx = std::min(
+        begin_example_idx + options.batch_size, total_num_examples);
+    RETURN_IF_ERROR(serving::decision_forest::LoadFlatBatchFromDataset(
+        dataset, begin_example_idx, end_example_idx,
+        serving::FeatureNames(engine_features.fixed_length_features()),
+        engine_features.fixed_length_na_replacement_values(), &batch,
+        *format));
+    // Makes sure that the engine accepts the batch before benchmarking it.
+    RETURN_IF_ERROR(
+        engine
+            ->WrapExamples(batch, end_example_idx - begin_example_idx, *format)
+            .status());
+    buffer.insert(buffer.end(), batch.begin(), batch.end());
+  }
+
+  const auto create_runner = [&]() -> BatchRunner {
+    auto predictions = std::make_shared<std::vector<float>>();
+    return [&, predictions](const int64_t begin_example_idx,
+                            const int64_t end_example_idx) {
+      const int64_t num_examples = end_example_idx - begin_example_idx;
+      const auto batch_of_examples = engine->WrapExamples(
+          absl::MakeConstSpan(buffer).subspan(begin_example_idx * num_features,
+                                              num_examples * num_features),
+          num_examples, *format);
+      // Note: All the batches were successfully wrapped above.
+      CHECK_OK(batch_of_examples.status());
+      engine->Predict(**batch_of_examples, num_examples, predictions.get());
+    };
   };
 
-  // Warming up.
-  for (int run_idx = 0; run_idx < options.warmup_runs; run_idx++) {
-    run_once();
+  RunSingleAndMultiThreadedBenchmarks(
+      options,
+      absl::StrCat(engine_factory.name(), " [virtual interface, zero-copy]"),
+      total_num_examples, num_threads, create_runner, results);
+  return absl::OkStatus();
+}
+
+// Benchmarks the setting of the string categorical features in the example set
+// of an engine.
+absl::Status BenchmarkCategoricalStrings(
+    const RunOptions& options, const model::FastEngineFactory& engine_factory,
+    const model::AbstractModel& model, const dataset::VerticalDataset& dataset,
+    std::vector<Result>* results) {
+  ASSIGN_OR_RETURN(const auto engine, engine_factory.CreateEngine(&model));
+  const auto& engine_features = engine->features();
+
+  // String values of the non-integerized categorical features.
+  struct StringFeature {
+    serving::FeaturesDefinition::CategoricalFeatureId id;
+    const dataset::proto::Column* col_spec;
+    std::vector<std::string> values;
+    std::vector<absl::string_view> value_views;
+  };
+  std::vector<StringFeature> string_features;
+  for (const auto& feature : engine_features.fixed_length_features()) {
+    const auto& col_spec = dataset.data_spec().columns(feature.spec_idx);
+    if (feature.type != dataset::proto::ColumnType::CATEGORICAL ||
+        col_spec.categorical().is_already_integerized()) {
+      continue;
+    }
+    const auto* column =
+        dataset.ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
+            feature.spec_idx);
+    StringFeature string_feature;
+    string_feature.id.index = feature.internal_idx;
+    string_feature.col_spec = &col_spec;
+    for (const int value : column->values()) {
+      string_feature.values.push_back(
+          value < 0 ? ""
+                    : dataset::CategoricalIdxToRepresentation(col_spec, value));
+    }
+    string_features.push_back(std::move(string_feature));
+  }
+  if (string_features.empty()) {
+    LOG(INFO) << "The model has no string categorical features.";
+    return absl::OkStatus();
+  }
+  for (auto& string_feature : string_features) {
+    string_feature.value_views.assign(string_feature.values.begin(),
+                                      string_feature.values.end());
+  }
+
+  const int64_t total_num_examples = dataset.nrow();
+  const auto benchmark = [&](const std::string& name, const auto& set_batch) {
+    const auto create_runner = [&]() -> BatchRunner {
+      std::shared_ptr<serving::AbstractExampleSet> batch_of_examples =
+          engine->AllocateExamples(options.batch_size);
+      return [&, batch_of_examples](const int64_t begin_example_idx,
+                                    const int64_t end_example_idx) {
+        set_batch(begin_example_idx, end_example_idx, batch_of_examples.get());
+      };
+    };
+    auto result = RunBenchmark(options, total_num_examples,
+                               /*num_threads=*/1, create_runner);
+    result.name = absl::StrCat("[categorical strings] ", name);
+    results->push_back(std::move(result));
+  };
+
+  benchmark("dataspec lookup + SetCategorical(int)",
+            [&](const int64_t begin_example_idx, const int64_t end_example_idx,
+                serving::AbstractExampleSet* examples) {
+              for (int64_t example_idx = begin_example_idx;
+                   example_idx < end_example_idx; example_idx++) {
+                for (const auto& feature : string_features) {
+                  examples->SetCategorical(
+                      example_idx - begin_example_idx, feature.id,
+                      dataset::CategoricalStringToValue(
+                          feature.values[example_idx], *feature.col_spec),
+                      engine_features);
+                }
+              }
+            });
+
+  benchmark("SetCategorical(string)",
+            [&](const int64_t begin_example_idx, const int64_t end_example_idx,
+                serving::AbstractExampleSet* examples) {
+              for (int64_t example_idx = begin_example_idx;
+                   example_idx < end_example_idx; example_idx++) {
+                for (const auto& feature : string_features) {
+                  examples->SetCategorical(example_idx - begin_example_idx,
+                                           feature.id,
+                                           feature.values[example_idx],
+                                           engine_features);
+                }
+              }
+            });
+
+  benchmark("SetCategoricalColumn",
+            [&](const int64_t begin_example_idx, const int64_t end_example_idx,
+                serving::AbstractExampleSet* examples) {
+              for (const auto& feature : string_features) {
+                examples->SetCategoricalColumn(
+                    feature.id,
+                    absl::MakeConstSpan(feature.value_views)
+                        .subspan(begin_example_idx,
+                                 end_example_idx - begin_example_idx),
+                    engine_features);
+              }
+            });
+
+  return absl::OkStatus();
+}
+
+// Benchmarks the parsing of proto::Examples and tf.Examples into the example
+// set of an engine, one example at a time and by batch.
+absl::Status BenchmarkExampleParsing(
+    const RunOptions& options, const model::FastEngineFactory& engine_factory,
+    const model::AbstractModel& model, const dataset::VerticalDataset& dataset,
+    const int num_threads, std::vector<Result>* results) {
+  ASSIGN_OR_RETURN(const auto engine, engine_factory.CreateEngine(&model));
+  const auto& engine_features = engine->features();
+
+  const int64_t total_num_examples = dataset.nrow();
+  std::vector<dataset::proto::Example> proto_examples(total_num_examples);
+  std::vector<tensorflow::Example> tf_examples(total_num_examples);
+  std::vector<const tensorflow::Example*> tf_example_ptrs;
+  tf_example_ptrs.reserve(total_num_examples);
+  for (int64_t example_idx = 0; example_idx < total_num_examples;
+       example_idx++) {
+    dataset.ExtractExample(example_idx, &proto_examples[example_idx]);
+    RETURN_IF_ERROR(dataset::ExampleToTfExampleWithStatus(
+        proto_examples[example_idx], dataset.data_spec(),
+        &tf_examples[example_idx]));
+    // Missing values are represented by absent features.
+    auto* tf_features =
+        tf_examples[example_idx].mutable_features()->mutable_feature();
+    for (auto it = tf_features->begin(); it != tf_features->end();) {
+      if (it->second.kind_case() == tensorflow::Feature::KIND_NOT_SET) {
+        it = tf_features->erase(it);
+      } else {
+        ++it;
+      }
+    }
+    tf_example_ptrs.push_back(&tf_examples[example_idx]);
   }
 
-  // Run benchmark.
-  const auto start_time = absl::Now();
-  for (int run_idx = 0; run_idx < options.num_runs; run_idx++) {
-    run_once();
+  // The calling thread participates in the batch parsing.
+  std::unique_ptr<utils::concurrency::ThreadPool> thread_pool;
+  if (num_threads > 1) {
+    thread_pool = absl::make_unique<utils::concurrency::ThreadPool>(
+        "parsing", num_threads - 1);
+    thread_pool->StartWorkers();
+  }
+
+  const auto benchmark = [&](const std::string& name, const auto& parse_batch) {
+    const auto create_runner = [&]() -> BatchRunner {
+      std::shared_ptr<serving::AbstractExampleSet> batch_of_examples =
+          engine->AllocateExamples(options.batch_size);
+      return [&, batch_of_examples](const int64_t begin_example_idx,
+                                    const int64_t end_example_idx) {
+        batch_of_examples->FillMissing(engine_features);
+        CHECK_OK(parse_batch(begin_example_idx, end_example_idx,
+                             batch_of_examples.get()));
+      };
+    };
+    auto result = RunBenchmark(options, total_num_examples,
+                               /*num_threads=*/1, create_runner);
+    result.name = absl::StrCat("[example parsing] ", name);
+    results->push_back(std::move(result));
+  };
+
+  benchmark("FromProtoExample loop",
+            [&](const int64_t begin_example_idx, const int64_t end_example_idx,
+                serving::AbstractExampleSet* examples) -> absl::Status {
+              for (int64_t example_idx = begin_example_idx;
+                   example_idx < end_example_idx; example_idx++) {
+                RETURN_IF_ERROR(examples->FromProtoExample(
+                    proto_examples[example_idx],
+                    example_idx - begin_example_idx, engine_features));
+              }
+              return absl::OkStatus();
+            });
+
+  benchmark("FromTensorflowExample loop",
+            [&](const int64_t begin_example_idx, const int64_t end_example_idx,
+                serving::AbstractExampleSet* examples) -> absl::Status {
+              for (int64_t example_idx = begin_example_idx;
+                   example_idx < end_example_idx; example_idx++) {
+                RETURN_IF_ERROR(examples->FromTensorflowExample(
+                    tf_examples[example_idx], example_idx - begin_example_idx,
+                    engine_features));
+              }
+              return absl::OkStatus();
+            });
+
+  // Batch parsing with one thread and, if "num_threads > 1", with
+  // "num_threads" threads.
+  std::vector<utils::concurrency::ThreadPool*> batch_thread_pools = {nullptr};
+  if (thread_pool) {
+    batch_thread_pools.push_back(thread_pool.get());
+  }
+  for (auto* batch_thread_pool : batch_thread_pools) {
+    const std::string suffix =
+        batch_thread_pool ? absl::StrCat(" ", num_threads, " threads") : "";
+
+    benchmark(absl::StrCat("FromProtoExamples", suffix),
+              [&](const int64_t begin_example_idx,
+                  const int64_t end_example_idx,
+                  serving::AbstractExampleSet* examples) {
+                return examples->FromProtoExamples(
+                    absl::MakeConstSpan(proto_examples)
+                        .subspan(begin_example_idx,
+                                 end_example_idx - begin_example_idx),
+                    /*begin_example_idx=*/0, engine_features,
+                    batch_thread_pool);
+              });
+
+    benchmark(absl::StrCat("FromTensorflowExamples", suffix),
+              [&](const int64_t begin_example_idx,
+                  const int64_t end_example_idx,
+                  serving::AbstractExampleSet* examples) {
+                return examples->FromTensorflowExamples(
+                    absl::MakeConstSpan(tf_example_ptrs)
+                        .subspan(begin_example_idx,
+                                 end_example_idx - begin_example_idx),
+                    /*begin_example_idx=*/0, engine_features,
+                    batch_thread_pool);
+              });
   }
-  const auto end_time = absl::Now();
 
-  // Save results.
-  results->push_back(
-      {/*.name =*/absl::StrCat(engine_factory.name(), " [virtual interface]"),
-       /*.avg_inference_duration =*/
-       (end_time - start_time) / (options.num_runs * dataset.nrow())});
   return absl::OkStatus();
 }
 
@@ -236,6 +905,19 @@ absl::Status Benchmark() {
     return absl::InvalidArgumentError("The --dataset is not specified.");
   }
 
+  const int num_threads = absl::GetFlag(FLAGS_num_threads);
+  if (num_threads < 1) {
+    return absl::InvalidArgumentError("--num_threads should be at least 1.");
+  }
+
+  const auto report_path = absl::GetFlag(FLAGS_report);
+  const auto report_format = absl::GetFlag(FLAGS_report_format);
+  if (report_format != "csv" && report_format != "json") {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown --report_format \"", report_format,
+                     "\". Possible values are \"csv\" and \"json\"."));
+  }
+
   const RunOptions options{
       /*.num_runs =*/absl::GetFlag(FLAGS_num_runs),
       /*.batch_size =*/absl::GetFlag(FLAGS_batch_size),
@@ -261,7 +943,26 @@ absl::Status Benchmark() {
   for (const auto& engine_factory : engine_factories) {
     LOG(INFO) << "Running " << engine_factory->name();
     RETURN_IF_ERROR(BenchmarkFastEngineWithVirtualInterface(
-        options, *engine_factory, *model.get(), dataset, &results));
+        options, *engine_factory, *model.get(), dataset, num_threads,
+        &results));
+    RETURN_IF_ERROR(BenchmarkFastEngineWithZeroCopy(
+        options, *engine_factory, *model.get(), dataset, num_threads,
+        &results));
+  }
+
+  if (absl::GetFlag(FLAGS_benchmark_categorical_strings) &&
+      !engine_factories.empty()) {
+    LOG(INFO) << "Running the categorical strings benchmark";
+    RETURN_IF_ERROR(BenchmarkCategoricalStrings(
+        options, *engine_factories.front(), *model, dataset, &results));
+  }
+
+  if (absl::GetFlag(FLAGS_benchmark_example_parsing) &&
+      !engine_factories.empty()) {
+    LOG(INFO) << "Running the example parsing benchmark";
+    RETURN_IF_ERROR(BenchmarkExampleParsing(options, *engine_factories.front(),
+                                            *model, dataset, num_threads,
+                                            &results));
   }
 
   if (absl::GetFlag(FLAGS_generic)) {
@@ -271,7 +972,17 @@ absl::Status Benchmark() {
   }
 
   // Show results.
-  std::cout << ResultsToString(options, results);
+  const auto structure = ComputeModelStructure(*model);
+  std::cout << ResultsToString(options, structure, results);
+
+  // Export results.
+  if (!report_path.empty()) {
+    const auto report = report_format == "json"
+                            ? ResultsToJson(options, structure, results)
+                            : ResultsToCsv(options, results);
+    RETURN_IF_ERROR(file::SetContent(report_path, report));
+    LOG(INFO) << "Report written to " << report_path;
+  }
   return absl::OkStatus();
 }
 
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the predictions of the reduced precision leaf engines (see
+// "GenericRandomForestMulticlassClassificationCompactLeaves" in
+// "serving/decision_forest/decision_forest.h") with the predictions of the
+// full precision engine on a dataset.
+//
+// Usage example:
+//   compare_leaf_precision --model=/path/to/model \
+//     --dataset=csv:/path/to/dataset.csv
+//
+// Output example:
+//   Leaf values  Memory (bytes)  Max delta  Mean delta  Changed top class
+//   float32             1600000          0           0                  0
+//   float16              800000   0.000214    1.21e-05                  0
+//   ...
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/example_set.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
+
+ABSL_FLAG(std::string, model, "",
+          "Model directory. Should be a multi-class Random Forest.");
+
+ABSL_FLAG(std::string, dataset, "",
+          "Typed path to dataset i.e. [type]:[path] format.");
+
+constexpr char kUsageMessage[] =
+    "Compares the predictions of the reduced precision leaf engines with the "
+    "full precision engine.";
+
+namespace yggdrasil_decision_forests {
+namespace cli {
+
+using model::random_forest::RandomForestModel;
+using serving::decision_forest::BFloat16LeafValue;
+using serving::decision_forest::Float16LeafValue;
+using serving::decision_forest::GenericRandomForestMulticlassClassification;
+using serving::decision_forest::
+    GenericRandomForestMulticlassClassificationCompactLeaves;
+using serving::decision_forest::UInt8LeafValue;
+
+// Differences between the predictions of an engine and the full precision
+// engine.
+struct Comparison {
+  std::string name;
+  // Memory used by the leaf values.
+  size_t leaf_value_bytes = 0;
+  // Maximum and mean absolute difference of the class probabilities.
+  float max_delta = 0.f;
+  double mean_delta = 0.;
+  // Number of examples for which the class with the highest probability is
+  // different.
+  int64_t num_changed_top_classes = 0;
+};
+
+// Index of the highest value.
+int ArgMax(absl::Span<const float> values) {
+  return std::max_element(values.begin(), values.end()) - values.begin();
+}
+
+// Compiles "src" into "Engine" and computes the predictions on "dataset".
+template <typename Engine>
+absl::Status CompileAndPredict(const RandomForestModel& src,
+                               const dataset::VerticalDataset& dataset,
+                               Engine* engine,
+                               std::vector<float>* predictions) {
+  RETURN_IF_ERROR(
+      serving::decision_forest::GenericToSpecializedModel(src, engine));
+  ASSIGN_OR_RETURN(const auto examples,
+                   serving::VerticalDatasetToExampleSet(dataset, *engine));
+  serving::decision_forest::Predict(*engine, examples, dataset.nrow(),
+                                    predictions);
+  return absl::OkStatus();
+}
+
+// Compares the engine with "LeafValue" encoding with the full precision
+// predictions "expected_predictions".
+template <typename LeafValue>
+absl::Status Compare(const RandomForestModel& src,
+                     const dataset::VerticalDataset& dataset,
+                     const std::vector<float>& expected_predictions,
+                     const absl::string_view name,
+                     std::vector<Comparison>* comparisons) {
+  // Note: uint32 node offsets support trees of any size.
+  GenericRandomForestMulticlassClassificationCompactLeaves<LeafValue, uint32_t>
+      engine;
+  std::vector<float> predictions;
+  RETURN_IF_ERROR(CompileAndPredict(src, dataset, &engine, &predictions));
+
+  Comparison comparison;
+  comparison.name = std::string(name);
+  comparison.leaf_value_bytes = engine.compact_label_buffer.size() *
+                                sizeof(typename LeafValue::Storage);
+  const int num_classes = engine.num_classes;
+  for (size_t idx = 0; idx < predictions.size(); idx++) {
+    const float delta = std::abs(predictions[idx] - expected_predictions[idx]);
+    comparison.max_delta = std::max(comparison.max_delta, delta);
+    comparison.mean_delta += delta;
+  }
+  if (!predictions.empty()) {
+    comparison.mean_delta /= predictions.size();
+  }
+  for (size_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
+    const auto begin = example_idx * num_classes;
+    if (ArgMax(absl::MakeConstSpan(predictions).subspan(begin, num_classes)) !=
+        ArgMax(absl::MakeConstSpan(expected_predictions)
+                   .subspan(begin, num_classes))) {
+      comparison.num_changed_top_classes++;
+    }
+  }
+  comparisons->push_back(comparison);
+  return absl::OkStatus();
+}
+
+absl::Status CompareLeafPrecision() {
+  // Check required flags.
+  QCHECK(!absl::GetFlag(FLAGS_model).empty());
+  QCHECK(!absl::GetFlag(FLAGS_dataset).empty());
+
+  std::unique_ptr<model::AbstractModel> model;
+  RETURN_IF_ERROR(model::LoadModel(absl::GetFlag(FLAGS_model), &model));
+  const auto* rf_model = dynamic_cast<const RandomForestModel*>(model.get());
+  if (rf_model == nullptr ||
+      rf_model->task() != model::proto::Task::CLASSIFICATION) {
+    return absl::InvalidArgumentError(
+        "The model is not a Random Forest classifier.");
+  }
+
+  dataset::VerticalDataset dataset;
+  RETURN_IF_ERROR(LoadVerticalDataset(absl::GetFlag(FLAGS_dataset),
+                                      model->data_spec(), &dataset));
+
+  // Full precision predictions.
+  GenericRandomForestMulticlassClassification<uint32_t> engine;
+  std::vector<float> expected_predictions;
+  RETURN_IF_ERROR(
+      CompileAndPredict(*rf_model, dataset, &engine, &expected_predictions));
+
+  std::vector<Comparison> comparisons;
+  comparisons.push_back(
+      {/*.name =*/"float32",
+       /*.leaf_value_bytes =*/engine.label_buffer.size() * sizeof(float)});
+  RETURN_IF_ERROR(Compare<Float16LeafValue>(
+      *rf_model, dataset, expected_predictions, "float16", &comparisons));
+  RETURN_IF_ERROR(Compare<BFloat16LeafValue>(
+      *rf_model, dataset, expected_predictions, "bfloat16", &comparisons));
+  RETURN_IF_ERROR(Compare<UInt8LeafValue>(
+      *rf_model, dataset, expected_predictions, "uint8", &comparisons));
+
+  std::cout << absl::StrFormat("Examples: %d  Classes: %d\n", dataset.nrow(),
+                               engine.num_classes);
+  std::cout << absl::StrFormat("%-12s %15s %10s %11s %18s\n", "Leaf values",
+                               "Memory (bytes)", "Max delta", "Mean delta",
+                               "Changed top class");
+  for (const auto& comparison : comparisons) {
+    std::cout << absl::StrFormat(
+        "%-12s %15d %10.3g %11.3g %18d\n", comparison.name,
+        comparison.leaf_value_bytes, comparison.max_delta,
+        comparison.mean_delta, comparison.num_changed_top_classes);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cli
+}  // namespace yggdrasil_decision_forests
+
+int main(int argc, char** argv) {
+  InitLogging(kUsageMessage, &argc, &argv, true);
+  const auto status = yggdrasil_decision_forests::cli::CompareLeafPrecision();
+  if (!status.ok()) {
+    LOG(INFO) << "The comparison failed with error: " << status;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compiles a Random Forest or Gradient Boosted Trees model into standalone C++
+// code. See "serving/decision_forest/model_compiler.h" for details.
+//
+// Usage example:
+//   compile_model --model=/path/to/model \
+//     --output_header=/path/to/my_model.h \
+//     --output_source=/path/to/my_model.cc \
+//     --namespace=my_project::my_model
+//
+
+#include "absl/flags/flag.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/model_compiler.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+
+ABSL_FLAG(std::string, model, "", "Model directory.");
+
+ABSL_FLAG(std::string, output_header, "", "Output C++ header file.");
+
+ABSL_FLAG(std::string, output_source, "", "Output C++ source file.");
+
+ABSL_FLAG(std::string, namespace, "compiled_model",
+          "C++ namespace of the generated code e.g. "
+          "\"my_project::my_model\".");
+
+ABSL_FLAG(std::string, header_include_path, "",
+          "Path used by the generated source file to include the generated "
+          "header. If not set, defaults to --output_header.");
+
+constexpr char kUsageMessage[] =
+    "Compiles a decision forest model into standalone C++ code.";
+
+namespace yggdrasil_decision_forests {
+namespace cli {
+
+void CompileModel() {
+  // Check required flags.
+  QCHECK(!absl::GetFlag(FLAGS_model).empty());
+  QCHECK(!absl::GetFlag(FLAGS_output_header).empty());
+  QCHECK(!absl::GetFlag(FLAGS_output_source).empty());
+
+  // Loads the model.
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(absl::GetFlag(FLAGS_model), &model));
+
+  // Compiles the model.
+  serving::decision_forest::CompileModelOptions options;
+  options.cpp_namespace = absl::GetFlag(FLAGS_namespace);
+  options.header_include_path = absl::GetFlag(FLAGS_header_include_path);
+  if (options.header_include_path.empty()) {
+    options.header_include_path = absl::GetFlag(FLAGS_output_header);
+  }
+  options.model_name = absl::GetFlag(FLAGS_model);
+  const auto compiled =
+      serving::decision_forest::CompileModelToCpp(*model, options);
+  CHECK_OK(compiled.status());
+
+  CHECK_OK(file::SetContent(absl::GetFlag(FLAGS_output_header),
+                            compiled.value().header));
+  CHECK_OK(file::SetContent(absl::GetFlag(FLAGS_output_source),
+                            compiled.value().source));
+}
+
+}  // namespace cli
+}  // namespace yggdrasil_decision_forests
+
+int main(int argc, char** argv) {
+  InitLogging(kUsageMessage, &argc, &argv, true);
+  yggdrasil_decision_forests::cli::CompileModel();
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include "yggdrasil_decision_forests/model/abstract_model.h"
 #include "yggdrasil_decision_forests/model/model_library.h"
 #include "yggdrasil_decision_forests/model/prediction.pb.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/evaluation.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
 
@@ -41,6 +42,11 @@ ABSL_FLAG(int, num_records_by_shard_in_output, -1,
           "Number of records per output shards. Only valid if the output "
           "path is sharded (e.g. contains @10).");
 
+ABSL_FLAG(int, num_threads, 1,
+          "Number of threads used to compute the predictions when a fast "
+          "engine is compatible with the model. The predictions of the slow "
+          "generic engine are always computed with a single thread.");
+
 constexpr char kUsageMessage[] =
     "Apply a model on a dataset and export the predictions to disk.";
 
@@ -79,7 +85,15 @@ void ConvertDataset() {
 
     // Apply the model.
     std::vector<float> fast_predictions;
-    engine->Predict(*examples, dataset.nrow(), &fast_predictions);
+    const int num_threads = absl::GetFlag(FLAGS_num_threads);
+    if (num_threads > 1) {
+      utils::concurrency::ThreadPool pool("predict", num_threads);
+      pool.StartWorkers();
+      QCHECK_OK(engine->PredictWithThreadPool(*examples, dataset.nrow(),
+                                              &fast_predictions, &pool));
+    } else {
+      engine->Predict(*examples, dataset.nrow(), &fast_predictions);
+    }
     examples.reset();
 
     // Convert the prediction to the expected format.
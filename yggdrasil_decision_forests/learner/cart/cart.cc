@@ -197,7 +197,8 @@ utils::StatusOr<std::unique_ptr<AbstractModel>> CartLearner::TrainWithStatus(
   RETURN_IF_ERROR(decision_tree::Train(train_dataset, train_examples, config,
                                        config_link, cart_config.decision_tree(),
                                        deployment(), weights, &random,
-                                       decision_tree, internal_config));
+                                       decision_tree, internal_config,
+                                       /*leaf_assignments=*/nullptr));
 
   // Prune the tree.
   RETURN_IF_ERROR(internal::PruneTree(train_dataset, weights, valid_examples,
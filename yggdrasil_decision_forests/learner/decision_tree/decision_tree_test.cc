@@ -58,6 +58,8 @@ namespace decision_tree {
 namespace {
 
 using row_t = dataset::VerticalDataset::row_t;
+using testing::ElementsAre;
+using test::EqualsProto;
 
 std::string DatasetDir() {
   return file::JoinPath(
@@ -136,8 +138,70 @@ TEST(DecisionTree, FakeTrain) {
 
   utils::RandomEngine random;
   DecisionTree dt;
-  CHECK_OK(Train(train_dataset, selected_examples, config, config_link,
-                 dt_config, deployment, weights, &random, &dt, {}));
+  CHECK_OK(DecisionTreeTrain(train_dataset, selected_examples, config,
+                             config_link, dt_config, deployment, weights,
+                             &random, &dt, {}));
+}
+
+TEST(DecisionTree, TrainWithLeafAssignments) {
+  const std::string ds_typed_path =
+      absl::StrCat("csv:", file::JoinPath(DatasetDir(), "adult.csv"));
+  dataset::proto::DataSpecification data_spec;
+  dataset::proto::DataSpecificationGuide guide;
+  dataset::CreateDataSpec(ds_typed_path, false, guide, &data_spec);
+
+  dataset::VerticalDataset train_dataset;
+  CHECK_OK(LoadVerticalDataset(ds_typed_path, data_spec, &train_dataset));
+
+  // Train on one example out of two.
+  std::vector<row_t> selected_examples;
+  for (row_t example_idx = 0; example_idx < train_dataset.nrow();
+       example_idx += 2) {
+    selected_examples.push_back(example_idx);
+  }
+
+  const std::vector<float> weights(train_dataset.nrow(), 1.f);
+
+  model::proto::TrainingConfig config;
+  config.set_task(model::proto::Task::CLASSIFICATION);
+  config.set_label("income");
+  config.add_features(".*");
+
+  const model::proto::DeploymentConfig deployment;
+
+  model::proto::TrainingConfigLinking config_link;
+  CHECK_OK(
+      AbstractLearner::LinkTrainingConfig(config, data_spec, &config_link));
+
+  for (const bool best_first_global : {false, true}) {
+    LOG(INFO) << "best_first_global: " << best_first_global;
+    proto::DecisionTreeTrainingConfig dt_config;
+    dt_config.set_max_depth(8);
+    if (best_first_global) {
+      dt_config.mutable_growing_strategy_best_first_global();
+    }
+
+    utils::RandomEngine random;
+    DecisionTree dt;
+    LeafAssignments leaf_assignments;
+    CHECK_OK(Train(train_dataset, selected_examples, config, config_link,
+                   dt_config, deployment, weights, &random, &dt, {},
+                   &leaf_assignments));
+
+    EXPECT_EQ(leaf_assignments.leaves.size(), dt.NumLeafs());
+    ASSERT_EQ(leaf_assignments.example_leaf_idxs.size(), train_dataset.nrow());
+    for (row_t example_idx = 0; example_idx < train_dataset.nrow();
+         example_idx++) {
+      const int32_t leaf_idx = leaf_assignments.example_leaf_idxs[example_idx];
+      if (example_idx % 2 == 1) {
+        EXPECT_EQ(leaf_idx, -1);
+        continue;
+      }
+      ASSERT_GE(leaf_idx, 0);
+      EXPECT_EQ(&leaf_assignments.leaves[leaf_idx]->node(),
+                &dt.GetLeaf(train_dataset, example_idx));
+    }
+  }
 }
 
 TEST(DecisionTree, FindBestNumericalSplitCartBase) {
@@ -991,6 +1055,177 @@ INSTANTIATE_TEST_SUITE_P(
     DuplicatedSelectedExamples,
     FindBestNumericalSplitCartNumericalLabelBasePresortedTest, testing::Bool());
 
+TEST(DecisionTree, FindBestNumericalSplitBinnedNumericalLabel) {
+  // Similar examples as for the
+  // DecisionTree.FindBestNumericalSplitCartNumericalLabelBase test.
+  const std::vector<row_t> selected_examples = {0, 1, 2, 3, 4, 5};
+  const std::vector<float> weights = {1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+  const float na = std::numeric_limits<float>::quiet_NaN();
+  const std::vector<float> attributes = {2, 3, 0, 1, na, na};
+  const std::vector<float> labels = {1.f, 1.f, 0.f, 0.f, 1.f, 0.f};
+  const row_t min_num_obs = 1;
+
+  // Computes the preprocessing.
+  Preprocessing preprocessing;
+  {
+    dataset::VerticalDataset dataset;
+    dataset.set_data_spec(PARSE_TEST_PROTO(
+        R"pb(
+          columns {
+            type: NUMERICAL
+            name: "a"
+            numerical { mean: 2 }
+          }
+        )pb"));
+    CHECK_OK(dataset.CreateColumnsFromDataspec());
+    for (const auto attribute : attributes) {
+      dataset::proto::Example example;
+      if (std::isnan(attribute)) {
+        example.add_attributes();
+      } else {
+        example.add_attributes()->set_numerical(attribute);
+      }
+      dataset.AppendExample(example);
+    }
+    model::proto::TrainingConfigLinking config_link;
+    config_link.add_features(0);
+    CHECK_OK(BinNumericalFeatures(dataset, config_link, 255, 6,
+                                  &preprocessing));
+    EXPECT_FALSE(
+        BinNumericalFeatures(dataset, config_link, 256, 6, &preprocessing)
+            .ok());
+  }
+  const auto& binned_attribute =
+      preprocessing.binned_numerical_features().front();
+  EXPECT_THAT(binned_attribute.boundaries, ElementsAre(0.5f, 1.5f, 2.5f));
+  EXPECT_THAT(binned_attribute.bins, ElementsAre(2, 3, 0, 1, 2, 2));
+  EXPECT_EQ(binned_attribute.na_bin, 2);
+
+  proto::DecisionTreeTrainingConfig dt_config;
+  utils::NormalDistributionDouble label_distribution;
+  for (int example_idx = 0; example_idx < selected_examples.size();
+       example_idx++) {
+    label_distribution.Add(labels[example_idx], weights[example_idx]);
+  }
+  proto::NodeCondition best_condition;
+  SplitterPerThreadCache cache;
+  EXPECT_EQ(FindSplitLabelRegressionFeatureBinnedNumerical(
+                selected_examples, weights, binned_attribute, labels,
+                min_num_obs, dt_config, label_distribution, 0, &best_condition,
+                &cache),
+            SplitSearchResult::kBetterSplitFound);
+
+  EXPECT_EQ(best_condition.condition().higher_condition().threshold(), 1.5f);
+  EXPECT_EQ(best_condition.num_training_examples_without_weight(), 6);
+  EXPECT_EQ(best_condition.num_training_examples_with_weight(), 6);
+  EXPECT_EQ(best_condition.num_pos_training_examples_without_weight(), 4);
+  EXPECT_EQ(best_condition.num_pos_training_examples_with_weight(), 4);
+  EXPECT_NEAR(best_condition.split_score(), 0.125, 0.01);
+  EXPECT_EQ(best_condition.na_value(), true);
+
+  EXPECT_EQ(FindSplitLabelRegressionFeatureBinnedNumerical(
+                selected_examples, weights, binned_attribute, labels,
+                min_num_obs, dt_config, label_distribution, 0, &best_condition,
+                &cache),
+            SplitSearchResult::kNoBetterSplitFound);
+}
+
+TEST(DecisionTree, FindBestNumericalSplitBinnedHistogramSubtraction) {
+  const std::vector<float> weights = {1.f, 2.f, 1.f, 1.f, 3.f, 1.f, 1.f, 2.f};
+  const std::vector<float> labels = {1.f, 4.f, 0.f, 2.f, 1.f, 0.f, 3.f, 5.f};
+  Preprocessing::BinnedNumericalFeature binned_attribute;
+  binned_attribute.boundaries = {0.5f, 1.5f, 2.5f};
+  binned_attribute.bins = {2, 3, 0, 1, 2, 0, 1, 3};
+  binned_attribute.na_bin = 2;
+
+  const std::vector<row_t> parent_examples = {0, 1, 2, 3, 4, 5, 6, 7};
+  const std::vector<row_t> small_child_examples = {0, 2, 5};
+  const std::vector<row_t> large_child_examples = {1, 3, 4, 6, 7};
+  const row_t min_num_obs = 1;
+  const proto::DecisionTreeTrainingConfig dt_config;
+
+  const auto label_distribution = [&](const std::vector<row_t>& examples) {
+    utils::NormalDistributionDouble distribution;
+    for (const auto example_idx : examples) {
+      distribution.Add(labels[example_idx], weights[example_idx]);
+    }
+    return distribution;
+  };
+
+  const auto find_split = [&](const std::vector<row_t>& examples,
+                              const NodeHistogramContext& histograms,
+                              proto::NodeCondition* condition) {
+    SplitterPerThreadCache cache;
+    cache.cache_v2.histograms = histograms;
+    return FindSplitLabelRegressionFeatureBinnedNumerical(
+        examples, weights, binned_attribute, labels, min_num_obs, dt_config,
+        label_distribution(examples), 0, condition, &cache);
+  };
+
+  // Reference split of the large child computed from the examples.
+  proto::NodeCondition expected_condition;
+  EXPECT_EQ(find_split(large_child_examples, {}, &expected_condition),
+            SplitSearchResult::kBetterSplitFound);
+
+  HistogramCache histogram_cache;
+  histogram_cache.Initialize(
+      /*num_attributes=*/1,
+      /*node_memory_bytes=*/
+      NodeHistograms::EstimateMemoryUsage(1, {4}, /*num_label_classes=*/0),
+      /*max_memory_bytes=*/1 << 20);
+  ASSERT_TRUE(histogram_cache.enabled());
+  NodeHistograms* parent_histograms = histogram_cache.Acquire();
+  NodeHistograms* small_child_histograms = histogram_cache.Acquire();
+  NodeHistograms* large_child_histograms = histogram_cache.Acquire();
+
+  proto::NodeCondition condition;
+  find_split(parent_examples, {parent_histograms}, &condition);
+  find_split(small_child_examples, {small_child_histograms}, &condition);
+  EXPECT_TRUE(parent_histograms->filled[0]);
+  EXPECT_TRUE(small_child_histograms->filled[0]);
+
+  // The histogram of the large child is computed by subtraction.
+  proto::NodeCondition subtracted_condition;
+  EXPECT_EQ(find_split(large_child_examples,
+                       {large_child_histograms, parent_histograms,
+                        small_child_histograms},
+                       &subtracted_condition),
+            SplitSearchResult::kBetterSplitFound);
+  EXPECT_THAT(subtracted_condition, EqualsProto(expected_condition));
+
+  histogram_cache.Release(parent_histograms);
+  histogram_cache.Release(small_child_histograms);
+  histogram_cache.Release(large_child_histograms);
+}
+
+TEST(DecisionTree, HistogramCacheMemoryBudget) {
+  const int64_t node_memory_bytes =
+      NodeHistograms::EstimateMemoryUsage(1, {4}, /*num_label_classes=*/0);
+  EXPECT_GT(node_memory_bytes, 0);
+
+  // The budget is enforced before any histogram is released.
+  HistogramCache histogram_cache;
+  histogram_cache.Initialize(/*num_attributes=*/1, node_memory_bytes,
+                             /*max_memory_bytes=*/2 * node_memory_bytes);
+  NodeHistograms* first = histogram_cache.Acquire();
+  NodeHistograms* second = histogram_cache.Acquire();
+  EXPECT_NE(first, nullptr);
+  EXPECT_NE(second, nullptr);
+  EXPECT_EQ(histogram_cache.Acquire(), nullptr);
+
+  // Released histograms are reused.
+  histogram_cache.Release(first);
+  EXPECT_EQ(histogram_cache.Acquire(), first);
+  histogram_cache.Release(first);
+  histogram_cache.Release(second);
+
+  // A budget smaller than the histograms of a single node disables the cache.
+  HistogramCache small_histogram_cache;
+  small_histogram_cache.Initialize(/*num_attributes=*/1, node_memory_bytes,
+                                   /*max_memory_bytes=*/node_memory_bytes - 1);
+  EXPECT_EQ(small_histogram_cache.Acquire(), nullptr);
+}
+
 TEST(DecisionTree, FindBestCategoricalSplitCartNumericalLabels) {
   // Small basic dataset.
   const std::vector<row_t> selected_examples = {0, 1, 2, 3, 4, 5};
@@ -1797,6 +2032,36 @@ TEST(DecisionTree, GenHistogramBins) {
   EXPECT_NEAR(bins_equal_width[num_bins / 2], 5.f, 0.5f);
 }
 
+TEST(DecisionTree, ComputeQuantileBinBoundaries) {
+  // Less unique values than bins.
+  EXPECT_THAT(internal::ComputeQuantileBinBoundaries({1, 1, 2, 4, 4}, 4),
+              ElementsAre(1.5f, 3.f));
+  EXPECT_TRUE(internal::ComputeQuantileBinBoundaries({1, 1, 1}, 4).empty());
+
+  // Quantiles.
+  std::vector<float> values;
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(i);
+  }
+  EXPECT_THAT(internal::ComputeQuantileBinBoundaries(values, 4),
+              ElementsAre(249.5f, 499.5f, 749.5f));
+
+  // A quantile in a run of equal values.
+  values.assign(500, 0.f);
+  for (int i = 0; i < 500; i++) {
+    values.push_back(i + 1);
+  }
+  EXPECT_THAT(internal::ComputeQuantileBinBoundaries(values, 4),
+              ElementsAre(0.5f, 250.5f));
+
+  // Extreme values.
+  const float kMax = std::numeric_limits<float>::max();
+  const float kInf = std::numeric_limits<float>::infinity();
+  EXPECT_THAT(
+      internal::ComputeQuantileBinBoundaries({-kInf, -kMax, kMax, kInf}, 4),
+      ElementsAre(-kMax, 0.f, kInf));
+}
+
 TEST(DecisionTree, FindBestConditionConcurrentManager_NoFeatures) {
   dataset::VerticalDataset dataset;
   utils::RandomEngine random(1234);
@@ -21,7 +21,8 @@
 //
 // Feature buckets
 // ===============
-// Available: FeatureNumericalBucket, FeatureCategoricalBucket,
+// Available: FeatureNumericalBucket, FeatureDiscretizedNumericalBucket,
+// FeatureBinnedNumericalBucket, FeatureCategoricalBucket,
 // FeatureIsMissingBucket.
 //
 // Label buckets & accumulator
@@ -35,6 +36,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iterator>
 #include <limits>
@@ -263,6 +265,74 @@ inline std::ostream& operator<<(std::ostream& os,
   return os;
 }
 
+// Numerical feature quantized once before the training (see
+// "NumericalSplit::PRE_BINNED"). The bucket "i" contains the examples with
+// values in [boundaries[i-1], boundaries[i]).
+struct FeatureBinnedNumericalBucket {
+  static constexpr bool kRequireSorting = false;
+
+  bool operator<(const FeatureBinnedNumericalBucket& other) const {
+    DCHECK(false);
+    return true;
+  }
+
+  static bool IsValidAttribute(const FeatureBinnedNumericalBucket& first,
+                               const FeatureBinnedNumericalBucket& last) {
+    return true;
+  }
+
+  static bool IsValidSplit(const FeatureBinnedNumericalBucket& left,
+                           const FeatureBinnedNumericalBucket& right) {
+    return true;
+  }
+
+  class Filler {
+   public:
+    // "bins" is the bin index of each example (missing values already
+    // replaced) and "boundaries" are the "bins.size()-1" sorted bin
+    // boundaries. "na_bin" is the bin of the missing values.
+    Filler(const std::vector<uint8_t>& bins,
+           const std::vector<float>& boundaries, const uint8_t na_bin)
+        : bins_(bins), boundaries_(boundaries), na_bin_(na_bin) {}
+
+    size_t NumBuckets() const { return boundaries_.size() + 1; }
+
+    void InitializeAndZero(const int bucket_idx,
+                           FeatureBinnedNumericalBucket* acc) const {}
+
+    size_t GetBucketIndex(const size_t local_example_idx,
+                          const row_t example_idx) const {
+      return bins_[example_idx];
+    }
+
+    void ConsumeExample(const row_t example_idx,
+                        FeatureBinnedNumericalBucket* acc) const {}
+
+    template <typename ExampleBucketSet>
+    void SetConditionFinal(const ExampleBucketSet& example_bucket_set,
+                           const size_t best_bucket_idx,
+                           proto::NodeCondition* condition) const {
+      condition->mutable_condition()->mutable_higher_condition()->set_threshold(
+          boundaries_[best_bucket_idx]);
+      condition->set_na_value(na_bin_ > best_bucket_idx);
+    }
+
+   private:
+    const std::vector<uint8_t>& bins_;
+    const std::vector<float>& boundaries_;
+    uint8_t na_bin_;
+  };
+
+  friend std::ostream& operator<<(std::ostream& os,
+                                  const FeatureBinnedNumericalBucket& data);
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const FeatureBinnedNumericalBucket& data) {
+  // The feature bucket contains no information.
+  return os;
+}
+
 // Categorical feature.
 struct FeatureCategoricalBucket {
   int32_t value;
@@ -1117,6 +1187,12 @@ struct LabelNumericalBucket {
     acc->label.Sub(value);
   }
 
+  // Removes the examples of "other" from the bucket.
+  void Sub(const LabelNumericalBucket& other) {
+    value.Sub(other.value);
+    count -= other.count;
+  }
+
   bool operator<(const LabelNumericalBucket& other) const {
     return value.Mean() < other.value.Mean();
   }
@@ -1197,6 +1273,15 @@ struct LabelHessianNumericalBucket {
     acc->Sub(sum_gradient, sum_hessian, sum_weight);
   }
 
+  // Removes the examples of "other" from the bucket. "priority" should be
+  // re-computed with "Filler::Finalize".
+  void Sub(const LabelHessianNumericalBucket& other) {
+    sum_gradient -= other.sum_gradient;
+    sum_hessian -= other.sum_hessian;
+    sum_weight -= other.sum_weight;
+    count -= other.count;
+  }
+
   bool operator<(const LabelHessianNumericalBucket& other) const {
     return priority < priority;
   }
@@ -1290,6 +1375,12 @@ struct LabelCategoricalBucket {
     acc->label.Sub(value);
   }
 
+  // Removes the examples of "other" from the bucket.
+  void Sub(const LabelCategoricalBucket& other) {
+    value.Sub(other.value);
+    count -= other.count;
+  }
+
   float SafeProportionOrMinusInfinity(int idx) const {
     return value.SafeProportionOrMinusInfinity(idx);
   }
@@ -1361,6 +1452,13 @@ struct LabelBinaryCategoricalBucket {
     acc->SubMany(sum_trues, sum_weights);
   }
 
+  // Removes the examples of "other" from the bucket.
+  void Sub(const LabelBinaryCategoricalBucket& other) {
+    sum_trues -= other.sum_trues;
+    sum_weights -= other.sum_weights;
+    count -= other.count;
+  }
+
   float SafeProportionOrMinusInfinity(int idx) const {
     if (sum_weights > 0) {
       DCHECK(idx == 1 || idx == 2);
@@ -113,6 +113,9 @@ using FeatureNumericalLabelNumericalOneValue = ExampleBucketSet<
 using FeatureDiscretizedNumericalLabelNumerical = ExampleBucketSet<
     ExampleBucket<FeatureDiscretizedNumericalBucket, LabelNumericalBucket>>;
 
+using FeatureBinnedNumericalLabelNumerical = ExampleBucketSet<
+    ExampleBucket<FeatureBinnedNumericalBucket, LabelNumericalBucket>>;
+
 using FeatureCategoricalLabelNumerical = ExampleBucketSet<
     ExampleBucket<FeatureCategoricalBucket, LabelNumericalBucket>>;
 
@@ -131,6 +134,9 @@ using FeatureDiscretizedNumericalLabelHessianNumerical =
     ExampleBucketSet<ExampleBucket<FeatureDiscretizedNumericalBucket,
                                    LabelHessianNumericalBucket>>;
 
+using FeatureBinnedNumericalLabelHessianNumerical = ExampleBucketSet<
+    ExampleBucket<FeatureBinnedNumericalBucket, LabelHessianNumericalBucket>>;
+
 using FeatureCategoricalLabelHessianNumerical = ExampleBucketSet<
     ExampleBucket<FeatureCategoricalBucket, LabelHessianNumericalBucket>>;
 
@@ -148,6 +154,9 @@ using FeatureNumericalLabelCategoricalOneValue = ExampleBucketSet<
 using FeatureDiscretizedNumericalLabelCategorical = ExampleBucketSet<
     ExampleBucket<FeatureDiscretizedNumericalBucket, LabelCategoricalBucket>>;
 
+using FeatureBinnedNumericalLabelCategorical = ExampleBucketSet<
+    ExampleBucket<FeatureBinnedNumericalBucket, LabelCategoricalBucket>>;
+
 using FeatureCategoricalLabelCategorical = ExampleBucketSet<
     ExampleBucket<FeatureCategoricalBucket, LabelCategoricalBucket>>;
 
@@ -167,6 +176,10 @@ using FeatureDiscretizedNumericalLabelBinaryCategorical =
     ExampleBucketSet<ExampleBucket<FeatureDiscretizedNumericalBucket,
                                    LabelBinaryCategoricalBucket>>;
 
+using FeatureBinnedNumericalLabelBinaryCategorical =
+    ExampleBucketSet<ExampleBucket<FeatureBinnedNumericalBucket,
+                                   LabelBinaryCategoricalBucket>>;
+
 using FeatureCategoricalLabelBinaryCategorical = ExampleBucketSet<
     ExampleBucket<FeatureCategoricalBucket, LabelBinaryCategoricalBucket>>;
 
@@ -176,28 +189,73 @@ using FeatureBooleanLabelBinaryCategorical = ExampleBucketSet<
 using FeatureIsMissingLabelBinaryCategorical = ExampleBucketSet<
     ExampleBucket<FeatureIsMissingBucket, LabelBinaryCategoricalBucket>>;
 
+// Histograms (i.e. example bucket sets) of the binned numerical features
+// computed in a node. Used to compute the histograms of the children by
+// subtraction: The histogram of a node is the histogram of its parent minus the
+// histogram of its sibling (see "FindBestSplitBinned").
+struct NodeHistograms {
+  // Histograms indexed by attribute index. Only the histograms matching the
+  // label type are used.
+  std::vector<FeatureBinnedNumericalLabelNumerical> num;
+  std::vector<FeatureBinnedNumericalLabelCategorical> cat;
+  std::vector<FeatureBinnedNumericalLabelHessianNumerical> hnum;
+  std::vector<FeatureBinnedNumericalLabelBinaryCategorical> bcat;
+
+  // "filled[i]" is true iff the histogram of the attribute "i" was computed.
+  // Note: Not a "std::vector<bool>" since the histograms of the different
+  // attributes are computed concurrently.
+  std::vector<uint8_t> filled;
+
+  // Marks all the histograms as not computed. Does not release the memory.
+  void Reset(int num_attributes);
+
+  // Approximate memory usage in bytes.
+  size_t MemoryUsage() const;
+
+  // Estimates "MemoryUsage()" before any histogram is computed.
+  // "num_bins[i]" is the number of bins of the attribute "i" (0 if the
+  // attribute is not binned) and "num_label_classes" is the number of classes
+  // of a categorical label (0 otherwise).
+  static size_t EstimateMemoryUsage(int num_attributes,
+                                    const std::vector<int>& num_bins,
+                                    int num_label_classes);
+};
+
+// Histograms available to the splitter of a node. All the fields are optional.
+struct NodeHistogramContext {
+  // Where to store the histograms of the node.
+  NodeHistograms* node = nullptr;
+  // Histograms of the parent and sibling nodes.
+  const NodeHistograms* parent = nullptr;
+  const NodeHistograms* sibling = nullptr;
+};
+
 struct PerThreadCacheV2 {
   // Cache for example bucket sets.
   FeatureNumericalLabelNumericalOneValue example_bucket_set_num_1;
   FeatureDiscretizedNumericalLabelNumerical example_bucket_set_num_5;
+  FeatureBinnedNumericalLabelNumerical example_bucket_set_num_6;
   FeatureCategoricalLabelNumerical example_bucket_set_num_2;
   FeatureIsMissingLabelNumerical example_bucket_set_num_3;
   FeatureBooleanLabelNumerical example_bucket_set_num_4;
 
   FeatureNumericalLabelCategoricalOneValue example_bucket_set_cat_1;
   FeatureDiscretizedNumericalLabelCategorical example_bucket_set_cat_5;
+  FeatureBinnedNumericalLabelCategorical example_bucket_set_cat_6;
   FeatureCategoricalLabelCategorical example_bucket_set_cat_2;
   FeatureIsMissingLabelCategorical example_bucket_set_cat_3;
   FeatureBooleanLabelCategorical example_bucket_set_cat_4;
 
   FeatureNumericalLabelHessianNumericalOneValue example_bucket_set_hnum_1;
   FeatureDiscretizedNumericalLabelHessianNumerical example_bucket_set_hnum_5;
+  FeatureBinnedNumericalLabelHessianNumerical example_bucket_set_hnum_6;
   FeatureCategoricalLabelHessianNumerical example_bucket_set_hnum_2;
   FeatureIsMissingLabelHessianNumerical example_bucket_set_hnum_3;
   FeatureBooleanLabelHessianNumerical example_bucket_set_hnum_4;
 
   FeatureNumericalLabelBinaryCategoricalOneValue example_bucket_set_bcat_1;
   FeatureDiscretizedNumericalLabelBinaryCategorical example_bucket_set_bcat_5;
+  FeatureBinnedNumericalLabelBinaryCategorical example_bucket_set_bcat_6;
   FeatureCategoricalLabelBinaryCategorical example_bucket_set_bcat_2;
   FeatureIsMissingLabelBinaryCategorical example_bucket_set_bcat_3;
   FeatureBooleanLabelBinaryCategorical example_bucket_set_bcat_4;
@@ -222,8 +280,90 @@ struct PerThreadCacheV2 {
 
   // Selected categorical attribute values;
   std::vector<int> categorical_attribute;
+
+  // Histograms of the node being split.
+  NodeHistogramContext histograms;
 };
 
+inline void NodeHistograms::Reset(const int num_attributes) {
+  num.resize(num_attributes);
+  cat.resize(num_attributes);
+  hnum.resize(num_attributes);
+  bcat.resize(num_attributes);
+  filled.assign(num_attributes, false);
+}
+
+inline size_t NodeHistograms::MemoryUsage() const {
+  size_t usage = 0;
+  const auto add_usage = [&usage](const auto& histograms) {
+    for (const auto& histogram : histograms) {
+      usage += sizeof(histogram) +
+               histogram.items.capacity() * sizeof(histogram.items.front());
+    }
+  };
+  add_usage(num);
+  add_usage(cat);
+  add_usage(hnum);
+  add_usage(bcat);
+  for (const auto& histogram : cat) {
+    for (const auto& item : histogram.items) {
+      usage += item.label.value.NumClasses() * sizeof(double);
+    }
+  }
+  return usage + filled.capacity();
+}
+
+inline size_t NodeHistograms::EstimateMemoryUsage(
+    const int num_attributes, const std::vector<int>& num_bins,
+    const int num_label_classes) {
+  const size_t histogram_set_size =
+      sizeof(FeatureBinnedNumericalLabelNumerical) +
+      sizeof(FeatureBinnedNumericalLabelCategorical) +
+      sizeof(FeatureBinnedNumericalLabelHessianNumerical) +
+      sizeof(FeatureBinnedNumericalLabelBinaryCategorical) + sizeof(uint8_t);
+  size_t usage = num_attributes * histogram_set_size;
+  // Only the histograms matching the label type are filled.
+  const size_t bucket_size = std::max(
+      {sizeof(FeatureBinnedNumericalLabelNumerical::ExampleBucketType),
+       sizeof(FeatureBinnedNumericalLabelCategorical::ExampleBucketType) +
+           num_label_classes * sizeof(double),
+       sizeof(FeatureBinnedNumericalLabelHessianNumerical::ExampleBucketType),
+       sizeof(FeatureBinnedNumericalLabelBinaryCategorical::ExampleBucketType)});
+  for (const int attribute_num_bins : num_bins) {
+    usage += attribute_num_bins * bucket_size;
+  }
+  return usage;
+}
+
+// Get the histograms matching the example bucket set.
+template <typename ExampleBucketSet>
+auto* GetNodeHistograms(NodeHistograms* histograms) {
+  using utils::is_same_v;
+  if constexpr (is_same_v<ExampleBucketSet,
+                          FeatureBinnedNumericalLabelNumerical>) {
+    return &histograms->num;
+  } else if constexpr (is_same_v<ExampleBucketSet,
+                                 FeatureBinnedNumericalLabelCategorical>) {
+    return &histograms->cat;
+  } else if constexpr (is_same_v<ExampleBucketSet,
+                                 FeatureBinnedNumericalLabelHessianNumerical>) {
+    return &histograms->hnum;
+  } else if constexpr (is_same_v<
+                           ExampleBucketSet,
+                           FeatureBinnedNumericalLabelBinaryCategorical>) {
+    return &histograms->bcat;
+  } else {
+    static_assert(!is_same_v<ExampleBucketSet, ExampleBucketSet>,
+                  "Not implemented.");
+  }
+}
+
+template <typename ExampleBucketSet>
+const auto* GetNodeHistograms(const NodeHistograms* histograms) {
+  return GetNodeHistograms<ExampleBucketSet>(
+      const_cast<NodeHistograms*>(histograms));
+}
+
 // Get the example bucket set from the thread cache.
 template <typename ExampleBucketSet>
 auto* GetCachedExampleBucketSet(PerThreadCacheV2* cache) {
@@ -235,6 +375,9 @@ auto* GetCachedExampleBucketSet(PerThreadCacheV2* cache) {
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureDiscretizedNumericalLabelNumerical>) {
     return &cache->example_bucket_set_num_5;
+  } else if constexpr (is_same_v<ExampleBucketSet,
+                                 FeatureBinnedNumericalLabelNumerical>) {
+    return &cache->example_bucket_set_num_6;
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureCategoricalLabelNumerical>) {
     return &cache->example_bucket_set_num_2;
@@ -253,6 +396,9 @@ auto* GetCachedExampleBucketSet(PerThreadCacheV2* cache) {
                            ExampleBucketSet,
                            FeatureDiscretizedNumericalLabelHessianNumerical>) {
     return &cache->example_bucket_set_hnum_5;
+  } else if constexpr (is_same_v<ExampleBucketSet,
+                                 FeatureBinnedNumericalLabelHessianNumerical>) {
+    return &cache->example_bucket_set_hnum_6;
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureCategoricalLabelHessianNumerical>) {
     return &cache->example_bucket_set_hnum_2;
@@ -269,6 +415,9 @@ auto* GetCachedExampleBucketSet(PerThreadCacheV2* cache) {
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureDiscretizedNumericalLabelCategorical>) {
     return &cache->example_bucket_set_cat_5;
+  } else if constexpr (is_same_v<ExampleBucketSet,
+                                 FeatureBinnedNumericalLabelCategorical>) {
+    return &cache->example_bucket_set_cat_6;
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureCategoricalLabelCategorical>) {
     return &cache->example_bucket_set_cat_2;
@@ -287,6 +436,10 @@ auto* GetCachedExampleBucketSet(PerThreadCacheV2* cache) {
                            ExampleBucketSet,
                            FeatureDiscretizedNumericalLabelBinaryCategorical>) {
     return &cache->example_bucket_set_bcat_5;
+  } else if constexpr (is_same_v<
+                           ExampleBucketSet,
+                           FeatureBinnedNumericalLabelBinaryCategorical>) {
+    return &cache->example_bucket_set_bcat_6;
   } else if constexpr (is_same_v<ExampleBucketSet,
                                  FeatureCategoricalLabelBinaryCategorical>) {
     return &cache->example_bucket_set_bcat_2;
@@ -951,6 +1104,77 @@ SplitSearchResult FindBestSplit(
       selected_examples.size(), min_num_obs, attribute_idx, condition, cache);
 }
 
+// Computes the example bucket set "dst" of a node as the example bucket set
+// "parent" of its parent minus the example bucket set "sibling" of its sibling.
+// Only valid for buckets whose content only depends on the set of examples and
+// not their order (e.g. histograms of binned numerical features).
+template <typename ExampleBucketSet>
+void SubtractExampleBucketSet(
+    const ExampleBucketSet& parent, const ExampleBucketSet& sibling,
+    const typename ExampleBucketSet::LabelBucketType::Filler& label_filler,
+    ExampleBucketSet* dst) {
+  DCHECK_EQ(parent.items.size(), sibling.items.size());
+  dst->items.resize(parent.items.size());
+  for (size_t bucket_idx = 0; bucket_idx < parent.items.size(); bucket_idx++) {
+    auto& bucket = dst->items[bucket_idx];
+    bucket = parent.items[bucket_idx];
+    bucket.label.Sub(sibling.items[bucket_idx].label);
+    if (bucket.label.count == 0) {
+      // Removes the floating point residual of the empty buckets.
+      label_filler.InitializeAndZero(&bucket.label);
+    }
+    label_filler.Finalize(&bucket.label);
+  }
+}
+
+// Similar to "FindBestSplit", but for example bucket sets that can be computed
+// by subtraction (see "SubtractExampleBucketSet") i.e. binned numerical
+// features. If the histograms of the parent and sibling nodes are available in
+// "cache->histograms", the histogram of the node is computed by subtraction
+// instead of scanning the examples. If "cache->histograms.node" is set, the
+// histogram of the node is stored there for the children.
+template <typename ExampleBucketSet, typename LabelBucketSet>
+SplitSearchResult FindBestSplitBinned(
+    const std::vector<row_t>& selected_examples,
+    const typename ExampleBucketSet::FeatureBucketType::Filler& feature_filler,
+    const typename ExampleBucketSet::LabelBucketType::Filler& label_filler,
+    const int min_num_obs, const int attribute_idx,
+    proto::NodeCondition* condition, PerThreadCacheV2* cache) {
+  static_assert(!ExampleBucketSet::FeatureBucketType::kRequireSorting,
+                "Subtraction requires unsorted buckets");
+  DCHECK(condition != nullptr);
+  const auto& histograms = cache->histograms;
+
+  ExampleBucketSet& example_set_accumulator =
+      histograms.node
+          ? (*GetNodeHistograms<ExampleBucketSet>(
+                histograms.node))[attribute_idx]
+          : *GetCachedExampleBucketSet<ExampleBucketSet>(cache);
+
+  if (histograms.parent && histograms.sibling &&
+      histograms.parent->filled[attribute_idx] &&
+      histograms.sibling->filled[attribute_idx]) {
+    SubtractExampleBucketSet(
+        (*GetNodeHistograms<ExampleBucketSet>(
+            histograms.parent))[attribute_idx],
+        (*GetNodeHistograms<ExampleBucketSet>(
+            histograms.sibling))[attribute_idx],
+        label_filler, &example_set_accumulator);
+  } else {
+    FillExampleBucketSet<ExampleBucketSet, /*require_label_sorting*/ false>(
+        selected_examples, feature_filler, label_filler,
+        &example_set_accumulator, cache);
+  }
+  if (histograms.node) {
+    histograms.node->filled[attribute_idx] = true;
+  }
+
+  // Scan buckets.
+  return ScanSplits<ExampleBucketSet, LabelBucketSet>(
+      feature_filler, label_filler, example_set_accumulator,
+      selected_examples.size(), min_num_obs, attribute_idx, condition, cache);
+}
+
 // Find the best possible split (and update the condition accordingly) using
 // a random scan of the buckets.  See "ScanSplitsRandomBuckets".
 template <typename ExampleBucketSet, typename LabelBucketSet>
@@ -992,6 +1216,10 @@ constexpr auto FindBestSplit_LabelRegressionFeatureDiscretizedNumerical =
                   LabelNumericalScoreAccumulator,
                   /*require_label_sorting*/ false>;
 
+constexpr auto FindBestSplit_LabelRegressionFeatureBinnedNumerical =
+    FindBestSplitBinned<FeatureBinnedNumericalLabelNumerical,
+                        LabelNumericalScoreAccumulator>;
+
 constexpr auto FindBestSplit_LabelRegressionFeatureCategoricalCart =
     FindBestSplit<FeatureCategoricalLabelNumerical,
                   LabelNumericalScoreAccumulator,
@@ -1022,6 +1250,10 @@ constexpr auto FindBestSplit_LabelClassificationFeatureDiscretizedNumerical =
                   LabelCategoricalScoreAccumulator,
                   /*require_label_sorting*/ false>;
 
+constexpr auto FindBestSplit_LabelClassificationFeatureBinnedNumerical =
+    FindBestSplitBinned<FeatureBinnedNumericalLabelCategorical,
+                        LabelCategoricalScoreAccumulator>;
+
 constexpr auto FindBestSplit_LabelClassificationFeatureCategoricalCart =
     FindBestSplit<FeatureCategoricalLabelCategorical,
                   LabelCategoricalScoreAccumulator,
@@ -1050,6 +1282,10 @@ constexpr auto
                       LabelBinaryCategoricalScoreAccumulator,
                       /*require_label_sorting*/ false>;
 
+constexpr auto FindBestSplit_LabelBinaryClassificationFeatureBinnedNumerical =
+    FindBestSplitBinned<FeatureBinnedNumericalLabelBinaryCategorical,
+                        LabelBinaryCategoricalScoreAccumulator>;
+
 constexpr auto FindBestSplit_LabelBinaryClassificationFeatureCategoricalCart =
     FindBestSplit<FeatureCategoricalLabelBinaryCategorical,
                   LabelBinaryCategoricalScoreAccumulator,
@@ -1077,6 +1313,10 @@ constexpr auto FindBestSplit_LabelHessianRegressionFeatureDiscretizedNumerical =
                   LabelHessianNumericalScoreAccumulator,
                   /*require_label_sorting*/ false>;
 
+constexpr auto FindBestSplit_LabelHessianRegressionFeatureBinnedNumerical =
+    FindBestSplitBinned<FeatureBinnedNumericalLabelHessianNumerical,
+                        LabelHessianNumericalScoreAccumulator>;
+
 constexpr auto FindBestSplit_LabelHessianRegressionFeatureCategoricalCart =
     FindBestSplit<FeatureCategoricalLabelHessianNumerical,
                   LabelHessianNumericalScoreAccumulator,
@@ -371,8 +371,123 @@ bool IsPresortingOnNumericalSplitMoreEfficient(
   return num_selected_examples >= 25 && ratio >= 0.125;
 }
 
+// Gets the quantized values of a numerical feature for the PRE_BINNED
+// numerical splitter. Returns null if the splitter is not PRE_BINNED or if the
+// feature was not quantized, in which case the EXACT splitter should be used.
+//
+// The quantized values are indexed by the example indices of the full training
+// dataset. With a missing value policy other than GLOBAL_IMPUTATION (e.g.
+// RANDOM_LOCAL_IMPUTATION), the nodes are trained on a compact copy of their
+// examples with locally imputed values, and the quantized values cannot be
+// used.
+const Preprocessing::BinnedNumericalFeature* GetBinnedNumericalFeature(
+    const dataset::VerticalDataset& train_dataset,
+    const proto::DecisionTreeTrainingConfig& dt_config,
+    const InternalTrainConfig& internal_config, const int32_t attribute_idx) {
+  if (dt_config.numerical_split().type() != proto::NumericalSplit::PRE_BINNED ||
+      dt_config.missing_value_policy() !=
+          proto::DecisionTreeTrainingConfig::GLOBAL_IMPUTATION ||
+      internal_config.preprocessing == nullptr) {
+    return nullptr;
+  }
+  const auto& features =
+      internal_config.preprocessing->binned_numerical_features();
+  if (attribute_idx >= features.size() ||
+      features[attribute_idx].bins.size() != train_dataset.nrow()) {
+    return nullptr;
+  }
+  return &features[attribute_idx];
+}
+
+// Enables the histogram cache if the histograms of the numerical features can
+// be computed by subtraction i.e. with the PRE_BINNED numerical splitter.
+void InitializeHistogramCache(
+    const dataset::VerticalDataset& train_dataset,
+    const model::proto::TrainingConfig& config,
+    const model::proto::TrainingConfigLinking& config_link,
+    const proto::DecisionTreeTrainingConfig& dt_config,
+    const InternalTrainConfig& internal_config, PerThreadCache* cache) {
+  if (dt_config.numerical_split().type() != proto::NumericalSplit::PRE_BINNED ||
+      internal_config.preprocessing == nullptr ||
+      internal_config.preprocessing->binned_numerical_features().empty() ||
+      dt_config.missing_value_policy() !=
+          proto::DecisionTreeTrainingConfig::GLOBAL_IMPUTATION ||
+      dt_config.internal().histogram_cache_max_bytes() <= 0) {
+    return;
+  }
+
+  std::vector<int> num_bins;
+  for (const auto& feature :
+       internal_config.preprocessing->binned_numerical_features()) {
+    num_bins.push_back(feature.bins.empty() ? 0
+                                            : feature.boundaries.size() + 1);
+  }
+  int num_label_classes = 0;
+  if (config.task() == model::proto::Task::CLASSIFICATION) {
+    num_label_classes = train_dataset.data_spec()
+                            .columns(config_link.label())
+                            .categorical()
+                            .number_of_unique_values();
+  }
+  cache->histogram_cache.Initialize(
+      train_dataset.ncol(),
+      NodeHistograms::EstimateMemoryUsage(train_dataset.ncol(), num_bins,
+                                          num_label_classes),
+      dt_config.internal().histogram_cache_max_bytes());
+}
+
+// Records that the examples "example_idxs" reach the leaf "leaf". No-op if
+// "leaf_assignments" is null.
+void AddLeafAssignment(const std::vector<row_t>& example_idxs,
+                       const NodeWithChildren* leaf,
+                       LeafAssignments* leaf_assignments) {
+  if (leaf_assignments == nullptr) {
+    return;
+  }
+  const int32_t leaf_idx = leaf_assignments->leaves.size();
+  leaf_assignments->leaves.push_back(leaf);
+  for (const auto example_idx : example_idxs) {
+    leaf_assignments->example_leaf_idxs[example_idx] = leaf_idx;
+  }
+}
+
 }  // namespace
 
+void HistogramCache::Initialize(const int num_attributes,
+                                const int64_t node_memory_bytes,
+                                const int64_t max_memory_bytes) {
+  num_attributes_ = num_attributes;
+  max_node_memory_bytes_ = node_memory_bytes;
+  max_memory_bytes_ = max_memory_bytes;
+}
+
+NodeHistograms* HistogramCache::Acquire() {
+  if (!enabled()) {
+    return nullptr;
+  }
+  if (available_histograms_.empty()) {
+    if ((histograms_.size() + 1) * max_node_memory_bytes_ >
+        max_memory_bytes_) {
+      return nullptr;
+    }
+    histograms_.push_back(absl::make_unique<NodeHistograms>());
+    available_histograms_.push_back(histograms_.back().get());
+  }
+  auto* histograms = available_histograms_.back();
+  available_histograms_.pop_back();
+  histograms->Reset(num_attributes_);
+  return histograms;
+}
+
+void HistogramCache::Release(NodeHistograms* histograms) {
+  if (histograms == nullptr) {
+    return;
+  }
+  max_node_memory_bytes_ = std::max(
+      max_node_memory_bytes_, static_cast<int64_t>(histograms->MemoryUsage()));
+  available_histograms_.push_back(histograms);
+}
+
 void SetLabelDistribution(
     const dataset::VerticalDataset& train_dataset,
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
@@ -427,7 +542,18 @@ SplitSearchResult FindBestCondition(
                   attribute_idx)
               ->values();
       const auto na_replacement = attribute_column_spec.numerical().mean();
-      if (dt_config.numerical_split().type() == proto::NumericalSplit::EXACT) {
+      const auto* binned_attribute = GetBinnedNumericalFeature(
+          train_dataset, dt_config, internal_config, attribute_idx);
+      if (binned_attribute) {
+        result = FindSplitLabelClassificationFeatureBinnedNumerical(
+            selected_examples, weights, *binned_attribute,
+            label_stats.label_data, label_stats.num_label_classes, min_num_obs,
+            dt_config, label_stats.label_distribution, attribute_idx,
+            best_condition, cache);
+      } else if (dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::EXACT ||
+                 dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::PRE_BINNED) {
         result = FindSplitLabelClassificationFeatureNumericalCart(
             selected_examples, weights, attribute_data, label_stats.label_data,
             label_stats.num_label_classes, na_replacement, min_num_obs,
@@ -565,7 +691,19 @@ SplitSearchResult FindBestCondition(
                   attribute_idx)
               ->values();
       const auto na_replacement = attribute_column_spec.numerical().mean();
-      if (dt_config.numerical_split().type() == proto::NumericalSplit::EXACT) {
+      const auto* binned_attribute = GetBinnedNumericalFeature(
+          train_dataset, dt_config, internal_config, attribute_idx);
+      if (binned_attribute) {
+        result = FindSplitLabelHessianRegressionFeatureBinnedNumerical(
+            selected_examples, weights, *binned_attribute,
+            label_stats.gradient_data, label_stats.hessian_data, min_num_obs,
+            dt_config, label_stats.sum_gradient, label_stats.sum_hessian,
+            label_stats.sum_weights, attribute_idx, internal_config,
+            best_condition, cache);
+      } else if (dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::EXACT ||
+                 dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::PRE_BINNED) {
         result = FindSplitLabelHessianRegressionFeatureNumericalCart(
             selected_examples, weights, attribute_data,
             label_stats.gradient_data, label_stats.hessian_data, na_replacement,
@@ -573,7 +711,8 @@ SplitSearchResult FindBestCondition(
             label_stats.sum_hessian, label_stats.sum_weights, attribute_idx,
             internal_config, best_condition, cache);
       } else {
-        LOG(FATAL) << "Only split exact implemented for hessian gains.";
+        LOG(FATAL) << "Only split exact and pre-binned implemented for hessian "
+                      "gains.";
       }
     } break;
 
@@ -695,7 +834,18 @@ SplitSearchResult FindBestCondition(
                   attribute_idx)
               ->values();
       const auto na_replacement = attribute_column_spec.numerical().mean();
-      if (dt_config.numerical_split().type() == proto::NumericalSplit::EXACT) {
+      const auto* binned_attribute = GetBinnedNumericalFeature(
+          train_dataset, dt_config, internal_config, attribute_idx);
+      if (binned_attribute) {
+        result = FindSplitLabelRegressionFeatureBinnedNumerical(
+            selected_examples, weights, *binned_attribute,
+            label_stats.label_data, min_num_obs, dt_config,
+            label_stats.label_distribution, attribute_idx, best_condition,
+            cache);
+      } else if (dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::EXACT ||
+                 dt_config.numerical_split().type() ==
+                     proto::NumericalSplit::PRE_BINNED) {
         result = FindSplitLabelRegressionFeatureNumericalCart(
             selected_examples, weights, attribute_data, label_stats.label_data,
             na_replacement, min_num_obs, dt_config,
@@ -872,6 +1022,7 @@ utils::StatusOr<bool> FindBestConditionSingleThreadManager(
     utils::RandomEngine* random, PerThreadCache* cache) {
   // Single Thread Setup.
   cache->splitter_cache_list.resize(1);
+  cache->splitter_cache_list[0].cache_v2.histograms = cache->histogram_context;
 
   // Was a least one good split found?
   bool found_good_condition = false;
@@ -1018,6 +1169,9 @@ utils::StatusOr<bool> FindBestConditionConcurrentManager(
   cache->splitter_cache_list.resize(num_threads);
   cache->work_status_list.resize(num_features);
   cache->condition_list.resize(num_threads * kConditionPoolGrowthFactor);
+  for (auto& splitter_cache : cache->splitter_cache_list) {
+    splitter_cache.cache_v2.histograms = cache->histogram_context;
+  }
 
   if (dt_config.split_axis_case() !=
           proto::DecisionTreeTrainingConfig::kAxisAlignedSplit &&
@@ -1510,6 +1664,36 @@ SplitSearchResult FindSplitLabelClassificationFeatureDiscretizedNumericalCart(
   }
 }
 
+SplitSearchResult FindSplitLabelClassificationFeatureBinnedNumerical(
+    const std::vector<row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<int32_t>& labels, const int32_t num_label_classes,
+    const row_t min_num_obs, const proto::DecisionTreeTrainingConfig& dt_config,
+    const utils::IntegerDistributionDouble& label_distribution,
+    const int32_t attribute_idx, proto::NodeCondition* condition,
+    SplitterPerThreadCache* cache) {
+  FeatureBinnedNumericalBucket::Filler feature_filler(
+      attribute.bins, attribute.boundaries, attribute.na_bin);
+  if (num_label_classes == 3) {
+    // Binary classification.
+    LabelBinaryCategoricalBucket::Filler label_filler(labels, weights,
+                                                      label_distribution);
+
+    return FindBestSplit_LabelBinaryClassificationFeatureBinnedNumerical(
+        selected_examples, feature_filler, label_filler, min_num_obs,
+        attribute_idx, condition, &cache->cache_v2);
+  } else {
+    // Multi-class classification.
+    LabelCategoricalBucket::Filler label_filler(labels, weights,
+                                                label_distribution);
+
+    return FindBestSplit_LabelClassificationFeatureBinnedNumerical(
+        selected_examples, feature_filler, label_filler, min_num_obs,
+        attribute_idx, condition, &cache->cache_v2);
+  }
+}
+
 SplitSearchResult FindSplitLabelRegressionFeatureNumericalHistogram(
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
     const std::vector<float>& weights, const std::vector<float>& attributes,
@@ -1710,6 +1894,27 @@ FindSplitLabelHessianRegressionFeatureDiscretizedNumericalCart(
       attribute_idx, condition, &cache->cache_v2);
 }
 
+SplitSearchResult FindSplitLabelHessianRegressionFeatureBinnedNumerical(
+    const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<float>& gradients, const std::vector<float>& hessians,
+    row_t min_num_obs, const proto::DecisionTreeTrainingConfig& dt_config,
+    double sum_gradient, double sum_hessian, double sum_weights,
+    int32_t attribute_idx, const InternalTrainConfig& internal_config,
+    proto::NodeCondition* condition, SplitterPerThreadCache* cache) {
+  FeatureBinnedNumericalBucket::Filler feature_filler(
+      attribute.bins, attribute.boundaries, attribute.na_bin);
+
+  LabelHessianNumericalBucket::Filler label_filler(
+      gradients, hessians, weights, sum_gradient, sum_hessian, sum_weights,
+      internal_config.hessian_l1, internal_config.hessian_l2_numerical);
+
+  return FindBestSplit_LabelHessianRegressionFeatureBinnedNumerical(
+      selected_examples, feature_filler, label_filler, min_num_obs,
+      attribute_idx, condition, &cache->cache_v2);
+}
+
 SplitSearchResult FindSplitLabelRegressionFeatureNumericalCart(
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
     const std::vector<float>& weights, const std::vector<float>& attributes,
@@ -1779,6 +1984,26 @@ SplitSearchResult FindSplitLabelRegressionFeatureDiscretizedNumericalCart(
       attribute_idx, condition, &cache->cache_v2);
 }
 
+SplitSearchResult FindSplitLabelRegressionFeatureBinnedNumerical(
+    const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<float>& labels, const row_t min_num_obs,
+    const proto::DecisionTreeTrainingConfig& dt_config,
+    const utils::NormalDistributionDouble& label_distribution,
+    const int32_t attribute_idx, proto::NodeCondition* condition,
+    SplitterPerThreadCache* cache) {
+  FeatureBinnedNumericalBucket::Filler feature_filler(
+      attribute.bins, attribute.boundaries, attribute.na_bin);
+
+  LabelNumericalBucket::Filler label_filler(labels, weights,
+                                            label_distribution);
+
+  return FindBestSplit_LabelRegressionFeatureBinnedNumerical(
+      selected_examples, feature_filler, label_filler, min_num_obs,
+      attribute_idx, condition, &cache->cache_v2);
+}
+
 SplitSearchResult FindSplitLabelClassificationFeatureNA(
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
     const std::vector<float>& weights,
@@ -2728,6 +2953,7 @@ void SetDefaultHyperParameters(proto::DecisionTreeTrainingConfig* config) {
         config->mutable_numerical_split()->set_num_candidates(1);
         break;
       case proto::NumericalSplit::HISTOGRAM_EQUAL_WIDTH:
+      case proto::NumericalSplit::PRE_BINNED:
         config->mutable_numerical_split()->set_num_candidates(255);
         break;
       default:
@@ -2743,7 +2969,9 @@ void SetDefaultHyperParameters(proto::DecisionTreeTrainingConfig* config) {
   // Disable pre-sorting if not supported by the splitters.
   if (config->internal().sorting_strategy() ==
       proto::DecisionTreeTrainingConfig::Internal::PRESORTED) {
+    // The PRE_BINNED splitter does not use the pre-sorted index.
     if (config->has_sparse_oblique_split() ||
+        config->numerical_split().type() == proto::NumericalSplit::PRE_BINNED ||
         config->missing_value_policy() !=
             proto::DecisionTreeTrainingConfig::GLOBAL_IMPUTATION) {
       config->mutable_internal()->set_sorting_strategy(
@@ -2772,7 +3000,7 @@ absl::Status GrowTreeBestFirstGlobal(
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights,
     const InternalTrainConfig& internal_config, NodeWithChildren* root,
-    utils::RandomEngine* random) {
+    utils::RandomEngine* random, LeafAssignments* leaf_assignments) {
   if (dt_config.missing_value_policy() ==
       proto::DecisionTreeTrainingConfig::RANDOM_LOCAL_IMPUTATION) {
     return absl::InvalidArgumentError(
@@ -2781,6 +3009,8 @@ absl::Status GrowTreeBestFirstGlobal(
   }
 
   PerThreadCache cache;
+  InitializeHistogramCache(train_dataset, config, config_link, dt_config,
+                           internal_config, &cache);
 
   struct CandidateSplit {
     // Split.
@@ -2793,6 +3023,8 @@ absl::Status GrowTreeBestFirstGlobal(
     NodeWithChildren* node;
     // Depth of the node.
     int depth;
+    // Histograms of the node. Owned by "cache.histogram_cache". Can be null.
+    NodeHistograms* histograms;
 
     bool operator<(const CandidateSplit& other) const {
       return score < other.score;
@@ -2802,11 +3034,20 @@ absl::Status GrowTreeBestFirstGlobal(
   // List of candidate splits.
   std::priority_queue<CandidateSplit> candidate_splits;
 
+  // Finalizes a candidate split as a leaf.
+  const auto finalize_candidate_as_leaf = [&](const CandidateSplit& split) {
+    split.node->FinalizeAsLeaf(dt_config.store_detailed_label_distribution());
+    AddLeafAssignment(split.example_idxs, split.node, leaf_assignments);
+    cache.histogram_cache.Release(split.histograms);
+  };
+
   // Initialize a node and update the list of candidate splits with a given
-  // node.
-  const auto ingest_node = [&](const std::vector<row_t>& example_idxs,
-                               NodeWithChildren* node,
-                               const int depth) -> absl::Status {
+  // node. Returns true iff. the node was added to the candidate splits, in
+  // which case the candidate split takes ownership of "histograms.node".
+  const auto ingest_node =
+      [&](const std::vector<row_t>& example_idxs, NodeWithChildren* node,
+          const int depth,
+          const NodeHistogramContext& histograms) -> utils::StatusOr<bool> {
     internal_config.set_leaf_value_functor(train_dataset, example_idxs, weights,
                                            config, config_link, node);
 
@@ -2814,19 +3055,23 @@ absl::Status GrowTreeBestFirstGlobal(
         (dt_config.max_depth() >= 0 && depth >= dt_config.max_depth())) {
       // Stop the grow of the branch.
       node->FinalizeAsLeaf(dt_config.store_detailed_label_distribution());
-      return absl::OkStatus();
+      AddLeafAssignment(example_idxs, node, leaf_assignments);
+      return false;
     }
     proto::NodeCondition condition;
+    cache.histogram_context = histograms;
     ASSIGN_OR_RETURN(
         const auto has_better_condition,
         FindBestCondition(train_dataset, example_idxs, weights, config,
                           config_link, dt_config, splitter_concurrency_setup,
                           node->node(), internal_config, &condition, random,
                           &cache));
+    cache.histogram_context = {};
     if (!has_better_condition) {
       // No good condition found. Close the branch.
       node->FinalizeAsLeaf(dt_config.store_detailed_label_distribution());
-      return absl::OkStatus();
+      AddLeafAssignment(example_idxs, node, leaf_assignments);
+      return false;
     }
 
     const float score = condition.split_score() * example_idxs.size();
@@ -2834,11 +3079,19 @@ absl::Status GrowTreeBestFirstGlobal(
                            /*.example_idxs =*/example_idxs,
                            /*.score =*/score,
                            /*.node =*/node,
-                           /*.depth =*/depth});
-    return absl::OkStatus();
+                           /*.depth =*/depth,
+                           /*.histograms =*/histograms.node});
+    return true;
   };
 
-  RETURN_IF_ERROR(ingest_node(train_example_idxs, root, /*depth=*/0));
+  NodeHistogramContext root_histograms;
+  root_histograms.node = cache.histogram_cache.Acquire();
+  ASSIGN_OR_RETURN(const bool root_is_candidate,
+                   ingest_node(train_example_idxs, root, /*depth=*/0,
+                               root_histograms));
+  if (!root_is_candidate) {
+    cache.histogram_cache.Release(root_histograms.node);
+  }
 
   // Total number of nodes in the tree.
   int num_nodes = 1;
@@ -2856,8 +3109,7 @@ absl::Status GrowTreeBestFirstGlobal(
     // Ensure the candidate set is not larger than  "max_num_nodes". Note:
     // There is not need for mode than "max_num_nodes" candidate splits.
     while (max_num_nodes >= 0 && candidate_splits.size() > max_num_nodes) {
-      candidate_splits.top().node->FinalizeAsLeaf(
-          dt_config.store_detailed_label_distribution());
+      finalize_candidate_as_leaf(candidate_splits.top());
       candidate_splits.pop();
     }
 
@@ -2880,17 +3132,57 @@ absl::Status GrowTreeBestFirstGlobal(
         dt_config.internal_error_on_wrong_splitter_statistics(),
         &positive_examples, &negative_examples));
 
-    RETURN_IF_ERROR(ingest_node(
-        positive_examples, split.node->mutable_pos_child(), split.depth + 1));
-    RETURN_IF_ERROR(ingest_node(
-        negative_examples, split.node->mutable_neg_child(), split.depth + 1));
+    if (!cache.histogram_cache.enabled()) {
+      RETURN_IF_ERROR(ingest_node(positive_examples,
+                                  split.node->mutable_pos_child(),
+                                  split.depth + 1, {})
+                          .status());
+      RETURN_IF_ERROR(ingest_node(negative_examples,
+                                  split.node->mutable_neg_child(),
+                                  split.depth + 1, {})
+                          .status());
+    } else {
+      // Histogram subtraction: The histograms of the larger child are
+      // computed as the histograms of the node minus the histograms of the
+      // smaller child.
+      const bool positive_is_smaller =
+          positive_examples.size() <= negative_examples.size();
+      NodeHistogramContext small_child_histograms;
+      small_child_histograms.node = cache.histogram_cache.Acquire();
+      NodeHistogramContext large_child_histograms;
+      large_child_histograms.node = cache.histogram_cache.Acquire();
+      large_child_histograms.parent = split.histograms;
+      large_child_histograms.sibling = small_child_histograms.node;
+
+      ASSIGN_OR_RETURN(
+          const bool small_child_is_candidate,
+          ingest_node(
+              positive_is_smaller ? positive_examples : negative_examples,
+              positive_is_smaller ? split.node->mutable_pos_child()
+                                  : split.node->mutable_neg_child(),
+              split.depth + 1, small_child_histograms));
+      ASSIGN_OR_RETURN(
+          const bool large_child_is_candidate,
+          ingest_node(
+              positive_is_smaller ? negative_examples : positive_examples,
+              positive_is_smaller ? split.node->mutable_neg_child()
+                                  : split.node->mutable_pos_child(),
+              split.depth + 1, large_child_histograms));
+
+      cache.histogram_cache.Release(split.histograms);
+      if (!small_child_is_candidate) {
+        cache.histogram_cache.Release(small_child_histograms.node);
+      }
+      if (!large_child_is_candidate) {
+        cache.histogram_cache.Release(large_child_histograms.node);
+      }
+    }
     num_nodes++;
   }
 
   // Finalize the remaining candidates.
   while (!candidate_splits.empty()) {
-    candidate_splits.top().node->FinalizeAsLeaf(
-        dt_config.store_detailed_label_distribution());
+    finalize_candidate_as_leaf(candidate_splits.top());
     candidate_splits.pop();
   }
   return absl::OkStatus();
@@ -2904,7 +3196,13 @@ absl::Status DecisionTreeTrain(
     const proto::DecisionTreeTrainingConfig& dt_config,
     const model::proto::DeploymentConfig& deployment,
     const std::vector<float>& weights, utils::RandomEngine* random,
-    DecisionTree* dt, const InternalTrainConfig& internal_config) {
+    DecisionTree* dt, const InternalTrainConfig& internal_config,
+    LeafAssignments* leaf_assignments) {
+  if (leaf_assignments) {
+    leaf_assignments->leaves.clear();
+    leaf_assignments->example_leaf_idxs.assign(train_dataset.nrow(), -1);
+  }
+
   // Decide if execution should happen in single-thread or concurrent mode.
 
   const bool force_single_thread =
@@ -2918,7 +3216,7 @@ absl::Status DecisionTreeTrain(
     return DecisionTreeCoreTrain(train_dataset, selected_examples, config,
                                  config_link, dt_config, deployment,
                                  splitter_concurrency_setup, weights, random,
-                                 internal_config, dt);
+                                 internal_config, dt, leaf_assignments);
   } else {
     splitter_concurrency_setup.concurrent_execution = true;
     splitter_concurrency_setup.num_threads = internal_config.num_threads;
@@ -2937,7 +3235,7 @@ absl::Status DecisionTreeTrain(
   return DecisionTreeCoreTrain(train_dataset, selected_examples, config,
                                config_link, dt_config, deployment,
                                splitter_concurrency_setup, weights, random,
-                               internal_config, dt);
+                               internal_config, dt, leaf_assignments);
 }
 
 absl::Status DecisionTreeCoreTrain(
@@ -2949,22 +3247,27 @@ absl::Status DecisionTreeCoreTrain(
     const model::proto::DeploymentConfig& deployment,
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights, utils::RandomEngine* random,
-    const InternalTrainConfig& internal_config, DecisionTree* dt) {
+    const InternalTrainConfig& internal_config, DecisionTree* dt,
+    LeafAssignments* leaf_assignments) {
   dt->CreateRoot();
   PerThreadCache cache;
   switch (dt_config.growing_strategy_case()) {
     case proto::DecisionTreeTrainingConfig::GROWING_STRATEGY_NOT_SET:
-    case proto::DecisionTreeTrainingConfig::kGrowingStrategyLocal:
+    case proto::DecisionTreeTrainingConfig::kGrowingStrategyLocal: {
+      InitializeHistogramCache(train_dataset, config, config_link, dt_config,
+                               internal_config, &cache);
+      NodeHistogramContext root_histograms;
+      root_histograms.node = cache.histogram_cache.Acquire();
       return NodeTrain(train_dataset, selected_examples, config, config_link,
                        dt_config, deployment, splitter_concurrency_setup,
                        weights, 1, internal_config, dt->mutable_root(), random,
-                       &cache);
-      break;
+                       &cache, root_histograms, leaf_assignments);
+    } break;
     case proto::DecisionTreeTrainingConfig::kGrowingStrategyBestFirstGlobal:
       return GrowTreeBestFirstGlobal(
           train_dataset, selected_examples, config, config_link, dt_config,
           deployment, splitter_concurrency_setup, weights, internal_config,
-          dt->mutable_root(), random);
+          dt->mutable_root(), random, leaf_assignments);
       break;
   }
 }
@@ -2979,7 +3282,8 @@ absl::Status NodeTrain(
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights, const int32_t depth,
     const InternalTrainConfig& internal_config, NodeWithChildren* node,
-    utils::RandomEngine* random, PerThreadCache* cache) {
+    utils::RandomEngine* random, PerThreadCache* cache,
+    const NodeHistogramContext& histograms, LeafAssignments* leaf_assignments) {
   if (selected_examples.empty()) {
     return absl::InternalError("No example feed to the no trainer");
   }
@@ -2994,6 +3298,7 @@ absl::Status NodeTrain(
        internal_config.timeout < absl::Now())) {
     // Stop the grow of the branch.
     node->FinalizeAsLeaf(dt_config.store_detailed_label_distribution());
+    AddLeafAssignment(selected_examples, node, leaf_assignments);
     return absl::OkStatus();
   }
   // Dataset used to train this node.
@@ -3026,6 +3331,7 @@ absl::Status NodeTrain(
   }
 
   // Determine the best split.
+  cache->histogram_context = histograms;
   ASSIGN_OR_RETURN(
       const auto has_better_condition,
       FindBestCondition(
@@ -3033,9 +3339,11 @@ absl::Status NodeTrain(
           config_link, dt_config, splitter_concurrency_setup, node->node(),
           internal_config, node->mutable_node()->mutable_condition(), random,
           cache));
+  cache->histogram_context = {};
   if (!has_better_condition) {
     // No good condition found. Close the branch.
     node->FinalizeAsLeaf(dt_config.store_detailed_label_distribution());
+    AddLeafAssignment(selected_examples, node, leaf_assignments);
     return absl::OkStatus();
   }
   CHECK_EQ(selected_examples.size(),
@@ -3058,16 +3366,51 @@ absl::Status NodeTrain(
       dt_config.internal_error_on_wrong_splitter_statistics(),
       &positive_examples, &negative_examples));
 
-  // Positive child.
+  if (!cache->histogram_cache.enabled()) {
+    // Positive child.
+    RETURN_IF_ERROR(NodeTrain(
+        train_dataset, positive_examples, config, config_link, dt_config,
+        deployment, splitter_concurrency_setup, weights, depth + 1,
+        internal_config, node->mutable_pos_child(), random, cache,
+        /*histograms=*/{}, leaf_assignments));
+    // Negative child.
+    RETURN_IF_ERROR(NodeTrain(
+        train_dataset, negative_examples, config, config_link, dt_config,
+        deployment, splitter_concurrency_setup, weights, depth + 1,
+        internal_config, node->mutable_neg_child(), random, cache,
+        /*histograms=*/{}, leaf_assignments));
+    return absl::OkStatus();
+  }
+
+  // Histogram subtraction: The smaller child is trained first. The histograms
+  // of the larger child are computed as the histograms of the node minus the
+  // histograms of the smaller child.
+  const bool positive_is_smaller =
+      positive_examples.size() <= negative_examples.size();
+  NodeHistogramContext small_child_histograms;
+  small_child_histograms.node = cache->histogram_cache.Acquire();
+  NodeHistogramContext large_child_histograms;
+  large_child_histograms.node = cache->histogram_cache.Acquire();
+  large_child_histograms.parent = histograms.node;
+  large_child_histograms.sibling = small_child_histograms.node;
+
   RETURN_IF_ERROR(NodeTrain(
-      train_dataset, positive_examples, config, config_link, dt_config,
-      deployment, splitter_concurrency_setup, weights, depth + 1,
-      internal_config, node->mutable_pos_child(), random, cache));
-  // Negative child.
+      train_dataset, positive_is_smaller ? positive_examples : negative_examples,
+      config, config_link, dt_config, deployment, splitter_concurrency_setup,
+      weights, depth + 1, internal_config,
+      positive_is_smaller ? node->mutable_pos_child()
+                          : node->mutable_neg_child(),
+      random, cache, small_child_histograms, leaf_assignments));
   RETURN_IF_ERROR(NodeTrain(
-      train_dataset, negative_examples, config, config_link, dt_config,
-      deployment, splitter_concurrency_setup, weights, depth + 1,
-      internal_config, node->mutable_neg_child(), random, cache));
+      train_dataset, positive_is_smaller ? negative_examples : positive_examples,
+      config, config_link, dt_config, deployment, splitter_concurrency_setup,
+      weights, depth + 1, internal_config,
+      positive_is_smaller ? node->mutable_neg_child()
+                          : node->mutable_pos_child(),
+      random, cache, large_child_histograms, leaf_assignments));
+
+  cache->histogram_cache.Release(small_child_histograms.node);
+  cache->histogram_cache.Release(large_child_histograms.node);
   return absl::OkStatus();
 }
 
@@ -3085,6 +3428,19 @@ utils::StatusOr<Preprocessing> PreprocessTrainingDataset(
                                              num_threads, &preprocessing));
   }
 
+  // The quantized features are only used with the global imputation (see
+  // "GetBinnedNumericalFeature").
+  if (dt_config.numerical_split().type() == proto::NumericalSplit::PRE_BINNED &&
+      dt_config.missing_value_policy() ==
+          proto::DecisionTreeTrainingConfig::GLOBAL_IMPUTATION) {
+    RETURN_IF_ERROR(BinNumericalFeatures(
+        train_dataset, config_link,
+        dt_config.numerical_split().has_num_candidates()
+            ? dt_config.numerical_split().num_candidates()
+            : 255,
+        num_threads, &preprocessing));
+  }
+
   return preprocessing;
 }
 
@@ -3165,6 +3521,93 @@ absl::Status PresortNumericalFeatures(
   return absl::OkStatus();
 }
 
+absl::Status BinNumericalFeatures(
+    const dataset::VerticalDataset& train_dataset,
+    const model::proto::TrainingConfigLinking& config_link,
+    const int max_num_bins, const int num_threads,
+    Preprocessing* preprocessing) {
+  if (max_num_bins < 2 || max_num_bins > 255) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("The number of bins of the PRE_BINNED numerical splitter "
+                     "(i.e. numerical_split.num_candidates) should be in [2, "
+                     "255]. Got ",
+                     max_num_bins, "."));
+  }
+
+  // Maximum number of values used to compute the bin boundaries of a feature.
+  const dataset::VerticalDataset::row_t kMaxNumBinningValues = 1 << 20;
+
+  preprocessing->mutable_binned_numerical_features()->resize(
+      train_dataset.data_spec().columns_size());
+
+  utils::concurrency::ThreadPool pool(
+      "bin_numerical_features",
+      std::min(num_threads, config_link.features().size()));
+  pool.StartWorkers();
+
+  // For all the input features in the model.
+  for (const auto feature_idx : config_link.features()) {
+    // Skip non numerical features.
+    if (train_dataset.data_spec().columns(feature_idx).type() !=
+        dataset::proto::NUMERICAL) {
+      continue;
+    }
+
+    pool.Schedule([feature_idx, max_num_bins, kMaxNumBinningValues,
+                   &train_dataset, preprocessing]() {
+      const dataset::VerticalDataset::row_t num_examples = train_dataset.nrow();
+      if (num_examples == 0) {
+        return;
+      }
+      const auto& values =
+          train_dataset
+              .ColumnWithCast<dataset::VerticalDataset::NumericalColumn>(
+                  feature_idx)
+              ->values();
+      CHECK_EQ(num_examples, values.size());
+
+      // Global imputation replacement.
+      const float na_replacement_value =
+          train_dataset.data_spec().columns(feature_idx).numerical().mean();
+      const auto value_or_replacement = [&](const float value) {
+        return std::isnan(value) ? na_replacement_value : value;
+      };
+
+      // Compute the bin boundaries on a regularly spaced subset of the
+      // values.
+      const auto num_binning_values =
+          std::min(num_examples, kMaxNumBinningValues);
+      std::vector<float> sorted_values(num_binning_values);
+      for (dataset::VerticalDataset::row_t idx = 0; idx < num_binning_values;
+           idx++) {
+        sorted_values[idx] = value_or_replacement(
+            values[static_cast<uint64_t>(idx) * num_examples /
+                   num_binning_values]);
+      }
+      std::sort(sorted_values.begin(), sorted_values.end());
+
+      auto& binned_feature =
+          (*preprocessing->mutable_binned_numerical_features())[feature_idx];
+      binned_feature.boundaries =
+          internal::ComputeQuantileBinBoundaries(sorted_values, max_num_bins);
+
+      const auto& boundaries = binned_feature.boundaries;
+      const auto get_bin = [&boundaries](const float value) -> uint8_t {
+        return std::upper_bound(boundaries.begin(), boundaries.end(), value) -
+               boundaries.begin();
+      };
+      binned_feature.na_bin = get_bin(na_replacement_value);
+      binned_feature.bins.resize(num_examples);
+      for (dataset::VerticalDataset::row_t example_idx = 0;
+           example_idx < num_examples; example_idx++) {
+        binned_feature.bins[example_idx] =
+            get_bin(value_or_replacement(values[example_idx]));
+      }
+    });
+  }
+  return absl::OkStatus();
+}
+
 namespace internal {
 
 bool MaskPureSampledOrPrunedItemsForCategoricalSetGreedySelection(
@@ -3204,6 +3647,58 @@ bool MaskPureSampledOrPrunedItemsForCategoricalSetGreedySelection(
   return valid_items > 0;
 }
 
+std::vector<float> ComputeQuantileBinBoundaries(
+    const std::vector<float>& sorted_values, const int max_num_bins) {
+  DCHECK(!sorted_values.empty());
+  std::vector<float> boundaries;
+
+  // Adds a boundary between two consecutive different values.
+  const auto add_boundary = [&boundaries](const float low, const float high) {
+    // Note: "low / 2 + high / 2" does not overflow.
+    float boundary = low / 2 + high / 2;
+    if (!(boundary > low) || boundary > high) {
+      boundary = high;
+    }
+    if (boundaries.empty() || boundary > boundaries.back()) {
+      boundaries.push_back(boundary);
+    }
+  };
+
+  const size_t num_values = sorted_values.size();
+  int num_unique_values = 1;
+  for (size_t idx = 1; idx < num_values; idx++) {
+    if (sorted_values[idx] != sorted_values[idx - 1]) {
+      num_unique_values++;
+    }
+  }
+
+  if (num_unique_values <= max_num_bins) {
+    // Each unique value has its own bin.
+    for (size_t idx = 1; idx < num_values; idx++) {
+      if (sorted_values[idx] != sorted_values[idx - 1]) {
+        add_boundary(sorted_values[idx - 1], sorted_values[idx]);
+      }
+    }
+    return boundaries;
+  }
+
+  // Quantiles. If a quantile falls in a run of equal values, the boundary is
+  // placed at the end of the run.
+  for (int bin_idx = 1; bin_idx < max_num_bins; bin_idx++) {
+    // Note: "quantile_idx" >= 1 since there are more values than bins.
+    const size_t quantile_idx = bin_idx * num_values / max_num_bins;
+    const size_t idx =
+        std::upper_bound(sorted_values.begin() + quantile_idx,
+                         sorted_values.end(), sorted_values[quantile_idx - 1]) -
+        sorted_values.begin();
+    if (idx >= num_values) {
+      break;
+    }
+    add_boundary(sorted_values[idx - 1], sorted_values[idx]);
+  }
+  return boundaries;
+}
+
 std::vector<float> GenHistogramBins(const proto::NumericalSplit::Type type,
                                     const int num_splits,
                                     const std::vector<float>& attributes,
@@ -166,6 +166,37 @@ struct SplitterWorkStatus {
   SplitSearchResult status;
 };
 
+// Pool of node histograms for the histogram subtraction of the PRE_BINNED
+// numerical splitter (see "NodeHistograms"). The memory usage of the pool is
+// bounded: When the budget is exhausted, the histograms of the new nodes are
+// not cached (and their children compute their histograms from the examples).
+class HistogramCache {
+ public:
+  // Enables the cache. "num_attributes" is the number of columns in the
+  // dataset and "node_memory_bytes" is the estimated memory usage of the
+  // histograms of a node (see "NodeHistograms::EstimateMemoryUsage").
+  void Initialize(int num_attributes, int64_t node_memory_bytes,
+                  int64_t max_memory_bytes);
+
+  bool enabled() const { return num_attributes_ > 0; }
+
+  // Gets empty node histograms. Returns null if the cache is disabled or if
+  // the memory budget is exhausted.
+  NodeHistograms* Acquire();
+
+  // Returns histograms obtained with "Acquire". No-op if "histograms" is null.
+  void Release(NodeHistograms* histograms);
+
+ private:
+  int num_attributes_ = 0;
+  int64_t max_memory_bytes_ = 0;
+  // Largest estimated or observed memory usage of the histograms of a node.
+  int64_t max_node_memory_bytes_ = 0;
+
+  std::vector<std::unique_ptr<NodeHistograms>> histograms_;
+  std::vector<NodeHistograms*> available_histograms_;
+};
+
 // Memory cache used to reduce the number of allocation / de-allocation of
 // memory during training. One mutable "PerThreadCache" object is required by
 // the "train" method.
@@ -196,6 +227,12 @@ struct PerThreadCache {
   utils::CircularBuffer<int32_t> available_cache_idxs;
   // List of available indices into condition_list.
   utils::CircularBuffer<int32_t> available_condition_idxs;
+
+  // Cached node histograms.
+  HistogramCache histogram_cache;
+  // Histograms of the node being split. Set by the caller of
+  // "FindBestCondition".
+  NodeHistogramContext histogram_context;
 };
 
 // In a concurrent setup, this structure encapsulates all the objects that are
@@ -228,6 +265,18 @@ class Preprocessing {
     std::vector<SparseItem> items;
   };
 
+  // Numerical feature quantized for the PRE_BINNED numerical splitter.
+  struct BinnedNumericalFeature {
+    // Bin index of each example i.e. the number of "boundaries" lower or equal
+    // to the feature value. Missing values are replaced using the
+    // GLOBAL_IMPUTATION strategy.
+    std::vector<uint8_t> bins;
+    // Strictly increasing bin boundaries. Contains at most 254 values.
+    std::vector<float> boundaries;
+    // Bin of the missing values.
+    uint8_t na_bin = 0;
+  };
+
   std::vector<PresortedNumericalFeature>*
   mutable_presorted_numerical_features() {
     return &presorted_numerical_features_;
@@ -238,6 +287,15 @@ class Preprocessing {
     return presorted_numerical_features_;
   }
 
+  std::vector<BinnedNumericalFeature>* mutable_binned_numerical_features() {
+    return &binned_numerical_features_;
+  }
+
+  const std::vector<BinnedNumericalFeature>& binned_numerical_features()
+      const {
+    return binned_numerical_features_;
+  }
+
   uint64_t num_examples() const { return num_examples_; }
 
   void set_num_examples(const uint64_t value) { num_examples_ = value; }
@@ -248,6 +306,11 @@ class Preprocessing {
   // "presorted_numerical_features_[i]" will be an empty index.
   std::vector<PresortedNumericalFeature> presorted_numerical_features_;
 
+  // List of quantized numerical features, indexed by feature index. If
+  // feature "i" is not numerical or not quantized,
+  // "binned_numerical_features_[i]" will be empty.
+  std::vector<BinnedNumericalFeature> binned_numerical_features_;
+
   // Total number of examples.
   uint64_t num_examples_ = -1;
 };
@@ -307,6 +370,22 @@ struct InternalTrainConfig {
   absl::optional<absl::Time> timeout;
 };
 
+// Assignment of the training examples to the leaves of a tree. Computed while
+// growing the tree, at no extra traversal cost.
+struct LeafAssignments {
+  // Leaves of the tree. Non owning pointers.
+  std::vector<const NodeWithChildren*> leaves;
+
+  // "example_leaf_idxs[i]" is the index, in "leaves", of the leaf reached by
+  // the i-th example of the training dataset. -1 if the example was not
+  // selected for training.
+  //
+  // If the missing value policy is RANDOM_LOCAL_IMPUTATION, the training
+  // examples are routed with the imputed values. In this case, the reached
+  // leaf can differ from the one returned by "DecisionTree::GetLeaf".
+  std::vector<int32_t> example_leaf_idxs;
+};
+
 // Find the best condition for this node. Return true iff a good condition has
 // been found.
 utils::StatusOr<bool> FindBestCondition(
@@ -566,6 +645,20 @@ SplitSearchResult FindSplitLabelClassificationFeatureDiscretizedNumericalCart(
     int32_t attribute_idx, proto::NodeCondition* condition,
     SplitterPerThreadCache* cache);
 
+// Similar to "FindSplitLabelClassificationFeatureNumericalCart", but work on
+// numerical values quantized before the training (see
+// "NumericalSplit::PRE_BINNED").
+SplitSearchResult FindSplitLabelClassificationFeatureBinnedNumerical(
+    const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<int32_t>& labels, int32_t num_label_classes,
+    dataset::VerticalDataset::row_t min_num_obs,
+    const proto::DecisionTreeTrainingConfig& dt_config,
+    const utils::IntegerDistributionDouble& label_distribution,
+    int32_t attribute_idx, proto::NodeCondition* condition,
+    SplitterPerThreadCache* cache);
+
 // Search for the best split for a numerical attribute and a numerical label
 // using the CART algorithm for a dataset loaded in memory.
 //
@@ -604,6 +697,17 @@ FindSplitLabelHessianRegressionFeatureDiscretizedNumericalCart(
     const InternalTrainConfig& internal_config, proto::NodeCondition* condition,
     SplitterPerThreadCache* cache);
 
+SplitSearchResult FindSplitLabelHessianRegressionFeatureBinnedNumerical(
+    const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<float>& gradients, const std::vector<float>& hessians,
+    dataset::VerticalDataset::row_t min_num_obs,
+    const proto::DecisionTreeTrainingConfig& dt_config, double sum_gradient,
+    double sum_hessian, double sum_weights, int32_t attribute_idx,
+    const InternalTrainConfig& internal_config, proto::NodeCondition* condition,
+    SplitterPerThreadCache* cache);
+
 // Similarly to "FindSplitLabelClassificationFeatureNumericalCart", but uses an
 // histogram approach to find the best split.
 SplitSearchResult FindSplitLabelRegressionFeatureNumericalHistogram(
@@ -630,6 +734,20 @@ SplitSearchResult FindSplitLabelRegressionFeatureDiscretizedNumericalCart(
     int32_t attribute_idx, proto::NodeCondition* condition,
     SplitterPerThreadCache* cache);
 
+// Similar to "FindSplitLabelRegressionFeatureNumericalCart", but work on
+// numerical values quantized before the training (see
+// "NumericalSplit::PRE_BINNED").
+SplitSearchResult FindSplitLabelRegressionFeatureBinnedNumerical(
+    const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
+    const std::vector<float>& weights,
+    const Preprocessing::BinnedNumericalFeature& attribute,
+    const std::vector<float>& labels,
+    dataset::VerticalDataset::row_t min_num_obs,
+    const proto::DecisionTreeTrainingConfig& dt_config,
+    const utils::NormalDistributionDouble& label_distribution,
+    int32_t attribute_idx, proto::NodeCondition* condition,
+    SplitterPerThreadCache* cache);
+
 // Looks for the best split for a categorical attribute and a categorical label
 // using the algorithm configured in "dt_config" for a dataset loaded in memory.
 // Such split is defined as a subset of the possible values of the attribute.
@@ -768,7 +886,7 @@ absl::Status GrowTreeBestFirstGlobal(
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights,
     const InternalTrainConfig& internal_config, NodeWithChildren* root,
-    utils::RandomEngine* random);
+    utils::RandomEngine* random, LeafAssignments* leaf_assignments = nullptr);
 
 // The core training logic that is the same between single-threaded execution
 // and concurrent execution.
@@ -781,9 +899,13 @@ absl::Status DecisionTreeCoreTrain(
     const model::proto::DeploymentConfig& deployment,
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights, utils::RandomEngine* random,
-    const InternalTrainConfig& internal_config, DecisionTree* dt);
+    const InternalTrainConfig& internal_config, DecisionTree* dt,
+    LeafAssignments* leaf_assignments = nullptr);
 
 // Train the tree. Fails if the tree is not empty.
+//
+// If "leaf_assignments" is set, it is populated with the assignment of the
+// "selected_examples" to the leaves of the tree.
 absl::Status DecisionTreeTrain(
     const dataset::VerticalDataset& train_dataset,
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
@@ -793,10 +915,12 @@ absl::Status DecisionTreeTrain(
     const model::proto::DeploymentConfig& deployment,
     const std::vector<float>& weights, utils::RandomEngine* random,
     DecisionTree* dt,
-    const InternalTrainConfig& internal_config = InternalTrainConfig());
+    const InternalTrainConfig& internal_config = InternalTrainConfig(),
+    LeafAssignments* leaf_assignments = nullptr);
 constexpr auto Train = DecisionTreeTrain;
 
-// This a node and its children.
+// This a node and its children. "histograms" are the cached histograms of the
+// node, its parent and its sibling (see "HistogramCache").
 absl::Status NodeTrain(
     const dataset::VerticalDataset& train_dataset,
     const std::vector<dataset::VerticalDataset::row_t>& selected_examples,
@@ -807,7 +931,9 @@ absl::Status NodeTrain(
     const SplitterConcurrencySetup& splitter_concurrency_setup,
     const std::vector<float>& weights, const int32_t depth,
     const InternalTrainConfig& internal_config, NodeWithChildren* node,
-    utils::RandomEngine* random, PerThreadCache* cache);
+    utils::RandomEngine* random, PerThreadCache* cache,
+    const NodeHistogramContext& histograms = {},
+    LeafAssignments* leaf_assignments = nullptr);
 
 // Preprocess the dataset before any tree training.
 utils::StatusOr<Preprocessing> PreprocessTrainingDataset(
@@ -823,6 +949,13 @@ absl::Status PresortNumericalFeatures(
     const model::proto::TrainingConfigLinking& config_link, int num_threads,
     Preprocessing* preprocessing);
 
+// Component of "PreprocessTrainingDataset". Quantizes the numerical features
+// into at most "max_num_bins" bins for the PRE_BINNED numerical splitter.
+absl::Status BinNumericalFeatures(
+    const dataset::VerticalDataset& train_dataset,
+    const model::proto::TrainingConfigLinking& config_link, int max_num_bins,
+    int num_threads, Preprocessing* preprocessing);
+
 // Set the default values of the hyper-parameters.
 void SetDefaultHyperParameters(proto::DecisionTreeTrainingConfig* config);
 
@@ -854,6 +987,14 @@ std::vector<float> GenHistogramBins(proto::NumericalSplit::Type type,
                                     float min_value, float max_value,
                                     utils::RandomEngine* random);
 
+// Computes the boundaries of at most "max_num_bins" bins containing
+// approximately the same number of values. "sorted_values" should be sorted
+// and non empty. The boundaries are strictly increasing, and two different
+// values in "sorted_values" are in different bins if "sorted_values" contains
+// less than "max_num_bins" unique values.
+std::vector<float> ComputeQuantileBinBoundaries(
+    const std::vector<float>& sorted_values, int max_num_bins);
+
 // Computes the indices of the subset of examples in "examples" that evaluates
 // positively and negatively to the condition.
 //
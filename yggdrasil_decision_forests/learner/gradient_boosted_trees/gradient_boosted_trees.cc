@@ -57,6 +57,7 @@
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
 #include "yggdrasil_decision_forests/utils/adaptive_work.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/filesystem.h"
 #include "yggdrasil_decision_forests/utils/hyper_parameters.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
@@ -400,6 +401,31 @@ decision_tree::InternalTrainConfig BuildWeakLearnerInternalConfig(
   return internal_config;
 }
 
+// Creates the thread pool used to compute the gradients, predictions and
+// losses (see "AbstractLoss"). The calling thread also participates in the
+// computation. Returns null if "num_threads" is 1.
+std::unique_ptr<utils::concurrency::ThreadPool> CreateLossThreadPool(
+    const int num_threads) {
+  if (num_threads <= 1) {
+    return {};
+  }
+  auto thread_pool = absl::make_unique<utils::concurrency::ThreadPool>(
+      "GBTLoss", num_threads - 1);
+  thread_pool->StartWorkers();
+  return thread_pool;
+}
+
+// Whether the assignment of the training examples to the leaves, computed
+// while growing the trees, can be used to update the training predictions.
+// With the random local imputation, the examples are routed with imputed
+// values i.e. not as they are during inference.
+bool CanUseLeafAssignments(
+    const decision_tree::proto::DecisionTreeTrainingConfig& dt_config) {
+  return dt_config.missing_value_policy() !=
+         decision_tree::proto::DecisionTreeTrainingConfig::
+             RANDOM_LOCAL_IMPUTATION;
+}
+
 }  // namespace
 
 GradientBoostedTreesLearner::GradientBoostedTreesLearner(
@@ -611,6 +637,11 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
   internal::EarlyStopping early_stopping(
       config.gbt_config->early_stopping_num_trees_look_ahead());
 
+  const auto loss_thread_pool =
+      CreateLossThreadPool(deployment().num_threads());
+  const bool use_leaf_assignments =
+      CanUseLeafAssignments(config.gbt_config->decision_tree());
+
   // Load the first sample of training dataset.
   int num_sample_train_shards =
       std::lround(training_shards.size() *
@@ -762,7 +793,8 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
         RETURN_IF_ERROR(config.loss->UpdatePredictions(
             last_trees, next_train_dataset->gradient_dataset,
             &next_train_dataset->predictions,
-            /*mean_abs_prediction=*/nullptr));
+            /*mean_abs_prediction=*/nullptr, /*leaf_assignments=*/nullptr,
+            loss_thread_pool.get()));
 
         current_train_dataset = std::move(next_train_dataset);
       }
@@ -818,11 +850,16 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
     RETURN_IF_ERROR(config.loss->UpdateGradients(
         current_train_dataset->gradient_dataset,
         config.train_config_link.label(), current_train_dataset->predictions,
-        nullptr, &current_train_dataset->gradients, &random));
+        nullptr, &current_train_dataset->gradients, &random,
+        loss_thread_pool.get()));
 
     // Train a tree on the gradient.
     std::vector<std::unique_ptr<decision_tree::DecisionTree>> new_trees;
     new_trees.reserve(mdl->num_trees_per_iter());
+    std::vector<decision_tree::LeafAssignments> leaf_assignments;
+    if (use_leaf_assignments) {
+      leaf_assignments.resize(mdl->num_trees_per_iter());
+    }
     for (int grad_idx = 0; grad_idx < mdl->num_trees_per_iter(); grad_idx++) {
       auto tree = absl::make_unique<decision_tree::DecisionTree>();
 
@@ -836,8 +873,8 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
           current_train_dataset->gradients[grad_idx].config,
           current_train_dataset->gradients[grad_idx].config_link,
           config.gbt_config->decision_tree(), deployment(),
-          current_train_dataset->weights, &random, tree.get(),
-          internal_config));
+          current_train_dataset->weights, &random, tree.get(), internal_config,
+          use_leaf_assignments ? &leaf_assignments[grad_idx] : nullptr));
       new_trees.push_back(std::move(tree));
     }
 
@@ -846,7 +883,8 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
       RETURN_IF_ERROR(config.loss->UpdatePredictions(
           RemoveUniquePtr(new_trees), validation->gradient_dataset,
           &validation->predictions,
-          /*mean_abs_prediction=*/nullptr));
+          /*mean_abs_prediction=*/nullptr, /*leaf_assignments=*/nullptr,
+          loss_thread_pool.get()));
     }
 
     if (recycle_next) {
@@ -854,7 +892,9 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
       RETURN_IF_ERROR(config.loss->UpdatePredictions(
           RemoveUniquePtr(new_trees), current_train_dataset->gradient_dataset,
           &current_train_dataset->predictions,
-          /*mean_abs_prediction=*/nullptr));
+          /*mean_abs_prediction=*/nullptr,
+          use_leaf_assignments ? &leaf_assignments : nullptr,
+          loss_thread_pool.get()));
     }
 
     // Add the tree to the model.
@@ -871,7 +911,7 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
           current_train_dataset->gradient_dataset,
           config.train_config_link.label(), current_train_dataset->predictions,
           current_train_dataset->weights, nullptr, &training_loss,
-          &train_secondary_metrics));
+          &train_secondary_metrics, loss_thread_pool.get()));
 
       auto* log_entry = mdl->training_logs_.mutable_entries()->Add();
       log_entry->set_number_of_trees(iter_idx + 1);
@@ -898,7 +938,8 @@ GradientBoostedTreesLearner::ShardedSamplingTrain(
         RETURN_IF_ERROR(config.loss->Loss(
             validation->gradient_dataset, config.train_config_link.label(),
             validation->predictions, validation->weights, nullptr,
-            &validation_loss, &validation_secondary_metrics));
+            &validation_loss, &validation_secondary_metrics,
+            loss_thread_pool.get()));
         log_entry->set_validation_loss(validation_loss);
         *log_entry->mutable_validation_secondary_metrics() = {
             validation_secondary_metrics.begin(),
@@ -1134,6 +1175,11 @@ GradientBoostedTreesLearner::TrainWithStatus(
       config.gbt_config->early_stopping_num_trees_look_ahead());
   early_stopping.set_trees_per_iterations(mdl->num_trees_per_iter_);
 
+  const auto loss_thread_pool =
+      CreateLossThreadPool(deployment().num_threads());
+  const bool use_leaf_assignments =
+      CanUseLeafAssignments(config.gbt_config->decision_tree());
+
   if (config.gbt_config->use_hessian_gain() &&
       gradients.front().hessian_col_idx == -1) {
     return absl::InvalidArgumentError(
@@ -1177,7 +1223,8 @@ GradientBoostedTreesLearner::TrainWithStatus(
     // Compute the gradient of the residual relative to the examples.
     RETURN_IF_ERROR(config.loss->UpdateGradients(
         gradient_sub_train_dataset, config.train_config_link.label(),
-        sub_train_predictions, train_ranking_index.get(), &gradients, &random));
+        sub_train_predictions, train_ranking_index.get(), &gradients, &random,
+        loss_thread_pool.get()));
 
     float subsample_factor = 1.f;
     // Select a random set of examples (without replacement).
@@ -1222,6 +1269,10 @@ GradientBoostedTreesLearner::TrainWithStatus(
     // Train a tree on the gradient.
     std::vector<std::unique_ptr<decision_tree::DecisionTree>> new_trees;
     new_trees.reserve(gradients.size());
+    std::vector<decision_tree::LeafAssignments> leaf_assignments;
+    if (use_leaf_assignments) {
+      leaf_assignments.resize(gradients.size());
+    }
     for (int grad_idx = 0; grad_idx < gradients.size(); grad_idx++) {
       auto tree = absl::make_unique<decision_tree::DecisionTree>();
 
@@ -1234,7 +1285,8 @@ GradientBoostedTreesLearner::TrainWithStatus(
           gradient_sub_train_dataset, selected_examples,
           gradients[grad_idx].config, gradients[grad_idx].config_link,
           config.gbt_config->decision_tree(), deployment(), *tree_weights,
-          &random, tree.get(), internal_config));
+          &random, tree.get(), internal_config,
+          use_leaf_assignments ? &leaf_assignments[grad_idx] : nullptr));
       new_trees.push_back(std::move(tree));
     }
 
@@ -1269,14 +1321,17 @@ GradientBoostedTreesLearner::TrainWithStatus(
       // Update the predictions on the training dataset.
       RETURN_IF_ERROR(config.loss->UpdatePredictions(
           RemoveUniquePtr(new_trees), gradient_sub_train_dataset,
-          &sub_train_predictions, &mean_abs_prediction));
+          &sub_train_predictions, &mean_abs_prediction,
+          use_leaf_assignments ? &leaf_assignments : nullptr,
+          loss_thread_pool.get()));
 
       if (has_validation_dataset) {
         // Update the predictions on the validation dataset.
         RETURN_IF_ERROR(config.loss->UpdatePredictions(
             RemoveUniquePtr(new_trees), gradient_validation_dataset,
             &validation_predictions,
-            /*mean_abs_prediction=*/nullptr));
+            /*mean_abs_prediction=*/nullptr, /*leaf_assignments=*/nullptr,
+            loss_thread_pool.get()));
       }
     }
 
@@ -1292,7 +1347,7 @@ GradientBoostedTreesLearner::TrainWithStatus(
       RETURN_IF_ERROR(config.loss->Loss(
           gradient_sub_train_dataset, config.train_config_link.label(),
           sub_train_predictions, weights, train_ranking_index.get(),
-          &training_loss, &train_secondary_metrics));
+          &training_loss, &train_secondary_metrics, loss_thread_pool.get()));
 
       auto* log_entry = training_logs.mutable_entries()->Add();
       log_entry->set_number_of_trees(iter_idx + 1);
@@ -1325,7 +1380,7 @@ GradientBoostedTreesLearner::TrainWithStatus(
             gradient_validation_dataset, config.train_config_link.label(),
             validation_predictions, validation_weights,
             valid_ranking_index.get(), &validation_loss,
-            &validation_secondary_metrics));
+            &validation_secondary_metrics, loss_thread_pool.get()));
         log_entry->set_validation_loss(validation_loss);
         *log_entry->mutable_validation_secondary_metrics() = {
             validation_secondary_metrics.begin(),
@@ -2218,7 +2273,9 @@ absl::Status ComputePredictions(
     }
 
     RETURN_IF_ERROR(config.loss->UpdatePredictions(
-        selected_trees, *gradient_dataset, predictions, nullptr));
+        selected_trees, *gradient_dataset, predictions,
+        /*mean_abs_prediction=*/nullptr, /*leaf_assignments=*/nullptr,
+        /*thread_pool=*/nullptr));
   }
   return absl::OkStatus();
 }
@@ -2435,7 +2492,8 @@ absl::Status DartPredictionAccumulator::UpdateWithNewIteration(
   tree_prediction.weight = 1.0f / (selected_iter_idxs.size() + 1);
   RETURN_IF_ERROR(loss_impl.UpdatePredictions(
       RemoveUniquePtr(new_trees), gradient_dataset,
-      &tree_prediction.predictions, mean_abs_prediction));
+      &tree_prediction.predictions, mean_abs_prediction,
+      /*leaf_assignments=*/nullptr, /*thread_pool=*/nullptr));
 
   const float sampled_factor = static_cast<float>(selected_iter_idxs.size()) /
                                (selected_iter_idxs.size() + 1);
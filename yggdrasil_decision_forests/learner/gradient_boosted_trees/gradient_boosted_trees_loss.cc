@@ -18,18 +18,23 @@
 #include <stddef.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/base/optimization.h"
 #include "absl/container/fixed_array.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
 #include "yggdrasil_decision_forests/learner/abstract_learner.pb.h"
@@ -42,7 +47,9 @@
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.pb.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/utils/bitmap.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
 #include "yggdrasil_decision_forests/utils/random.h"
 
@@ -67,6 +74,16 @@ constexpr int kBinomialLossSecondaryMetricClassificationIdx = 0;
 // optimization.
 constexpr float kMinHessianForNewtonStep = 0.001f;
 
+// The examples (or ranking groups) are processed in blocks of fixed size, in
+// parallel. The blocks do not depend on the number of threads, and the
+// per-block results (e.g. partial sums) are aggregated in the block order. This
+// way, the results do not depend on the number of threads.
+//
+// Number of examples in a block.
+constexpr size_t kNumExamplesPerBlock = 16 * 1024;
+// Number of ranking groups in a block.
+constexpr size_t kNumGroupsPerBlock = 64;
+
 // Ensures that the value is finite i.e. not NaN and not infinite.
 // This is a no-op in release mode.
 template <typename T>
@@ -74,35 +91,158 @@ void DCheckIsFinite(T v) {
   DCHECK(!std::isnan(v) && !std::isinf(v));
 }
 
+size_t NumBlocks(const size_t num_items, const size_t block_size) {
+  return (num_items + block_size - 1) / block_size;
+}
+
+// Calls "callback(block_idx, begin, end)" on each of the consecutive blocks of
+// at most "block_size" items in "[0, num_items)". If "thread_pool" is set, the
+// blocks are processed in parallel by the threads of the pool and the calling
+// thread. Returns when all the blocks are processed.
+void ParallelForBlocks(
+    const size_t num_items, const size_t block_size,
+    utils::concurrency::ThreadPool* thread_pool,
+    const std::function<void(size_t block_idx, size_t begin, size_t end)>&
+        callback) {
+  const size_t num_blocks = NumBlocks(num_items, block_size);
+  const auto run_block = [&](const size_t block_idx) {
+    const size_t begin = block_idx * block_size;
+    callback(block_idx, begin, std::min(begin + block_size, num_items));
+  };
+
+  size_t num_workers = 1;
+  if (thread_pool) {
+    num_workers = std::min(
+        static_cast<size_t>(thread_pool->num_threads()) + 1, num_blocks);
+  }
+  if (num_workers <= 1) {
+    for (size_t block_idx = 0; block_idx < num_blocks; block_idx++) {
+      run_block(block_idx);
+    }
+    return;
+  }
+
+  // The workers process the next available block until all the blocks are
+  // processed.
+  std::atomic<size_t> next_block_idx{0};
+  const auto worker = [&]() {
+    for (size_t block_idx = next_block_idx++; block_idx < num_blocks;
+         block_idx = next_block_idx++) {
+      run_block(block_idx);
+    }
+  };
+  absl::BlockingCounter pending_workers(num_workers - 1);
+  for (size_t worker_idx = 1; worker_idx < num_workers; worker_idx++) {
+    thread_pool->Schedule([&]() {
+      worker();
+      pending_workers.DecrementCount();
+    });
+  }
+  worker();
+  pending_workers.Wait();
+}
+
+// Sums "block_sum(begin, end)" over the blocks of "ParallelForBlocks". The
+// partial sums are added in the block order.
+template <typename T>
+T ParallelSum(const size_t num_items, const size_t block_size,
+              utils::concurrency::ThreadPool* thread_pool,
+              const std::function<T(size_t begin, size_t end)>& block_sum) {
+  std::vector<T> block_sums(NumBlocks(num_items, block_size));
+  ParallelForBlocks(num_items, block_size, thread_pool,
+                    [&](const size_t block_idx, const size_t begin,
+                        const size_t end) {
+                      block_sums[block_idx] = block_sum(begin, end);
+                    });
+  T sum{};
+  for (const auto& value : block_sums) {
+    sum += value;
+  }
+  return sum;
+}
+
+// Accumulator for the computation of a loss.
+struct LossAccumulator {
+  double sum_loss = 0;
+  double sum_weights = 0;
+  // Sum of the weights of the correctly predicted examples (classification
+  // only).
+  double sum_correct_predictions = 0;
+
+  LossAccumulator& operator+=(const LossAccumulator& other) {
+    sum_loss += other.sum_loss;
+    sum_weights += other.sum_weights;
+    sum_correct_predictions += other.sum_correct_predictions;
+    return *this;
+  }
+};
+
+// "offsets[i]" is the sum of the number of items in the groups before the i-th
+// group. The last value is the total number of items.
+std::vector<size_t> GroupItemOffsets(
+    const std::vector<RankingGroupsIndices::Group>& groups) {
+  std::vector<size_t> offsets(groups.size() + 1);
+  offsets[0] = 0;
+  for (size_t group_idx = 0; group_idx < groups.size(); group_idx++) {
+    offsets[group_idx + 1] =
+        offsets[group_idx] + groups[group_idx].items.size();
+  }
+  return offsets;
+}
+
+// "leaf_assignments" is optional (see "AbstractLoss::UpdatePredictions").
 void UpdatePredictionWithSingleUnivariateTree(
     const dataset::VerticalDataset& dataset,
-    const decision_tree::DecisionTree& tree, std::vector<float>* predictions,
-    double* mean_abs_prediction) {
-  double sum_abs_predictions = 0;
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    const auto& leaf = tree.GetLeaf(dataset, example_idx);
-    (*predictions)[example_idx] += leaf.regressor().top_value();
-    sum_abs_predictions += std::abs(leaf.regressor().top_value());
-  }
+    const decision_tree::DecisionTree& tree,
+    const decision_tree::LeafAssignments* leaf_assignments,
+    std::vector<float>* predictions, double* mean_abs_prediction,
+    utils::concurrency::ThreadPool* thread_pool) {
+  const CompiledRegressionTree compiled_tree(tree, dataset, leaf_assignments);
+  const double sum_abs_predictions = ParallelSum<double>(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        double block_sum_abs_predictions = 0;
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const float leaf_value = compiled_tree.GetLeafValue(example_idx);
+          (*predictions)[example_idx] += leaf_value;
+          block_sum_abs_predictions += std::abs(leaf_value);
+        }
+        return block_sum_abs_predictions;
+      });
   if (mean_abs_prediction) {
     *mean_abs_prediction = sum_abs_predictions / dataset.nrow();
   }
 }
 
+// "leaf_assignments" is optional (see "AbstractLoss::UpdatePredictions").
 void UpdatePredictionWithMultipleUnivariateTrees(
     const dataset::VerticalDataset& dataset,
     const std::vector<const decision_tree::DecisionTree*>& trees,
-    std::vector<float>* predictions, double* mean_abs_prediction) {
-  double sum_abs_predictions = 0;
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    std::vector<float>* predictions, double* mean_abs_prediction,
+    utils::concurrency::ThreadPool* thread_pool) {
   const int num_trees = trees.size();
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    for (int grad_idx = 0; grad_idx < num_trees; grad_idx++) {
-      const auto& leaf = trees[grad_idx]->GetLeaf(dataset, example_idx);
-      (*predictions)[grad_idx + example_idx * num_trees] +=
-          leaf.regressor().top_value();
-      sum_abs_predictions += std::abs(leaf.regressor().top_value());
-    }
+  std::vector<CompiledRegressionTree> compiled_trees;
+  compiled_trees.reserve(num_trees);
+  for (int tree_idx = 0; tree_idx < num_trees; tree_idx++) {
+    compiled_trees.emplace_back(
+        *trees[tree_idx], dataset,
+        leaf_assignments ? &(*leaf_assignments)[tree_idx] : nullptr);
   }
+  const double sum_abs_predictions = ParallelSum<double>(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        double block_sum_abs_predictions = 0;
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          for (int grad_idx = 0; grad_idx < num_trees; grad_idx++) {
+            const float leaf_value =
+                compiled_trees[grad_idx].GetLeafValue(example_idx);
+            (*predictions)[grad_idx + example_idx * num_trees] += leaf_value;
+            block_sum_abs_predictions += std::abs(leaf_value);
+          }
+        }
+        return block_sum_abs_predictions;
+      });
   if (mean_abs_prediction) {
     *mean_abs_prediction = sum_abs_predictions / dataset.nrow();
   }
@@ -189,7 +329,8 @@ absl::Status BinomialLogLikelihoodLoss::UpdateGradients(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions,
     const RankingGroupsIndices* ranking_index,
-    std::vector<GradientData>* gradients, utils::RandomEngine* random) const {
+    std::vector<GradientData>* gradients, utils::RandomEngine* random,
+    utils::concurrency::ThreadPool* thread_pool) const {
   // Set the gradient to:
   //   label - 1/(1 + exp(-prediction))
   // where "label" is in {0,1} and prediction is the probability of
@@ -205,17 +346,22 @@ absl::Status BinomialLogLikelihoodLoss::UpdateGradients(
   if (gbt_config_.use_hessian_gain()) {
     hessian_data = (*gradients)[0].hessian;
   }
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    const float label = (labels->values()[example_idx] == 2) ? 1.f : 0.f;
-    const float prediction = predictions[example_idx];
-    const float prediction_proba = 1.f / (1.f + std::exp(-prediction));
-    DCheckIsFinite(prediction);
-    DCheckIsFinite(prediction_proba);
-    gradient_data[example_idx] = label - prediction_proba;
-    if (hessian_data) {
-      (*hessian_data)[example_idx] = prediction_proba * (1 - prediction_proba);
-    }
-  }
+  ParallelForBlocks(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t block_idx, const size_t begin, const size_t end) {
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const float label = (labels->values()[example_idx] == 2) ? 1.f : 0.f;
+          const float prediction = predictions[example_idx];
+          const float prediction_proba = 1.f / (1.f + std::exp(-prediction));
+          DCheckIsFinite(prediction);
+          DCheckIsFinite(prediction_proba);
+          gradient_data[example_idx] = label - prediction_proba;
+          if (hessian_data) {
+            (*hessian_data)[example_idx] =
+                prediction_proba * (1 - prediction_proba);
+          }
+        }
+      });
   return absl::OkStatus();
 }
 
@@ -301,12 +447,17 @@ void BinomialLogLikelihoodLoss::SetLeaf(
 absl::Status BinomialLogLikelihoodLoss::UpdatePredictions(
     const std::vector<const decision_tree::DecisionTree*>& new_trees,
     const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-    double* mean_abs_prediction) const {
-  if (new_trees.size() != 1) {
+    double* mean_abs_prediction,
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    utils::concurrency::ThreadPool* thread_pool) const {
+  if (new_trees.size() != 1 ||
+      (leaf_assignments && leaf_assignments->size() != 1)) {
     return absl::InternalError("Wrong number of trees");
   }
-  UpdatePredictionWithSingleUnivariateTree(dataset, *new_trees.front(),
-                                           predictions, mean_abs_prediction);
+  UpdatePredictionWithSingleUnivariateTree(
+      dataset, *new_trees.front(),
+      leaf_assignments ? &leaf_assignments->front() : nullptr, predictions,
+      mean_abs_prediction, thread_pool);
   return absl::OkStatus();
 }
 
@@ -319,34 +470,39 @@ absl::Status BinomialLogLikelihoodLoss::Loss(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions, const std::vector<float>& weights,
     const RankingGroupsIndices* ranking_index, float* loss_value,
-    std::vector<float>* secondary_metric) const {
+    std::vector<float>* secondary_metric,
+    utils::concurrency::ThreadPool* thread_pool) const {
   const auto* labels =
       dataset.ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
           label_col_idx);
-  double sum_loss = 0;
-  double count_correct_predictions = 0;
-  double sum_weights = 0;
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    const bool pos_label = labels->values()[example_idx] == 2;
-    const float label = pos_label ? 1.f : 0.f;
-    const float prediction = predictions[example_idx];
-    const float weight = weights[example_idx];
-    const bool pos_prediction = prediction >= 0;
-    sum_weights += weight;
-    if (pos_label == pos_prediction) {
-      count_correct_predictions += weight;
-    }
-    // Loss:
-    //   -2 * ( label * prediction - log(1+exp(prediction)))
-    sum_loss -=
-        2 * weight * (label * prediction - std::log(1 + std::exp(prediction)));
-    DCheckIsFinite(sum_loss);
-  }
+  const auto acc = ParallelSum<LossAccumulator>(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        LossAccumulator block_acc;
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const bool pos_label = labels->values()[example_idx] == 2;
+          const float label = pos_label ? 1.f : 0.f;
+          const float prediction = predictions[example_idx];
+          const float weight = weights[example_idx];
+          const bool pos_prediction = prediction >= 0;
+          block_acc.sum_weights += weight;
+          if (pos_label == pos_prediction) {
+            block_acc.sum_correct_predictions += weight;
+          }
+          // Loss:
+          //   -2 * ( label * prediction - log(1+exp(prediction)))
+          block_acc.sum_loss -=
+              2 * weight *
+              (label * prediction - std::log(1 + std::exp(prediction)));
+          DCheckIsFinite(block_acc.sum_loss);
+        }
+        return block_acc;
+      });
   secondary_metric->resize(1);
-  if (sum_weights > 0) {
-    *loss_value = static_cast<float>(sum_loss / sum_weights);
+  if (acc.sum_weights > 0) {
+    *loss_value = static_cast<float>(acc.sum_loss / acc.sum_weights);
     (*secondary_metric)[kBinomialLossSecondaryMetricClassificationIdx] =
-        static_cast<float>(count_correct_predictions / sum_weights);
+        static_cast<float>(acc.sum_correct_predictions / acc.sum_weights);
   } else {
     *loss_value =
         (*secondary_metric)[kBinomialLossSecondaryMetricClassificationIdx] =
@@ -404,7 +560,8 @@ absl::Status MeanSquaredErrorLoss::UpdateGradients(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions,
     const RankingGroupsIndices* ranking_index,
-    std::vector<GradientData>* gradients, utils::RandomEngine* random) const {
+    std::vector<GradientData>* gradients, utils::RandomEngine* random,
+    utils::concurrency::ThreadPool* thread_pool) const {
   // Set the gradient to:
   //   label - prediction
   if (gradients->size() != 1) {
@@ -414,23 +571,32 @@ absl::Status MeanSquaredErrorLoss::UpdateGradients(
       dataset.ColumnWithCast<dataset::VerticalDataset::NumericalColumn>(
           label_col_idx);
   std::vector<float>& gradient_data = (*gradients)[0].gradient;
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    const float label = labels->values()[example_idx];
-    const float prediction = predictions[example_idx];
-    gradient_data[example_idx] = label - prediction;
-  }
+  ParallelForBlocks(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t block_idx, const size_t begin, const size_t end) {
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const float label = labels->values()[example_idx];
+          const float prediction = predictions[example_idx];
+          gradient_data[example_idx] = label - prediction;
+        }
+      });
   return absl::OkStatus();
 }
 
 absl::Status MeanSquaredErrorLoss::UpdatePredictions(
     const std::vector<const decision_tree::DecisionTree*>& new_trees,
     const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-    double* mean_abs_prediction) const {
-  if (new_trees.size() != 1) {
+    double* mean_abs_prediction,
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    utils::concurrency::ThreadPool* thread_pool) const {
+  if (new_trees.size() != 1 ||
+      (leaf_assignments && leaf_assignments->size() != 1)) {
     return absl::InternalError("Wrong number of trees");
   }
-  UpdatePredictionWithSingleUnivariateTree(dataset, *new_trees.front(),
-                                           predictions, mean_abs_prediction);
+  UpdatePredictionWithSingleUnivariateTree(
+      dataset, *new_trees.front(),
+      leaf_assignments ? &leaf_assignments->front() : nullptr, predictions,
+      mean_abs_prediction, thread_pool);
   return absl::OkStatus();
 }
 
@@ -498,19 +664,38 @@ absl::Status MeanSquaredErrorLoss::Loss(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions, const std::vector<float>& weights,
     const RankingGroupsIndices* ranking_index, float* loss_value,
-    std::vector<float>* secondary_metric) const {
+    std::vector<float>* secondary_metric,
+    utils::concurrency::ThreadPool* thread_pool) const {
   const auto* labels =
       dataset.ColumnWithCast<dataset::VerticalDataset::NumericalColumn>(
           label_col_idx);
-  const float rmse = metric::RMSE(labels->values(), predictions, weights);
+  const auto acc = ParallelSum<LossAccumulator>(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        LossAccumulator block_acc;
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const float label = labels->values()[example_idx];
+          const float prediction = predictions[example_idx];
+          const float weight = weights[example_idx];
+          block_acc.sum_weights += weight;
+          // Loss:
+          //   (label - prediction)^2
+          block_acc.sum_loss +=
+              weight * (label - prediction) * (label - prediction);
+        }
+        return block_acc;
+      });
+  const float rmse = acc.sum_weights > 0
+                         ? std::sqrt(acc.sum_loss / acc.sum_weights)
+                         : std::numeric_limits<float>::quiet_NaN();
   // The RMSE is also the loss.
   *loss_value = rmse;
 
   if (task_ == model::proto::Task::RANKING) {
     secondary_metric->resize(2);
     (*secondary_metric)[0] = rmse;
-    (*secondary_metric)[1] =
-        ranking_index->NDCG(predictions, weights, kNDCG5Truncation);
+    (*secondary_metric)[1] = ranking_index->NDCG(predictions, weights,
+                                                 kNDCG5Truncation, thread_pool);
   } else {
     secondary_metric->resize(1);
     (*secondary_metric)[0] = rmse;
@@ -548,42 +733,47 @@ absl::Status MultinomialLogLikelihoodLoss::UpdateGradients(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions,
     const RankingGroupsIndices* ranking_index,
-    std::vector<GradientData>* gradients, utils::RandomEngine* random) const {
+    std::vector<GradientData>* gradients, utils::RandomEngine* random,
+    utils::concurrency::ThreadPool* thread_pool) const {
   // Set the gradient to:
   //   label_i - pred_i
   // where "label_i" is in {0,1}.
   const auto* labels =
       dataset.ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
           label_col_idx);
-  absl::FixedArray<float> accumulator(gradients->size());
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    // Compute normalization term.
-    float sum_exp = 0;
-    for (int grad_idx = 0; grad_idx < gradients->size(); grad_idx++) {
-      float exp_val =
-          std::exp(predictions[grad_idx + example_idx * gradients->size()]);
-      accumulator[grad_idx] = exp_val;
-      sum_exp += exp_val;
-    }
-    const float normalization = 1.f / sum_exp;
-    // Update gradient.
-    const int label_cat = labels->values()[example_idx];
-    for (int grad_idx = 0; grad_idx < gradients->size(); grad_idx++) {
-      const float label = (label_cat == (grad_idx + 1)) ? 1.f : 0.f;
-      DCheckIsFinite(label);
-      const float prediction = accumulator[grad_idx] * normalization;
-      DCheckIsFinite(prediction);
-      const float grad = label - prediction;
-      const float abs_grad = std::abs(grad);
-      DCheckIsFinite(grad);
-      (*gradients)[grad_idx].gradient[example_idx] = grad;
-      if (gbt_config_.use_hessian_gain()) {
-        (*(*gradients)[grad_idx].hessian)[example_idx] =
-            abs_grad * (1 - abs_grad);
-        DCheckIsFinite(abs_grad * (1 - abs_grad));
-      }
-    }
-  }
+  ParallelForBlocks(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t block_idx, const size_t begin, const size_t end) {
+        absl::FixedArray<float> accumulator(gradients->size());
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          // Compute normalization term.
+          float sum_exp = 0;
+          for (int grad_idx = 0; grad_idx < gradients->size(); grad_idx++) {
+            float exp_val = std::exp(
+                predictions[grad_idx + example_idx * gradients->size()]);
+            accumulator[grad_idx] = exp_val;
+            sum_exp += exp_val;
+          }
+          const float normalization = 1.f / sum_exp;
+          // Update gradient.
+          const int label_cat = labels->values()[example_idx];
+          for (int grad_idx = 0; grad_idx < gradients->size(); grad_idx++) {
+            const float label = (label_cat == (grad_idx + 1)) ? 1.f : 0.f;
+            DCheckIsFinite(label);
+            const float prediction = accumulator[grad_idx] * normalization;
+            DCheckIsFinite(prediction);
+            const float grad = label - prediction;
+            const float abs_grad = std::abs(grad);
+            DCheckIsFinite(grad);
+            (*gradients)[grad_idx].gradient[example_idx] = grad;
+            if (gbt_config_.use_hessian_gain()) {
+              (*(*gradients)[grad_idx].hessian)[example_idx] =
+                  abs_grad * (1 - abs_grad);
+              DCheckIsFinite(abs_grad * (1 - abs_grad));
+            }
+          }
+        }
+      });
   return absl::OkStatus();
 }
 
@@ -671,12 +861,16 @@ void MultinomialLogLikelihoodLoss::SetLeaf(
 absl::Status MultinomialLogLikelihoodLoss::UpdatePredictions(
     const std::vector<const decision_tree::DecisionTree*>& new_trees,
     const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-    double* mean_abs_prediction) const {
-  if (new_trees.size() != dimension_) {
+    double* mean_abs_prediction,
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    utils::concurrency::ThreadPool* thread_pool) const {
+  if (new_trees.size() != dimension_ ||
+      (leaf_assignments && leaf_assignments->size() != dimension_)) {
     return absl::InternalError("Wrong number of trees");
   }
-  UpdatePredictionWithMultipleUnivariateTrees(dataset, new_trees, predictions,
-                                              mean_abs_prediction);
+  UpdatePredictionWithMultipleUnivariateTrees(dataset, new_trees,
+                                              leaf_assignments, predictions,
+                                              mean_abs_prediction, thread_pool);
   return absl::OkStatus();
 }
 
@@ -689,49 +883,54 @@ absl::Status MultinomialLogLikelihoodLoss::Loss(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions, const std::vector<float>& weights,
     const RankingGroupsIndices* ranking_index, float* loss_value,
-    std::vector<float>* secondary_metric) const {
+    std::vector<float>* secondary_metric,
+    utils::concurrency::ThreadPool* thread_pool) const {
   const auto* labels =
       dataset.ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
           label_col_idx);
-  double sum_loss = 0;
-  double count_correct_predictions = 0;
-  double sum_weights = 0;
-  for (row_t example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
-    const int label = labels->values()[example_idx];
-    const float weight = weights[example_idx];
-    sum_weights += weight;
-
-    int predicted_class = -1;
-    float predicted_class_exp_value = 0;
-    float sum_exp = 0;
-    for (int grad_idx = 0; grad_idx < dimension_; grad_idx++) {
-      const float exp_val =
-          std::exp(predictions[grad_idx + example_idx * dimension_]);
-      sum_exp += exp_val;
-      DCheckIsFinite(sum_exp);
-      if (exp_val > predicted_class_exp_value) {
-        predicted_class_exp_value = exp_val;
-        predicted_class = grad_idx + 1;
-      }
-    }
-    if (label == predicted_class) {
-      count_correct_predictions += weight;
-    }
-    // Loss:
-    //   - log(predict_proba[true_label])
-    const float tree_label_exp_value =
-        std::exp(predictions[(label - 1) + example_idx * dimension_]);
-    sum_loss -= weight * std::log(tree_label_exp_value / sum_exp);
-    DCheckIsFinite(sum_loss);
-    DCheckIsFinite(sum_weights);
-  }
+  const auto acc = ParallelSum<LossAccumulator>(
+      dataset.nrow(), kNumExamplesPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        LossAccumulator block_acc;
+        for (row_t example_idx = begin; example_idx < end; example_idx++) {
+          const int label = labels->values()[example_idx];
+          const float weight = weights[example_idx];
+          block_acc.sum_weights += weight;
+
+          int predicted_class = -1;
+          float predicted_class_exp_value = 0;
+          float sum_exp = 0;
+          for (int grad_idx = 0; grad_idx < dimension_; grad_idx++) {
+            const float exp_val =
+                std::exp(predictions[grad_idx + example_idx * dimension_]);
+            sum_exp += exp_val;
+            DCheckIsFinite(sum_exp);
+            if (exp_val > predicted_class_exp_value) {
+              predicted_class_exp_value = exp_val;
+              predicted_class = grad_idx + 1;
+            }
+          }
+          if (label == predicted_class) {
+            block_acc.sum_correct_predictions += weight;
+          }
+          // Loss:
+          //   - log(predict_proba[true_label])
+          const float tree_label_exp_value =
+              std::exp(predictions[(label - 1) + example_idx * dimension_]);
+          block_acc.sum_loss -=
+              weight * std::log(tree_label_exp_value / sum_exp);
+          DCheckIsFinite(block_acc.sum_loss);
+          DCheckIsFinite(block_acc.sum_weights);
+        }
+        return block_acc;
+      });
 
   secondary_metric->resize(1);
-  if (sum_weights > 0) {
-    *loss_value = static_cast<float>(sum_loss / sum_weights);
+  if (acc.sum_weights > 0) {
+    *loss_value = static_cast<float>(acc.sum_loss / acc.sum_weights);
     DCheckIsFinite(*loss_value);
     (*secondary_metric)[kBinomialLossSecondaryMetricClassificationIdx] =
-        static_cast<float>(count_correct_predictions / sum_weights);
+        static_cast<float>(acc.sum_correct_predictions / acc.sum_weights);
   } else {
     *loss_value =
         (*secondary_metric)[kBinomialLossSecondaryMetricClassificationIdx] =
@@ -763,34 +962,52 @@ absl::Status NDCGLoss::UpdateGradients(
     const dataset::VerticalDataset& dataset, const int label_col_idx,
     const std::vector<float>& predictions,
     const RankingGroupsIndices* ranking_index,
-    std::vector<GradientData>* gradients, utils::RandomEngine* random) const {
+    std::vector<GradientData>* gradients, utils::RandomEngine* random,
+    utils::concurrency::ThreadPool* thread_pool) const {
   std::vector<float>& gradient_data = (*gradients)[0].gradient;
   std::vector<float>& second_order_derivative_data = *(*gradients)[0].hessian;
-  metric::NDCGCalculator ndcg_calculator(kNDCG5Truncation);
+  const metric::NDCGCalculator ndcg_calculator(kNDCG5Truncation);
 
   const float lambda_loss = gbt_config_.lambda_loss();
   const float lambda_loss_squared = lambda_loss * lambda_loss;
 
-  // Reset gradient accumulators.
-  std::fill(gradient_data.begin(), gradient_data.end(), 0.f);
-  std::fill(second_order_derivative_data.begin(),
-            second_order_derivative_data.end(), 0.f);
+  const auto& groups = ranking_index->groups();
+  const auto item_offsets = GroupItemOffsets(groups);
+
+  // Note: We shuffle the predictions so that the expected gradient value is
+  // aligned with the metric value with ties taken into account (which is too
+  // expensive to do here).
+  //
+  // The items are shuffled sequentially, group by group, so that the random
+  // generator is used in the same way for any number of threads.
+  // "shuffled_item_idxs[item_offsets[i] + j]" is the index, in the i-th group,
+  // of the j-th shuffled item.
+  std::vector<int> shuffled_item_idxs(item_offsets.back());
+  for (size_t group_idx = 0; group_idx < groups.size(); group_idx++) {
+    const auto begin = shuffled_item_idxs.begin() + item_offsets[group_idx];
+    const auto end = shuffled_item_idxs.begin() + item_offsets[group_idx + 1];
+    std::iota(begin, end, 0);
+    std::shuffle(begin, end, *random);
+  }
 
+  // Computes the gradients of the items of a group.
+  //
   // "pred_and_in_ground_idx[j].first" is the prediction for the example
   // "group[pred_and_in_ground_idx[j].second].example_idx".
-  std::vector<std::pair<float, int>> pred_and_in_ground_idx;
-  for (const auto& group : ranking_index->groups()) {
-    // Extract predictions.
+  const auto update_group_gradients =
+      [&](const RankingGroupsIndices::Group& group,
+          const int* group_shuffled_item_idxs,
+          std::vector<std::pair<float, int>>& pred_and_in_ground_idx) {
     const int group_size = group.items.size();
-    pred_and_in_ground_idx.resize(group_size);
-    for (int item_idx = 0; item_idx < group_size; item_idx++) {
-      pred_and_in_ground_idx[item_idx] = {
-          predictions[group.items[item_idx].example_idx], item_idx};
+
+    // Reset gradient accumulators.
+    for (const auto& item : group.items) {
+      gradient_data[item.example_idx] = 0.f;
+      second_order_derivative_data[item.example_idx] = 0.f;
     }
 
     // NDCG normalization term.
-    // Note: At this point, "pred_and_in_ground_idx" is sorted by relevance
-    // i.e. ground truth.
+    // Note: "group.items" is sorted by relevance i.e. ground truth.
     float utility_norm_factor = 1.;
     if (!gbt_config_.lambda_mart_ndcg().gradient_use_non_normalized_dcg()) {
       const int max_rank = std::min(kNDCG5Truncation, group_size);
@@ -801,12 +1018,15 @@ absl::Status NDCGLoss::UpdateGradients(
       utility_norm_factor = 1.f / max_ndcg;
     }
 
+    // Extract the predictions in the shuffled order.
+    pred_and_in_ground_idx.resize(group_size);
+    for (int item_idx = 0; item_idx < group_size; item_idx++) {
+      const int in_ground_idx = group_shuffled_item_idxs[item_idx];
+      pred_and_in_ground_idx[item_idx] = {
+          predictions[group.items[in_ground_idx].example_idx], in_ground_idx};
+    }
+
     // Sort by decreasing predicted value.
-    // Note: We shuffle the predictions so that the expected gradient value is
-    // aligned with the metric value with ties taken into account (which is too
-    // expensive to do here).
-    std::shuffle(pred_and_in_ground_idx.begin(), pred_and_in_ground_idx.end(),
-                 *random);
     std::sort(pred_and_in_ground_idx.begin(), pred_and_in_ground_idx.end(),
               [](const auto& a, const auto& b) { return a.first > b.first; });
 
@@ -884,7 +1104,22 @@ absl::Status NDCGLoss::UpdateGradients(
         second_order_derivative_data[example_2_idx] += unit_second_order;
       }
     }
-  }
+  };
+
+  // Note: The groups don't share examples i.e. the groups can be processed
+  // in parallel.
+  ParallelForBlocks(
+      groups.size(), kNumGroupsPerBlock, thread_pool,
+      [&](const size_t block_idx, const size_t begin_group_idx,
+          const size_t end_group_idx) {
+        std::vector<std::pair<float, int>> pred_and_in_ground_idx;
+        for (size_t group_idx = begin_group_idx; group_idx < end_group_idx;
+             group_idx++) {
+          update_group_gradients(groups[group_idx],
+                                 &shuffled_item_idxs[item_offsets[group_idx]],
+                                 pred_and_in_ground_idx);
+        }
+      });
   return absl::OkStatus();
 }
 
@@ -958,12 +1193,17 @@ void NDCGLoss::SetLeafStatic(
 absl::Status NDCGLoss::UpdatePredictions(
     const std::vector<const decision_tree::DecisionTree*>& new_trees,
     const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-    double* mean_abs_prediction) const {
-  if (new_trees.size() != 1) {
+    double* mean_abs_prediction,
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    utils::concurrency::ThreadPool* thread_pool) const {
+  if (new_trees.size() != 1 ||
+      (leaf_assignments && leaf_assignments->size() != 1)) {
     return absl::InternalError("Wrong number of trees");
   }
-  UpdatePredictionWithSingleUnivariateTree(dataset, *new_trees.front(),
-                                           predictions, mean_abs_prediction);
+  UpdatePredictionWithSingleUnivariateTree(
+      dataset, *new_trees.front(),
+      leaf_assignments ? &leaf_assignments->front() : nullptr, predictions,
+      mean_abs_prediction, thread_pool);
   return absl::OkStatus();
 }
 
@@ -977,11 +1217,13 @@ absl::Status NDCGLoss::Loss(const dataset::VerticalDataset& dataset,
                             const std::vector<float>& weights,
                             const RankingGroupsIndices* ranking_index,
                             float* loss_value,
-                            std::vector<float>* secondary_metric) const {
+                            std::vector<float>* secondary_metric,
+                            utils::concurrency::ThreadPool* thread_pool) const {
   if (ranking_index == nullptr) {
     return absl::InternalError("Missing ranking index");
   }
-  const auto ndcg = ranking_index->NDCG(predictions, weights, kNDCG5Truncation);
+  const auto ndcg = ranking_index->NDCG(predictions, weights, kNDCG5Truncation,
+                                        thread_pool);
 
   // The loss is -1 * the ndcg.
   *loss_value = -ndcg;
@@ -1014,46 +1256,63 @@ absl::Status CrossEntropyNDCGLoss::UpdateGradients(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions,
     const RankingGroupsIndices* ranking_index,
-    std::vector<GradientData>* gradients, utils::RandomEngine* random) const {
+    std::vector<GradientData>* gradients, utils::RandomEngine* random,
+    utils::concurrency::ThreadPool* thread_pool) const {
   std::vector<float>& gradient_data = (*gradients)[0].gradient;
   std::vector<float>& second_order_derivative_data = *((*gradients)[0].hessian);
 
-  std::uniform_real_distribution<float> distribution(0.0, 1.0);
-
-  // Reset gradient accumulators.
-  std::fill(gradient_data.begin(), gradient_data.end(), 0.f);
-  std::fill(second_order_derivative_data.begin(),
-            second_order_derivative_data.end(), 0.f);
-
-  // A vector of predictions for items in a group.
-  std::vector<float> preds;
-  // An auxiliary buffer of parameters used to form the ground-truth
-  // distribution and compute the loss.
-  std::vector<float> params;
+  const auto& groups = ranking_index->groups();
+  const auto item_offsets = GroupItemOffsets(groups);
+
+  // Sample the "gamma" parameters of the items. The parameters are sampled
+  // sequentially, group by group, so that the random generator is used in the
+  // same way for any number of threads. "gammas[item_offsets[i] + j]" is the
+  // parameter of the j-th item of the i-th group.
+  std::vector<float> gammas(item_offsets.back());
+  switch (gbt_config_.xe_ndcg().gamma()) {
+    case proto::GradientBoostedTreesTrainingConfig::XeNdcg::ONE:
+      std::fill(gammas.begin(), gammas.end(), 1.f);
+      break;
+    case proto::GradientBoostedTreesTrainingConfig::XeNdcg::AUTO:
+    case proto::GradientBoostedTreesTrainingConfig::XeNdcg::UNIFORM: {
+      std::uniform_real_distribution<float> distribution(0.0, 1.0);
+      for (size_t group_idx = 0; group_idx < groups.size(); group_idx++) {
+        // Groups with too few items are skipped (see below).
+        if (groups[group_idx].items.size() <= 1) {
+          continue;
+        }
+        for (size_t item_idx = item_offsets[group_idx];
+             item_idx < item_offsets[group_idx + 1]; item_idx++) {
+          gammas[item_idx] = distribution(*random);
+        }
+      }
+    } break;
+  }
 
-  for (const auto& group : ranking_index->groups()) {
+  // Computes the gradients of the items of a group.
+  //
+  // "preds" is a vector of predictions for items in a group. "params" is an
+  // auxiliary buffer of parameters used to form the ground-truth distribution
+  // and compute the loss.
+  const auto update_group_gradients =
+      [&](const RankingGroupsIndices::Group& group, const float* group_gammas,
+          std::vector<float>& preds, std::vector<float>& params) {
     const size_t group_size = group.items.size();
 
+    // Reset gradient accumulators.
+    for (const auto& item : group.items) {
+      gradient_data[item.example_idx] = 0.f;
+      second_order_derivative_data[item.example_idx] = 0.f;
+    }
+
     // Skip groups with too few items.
     if (group_size <= 1) {
-      continue;
+      return;
     }
 
     // Extract predictions.
     preds.resize(group_size);
-    params.resize(group_size);
-
-    switch (gbt_config_.xe_ndcg().gamma()) {
-      case proto::GradientBoostedTreesTrainingConfig::XeNdcg::ONE:
-        std::fill(params.begin(), params.end(), 1.f);
-        break;
-      case proto::GradientBoostedTreesTrainingConfig::XeNdcg::AUTO:
-      case proto::GradientBoostedTreesTrainingConfig::XeNdcg::UNIFORM:
-        for (int item_idx = 0; item_idx < group_size; item_idx++) {
-          params[item_idx] = distribution(*random);
-        }
-        break;
-    }
+    params.assign(group_gammas, group_gammas + group_size);
     for (int item_idx = 0; item_idx < group_size; item_idx++) {
       preds[item_idx] = predictions[group.items[item_idx].example_idx];
     }
@@ -1080,7 +1339,7 @@ absl::Status CrossEntropyNDCGLoss::UpdateGradients(
       inv_denominator += params[idx];
     }
     if (inv_denominator == 0.f) {
-      continue;
+      return;
     }
     inv_denominator = 1.f / inv_denominator;
 
@@ -1113,7 +1372,23 @@ absl::Status CrossEntropyNDCGLoss::UpdateGradients(
       second_order_derivative_data[example_idx] =
           preds[idx] * (1.f - preds[idx]);
     }
-  }
+  };
+
+  // Note: The groups don't share examples i.e. the groups can be processed
+  // in parallel.
+  ParallelForBlocks(
+      groups.size(), kNumGroupsPerBlock, thread_pool,
+      [&](const size_t block_idx, const size_t begin_group_idx,
+          const size_t end_group_idx) {
+        std::vector<float> preds;
+        std::vector<float> params;
+        for (size_t group_idx = begin_group_idx; group_idx < end_group_idx;
+             group_idx++) {
+          update_group_gradients(groups[group_idx],
+                                 &gammas[item_offsets[group_idx]], preds,
+                                 params);
+        }
+      });
   return absl::OkStatus();
 }
 
@@ -1137,12 +1412,17 @@ decision_tree::CreateSetLeafValueFunctor CrossEntropyNDCGLoss::SetLeafFunctor(
 absl::Status CrossEntropyNDCGLoss::UpdatePredictions(
     const std::vector<const decision_tree::DecisionTree*>& new_trees,
     const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-    double* mean_abs_prediction) const {
-  if (new_trees.size() != 1) {
+    double* mean_abs_prediction,
+    const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+    utils::concurrency::ThreadPool* thread_pool) const {
+  if (new_trees.size() != 1 ||
+      (leaf_assignments && leaf_assignments->size() != 1)) {
     return absl::InternalError("Wrong number of trees");
   }
-  UpdatePredictionWithSingleUnivariateTree(dataset, *new_trees.front(),
-                                           predictions, mean_abs_prediction);
+  UpdatePredictionWithSingleUnivariateTree(
+      dataset, *new_trees.front(),
+      leaf_assignments ? &leaf_assignments->front() : nullptr, predictions,
+      mean_abs_prediction, thread_pool);
   return absl::OkStatus();
 }
 
@@ -1154,11 +1434,13 @@ absl::Status CrossEntropyNDCGLoss::Loss(
     const dataset::VerticalDataset& dataset, int label_col_idx,
     const std::vector<float>& predictions, const std::vector<float>& weights,
     const RankingGroupsIndices* ranking_index, float* loss_value,
-    std::vector<float>* secondary_metric) const {
+    std::vector<float>* secondary_metric,
+    utils::concurrency::ThreadPool* thread_pool) const {
   if (ranking_index == nullptr) {
     return absl::InternalError("Missing ranking index");
   }
-  *loss_value = -ranking_index->NDCG(predictions, weights, kNDCG5Truncation);
+  *loss_value = -ranking_index->NDCG(predictions, weights, kNDCG5Truncation,
+                                     thread_pool);
   return absl::OkStatus();
 }
 
@@ -1232,29 +1514,35 @@ void RankingGroupsIndices::Initialize(const dataset::VerticalDataset& dataset,
             << " examples.";
 }
 
-double RankingGroupsIndices::NDCG(const std::vector<float>& predictions,
-                                  const std::vector<float>& weights,
-                                  const int truncation) const {
+double RankingGroupsIndices::NDCG(
+    const std::vector<float>& predictions, const std::vector<float>& weights,
+    const int truncation, utils::concurrency::ThreadPool* thread_pool) const {
   DCHECK_EQ(predictions.size(), num_items_);
   DCHECK_EQ(weights.size(), num_items_);
 
-  metric::NDCGCalculator ndcg_calculator(truncation);
-  std::vector<metric::RankingLabelAndPrediction> pred_and_label_relevance;
-
-  double sum_weighted_ndcg = 0;
-  double sum_weights = 0;
-  for (auto& group : groups_) {
-    DCHECK(!group.items.empty());
-    const float weight = weights[group.items.front().example_idx];
-
-    ExtractPredAndLabelRelevance(group.items, predictions,
-                                 &pred_and_label_relevance);
-
-    sum_weighted_ndcg +=
-        weight * ndcg_calculator.NDCG(pred_and_label_relevance);
-    sum_weights += weight;
-  }
-  return sum_weighted_ndcg / sum_weights;
+  const metric::NDCGCalculator ndcg_calculator(truncation);
+
+  // Note: "sum_loss" is the sum of the weighted NDCGs.
+  const auto acc = ParallelSum<LossAccumulator>(
+      groups_.size(), kNumGroupsPerBlock, thread_pool,
+      [&](const size_t begin, const size_t end) {
+        std::vector<metric::RankingLabelAndPrediction> pred_and_label_relevance;
+        LossAccumulator block_acc;
+        for (size_t group_idx = begin; group_idx < end; group_idx++) {
+          const auto& group = groups_[group_idx];
+          DCHECK(!group.items.empty());
+          const float weight = weights[group.items.front().example_idx];
+
+          ExtractPredAndLabelRelevance(group.items, predictions,
+                                       &pred_and_label_relevance);
+
+          block_acc.sum_loss +=
+              weight * ndcg_calculator.NDCG(pred_and_label_relevance);
+          block_acc.sum_weights += weight;
+        }
+        return block_acc;
+      });
+  return acc.sum_loss / acc.sum_weights;
 }
 
 void RankingGroupsIndices::ExtractPredAndLabelRelevance(
@@ -1268,6 +1556,148 @@ void RankingGroupsIndices::ExtractPredAndLabelRelevance(
   }
 }
 
+CompiledRegressionTree::CompiledRegressionTree(
+    const decision_tree::DecisionTree& tree,
+    const dataset::VerticalDataset& dataset,
+    const decision_tree::LeafAssignments* leaf_assignments)
+    : dataset_(dataset) {
+  nodes_.reserve(tree.NumNodes());
+  AddNode(tree.root());
+
+  if (leaf_assignments) {
+    DCHECK_EQ(leaf_assignments->example_leaf_idxs.size(), dataset.nrow());
+    example_leaf_idxs_ = leaf_assignments->example_leaf_idxs.data();
+    assigned_leaf_values_.reserve(leaf_assignments->leaves.size());
+    for (const auto* leaf : leaf_assignments->leaves) {
+      assigned_leaf_values_.push_back(leaf->node().regressor().top_value());
+    }
+  }
+}
+
+void CompiledRegressionTree::AddNode(
+    const decision_tree::NodeWithChildren& src_node) {
+  const size_t node_idx = nodes_.size();
+  nodes_.emplace_back();
+  Node node;
+
+  if (src_node.IsLeaf()) {
+    node.type = Node::Type::kLeaf;
+    node.label = src_node.node().regressor().top_value();
+    nodes_[node_idx] = node;
+    return;
+  }
+
+  using decision_tree::proto::Condition;
+  const auto& condition = src_node.node().condition();
+  const auto* column = dataset_.column(condition.attribute());
+  node.na_value = condition.na_value();
+  node.condition = &condition;
+  node.type = Node::Type::kGeneric;
+  node.column = column;
+
+  switch (condition.condition().type_case()) {
+    case Condition::TypeCase::kHigherCondition:
+      node.type = Node::Type::kNumericalIsHigher;
+      node.numerical_is_higher_threshold =
+          condition.condition().higher_condition().threshold();
+      node.numerical_values =
+          dataset_
+              .ColumnWithCast<dataset::VerticalDataset::NumericalColumn>(
+                  condition.attribute())
+              ->values()
+              .data();
+      break;
+
+    case Condition::TypeCase::kDiscretizedHigherCondition:
+      node.type = Node::Type::kDiscretizedNumericalIsHigher;
+      node.discretized_is_higher_threshold =
+          condition.condition().discretized_higher_condition().threshold();
+      node.discretized_values =
+          dataset_
+              .ColumnWithCast<
+                  dataset::VerticalDataset::DiscretizedNumericalColumn>(
+                  condition.attribute())
+              ->values()
+              .data();
+      break;
+
+    case Condition::TypeCase::kContainsBitmapCondition:
+      if (column->type() == dataset::proto::ColumnType::CATEGORICAL) {
+        node.type = Node::Type::kCategoricalContainsBitmap;
+        node.categorical_values =
+            dataset_
+                .ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
+                    condition.attribute())
+                ->values()
+                .data();
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  // The negative child directly follows its parent.
+  AddNode(*src_node.neg_child());
+  node.right_idx = nodes_.size() - node_idx;
+  AddNode(*src_node.pos_child());
+  nodes_[node_idx] = node;
+}
+
+bool CompiledRegressionTree::EvalCondition(const Node& node,
+                                           const row_t example_idx) const {
+  switch (node.type) {
+    case Node::Type::kNumericalIsHigher: {
+      const float value = node.numerical_values[example_idx];
+      if (ABSL_PREDICT_FALSE(std::isnan(value))) {
+        return node.na_value;
+      }
+      return value >= node.numerical_is_higher_threshold;
+    }
+
+    case Node::Type::kDiscretizedNumericalIsHigher: {
+      const auto value = node.discretized_values[example_idx];
+      if (ABSL_PREDICT_FALSE(
+              value ==
+              dataset::VerticalDataset::DiscretizedNumericalColumn::kNaValue)) {
+        return node.na_value;
+      }
+      return value >= node.discretized_is_higher_threshold;
+    }
+
+    case Node::Type::kCategoricalContainsBitmap: {
+      const int32_t value = node.categorical_values[example_idx];
+      if (ABSL_PREDICT_FALSE(
+              value == dataset::VerticalDataset::CategoricalColumn::kNaValue)) {
+        return node.na_value;
+      }
+      return utils::bitmap::GetValueBit(
+          node.condition->condition().contains_bitmap_condition()
+              .elements_bitmap(),
+          value);
+    }
+
+    default:
+      return decision_tree::EvalConditionFromColumn(*node.condition,
+                                                    node.column, dataset_,
+                                                    example_idx);
+  }
+}
+
+float CompiledRegressionTree::GetLeafValue(const row_t example_idx) const {
+  if (example_leaf_idxs_) {
+    const int32_t leaf_idx = example_leaf_idxs_[example_idx];
+    if (leaf_idx >= 0) {
+      return assigned_leaf_values_[leaf_idx];
+    }
+  }
+  const Node* node = nodes_.data();
+  while (node->type != Node::Type::kLeaf) {
+    node += EvalCondition(*node, example_idx) ? node->right_idx : 1;
+  }
+  return node->label;
+}
+
 }  // namespace gradient_boosted_trees
 }  // namespace model
 }  // namespace yggdrasil_decision_forests
@@ -36,6 +36,7 @@
 #include "yggdrasil_decision_forests/model/abstract_model.pb.h"
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 
 namespace yggdrasil_decision_forests {
 namespace model {
@@ -99,8 +100,12 @@ class RankingGroupsIndices {
   void Initialize(const dataset::VerticalDataset& dataset, int label_col_idx,
                   int group_col_idx);
 
+  // Weighted mean of the NDCG of the groups. If "thread_pool" is set, the
+  // groups are processed in parallel. The result does not depend on the number
+  // of threads.
   double NDCG(const std::vector<float>& predictions,
-              const std::vector<float>& weights, int truncation) const;
+              const std::vector<float>& weights, int truncation,
+              utils::concurrency::ThreadPool* thread_pool = nullptr) const;
 
   const std::vector<Group>& groups() const { return groups_; }
 
@@ -130,6 +135,97 @@ struct LossShape {
   bool has_hessian;
 };
 
+// Regression tree compiled into a flat array of nodes bound to the columns of
+// a dataset. Used to update the training and validation predictions after each
+// iteration: The nodes are contiguous in memory, the column data is resolved
+// once at compilation, and the most common conditions are evaluated without
+// virtual calls.
+//
+// Similarly to the serving engines (see
+// "serving/decision_forest/decision_forest.h"), the negative child of a node
+// directly follows the node, and "right_idx" is the offset to the positive
+// child.
+//
+// If the assignment of the examples to the leaves is known (see
+// "decision_tree::LeafAssignments"), the assigned examples are not routed
+// through the nodes.
+//
+// The compiled tree should not outlive "tree", "dataset" and
+// "leaf_assignments", and "dataset" should not be resized while the compiled
+// tree is used.
+class CompiledRegressionTree {
+ public:
+  // Compiles "tree" for the evaluation on "dataset". The value of a leaf is the
+  // "top_value" of its regressor. If set, "leaf_assignments" is the
+  // assignment of the examples of "dataset" to the leaves of "tree".
+  CompiledRegressionTree(
+      const decision_tree::DecisionTree& tree,
+      const dataset::VerticalDataset& dataset,
+      const decision_tree::LeafAssignments* leaf_assignments = nullptr);
+
+  // Value of the leaf reached by an example. Equivalent to
+  // "tree.GetLeaf(dataset, example_idx).regressor().top_value()".
+  float GetLeafValue(dataset::VerticalDataset::row_t example_idx) const;
+
+  size_t num_nodes() const { return nodes_.size(); }
+
+ private:
+  struct Node {
+    enum class Type : uint8_t {
+      kLeaf,
+      // {attribute type}{condition}.
+      kNumericalIsHigher,
+      kDiscretizedNumericalIsHigher,
+      kCategoricalContainsBitmap,
+      // Any other condition. Evaluated with "EvalConditionFromColumn".
+      kGeneric,
+    };
+
+    // Offset to the positive child node. 0 if is leaf.
+    uint32_t right_idx = 0;
+    Type type = Type::kLeaf;
+    // Value of the condition if the attribute is missing.
+    bool na_value = false;
+
+    union {
+      // Output value (if this is a leaf).
+      float label;
+      // Condition "attribute >= threshold" on a numerical attribute.
+      float numerical_is_higher_threshold;
+      // Condition "attribute >= threshold" on a discretized numerical
+      // attribute.
+      dataset::DiscretizedNumericalIndex discretized_is_higher_threshold;
+    };
+
+    union {
+      const float* numerical_values;
+      const dataset::DiscretizedNumericalIndex* discretized_values;
+      const int32_t* categorical_values;
+      // Only for "kGeneric" conditions.
+      const dataset::VerticalDataset::AbstractColumn* column;
+    };
+
+    // Original condition. Only for "kCategoricalContainsBitmap" and "kGeneric"
+    // conditions.
+    const decision_tree::proto::NodeCondition* condition = nullptr;
+  };
+
+  // Appends the node and its children to "nodes_" in depth first order.
+  void AddNode(const decision_tree::NodeWithChildren& src_node);
+
+  bool EvalCondition(const Node& node,
+                     dataset::VerticalDataset::row_t example_idx) const;
+
+  const dataset::VerticalDataset& dataset_;
+  std::vector<Node> nodes_;
+
+  // Leaf index of each example (see "LeafAssignments::example_leaf_idxs"). Null
+  // if the leaf assignments are not known.
+  const int32_t* example_leaf_idxs_ = nullptr;
+  // Value of each leaf of "LeafAssignments::leaves".
+  std::vector<float> assigned_leaf_values_;
+};
+
 // Loss to optimize during the training of a GBT.
 //
 // The life of a loss object is as follow:
@@ -144,6 +240,11 @@ struct LossShape {
 //   7. Optionally (for logging or early stopping), the "Loss" is computed.
 //   8. The training stops or goes back to step 4.
 //
+// The "thread_pool" argument of "UpdateGradients", "UpdatePredictions" and
+// "Loss" is optional. If set, the computation is distributed over the threads
+// of the pool (and the calling thread). The results are the same (bitwise)
+// for any number of threads.
+//
 class AbstractLoss {
  public:
   virtual ~AbstractLoss() = default;
@@ -170,8 +271,8 @@ class AbstractLoss {
       const dataset::VerticalDataset& dataset, int label_col_idx,
       const std::vector<float>& predictions,
       const RankingGroupsIndices* ranking_index,
-      std::vector<GradientData>* gradients,
-      utils::RandomEngine* random) const = 0;
+      std::vector<GradientData>* gradients, utils::RandomEngine* random,
+      utils::concurrency::ThreadPool* thread_pool) const = 0;
 
   // Creates a functions able to set the value of a leaf.
   //
@@ -201,10 +302,17 @@ class AbstractLoss {
   //     prediction accumulation not to have the activation function applied.
   //   mean_abs_prediction: (output) Return value for the mean absolute
   //     prediction of the tree. Used to plot the "impact" of each new tree.
+  //   leaf_assignments: Optional. Assignment of the examples of "dataset" to
+  //     the leaves of the "new_trees" (one per tree), as computed during the
+  //     training of the trees. The predictions of the assigned examples are
+  //     updated without traversing the trees.
+  //   thread_pool: Optional thread pool.
   virtual absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const = 0;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const = 0;
 
   // Gets the name of the metrics returned in "secondary_metric" of the "Loss"
   // method.
@@ -217,7 +325,9 @@ class AbstractLoss {
                             const std::vector<float>& weights,
                             const RankingGroupsIndices* ranking_index,
                             float* loss_value,
-                            std::vector<float>* secondary_metric) const = 0;
+                            std::vector<float>* secondary_metric,
+                            utils::concurrency::ThreadPool* thread_pool)
+      const = 0;
 };
 
 // Binomial log-likelihood loss.
@@ -246,7 +356,9 @@ class BinomialLogLikelihoodLoss : public AbstractLoss {
                                const std::vector<float>& predictions,
                                const RankingGroupsIndices* ranking_index,
                                std::vector<GradientData>* gradients,
-                               utils::RandomEngine* random) const override;
+                               utils::RandomEngine* random,
+                               utils::concurrency::ThreadPool* thread_pool)
+      const override;
 
   decision_tree::CreateSetLeafValueFunctor SetLeafFunctor(
       const std::vector<float>& predictions,
@@ -265,7 +377,9 @@ class BinomialLogLikelihoodLoss : public AbstractLoss {
   absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const override;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const override;
 
   std::vector<std::string> SecondaryMetricNames() const override;
 
@@ -273,8 +387,8 @@ class BinomialLogLikelihoodLoss : public AbstractLoss {
                     const std::vector<float>& predictions,
                     const std::vector<float>& weights,
                     const RankingGroupsIndices* ranking_index,
-                    float* loss_value,
-                    std::vector<float>* secondary_metric) const override;
+                    float* loss_value, std::vector<float>* secondary_metric,
+                    utils::concurrency::ThreadPool* thread_pool) const override;
 
  private:
   proto::GradientBoostedTreesTrainingConfig gbt_config_;
@@ -307,7 +421,9 @@ class MeanSquaredErrorLoss : public AbstractLoss {
                                const std::vector<float>& predictions,
                                const RankingGroupsIndices* ranking_index,
                                std::vector<GradientData>* gradients,
-                               utils::RandomEngine* random) const override;
+                               utils::RandomEngine* random,
+                               utils::concurrency::ThreadPool* thread_pool)
+      const override;
 
   decision_tree::CreateSetLeafValueFunctor SetLeafFunctor(
       const std::vector<float>& predictions,
@@ -326,7 +442,9 @@ class MeanSquaredErrorLoss : public AbstractLoss {
   absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const override;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const override;
 
   std::vector<std::string> SecondaryMetricNames() const override;
 
@@ -334,8 +452,8 @@ class MeanSquaredErrorLoss : public AbstractLoss {
                     const std::vector<float>& predictions,
                     const std::vector<float>& weights,
                     const RankingGroupsIndices* ranking_index,
-                    float* loss_value,
-                    std::vector<float>* secondary_metric) const override;
+                    float* loss_value, std::vector<float>* secondary_metric,
+                    utils::concurrency::ThreadPool* thread_pool) const override;
 
  private:
   // Effective task to solve. RMSE can be used for both RMSE and RANKING.
@@ -369,7 +487,9 @@ class MultinomialLogLikelihoodLoss : public AbstractLoss {
                                const std::vector<float>& predictions,
                                const RankingGroupsIndices* ranking_index,
                                std::vector<GradientData>* gradients,
-                               utils::RandomEngine* random) const override;
+                               utils::RandomEngine* random,
+                               utils::concurrency::ThreadPool* thread_pool)
+      const override;
 
   decision_tree::CreateSetLeafValueFunctor SetLeafFunctor(
       const std::vector<float>& predictions,
@@ -388,7 +508,9 @@ class MultinomialLogLikelihoodLoss : public AbstractLoss {
   absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const override;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const override;
 
   std::vector<std::string> SecondaryMetricNames() const override;
 
@@ -396,8 +518,8 @@ class MultinomialLogLikelihoodLoss : public AbstractLoss {
                     const std::vector<float>& predictions,
                     const std::vector<float>& weights,
                     const RankingGroupsIndices* ranking_index,
-                    float* loss_value,
-                    std::vector<float>* secondary_metric) const override;
+                    float* loss_value, std::vector<float>* secondary_metric,
+                    utils::concurrency::ThreadPool* thread_pool) const override;
 
  private:
   int dimension_;
@@ -432,7 +554,9 @@ class NDCGLoss : public AbstractLoss {
                                const std::vector<float>& predictions,
                                const RankingGroupsIndices* ranking_index,
                                std::vector<GradientData>* gradients,
-                               utils::RandomEngine* random) const override;
+                               utils::RandomEngine* random,
+                               utils::concurrency::ThreadPool* thread_pool)
+      const override;
 
   decision_tree::CreateSetLeafValueFunctor SetLeafFunctor(
       const std::vector<float>& predictions,
@@ -453,7 +577,9 @@ class NDCGLoss : public AbstractLoss {
   absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const override;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const override;
 
   std::vector<std::string> SecondaryMetricNames() const override;
 
@@ -461,8 +587,8 @@ class NDCGLoss : public AbstractLoss {
                     const std::vector<float>& predictions,
                     const std::vector<float>& weights,
                     const RankingGroupsIndices* ranking_index,
-                    float* loss_value,
-                    std::vector<float>* secondary_metric) const override;
+                    float* loss_value, std::vector<float>* secondary_metric,
+                    utils::concurrency::ThreadPool* thread_pool) const override;
 
  private:
   proto::GradientBoostedTreesTrainingConfig gbt_config_;
@@ -496,7 +622,9 @@ class CrossEntropyNDCGLoss : public AbstractLoss {
                                const std::vector<float>& predictions,
                                const RankingGroupsIndices* ranking_index,
                                std::vector<GradientData>* gradients,
-                               utils::RandomEngine* random) const override;
+                               utils::RandomEngine* random,
+                               utils::concurrency::ThreadPool* thread_pool)
+      const override;
 
   decision_tree::CreateSetLeafValueFunctor SetLeafFunctor(
       const std::vector<float>& predictions,
@@ -506,7 +634,9 @@ class CrossEntropyNDCGLoss : public AbstractLoss {
   absl::Status UpdatePredictions(
       const std::vector<const decision_tree::DecisionTree*>& new_trees,
       const dataset::VerticalDataset& dataset, std::vector<float>* predictions,
-      double* mean_abs_prediction) const override;
+      double* mean_abs_prediction,
+      const std::vector<decision_tree::LeafAssignments>* leaf_assignments,
+      utils::concurrency::ThreadPool* thread_pool) const override;
 
   std::vector<std::string> SecondaryMetricNames() const override;
 
@@ -514,8 +644,8 @@ class CrossEntropyNDCGLoss : public AbstractLoss {
                     const std::vector<float>& predictions,
                     const std::vector<float>& weights,
                     const RankingGroupsIndices* ranking_index,
-                    float* loss_value,
-                    std::vector<float>* secondary_metric) const override;
+                    float* loss_value, std::vector<float>* secondary_metric,
+                    utils::concurrency::ThreadPool* thread_pool) const override;
 
  private:
   proto::GradientBoostedTreesTrainingConfig gbt_config_;
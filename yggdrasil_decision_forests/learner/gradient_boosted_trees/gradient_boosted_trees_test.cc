@@ -58,6 +58,7 @@
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.pb.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/csv.h"
 #include "yggdrasil_decision_forests/utils/distribution.pb.h"
 #include "yggdrasil_decision_forests/utils/filesystem.h"
@@ -305,7 +306,8 @@ TEST(GradientBoostedTrees, UpdateGradientsBinomialLogLikelihood) {
   utils::RandomEngine random(1234);
   CHECK_OK(loss_imp.UpdateGradients(gradient_dataset, /* label_col_idx= */ 1,
                                     predictions, /*ranking_index=*/nullptr,
-                                    &gradients, &random));
+                                    &gradients, &random,
+                                    /*thread_pool=*/nullptr));
 
   EXPECT_THAT(gradients.front().gradient, ElementsAre(-0.5f, 0.5, -0.5f, 0.5f));
 }
@@ -336,7 +338,7 @@ TEST(GradientBoostedTrees, UpdateGradientsSquaredError) {
   CHECK_OK(loss_imp.UpdateGradients(gradient_dataset,
                                     /* label_col_idx= */ 0, predictions,
                                     /*ranking_index=*/nullptr, &gradients,
-                                    &random));
+                                    &random, /*thread_pool=*/nullptr));
 
   EXPECT_THAT(gradients.front().gradient,
               ElementsAre(1.f - 2.5f, 2.f - 2.5f, 3.f - 2.5f, 4.f - 2.5f));
@@ -430,13 +432,247 @@ TEST(GradientBoostedTrees, ComputeLoss) {
   std::vector<float> secondary_metric;
   CHECK_OK(loss_imp.Loss(dataset,
                          /* label_col_idx= */ 1, predictions, weights, nullptr,
-                         &loss_value, &secondary_metric));
+                         &loss_value, &secondary_metric,
+                         /*thread_pool=*/nullptr));
 
   EXPECT_NEAR(loss_value, 2 * std::log(2), 0.0001);
   EXPECT_EQ(secondary_metric.size(), 1);
   EXPECT_NEAR(secondary_metric[0], 0.5f, 0.0001);
 }
 
+// The gradients and losses computed with thread pools of different sizes are
+// exactly equal to the ones computed without.
+TEST(GradientBoostedTrees, ParallelGradientAndLossAreDeterministic) {
+  // A dataset spanning multiple blocks of examples and ranking groups.
+  const int num_examples = 100000;
+  const int num_groups = 1000;
+  dataset::VerticalDataset dataset;
+  *dataset.mutable_data_spec() = PARSE_TEST_PROTO(R"pb(
+    columns { type: NUMERICAL name: "a" }
+    columns {
+      type: CATEGORICAL
+      name: "b"
+      categorical { number_of_unique_values: 3 is_already_integerized: true }
+    }
+    columns {
+      type: CATEGORICAL
+      name: "c"
+      categorical { number_of_unique_values: 5 is_already_integerized: true }
+    }
+    columns { type: NUMERICAL name: "relevance" }
+    columns {
+      type: CATEGORICAL
+      name: "group"
+      categorical { number_of_unique_values: 1001 is_already_integerized: true }
+    }
+  )pb");
+  CHECK_OK(dataset.CreateColumnsFromDataspec());
+  dataset.set_nrow(num_examples);
+  const auto numerical_values = [&](const int col_idx) {
+    auto* values =
+        dataset
+            .MutableColumnWithCast<dataset::VerticalDataset::NumericalColumn>(
+                col_idx)
+            ->mutable_values();
+    values->resize(num_examples);
+    return values;
+  };
+  const auto categorical_values = [&](const int col_idx) {
+    auto* values =
+        dataset
+            .MutableColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(
+                col_idx)
+            ->mutable_values();
+    values->resize(num_examples);
+    return values;
+  };
+  auto* a_values = numerical_values(0);
+  auto* b_values = categorical_values(1);
+  auto* c_values = categorical_values(2);
+  auto* relevance_values = numerical_values(3);
+  auto* group_values = categorical_values(4);
+  utils::RandomEngine random(1234);
+  std::uniform_real_distribution<float> unif(-1.f, 1.f);
+  std::uniform_int_distribution<int> unif_relevance(0, 4);
+  std::uniform_int_distribution<int> unif_class(1, 4);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    (*a_values)[example_idx] = unif(random);
+    (*b_values)[example_idx] = 1 + (unif(random) > 0);
+    (*c_values)[example_idx] = unif_class(random);
+    (*relevance_values)[example_idx] = unif_relevance(random);
+    (*group_values)[example_idx] = 1 + example_idx % num_groups;
+  }
+  std::vector<float> weights(num_examples);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    weights[example_idx] = 1.f + unif(random);
+  }
+
+  RankingGroupsIndices ranking_index;
+  ranking_index.Initialize(dataset, /*label_col_idx=*/3, /*group_col_idx=*/4);
+
+  utils::concurrency::ThreadPool small_thread_pool("test", 2);
+  small_thread_pool.StartWorkers();
+  utils::concurrency::ThreadPool large_thread_pool("test", 7);
+  large_thread_pool.StartWorkers();
+
+  const auto check = [&](const AbstractLoss& loss_imp, const int label_col_idx,
+                         const proto::Loss loss_type,
+                         const RankingGroupsIndices* ranking_index) {
+    SCOPED_TRACE(proto::Loss_Name(loss_type));
+    std::vector<float> predictions(num_examples *
+                                   loss_imp.Shape().prediction_dim);
+    for (auto& prediction : predictions) {
+      prediction = unif(random);
+    }
+
+    dataset::VerticalDataset gradient_dataset;
+    std::vector<GradientData> gradients;
+    CHECK_OK(internal::CreateGradientDataset(
+        dataset, loss_type, label_col_idx,
+        /*hessian_splits=*/false, loss_imp, &gradient_dataset, &gradients,
+        nullptr));
+
+    // Gradients and hessians of all the dimensions.
+    const auto compute_gradients =
+        [&](utils::concurrency::ThreadPool* thread_pool) {
+          // The ranking losses sample the gradients with the same random
+          // sequence regardless of the thread pool.
+          utils::RandomEngine gradient_random(5678);
+          CHECK_OK(loss_imp.UpdateGradients(
+              gradient_dataset, label_col_idx, predictions, ranking_index,
+              &gradients, &gradient_random, thread_pool));
+          std::vector<std::vector<float>> values;
+          for (const auto& gradient : gradients) {
+            values.push_back(gradient.gradient);
+            if (gradient.hessian) {
+              values.push_back(*gradient.hessian);
+            }
+          }
+          return values;
+        };
+
+    const auto compute_loss = [&](utils::concurrency::ThreadPool* thread_pool) {
+      float loss_value;
+      std::vector<float> secondary_metric;
+      CHECK_OK(loss_imp.Loss(dataset, label_col_idx, predictions, weights,
+                             ranking_index, &loss_value, &secondary_metric,
+                             thread_pool));
+      secondary_metric.push_back(loss_value);
+      return secondary_metric;
+    };
+
+    const auto expected_gradients = compute_gradients(/*thread_pool=*/nullptr);
+    const auto expected_loss = compute_loss(/*thread_pool=*/nullptr);
+    for (auto* thread_pool : {&small_thread_pool, &large_thread_pool}) {
+      EXPECT_EQ(compute_gradients(thread_pool), expected_gradients);
+      EXPECT_EQ(compute_loss(thread_pool), expected_loss);
+    }
+  };
+
+  check(MeanSquaredErrorLoss({}, model::proto::Task::REGRESSION,
+                             dataset.data_spec().columns(0)),
+        /*label_col_idx=*/0, proto::Loss::SQUARED_ERROR,
+        /*ranking_index=*/nullptr);
+  check(BinomialLogLikelihoodLoss({}, model::proto::Task::CLASSIFICATION,
+                                  dataset.data_spec().columns(1)),
+        /*label_col_idx=*/1, proto::Loss::BINOMIAL_LOG_LIKELIHOOD,
+        /*ranking_index=*/nullptr);
+  check(MultinomialLogLikelihoodLoss({}, model::proto::Task::CLASSIFICATION,
+                                     dataset.data_spec().columns(2)),
+        /*label_col_idx=*/2, proto::Loss::MULTINOMIAL_LOG_LIKELIHOOD,
+        /*ranking_index=*/nullptr);
+  check(NDCGLoss({}, model::proto::Task::RANKING,
+                 dataset.data_spec().columns(3)),
+        /*label_col_idx=*/3, proto::Loss::LAMBDA_MART_NDCG5, &ranking_index);
+  check(CrossEntropyNDCGLoss({}, model::proto::Task::RANKING,
+                             dataset.data_spec().columns(3)),
+        /*label_col_idx=*/3, proto::Loss::XE_NDCG_MART, &ranking_index);
+}
+
+TEST(GradientBoostedTrees, CompiledRegressionTree) {
+  auto dataset = CreateToyDataset();
+  dataset.AppendExample({{"a", "1"}, {"b", "1"}});
+  dataset.AppendExample({{"a", "3"}, {"b", "1"}});
+  dataset.mutable_column(0)->SetNA(4);
+  dataset.mutable_column(1)->SetNA(5);
+
+  // Tree:
+  //   a >= 2.5 [na:true]
+  //     -> b in {2} (contains) [na:true]
+  //       -> 4
+  //       -> 3
+  //     -> b in {1} (bitmap) [na:false]
+  //       -> 2
+  //       -> 1
+  decision_tree::DecisionTree tree;
+  tree.CreateRoot();
+  auto* root = tree.mutable_root();
+  root->CreateChildren();
+  auto* root_condition = root->mutable_node()->mutable_condition();
+  root_condition->set_attribute(0);
+  root_condition->set_na_value(true);
+  root_condition->mutable_condition()
+      ->mutable_higher_condition()
+      ->set_threshold(2.5f);
+
+  auto* neg_child = root->mutable_neg_child();
+  neg_child->CreateChildren();
+  auto* neg_condition = neg_child->mutable_node()->mutable_condition();
+  neg_condition->set_attribute(1);
+  neg_condition->set_na_value(false);
+  neg_condition->mutable_condition()
+      ->mutable_contains_bitmap_condition()
+      ->set_elements_bitmap(std::string(1, 1 << 1));
+  neg_child->mutable_neg_child()
+      ->mutable_node()
+      ->mutable_regressor()
+      ->set_top_value(1.f);
+  neg_child->mutable_pos_child()
+      ->mutable_node()
+      ->mutable_regressor()
+      ->set_top_value(2.f);
+
+  auto* pos_child = root->mutable_pos_child();
+  pos_child->CreateChildren();
+  auto* pos_condition = pos_child->mutable_node()->mutable_condition();
+  pos_condition->set_attribute(1);
+  pos_condition->set_na_value(true);
+  pos_condition->mutable_condition()
+      ->mutable_contains_condition()
+      ->add_elements(2);
+  pos_child->mutable_neg_child()
+      ->mutable_node()
+      ->mutable_regressor()
+      ->set_top_value(3.f);
+  pos_child->mutable_pos_child()
+      ->mutable_node()
+      ->mutable_regressor()
+      ->set_top_value(4.f);
+
+  const CompiledRegressionTree compiled_tree(tree, dataset);
+  EXPECT_EQ(compiled_tree.num_nodes(), 7);
+  std::vector<float> leaf_values;
+  for (int example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
+    leaf_values.push_back(compiled_tree.GetLeafValue(example_idx));
+    EXPECT_EQ(leaf_values.back(),
+              tree.GetLeaf(dataset, example_idx).regressor().top_value());
+  }
+  EXPECT_THAT(leaf_values, ElementsAre(2, 1, 3, 4, 3, 4));
+
+  // The assigned examples are not routed through the tree.
+  decision_tree::LeafAssignments leaf_assignments;
+  leaf_assignments.leaves = {neg_child->neg_child()};
+  leaf_assignments.example_leaf_idxs = {0, -1, -1, -1, -1, 0};
+  const CompiledRegressionTree compiled_tree_with_assignments(
+      tree, dataset, &leaf_assignments);
+  leaf_values.clear();
+  for (int example_idx = 0; example_idx < dataset.nrow(); example_idx++) {
+    leaf_values.push_back(
+        compiled_tree_with_assignments.GetLeafValue(example_idx));
+  }
+  EXPECT_THAT(leaf_values, ElementsAre(1, 1, 3, 4, 3, 1));
+}
+
 TEST(GradientBoostedTrees, SecondaryMetricName) {
   const auto dataset = CreateToyDataset();
   const auto loss_imp = BinomialLogLikelihoodLoss(
@@ -833,6 +1069,61 @@ TEST_F(GradientBoostedTreesOnAdult, BaseDiscretizedNumerical) {
   EXPECT_NEAR(metric::LogLoss(evaluation_), 0.320, 0.04);
 }
 
+TEST_F(GradientBoostedTreesOnAdult, BasePreBinnedNumerical) {
+  auto* gbt_config = train_config_.MutableExtension(
+      gradient_boosted_trees::proto::gradient_boosted_trees_config);
+  gbt_config->set_num_trees(100);
+  gbt_config->mutable_decision_tree()->set_max_depth(4);
+  gbt_config->set_shrinkage(0.1f);
+  gbt_config->set_subsample(0.9f);
+  gbt_config->mutable_decision_tree()->mutable_numerical_split()->set_type(
+      decision_tree::proto::NumericalSplit::PRE_BINNED);
+
+  TrainAndEvaluateModel();
+
+  // Note: Similar quality as the EXACT numerical splits.
+  EXPECT_NEAR(metric::Accuracy(evaluation_), 0.8605, 0.015);
+  EXPECT_NEAR(metric::LogLoss(evaluation_), 0.320, 0.04);
+}
+
+TEST_F(GradientBoostedTreesOnAdult, BestFirstGlobalPreBinnedNumerical) {
+  auto* gbt_config = train_config_.MutableExtension(
+      gradient_boosted_trees::proto::gradient_boosted_trees_config);
+  gbt_config->set_num_trees(100);
+  gbt_config->set_shrinkage(0.1f);
+  gbt_config->set_subsample(0.9f);
+  gbt_config->mutable_decision_tree()
+      ->mutable_growing_strategy_best_first_global()
+      ->set_max_num_nodes(32);
+  gbt_config->mutable_decision_tree()->mutable_numerical_split()->set_type(
+      decision_tree::proto::NumericalSplit::PRE_BINNED);
+
+  TrainAndEvaluateModel();
+
+  EXPECT_NEAR(metric::Accuracy(evaluation_), 0.8605, 0.015);
+  EXPECT_NEAR(metric::LogLoss(evaluation_), 0.320, 0.04);
+}
+
+// The PRE_BINNED splitter falls back to EXACT with the local imputation.
+TEST_F(GradientBoostedTreesOnAdult, PreBinnedNumericalRandomLocalImputation) {
+  auto* gbt_config = train_config_.MutableExtension(
+      gradient_boosted_trees::proto::gradient_boosted_trees_config);
+  gbt_config->set_num_trees(100);
+  gbt_config->mutable_decision_tree()->set_max_depth(4);
+  gbt_config->set_shrinkage(0.1f);
+  gbt_config->set_subsample(0.9f);
+  gbt_config->mutable_decision_tree()->mutable_numerical_split()->set_type(
+      decision_tree::proto::NumericalSplit::PRE_BINNED);
+  gbt_config->mutable_decision_tree()->set_missing_value_policy(
+      decision_tree::proto::DecisionTreeTrainingConfig::
+          RANDOM_LOCAL_IMPUTATION);
+
+  TrainAndEvaluateModel();
+
+  EXPECT_NEAR(metric::Accuracy(evaluation_), 0.8605, 0.015);
+  EXPECT_NEAR(metric::LogLoss(evaluation_), 0.320, 0.04);
+}
+
 // Train and test a model on the adult dataset.
 TEST_F(GradientBoostedTreesOnAdult, BaseAggresiveDiscretizedNumerical) {
   auto* gbt_config = train_config_.MutableExtension(
@@ -1113,6 +1404,22 @@ TEST_F(GradientBoostedTreesOnAdult, HessianDiscretizedNumerical) {
   EXPECT_NEAR(metric::LogLoss(evaluation_), 0.283, 0.05);
 }
 
+TEST_F(GradientBoostedTreesOnAdult, HessianPreBinnedNumerical) {
+  auto* gbt_config = train_config_.MutableExtension(
+      gradient_boosted_trees::proto::gradient_boosted_trees_config);
+  gbt_config->set_num_trees(100);
+  gbt_config->mutable_decision_tree()->set_max_depth(4);
+  gbt_config->set_subsample(0.9f);
+  gbt_config->set_use_hessian_gain(true);
+  gbt_config->mutable_decision_tree()->mutable_numerical_split()->set_type(
+      decision_tree::proto::NumericalSplit::PRE_BINNED);
+
+  TrainAndEvaluateModel();
+
+  EXPECT_NEAR(metric::Accuracy(evaluation_), 0.86, 0.015);
+  EXPECT_NEAR(metric::LogLoss(evaluation_), 0.283, 0.05);
+}
+
 TEST_F(GradientBoostedTreesOnAdult, HessianL2Categorical) {
   auto* gbt_config = train_config_.MutableExtension(
       gradient_boosted_trees::proto::gradient_boosted_trees_config);
@@ -1306,7 +1613,8 @@ TEST(GradientBoostedTrees, UpdateGradientsNDCG) {
   utils::RandomEngine random(1234);
   CHECK_OK(loss_imp.UpdateGradients(gradient_dataset,
                                     /* label_col_idx= */ 0, predictions, &index,
-                                    &gradients, &random));
+                                    &gradients, &random,
+                                    /*thread_pool=*/nullptr));
 
   // Explanation:
   // - Element 0 is pushed down by element 2 (and in reverse).
@@ -1345,7 +1653,8 @@ TEST(GradientBoostedTrees, UpdateGradientsXeNDCGMart) {
   utils::RandomEngine random(1234);
   CHECK_OK(loss_imp.UpdateGradients(gradient_dataset,
                                     /* label_col_idx= */ 0, predictions, &index,
-                                    &gradients, &random));
+                                    &gradients, &random,
+                                    /*thread_pool=*/nullptr));
 
   // Explanation:
   // - Element 0 is pushed down by element 2 (and in reverse).
@@ -1435,7 +1744,7 @@ TEST(DartPredictionAccumulator, Base) {
   CHECK_OK(loss_imp.UpdateGradients(gradient_dataset,
                                     /* label_col_idx= */ 0, predictions,
                                     /*ranking_index=*/nullptr, &gradients,
-                                    &random));
+                                    &random, /*thread_pool=*/nullptr));
 
   utils::RandomEngine rnd(12345);
   internal::DartPredictionAccumulator acc;
@@ -501,7 +501,7 @@ RandomForestLearner::TrainWithStatus(
         CHECK_OK(decision_tree::Train(
             train_dataset, selected_examples, config_with_default, config_link,
             rf_config.decision_tree(), deployment(), weights, &random,
-            decision_tree, internal_config));
+            decision_tree, internal_config, /*leaf_assignments=*/nullptr));
 
         const auto current_num_trained_trees = ++num_trained_trees;
 
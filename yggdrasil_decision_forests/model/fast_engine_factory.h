@@ -21,6 +21,8 @@
 #include <string>
 #include <vector>
 
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "yggdrasil_decision_forests/serving/fast_engine.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
 #include "yggdrasil_decision_forests/utils/registration.h"
@@ -41,6 +43,16 @@ class FastEngineFactory {
   virtual utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngine(
       const AbstractModel* const model) const = 0;
 
+  // Creates an engine from a file created with "FastEngine::SaveToFile" by an
+  // engine of this factory. The file is not parsed and the model is not
+  // re-compiled i.e. this is much faster than "CreateEngine". Returns an
+  // Unimplemented error if the engine does not support it.
+  virtual utils::StatusOr<std::unique_ptr<serving::FastEngine>>
+  CreateEngineFromFile(absl::string_view path) const {
+    return absl::UnimplementedError(
+        "This engine does not support being loaded from a file.");
+  }
+
   // Checks if an engine is compatible with a model.
   virtual bool IsCompatible(const AbstractModel* const model) const = 0;
 
@@ -0,0 +1,59 @@
+"""Ahead-of-time compilation of decision forest models into C++ libraries."""
+
+def cc_compiled_model(
+        name,
+        model_dir,
+        model_files,
+        cpp_namespace = None,
+        **attrs):
+    """Compiles a decision forest model into a cc_library.
+
+    The library exposes the header "<name>.h". See
+    "serving/decision_forest/model_compiler.h" for the generated API.
+
+    Usage example:
+        cc_compiled_model(
+            name = "my_model",
+            model_dir = "my_project/models/my_model",
+            model_files = glob(["models/my_model/**"]),
+            cpp_namespace = "my_project::my_model",
+        )
+
+        cc_binary(deps=[":my_model"], ...)
+
+    Args:
+      name: Name of the cc_library rule.
+      model_dir: Path to the model directory, relative to the workspace root.
+      model_files: Files of the model directory.
+      cpp_namespace: C++ namespace of the generated code. Defaults to "name".
+      **attrs: Extra attributes of the cc_library rule e.g. "visibility".
+    """
+
+    if not cpp_namespace:
+        cpp_namespace = name
+
+    header = name + ".h"
+    source = name + ".cc"
+    header_include_path = header
+    if native.package_name():
+        header_include_path = native.package_name() + "/" + header
+
+    native.genrule(
+        name = name + "_gen",
+        srcs = model_files,
+        outs = [header, source],
+        cmd = ("$(location //yggdrasil_decision_forests/cli:compile_model)" +
+               " --model=" + model_dir +
+               " --output_header=$(location " + header + ")" +
+               " --output_source=$(location " + source + ")" +
+               " --namespace=" + cpp_namespace +
+               " --header_include_path=" + header_include_path),
+        tools = ["//yggdrasil_decision_forests/cli:compile_model"],
+    )
+
+    native.cc_library(
+        name = name,
+        srcs = [source],
+        hdrs = [header],
+        **attrs
+    )
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that the models compiled with the "cc_compiled_model" rule produce the
+// same predictions as the generic "AbstractModel::Predict".
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/model/prediction.pb.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/compiled_abalone_regression_gbdt.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/compiled_adult_binary_class_gbdt.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/compiled_iris_multi_class_gbdt.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/compiled_iris_multi_class_rf.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/compiled_synthetic_ranking_gbdt.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/model_compiler.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+#include "yggdrasil_decision_forests/utils/test.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using dataset::proto::ColumnType;
+using testing::HasSubstr;
+
+// Signature of the generated "Predict" functions.
+using CompiledPredict = std::function<void(const float*, float*)>;
+
+std::string TestDataDir() {
+  return file::JoinPath(test::DataRootDirectory(),
+                        "yggdrasil_decision_forests/test_data");
+}
+
+// Value of a feature, as expected by the compiled model.
+float FeatureValue(const dataset::VerticalDataset& dataset, const int col_idx,
+                   const dataset::VerticalDataset::row_t row) {
+  const auto* column = dataset.column(col_idx);
+  if (column->IsNa(row)) {
+    return std::numeric_limits<float>::quiet_NaN();
+  }
+  switch (column->type()) {
+    case ColumnType::NUMERICAL:
+      return dataset
+          .ColumnWithCast<dataset::VerticalDataset::NumericalColumn>(col_idx)
+          ->values()[row];
+    case ColumnType::BOOLEAN:
+      return dataset
+          .ColumnWithCast<dataset::VerticalDataset::BooleanColumn>(col_idx)
+          ->values()[row];
+    case ColumnType::CATEGORICAL:
+      return dataset
+          .ColumnWithCast<dataset::VerticalDataset::CategoricalColumn>(col_idx)
+          ->values()[row];
+    default:
+      LOG(FATAL) << "Non supported type";
+  }
+}
+
+// Prediction of the generic model, in the format of the compiled model.
+std::vector<float> GenericPrediction(const model::AbstractModel& model,
+                                     const dataset::VerticalDataset& dataset,
+                                     const dataset::VerticalDataset::row_t row,
+                                     const int num_outputs) {
+  model::proto::Prediction prediction;
+  model.Predict(dataset, row, &prediction);
+  switch (prediction.type_case()) {
+    case model::proto::Prediction::kClassification: {
+      const auto& distribution = prediction.classification().distribution();
+      if (num_outputs == 1) {
+        return {distribution.counts(2) / distribution.sum()};
+      }
+      std::vector<float> output;
+      for (int class_idx = 1; class_idx <= num_outputs; class_idx++) {
+        output.push_back(distribution.counts(class_idx) / distribution.sum());
+      }
+      return output;
+    }
+    case model::proto::Prediction::kRegression:
+      return {prediction.regression().value()};
+    case model::proto::Prediction::kRanking:
+      return {prediction.ranking().relevance()};
+    default:
+      LOG(FATAL) << "Non supported prediction";
+  }
+}
+
+void CheckCompiledModel(const std::string& model_name,
+                        const std::string& dataset_filename,
+                        const int num_features, const int num_outputs,
+                        const char* const* feature_names,
+                        const CompiledPredict& predict) {
+  LOG(INFO) << "Model: " << model_name;
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(file::JoinPath(TestDataDir(), "model", model_name),
+                            &model));
+  dataset::VerticalDataset dataset;
+  CHECK_OK(LoadVerticalDataset(
+      absl::StrCat("csv:",
+                   file::JoinPath(TestDataDir(), "dataset", dataset_filename)),
+      model->data_spec(), &dataset));
+
+  ASSERT_EQ(num_features, model->input_features().size());
+  for (int feature_idx = 0; feature_idx < num_features; feature_idx++) {
+    EXPECT_EQ(feature_names[feature_idx],
+              model->data_spec()
+                  .columns(model->input_features()[feature_idx])
+                  .name());
+  }
+
+  std::vector<float> features(num_features);
+  std::vector<float> output(num_outputs);
+  for (dataset::VerticalDataset::row_t row = 0; row < dataset.nrow(); row++) {
+    for (int feature_idx = 0; feature_idx < num_features; feature_idx++) {
+      features[feature_idx] =
+          FeatureValue(dataset, model->input_features()[feature_idx], row);
+    }
+    predict(features.data(), output.data());
+    const auto expected =
+        GenericPrediction(*model, dataset, row, num_outputs);
+    ASSERT_EQ(expected.size(), num_outputs);
+    for (int output_idx = 0; output_idx < num_outputs; output_idx++) {
+      EXPECT_NEAR(output[output_idx], expected[output_idx], 1e-4)
+          << "row:" << row << " output:" << output_idx;
+    }
+  }
+}
+
+// Runs "CheckCompiledModel" on the model compiled in "NAMESPACE".
+#define CHECK_COMPILED_MODEL(MODEL, DATASET, NAMESPACE)                     \
+  CheckCompiledModel(MODEL, DATASET, NAMESPACE::kNumFeatures,               \
+                     NAMESPACE::kNumOutputs, NAMESPACE::kFeatureNames,      \
+                     [](const float* features, float* output) {            \
+                       NAMESPACE::Predict(features, output);                \
+                     })
+
+TEST(CompiledModel, AdultBinaryClassGbdt) {
+  CHECK_COMPILED_MODEL("adult_binary_class_gbdt", "adult_test.csv",
+                       compiled_model_test::adult_binary_class_gbdt);
+}
+
+TEST(CompiledModel, IrisMultiClassGbdt) {
+  CHECK_COMPILED_MODEL("iris_multi_class_gbdt", "iris.csv",
+                       compiled_model_test::iris_multi_class_gbdt);
+}
+
+TEST(CompiledModel, IrisMultiClassRf) {
+  CHECK_COMPILED_MODEL("iris_multi_class_rf", "iris.csv",
+                       compiled_model_test::iris_multi_class_rf);
+}
+
+TEST(CompiledModel, AbaloneRegressionGbdt) {
+  CHECK_COMPILED_MODEL("abalone_regression_gbdt", "abalone.csv",
+                       compiled_model_test::abalone_regression_gbdt);
+}
+
+TEST(CompiledModel, SyntheticRankingGbdt) {
+  CHECK_COMPILED_MODEL("synthetic_ranking_gbdt", "synthetic_ranking_test.csv",
+                       compiled_model_test::synthetic_ranking_gbdt);
+}
+
+TEST(CompiledModel, SingleOutput) {
+  const float features[compiled_model_test::abalone_regression_gbdt::
+                           kNumFeatures] = {};
+  float output;
+  compiled_model_test::abalone_regression_gbdt::Predict(features, &output);
+  EXPECT_EQ(compiled_model_test::abalone_regression_gbdt::Predict(features),
+            output);
+}
+
+TEST(ModelCompiler, InvalidNamespace) {
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(
+      file::JoinPath(TestDataDir(), "model", "iris_multi_class_gbdt"), &model));
+  CompileModelOptions options;
+  options.cpp_namespace = "my::1model";
+  EXPECT_FALSE(CompileModelToCpp(*model, options).ok());
+}
+
+// The header guard is a non-reserved identifier, even for an absolute path.
+TEST(ModelCompiler, HeaderGuard) {
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(
+      file::JoinPath(TestDataDir(), "model", "iris_multi_class_gbdt"), &model));
+  CompileModelOptions options;
+  options.header_include_path = "/tmp/my-models//iris.h";
+  const auto compiled = CompileModelToCpp(*model, options).value();
+  EXPECT_THAT(compiled.header, HasSubstr("#ifndef TMP_MY_MODELS_IRIS_H_\n"));
+}
+
+}  // namespace
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
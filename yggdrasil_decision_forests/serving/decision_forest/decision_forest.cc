@@ -15,8 +15,12 @@
 
 #include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
 
+#include <cmath>
+#include <limits>
+
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/utils/bitmap.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
@@ -274,6 +278,7 @@ absl::Status SetNonLeafNode(const GenericModel& src_model,
 
   dst_node->right_idx = 0;
   dst_node->feature_idx = static_cast<FeatureIdx>(feature.internal_idx);
+  dst_node->negated_condition = 0;
 
   const auto& src_condition = src_node.node().condition().condition();
 
@@ -538,7 +543,8 @@ absl::Status ConvertGenericNodeToFlatNode(
     const GenericModel& src_model, const NodeWithChildren& node,
     const SetLeafFunctor<GenericModel, SpecializedModel> set_node,
     SpecializedModel* dst_model,
-    std::vector<typename SpecializedModel::NodeType>* specialized_node_array) {
+    MappableVector<typename SpecializedModel::NodeType>*
+        specialized_node_array) {
   if (node.IsLeaf()) {
     // Create a leaf.
     typename SpecializedModel::NodeType dst_node;
@@ -550,13 +556,28 @@ absl::Status ConvertGenericNodeToFlatNode(
     typename SpecializedModel::NodeType non_leaf_node;
     RETURN_IF_ERROR(SetNonLeafNode(src_model, node, spec_feature_idx, dst_model,
                                    &non_leaf_node));
+    // Only "generic" nodes support negated conditions (see
+    // "ExampleSetModel::node_layout").
+    bool positive_first = false;
+    if constexpr (utils::is_same_v<typename SpecializedModel::NodeType,
+                                   GenericNode<uint16_t>> ||
+                  utils::is_same_v<typename SpecializedModel::NodeType,
+                                   GenericNode<uint32_t>>) {
+      positive_first =
+          dst_model->node_layout == SpecializedModel::NodeLayout::kHotPath &&
+          IsPositiveChildMoreFrequent(node);
+      non_leaf_node.negated_condition = positive_first;
+    }
+    const auto& first_child =
+        positive_first ? *node.pos_child() : *node.neg_child();
+    const auto& second_child =
+        positive_first ? *node.neg_child() : *node.pos_child();
     const size_t new_node_idx = specialized_node_array->size();
     specialized_node_array->push_back(non_leaf_node);
 
     // Create its children.
-    RETURN_IF_ERROR(ConvertGenericNodeToFlatNode(src_model, *node.neg_child(),
-                                                 set_node, dst_model,
-                                                 specialized_node_array));
+    RETURN_IF_ERROR(ConvertGenericNodeToFlatNode(
+        src_model, first_child, set_node, dst_model, specialized_node_array));
     const int node_offset = specialized_node_array->size() - new_node_idx;
     if (node_offset >=
         std::numeric_limits<
@@ -565,9 +586,8 @@ absl::Status ConvertGenericNodeToFlatNode(
           "Tree with too many nodes for this optimized model format.");
     }
     (*specialized_node_array)[new_node_idx].right_idx = node_offset;
-    RETURN_IF_ERROR(ConvertGenericNodeToFlatNode(src_model, *node.pos_child(),
-                                                 set_node, dst_model,
-                                                 specialized_node_array));
+    RETURN_IF_ERROR(ConvertGenericNodeToFlatNode(
+        src_model, second_child, set_node, dst_model, specialized_node_array));
   }
   return absl::OkStatus();
 }
@@ -595,6 +615,39 @@ absl::Status CreateFlatModelNodes(
   return absl::OkStatus();
 }
 
+// Computes the "remaining_output_bounds" of a model with single-dimensional
+// output leaves.
+template <typename SpecializedModel>
+void ComputeRemainingOutputBounds(SpecializedModel* model) {
+  const int num_trees = model->root_offsets.size();
+  auto& bounds = model->remaining_output_bounds;
+  bounds.min.assign(num_trees + 1, 0.f);
+  bounds.max.assign(num_trees + 1, 0.f);
+  double min_sum = 0.;
+  double max_sum = 0.;
+  for (int tree_idx = num_trees - 1; tree_idx >= 0; tree_idx--) {
+    // The nodes of a tree are stored contiguously after its root.
+    const size_t begin_node_idx = model->root_offsets[tree_idx];
+    const size_t end_node_idx = tree_idx + 1 < num_trees
+                                    ? model->root_offsets[tree_idx + 1]
+                                    : model->nodes.size();
+    float min_leaf = std::numeric_limits<float>::infinity();
+    float max_leaf = -std::numeric_limits<float>::infinity();
+    for (size_t node_idx = begin_node_idx; node_idx < end_node_idx;
+         node_idx++) {
+      const auto& node = model->nodes[node_idx];
+      if (node.right_idx == 0) {
+        min_leaf = std::min(min_leaf, node.label);
+        max_leaf = std::max(max_leaf, node.label);
+      }
+    }
+    min_sum += min_leaf;
+    max_sum += max_leaf;
+    bounds.min[tree_idx] = min_sum;
+    bounds.max[tree_idx] = max_sum;
+  }
+}
+
 // Final function applied by a Gradient Boosted Trees with
 // BINOMIAL_LOG_LIKELIHOOD loss function.
 template <typename SpecializedModel>
@@ -665,6 +718,39 @@ absl::Status CheckBinaryClassification(const GenericModel& src) {
 
 }  // namespace
 
+absl::Status Float16LeafValue::ComputeScale(absl::Span<const float> values,
+                                            float* scale) {
+  for (const float value : values) {
+    if (!(std::abs(value) <= 65504.f)) {
+      return absl::InvalidArgumentError(
+          "The leaf values cannot be represented as float16.");
+    }
+  }
+  *scale = 1.f;
+  return absl::OkStatus();
+}
+
+absl::Status BFloat16LeafValue::ComputeScale(absl::Span<const float> values,
+                                             float* scale) {
+  *scale = 1.f;
+  return absl::OkStatus();
+}
+
+absl::Status UInt8LeafValue::ComputeScale(absl::Span<const float> values,
+                                          float* scale) {
+  float max_value = 0.f;
+  for (const float value : values) {
+    if (!(value >= 0.f) || std::isinf(value)) {
+      return absl::InvalidArgumentError(
+          "The 8-bits encoding only supports finite non-negative leaf "
+          "values.");
+    }
+    max_value = std::max(max_value, value);
+  }
+  *scale = max_value > 0.f ? max_value / 255.f : 1.f;
+  return absl::OkStatus();
+}
+
 absl::Status GenericToSpecializedModel(
     const RandomForestModel& src,
     RandomForestBinaryClassificationNumericalFeatures* dst) {
@@ -752,6 +838,7 @@ absl::Status GenericToSpecializedModel(
       dst));
 
   dst->initial_predictions = src.initial_predictions()[0];
+  ComputeRemainingOutputBounds(dst);
   return absl::OkStatus();
 }
 
@@ -886,6 +973,58 @@ absl::Status GenericToSpecializedModel(
       SetLeafNodeRandomForestMulticlassClassification<DstType>, src, dst);
 }
 
+template <typename LeafValue, typename NodeOffsetRep>
+absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>* dst) {
+  dst->num_classes =
+      src.label_col_spec().categorical().number_of_unique_values() - 1;
+
+  // The leaf values are first computed in full precision in "label_buffer".
+  using DstType = GenericRandomForestMulticlassClassificationCompactLeaves<
+      LeafValue, NodeOffsetRep>;
+  RETURN_IF_ERROR(GenericToSpecializedModelHelper2(
+      SetLeafNodeRandomForestMulticlassClassification<DstType>, src, dst));
+
+  RETURN_IF_ERROR(
+      LeafValue::ComputeScale(dst->label_buffer, &dst->label_scale));
+  dst->compact_label_buffer.resize(dst->label_buffer.size());
+  for (size_t value_idx = 0; value_idx < dst->label_buffer.size();
+       value_idx++) {
+    dst->compact_label_buffer[value_idx] =
+        LeafValue::Encode(dst->label_buffer[value_idx], dst->label_scale);
+  }
+  dst->label_buffer.clear();
+  dst->label_buffer.shrink_to_fit();
+  return absl::OkStatus();
+}
+
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<Float16LeafValue,
+                                                             uint16_t>* dst);
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<Float16LeafValue,
+                                                             uint32_t>* dst);
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<BFloat16LeafValue,
+                                                             uint16_t>* dst);
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<BFloat16LeafValue,
+                                                             uint32_t>* dst);
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<UInt8LeafValue,
+                                                             uint16_t>* dst);
+template absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<UInt8LeafValue,
+                                                             uint32_t>* dst);
+
 template <>
 absl::Status GenericToSpecializedModel(
     const RandomForestModel& src,
@@ -907,8 +1046,10 @@ absl::Status GenericToSpecializedModel(
   dst->initial_predictions = src.initial_predictions()[0];
 
   using DstType = std::remove_pointer<decltype(dst)>::type;
-  return GenericToSpecializedModelHelper2(
-      SetLeafGradientBoostedTreesClassification<DstType>, src, dst);
+  RETURN_IF_ERROR(GenericToSpecializedModelHelper2(
+      SetLeafGradientBoostedTreesClassification<DstType>, src, dst));
+  ComputeRemainingOutputBounds(dst);
+  return absl::OkStatus();
 }
 
 template <>
@@ -923,8 +1064,10 @@ absl::Status GenericToSpecializedModel(
   dst->initial_predictions = src.initial_predictions()[0];
 
   using DstType = std::remove_pointer<decltype(dst)>::type;
-  return GenericToSpecializedModelHelper2(
-      SetLeafGradientBoostedTreesClassification<DstType>, src, dst);
+  RETURN_IF_ERROR(GenericToSpecializedModelHelper2(
+      SetLeafGradientBoostedTreesClassification<DstType>, src, dst));
+  ComputeRemainingOutputBounds(dst);
+  return absl::OkStatus();
 }
 
 template <>
@@ -1181,10 +1324,12 @@ inline bool EvalCondition(
   }
 }
 
+// Evaluates the condition of a "generic" node, ignoring
+// "negated_condition".
 template <typename Model>
-inline bool EvalCondition(const typename Model::NodeType* node,
-                          const typename Model::ExampleSet& examples,
-                          const int example_idx, const Model& model) {
+inline bool EvalNonNegatedCondition(const typename Model::NodeType* node,
+                                    const typename Model::ExampleSet& examples,
+                                    const int example_idx, const Model& model) {
   using GenericNode = typename Model::NodeType;
   switch (node->type) {
     case GenericNode::Type::kNumericalIsHigher: {
@@ -1248,11 +1393,36 @@ inline bool EvalCondition(const typename Model::NodeType* node,
   }
 }
 
+// Note: Missing values are replaced before the inference. Therefore, negating
+// the result of a condition is equivalent to swapping its children.
+template <typename Model>
+inline bool EvalCondition(const typename Model::NodeType* node,
+                          const typename Model::ExampleSet& examples,
+                          const int example_idx, const Model& model) {
+  return EvalNonNegatedCondition(node, examples, example_idx, model) !=
+         (node->negated_condition != 0);
+}
+
+// Value "index" of the label buffer of a model with multi-dimensional leaves.
+template <typename Model>
+inline float LabelBufferValue(const Model& model, const uint32_t index) {
+  return model.label_buffer[index];
+}
+
+template <typename LeafValue, typename NodeOffsetRep>
+inline float LabelBufferValue(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>& model,
+    const uint32_t index) {
+  return LeafValue::Decode(model.compact_label_buffer[index],
+                           model.label_scale);
+}
+
 // Basic inference of a decision forest on a set of trees.
 template <typename Model,
           float (*FinalTransform)(const Model&, const float) = Idendity<Model>>
 inline void PredictHelper(
-    const Model& model, const std::vector<typename Model::ValueType>& examples,
+    const Model& model, absl::Span<const typename Model::ValueType> examples,
     int num_examples, std::vector<float>* predictions) {
   utils::usage::OnInference(num_examples);
   predictions->resize(num_examples);
@@ -1312,7 +1482,7 @@ inline void PredictHelperMultiDimensionTrees(
       }
       for (int class_idx = 0; class_idx < model.num_classes; class_idx++) {
         cur_predictions[class_idx] +=
-            model.label_buffer[node->label_buffer_offset + class_idx];
+            LabelBufferValue(model, node->label_buffer_offset + class_idx);
       }
     }
     for (int class_idx = 0; class_idx < model.num_classes; class_idx++) {
@@ -1352,7 +1522,7 @@ template <typename Model,
           float (*FinalTransform)(const Model&, const float) = Idendity<Model>,
           int kTreeBatchSize = 5>
 inline void PredictHelperOptimizedV1(
-    const Model& model, const std::vector<typename Model::ValueType>& examples,
+    const Model& model, absl::Span<const typename Model::ValueType> examples,
     int num_examples, std::vector<float>* predictions) {
   utils::usage::OnInference(num_examples);
   // A Group of "kTreeBatchSize" trees is called a "tree batch".
@@ -1378,7 +1548,7 @@ inline void PredictHelperOptimizedV1(
 
   // Select the first example.
   // Note: The examples are stored example-major/feature-minor.
-  const typename Model::ValueType* sample = &examples[0];
+  const typename Model::ValueType* sample = examples.data();
   for (size_t example_idx = 0; example_idx < num_examples; ++example_idx) {
     // Accumulator of the predictions for the current example.
     float output = 0.f;
@@ -1442,8 +1612,257 @@ inline void PredictHelperOptimizedV1(
   }
 }
 
+// Branch-free version of "EvalCondition" used by the lockstep traversal. Both
+// the numerical and the categorical tests are evaluated, and the result is
+// selected with a mask. This way, the loop over the examples of a block does
+// not contain any data-dependent branch and can be vectorized (gather +
+// compare) by the compiler.
+//
+// Note: Leaf nodes are evaluated as well (their result is ignored). Their
+// "feature_idx" is 0.
+inline uint32_t EvalConditionBranchless(
+    const OneDimensionOutputNumericalAndCategoricalFeatureNode& node,
+    const NumericalOrCategoricalValue* example) {
+  const int32_t feature_idx = node.feature_idx;
+  // 0 for numerical conditions, ~0 for categorical conditions.
+  const uint32_t is_categorical = static_cast<uint32_t>(feature_idx >> 31);
+  // "~feature_idx" is equal to "-(feature_idx+1)".
+  const NumericalOrCategoricalValue value =
+      example[feature_idx ^ static_cast<int32_t>(is_categorical)];
+  const uint32_t numerical_test = value.numerical_value >= node.threshold;
+  const uint32_t categorical_test =
+      ((1u << (value.categorical_value & 31)) & node.mask) != 0;
+  return (numerical_test & ~is_categorical) |
+         (categorical_test & is_categorical);
+}
+
+// See the documentation of "PredictBatched".
+template <typename Model,
+          float (*FinalTransform)(const Model&, const float) = Idendity<Model>,
+          int kExampleBatchSize = 8>
+inline void PredictHelperBatched(
+    const Model& model, absl::Span<const typename Model::ValueType> examples,
+    int num_examples, std::vector<float>* predictions) {
+  utils::usage::OnInference(num_examples);
+  predictions->resize(num_examples);
+
+  const int num_features = model.features().fixed_length_features().size();
+  const auto* nodes = model.nodes.data();
+
+  int example_idx = 0;
+  if (num_features > 0) {
+    // Index of the current node of each example in the block.
+    uint32_t node_idxs[kExampleBatchSize];
+    // Accumulator of the predictions of each example in the block.
+    float outputs[kExampleBatchSize];
+
+    for (; example_idx + kExampleBatchSize <= num_examples;
+         example_idx += kExampleBatchSize) {
+      const auto* block = &examples[example_idx * num_features];
+      std::fill(outputs, outputs + kExampleBatchSize, 0.f);
+
+      for (const auto root_node_idx : model.root_offsets) {
+        std::fill(node_idxs, node_idxs + kExampleBatchSize, root_node_idx);
+
+        // All the examples of the block go down the tree in lockstep. An
+        // example that reached a leaf stays on it (i.e. its step is zero)
+        // until all the examples have reached a leaf.
+        uint32_t any_step;
+        do {
+          any_step = 0;
+          for (int lane = 0; lane < kExampleBatchSize; lane++) {
+            const auto& node = nodes[node_idxs[lane]];
+            const uint32_t right_idx = node.right_idx;
+            const uint32_t condition =
+                EvalConditionBranchless(node, block + lane * num_features);
+            // "right_idx" if the condition is true, 1 if the condition is
+            // false, and 0 if the node is a leaf.
+            const uint32_t step =
+                condition * right_idx + ((1 - condition) & (right_idx != 0));
+            node_idxs[lane] += step;
+            any_step |= step;
+          }
+        } while (any_step);
+
+        for (int lane = 0; lane < kExampleBatchSize; lane++) {
+          outputs[lane] += nodes[node_idxs[lane]].label;
+        }
+      }
+
+      for (int lane = 0; lane < kExampleBatchSize; lane++) {
+        (*predictions)[example_idx + lane] =
+            FinalTransform(model, outputs[lane]);
+      }
+    }
+  }
+
+  // Remaining examples.
+  for (; example_idx < num_examples; ++example_idx) {
+    float output = 0.f;
+    const auto* sample = &examples[example_idx * num_features];
+    for (const auto root_node_idx : model.root_offsets) {
+      const auto* node = &model.nodes[root_node_idx];
+      while (node->right_idx) {
+        node += EvalCondition(node, sample) ? node->right_idx : 1;
+      }
+      output += node->label;
+    }
+    (*predictions)[example_idx] = FinalTransform(model, output);
+  }
+}
+
+// See the documentation of "PredictTreeParallel".
+template <typename Model,
+          float (*FinalTransform)(const Model&, const float) = Idendity<Model>>
+inline void PredictHelperTreeParallel(
+    const Model& model, absl::Span<const typename Model::ValueType> examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  const int num_trees = model.root_offsets.size();
+  int num_partitions = 1;
+  if (thread_pool) {
+    num_partitions = std::min(thread_pool->num_threads() + 1,
+                              num_trees / kMinNumTreesPerPartition);
+  }
+  if (num_partitions <= 1) {
+    PredictHelper<Model, FinalTransform>(model, examples, num_examples,
+                                         predictions);
+    return;
+  }
+
+  utils::usage::OnInference(num_examples);
+  predictions->resize(num_examples);
+  const int num_features = model.features().fixed_length_features().size();
+  const int num_trees_per_partition =
+      (num_trees + num_partitions - 1) / num_partitions;
+  num_partitions =
+      (num_trees + num_trees_per_partition - 1) / num_trees_per_partition;
+
+  // "partial_outputs[i + j * num_examples]" is the sum of the leaf values of
+  // the "j-th" partition of trees for the "i-th" example.
+  std::vector<float> partial_outputs(num_partitions * num_examples);
+
+  // Accumulates the leaf values of a partition of trees.
+  const auto run_partition = [&](const int partition_idx) {
+    const int begin_tree_idx = partition_idx * num_trees_per_partition;
+    const int end_tree_idx =
+        std::min(begin_tree_idx + num_trees_per_partition, num_trees);
+    float* outputs = &partial_outputs[partition_idx * num_examples];
+    for (int example_idx = 0; example_idx < num_examples; ++example_idx) {
+      float output = 0.f;
+      const auto* sample = &examples[example_idx * num_features];
+      for (int tree_idx = begin_tree_idx; tree_idx < end_tree_idx;
+           ++tree_idx) {
+        const auto* node = &model.nodes[model.root_offsets[tree_idx]];
+        while (node->right_idx) {
+          node += EvalCondition(node, sample) ? node->right_idx : 1;
+        }
+        output += node->label;
+      }
+      outputs[example_idx] = output;
+    }
+  };
+
+  // The first partition is evaluated by the calling thread.
+  absl::BlockingCounter pending_partitions(num_partitions - 1);
+  for (int partition_idx = 1; partition_idx < num_partitions;
+       partition_idx++) {
+    thread_pool->Schedule([&, partition_idx]() {
+      run_partition(partition_idx);
+      pending_partitions.DecrementCount();
+    });
+  }
+  run_partition(0);
+  pending_partitions.Wait();
+
+  // Reduce the partial sums. The partitions are always reduced in the same
+  // order, so the predictions are deterministic.
+  for (int example_idx = 0; example_idx < num_examples; ++example_idx) {
+    float output = 0.f;
+    for (int partition_idx = 0; partition_idx < num_partitions;
+         partition_idx++) {
+      output += partial_outputs[partition_idx * num_examples + example_idx];
+    }
+    (*predictions)[example_idx] = FinalTransform(model, output);
+  }
+}
+
+// Early-exit inference of a binary classification GBT. "get_leaf(example_idx,
+// root)" returns the leaf reached by the "example_idx-th" example in the tree
+// starting at the node "root".
+template <typename Model, typename GetLeaf>
+inline absl::Status PredictHelperEarlyExit(const Model& model,
+                                           const int num_examples,
+                                           const float threshold,
+                                           const GetLeaf& get_leaf,
+                                           std::vector<float>* predictions,
+                                           EarlyExitStats* stats) {
+  if (!(threshold > 0.f && threshold < 1.f)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("The threshold should be in ]0, 1[. Got ", threshold));
+  }
+  const auto& bounds = model.remaining_output_bounds;
+  const int num_trees = model.root_offsets.size();
+  if (bounds.min.size() != num_trees + 1 ||
+      bounds.max.size() != num_trees + 1) {
+    return absl::InvalidArgumentError(
+        "The remaining output bounds do not match the trees of the model. The "
+        "model should be compiled with \"GenericToSpecializedModel\".");
+  }
+
+  utils::usage::OnInference(num_examples);
+  predictions->resize(num_examples);
+
+  // The threshold expressed on the sum of the leaf values i.e. before the
+  // activation function.
+  const float output_threshold =
+      std::log(threshold / (1.f - threshold)) - model.initial_predictions;
+
+  int64_t num_evaluated_trees = 0;
+  for (int example_idx = 0; example_idx < num_examples; ++example_idx) {
+    float output = 0.f;
+    int tree_idx = 0;
+    // -1: Exited below the threshold. +1: Exited above the threshold.
+    int exit_side = 0;
+    for (; tree_idx < num_trees; ++tree_idx) {
+      if (output + bounds.min[tree_idx] >= output_threshold) {
+        // The output is above the threshold, whatever the remaining trees.
+        output += bounds.min[tree_idx];
+        exit_side = 1;
+        break;
+      }
+      if (output + bounds.max[tree_idx] < output_threshold) {
+        // The output is below the threshold, whatever the remaining trees.
+        output += bounds.max[tree_idx];
+        exit_side = -1;
+        break;
+      }
+      output +=
+          get_leaf(example_idx, &model.nodes[model.root_offsets[tree_idx]])
+              ->label;
+    }
+    num_evaluated_trees += tree_idx;
+    float prediction =
+        ActivationGradientBoostedTreesBinomialLogLikelihood(model, output);
+    // The activation can round a bound lying right next to the threshold onto
+    // the wrong side of it.
+    if (exit_side > 0 && prediction < threshold) {
+      prediction = threshold;
+    } else if (exit_side < 0 && prediction >= threshold) {
+      prediction = std::nextafter(threshold, 0.f);
+    }
+    (*predictions)[example_idx] = prediction;
+  }
+
+  if (stats) {
+    stats->num_examples += num_examples;
+    stats->num_evaluated_trees += num_evaluated_trees;
+  }
+  return absl::OkStatus();
+}
+
 void Predict(const RandomForestBinaryClassificationNumericalFeatures& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type, Clamp01>(
       model, examples, num_examples, predictions);
@@ -1452,14 +1871,14 @@ void Predict(const RandomForestBinaryClassificationNumericalFeatures& model,
 void Predict(
     const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type, Clamp01>(
       model, examples, num_examples, predictions);
 }
 
 void Predict(const GradientBoostedTreesBinaryClassificationNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationGradientBoostedTreesBinomialLogLikelihood>(
@@ -1469,7 +1888,7 @@ void Predict(const GradientBoostedTreesBinaryClassificationNumericalOnly& model,
 void Predict(
     const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationGradientBoostedTreesBinomialLogLikelihood>(
@@ -1477,21 +1896,21 @@ void Predict(
 }
 
 void Predict(const RandomForestRegressionNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type, Idendity>(
       model, examples, num_examples, predictions);
 }
 
 void Predict(const RandomForestRegressionNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type, Idendity>(
       model, examples, num_examples, predictions);
 }
 
 void Predict(const GradientBoostedTreesRegressionNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationAddInitialPrediction>(model, examples, num_examples,
@@ -1499,7 +1918,7 @@ void Predict(const GradientBoostedTreesRegressionNumericalOnly& model,
 }
 
 void Predict(const GradientBoostedTreesRegressionNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationAddInitialPrediction>(model, examples, num_examples,
@@ -1507,7 +1926,7 @@ void Predict(const GradientBoostedTreesRegressionNumericalAndCategorical& model,
 }
 
 void Predict(const GradientBoostedTreesRankingNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationAddInitialPrediction>(model, examples, num_examples,
@@ -1515,7 +1934,7 @@ void Predict(const GradientBoostedTreesRankingNumericalOnly& model,
 }
 
 void Predict(const GradientBoostedTreesRankingNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions) {
   PredictHelper<std::remove_reference<decltype(model)>::type,
                 ActivationAddInitialPrediction>(model, examples, num_examples,
@@ -1524,7 +1943,7 @@ void Predict(const GradientBoostedTreesRankingNumericalAndCategorical& model,
 
 void PredictOptimizedV1(
     const RandomForestBinaryClassificationNumericalFeatures& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       RandomForestBinaryClassificationNumericalFeatures,
@@ -1535,7 +1954,7 @@ void PredictOptimizedV1(
 void PredictOptimizedV1(
     const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       RandomForestBinaryClassificationNumericalAndCategoricalFeatures,
@@ -1546,7 +1965,7 @@ void PredictOptimizedV1(
 
 void PredictOptimizedV1(
     const GradientBoostedTreesBinaryClassificationNumericalOnly& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       GradientBoostedTreesBinaryClassificationNumericalOnly,
@@ -1557,7 +1976,7 @@ void PredictOptimizedV1(
 void PredictOptimizedV1(
     const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       GradientBoostedTreesBinaryClassificationNumericalAndCategorical,
@@ -1566,7 +1985,7 @@ void PredictOptimizedV1(
 }
 
 void PredictOptimizedV1(const RandomForestRegressionNumericalOnly& model,
-                        const std::vector<float>& examples, int num_examples,
+                        absl::Span<const float> examples, int num_examples,
                         std::vector<float>* predictions) {
   PredictHelperOptimizedV1<RandomForestRegressionNumericalOnly,
                            Idendity<RandomForestRegressionNumericalOnly>>(
@@ -1575,7 +1994,7 @@ void PredictOptimizedV1(const RandomForestRegressionNumericalOnly& model,
 
 void PredictOptimizedV1(
     const RandomForestRegressionNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       RandomForestRegressionNumericalAndCategorical,
@@ -1585,7 +2004,7 @@ void PredictOptimizedV1(
 
 void PredictOptimizedV1(
     const GradientBoostedTreesRegressionNumericalOnly& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<GradientBoostedTreesRegressionNumericalOnly,
                            ActivationAddInitialPrediction>(
@@ -1594,7 +2013,7 @@ void PredictOptimizedV1(
 
 void PredictOptimizedV1(
     const GradientBoostedTreesRegressionNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<
       GradientBoostedTreesRegressionNumericalAndCategorical,
@@ -1603,7 +2022,7 @@ void PredictOptimizedV1(
 }
 
 void PredictOptimizedV1(const GradientBoostedTreesRankingNumericalOnly& model,
-                        const std::vector<float>& examples, int num_examples,
+                        absl::Span<const float> examples, int num_examples,
                         std::vector<float>* predictions) {
   PredictHelperOptimizedV1<GradientBoostedTreesRankingNumericalOnly,
                            ActivationAddInitialPrediction>(
@@ -1612,13 +2031,119 @@ void PredictOptimizedV1(const GradientBoostedTreesRankingNumericalOnly& model,
 
 void PredictOptimizedV1(
     const GradientBoostedTreesRankingNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictHelperOptimizedV1<GradientBoostedTreesRankingNumericalAndCategorical,
                            ActivationAddInitialPrediction>(
       model, examples, num_examples, predictions);
 }
 
+void PredictBatched(
+    const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions) {
+  PredictHelperBatched<
+      RandomForestBinaryClassificationNumericalAndCategoricalFeatures,
+      Clamp01<RandomForestBinaryClassificationNumericalAndCategoricalFeatures>>(
+      model, examples, num_examples, predictions);
+}
+
+void PredictBatched(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions) {
+  PredictHelperBatched<
+      GradientBoostedTreesBinaryClassificationNumericalAndCategorical,
+      ActivationGradientBoostedTreesBinomialLogLikelihood>(
+      model, examples, num_examples, predictions);
+}
+
+void PredictBatched(
+    const RandomForestRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions) {
+  PredictHelperBatched<
+      RandomForestRegressionNumericalAndCategorical,
+      Idendity<RandomForestRegressionNumericalAndCategorical>>(
+      model, examples, num_examples, predictions);
+}
+
+void PredictBatched(
+    const GradientBoostedTreesRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions) {
+  PredictHelperBatched<GradientBoostedTreesRegressionNumericalAndCategorical,
+                       ActivationAddInitialPrediction>(
+      model, examples, num_examples, predictions);
+}
+
+void PredictBatched(
+    const GradientBoostedTreesRankingNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions) {
+  PredictHelperBatched<GradientBoostedTreesRankingNumericalAndCategorical,
+                       ActivationAddInitialPrediction>(
+      model, examples, num_examples, predictions);
+}
+
+void PredictTreeParallel(
+    const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictHelperTreeParallel<
+      RandomForestBinaryClassificationNumericalAndCategoricalFeatures,
+      Clamp01<RandomForestBinaryClassificationNumericalAndCategoricalFeatures>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+void PredictTreeParallel(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictHelperTreeParallel<
+      GradientBoostedTreesBinaryClassificationNumericalAndCategorical,
+      ActivationGradientBoostedTreesBinomialLogLikelihood>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+void PredictTreeParallel(
+    const RandomForestRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictHelperTreeParallel<
+      RandomForestRegressionNumericalAndCategorical,
+      Idendity<RandomForestRegressionNumericalAndCategorical>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+void PredictTreeParallel(
+    const GradientBoostedTreesRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictHelperTreeParallel<
+      GradientBoostedTreesRegressionNumericalAndCategorical,
+      ActivationAddInitialPrediction>(model, examples, num_examples,
+                                      predictions, thread_pool);
+}
+
+void PredictTreeParallel(
+    const GradientBoostedTreesRankingNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictHelperTreeParallel<GradientBoostedTreesRankingNumericalAndCategorical,
+                            ActivationAddInitialPrediction>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
 template <>
 void Predict(
     const RandomForestBinaryClassification& model,
@@ -1665,6 +2190,56 @@ void Predict(const GenericRandomForestMulticlassClassification<uint32_t>& model,
                                             predictions);
 }
 
+template <typename LeafValue, typename NodeOffsetRep>
+void Predict(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>& model,
+    const typename GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions) {
+  using Model = GenericRandomForestMulticlassClassificationCompactLeaves<
+      LeafValue, NodeOffsetRep>;
+  PredictHelperMultiDimensionTrees<Model, Clamp01>(model, examples,
+                                                   num_examples, predictions);
+}
+
+template void Predict(
+    const RandomForestMulticlassClassificationCompactLeaves<Float16LeafValue>&
+        model,
+    const RandomForestMulticlassClassificationCompactLeaves<
+        Float16LeafValue>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+template void Predict(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        Float16LeafValue, uint32_t>& model,
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        Float16LeafValue, uint32_t>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+template void Predict(
+    const RandomForestMulticlassClassificationCompactLeaves<BFloat16LeafValue>&
+        model,
+    const RandomForestMulticlassClassificationCompactLeaves<
+        BFloat16LeafValue>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+template void Predict(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        BFloat16LeafValue, uint32_t>& model,
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        BFloat16LeafValue, uint32_t>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+template void Predict(
+    const RandomForestMulticlassClassificationCompactLeaves<UInt8LeafValue>&
+        model,
+    const RandomForestMulticlassClassificationCompactLeaves<
+        UInt8LeafValue>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+template void Predict(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        UInt8LeafValue, uint32_t>& model,
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        UInt8LeafValue, uint32_t>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+
 template <>
 void Predict(const GenericRandomForestRegression<uint32_t>& model,
              const typename GenericRandomForestRegression<uint32_t>::ExampleSet&
@@ -1696,6 +2271,68 @@ void Predict(
       model, examples, num_examples, predictions);
 }
 
+absl::Status PredictWithEarlyExit(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples,
+    const int num_examples, const float threshold,
+    std::vector<float>* predictions, EarlyExitStats* stats) {
+  using Node = OneDimensionOutputNumericalAndCategoricalFeatureNode;
+  const int num_features = model.features().fixed_length_features().size();
+  return PredictHelperEarlyExit(
+      model, num_examples, threshold,
+      [&](const int example_idx, const Node* node) {
+        const auto* sample = examples.data() + example_idx * num_features;
+        while (node->right_idx) {
+          node += EvalCondition(node, sample) ? node->right_idx : 1;
+        }
+        return node;
+      },
+      predictions, stats);
+}
+
+// Early-exit inference of a "GenericGradientBoostedTreesBinaryClassification".
+template <typename Model>
+absl::Status PredictWithEarlyExitGenericHelper(
+    const Model& model, const typename Model::ExampleSet& examples,
+    const int num_examples, const float threshold,
+    std::vector<float>* predictions, EarlyExitStats* stats) {
+  using Node = typename Model::NodeType;
+  return PredictHelperEarlyExit(
+      model, num_examples, threshold,
+      [&](const int example_idx, const Node* node) {
+        while (node->right_idx) {
+          node += EvalCondition(node, examples, example_idx, model)
+                      ? node->right_idx
+                      : 1;
+        }
+        return node;
+      },
+      predictions, stats);
+}
+
+template <>
+absl::Status PredictWithEarlyExit(
+    const GradientBoostedTreesBinaryClassification& model,
+    const typename GradientBoostedTreesBinaryClassification::ExampleSet&
+        examples,
+    const int num_examples, const float threshold,
+    std::vector<float>* predictions, EarlyExitStats* stats) {
+  return PredictWithEarlyExitGenericHelper(model, examples, num_examples,
+                                           threshold, predictions, stats);
+}
+
+template <>
+absl::Status PredictWithEarlyExit(
+    const GenericGradientBoostedTreesBinaryClassification<uint32_t>& model,
+    const typename GenericGradientBoostedTreesBinaryClassification<
+        uint32_t>::ExampleSet& examples,
+    const int num_examples, const float threshold,
+    std::vector<float>* predictions, EarlyExitStats* stats) {
+  return PredictWithEarlyExitGenericHelper(model, examples, num_examples,
+                                           threshold, predictions, stats);
+}
+
 template <>
 void Predict(
     const GradientBoostedTreesMulticlassClassification& model,
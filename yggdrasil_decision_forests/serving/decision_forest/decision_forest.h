@@ -47,11 +47,20 @@
 #ifndef YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_H_
 #define YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_H_
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/casts.h"
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/mappable_vector.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/utils.h"
 #include "yggdrasil_decision_forests/serving/example_set.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 
 namespace yggdrasil_decision_forests {
 namespace serving {
@@ -152,6 +161,11 @@ struct GenericNode {
   // Type of the node (leaf or condition type).
   Type type;
 
+  // If non-zero, the condition is negated i.e. the next node is the positive
+  // child of the original tree, and "right_idx" points to its negative child.
+  // Stored in the padding after "type". See "ExampleSetModel::node_layout".
+  uint8_t negated_condition;
+
   union {
     // Output value (if this is a leaf) if the node is a leaf. Used for
     // single-dimensional output (e.G. binary classification RF, regressive
@@ -202,6 +216,7 @@ struct GenericNode {
     node.right_idx = right_idx;
     node.feature_idx = feature_idx;
     node.type = type;
+    node.negated_condition = 0;
     node.label_buffer_offset = label_buffer_offset;
     return node;
   }
@@ -223,9 +238,9 @@ struct FlatNodeModel {
   FeaturesDefinition* mutable_features() { return &internal_features; }
 
   // The list of nodes in the model.
-  std::vector<Node> nodes;
+  MappableVector<Node> nodes;
   // The indices (in "nodes") of the root nodes.
-  std::vector<int32_t> root_offsets;
+  MappableVector<int32_t> root_offsets;
 
   FeaturesDefinition internal_features;
 
@@ -240,6 +255,20 @@ struct FlatNodeModel {
   // documentation about these fields.
   std::vector<float> oblique_weights;
   std::vector<typename Node::FeatureIdx> oblique_internal_feature_idxs;
+
+  // Keeps alive the buffer referenced by "nodes" and "root_offsets", if any
+  // (e.g. a memory-mapped engine file; see "engine_file.h").
+  std::shared_ptr<const void> referenced_buffer;
+};
+
+// Bounds of the output of the trees of a model. Used by the early-exit
+// inference (see "PredictWithEarlyExit").
+struct RemainingOutputBounds {
+  // "min[i]" (resp. "max[i]") is the sum of the smallest (resp. largest) leaf
+  // value of each of the trees "[i, num_trees)". Contains "num_trees + 1"
+  // values, the last one being 0.
+  std::vector<float> min;
+  std::vector<float> max;
 };
 
 // Specialized models.
@@ -294,6 +323,8 @@ struct GradientBoostedTreesBinaryClassificationNumericalAndCategorical
   // Output of the model before any tree is applied, and before the final
   // activation function.
   float initial_predictions = 0.f;
+  // Computed by "GenericToSpecializedModel".
+  RemainingOutputBounds remaining_output_bounds;
 };
 
 // Gradient Boosted Trees model for regression with numerical input
@@ -349,6 +380,21 @@ struct ExampleSetModel
   using ExampleSet =
       ExampleSetNumericalOrCategoricalFlat<ExampleSetModel<NodeOffsetRep>,
                                            ExampleFormat::FORMAT_EXAMPLE_MAJOR>;
+
+  // Order of the nodes of a tree.
+  enum class NodeLayout {
+    // Depth-first <node, negative child, positive child> order.
+    kDepthFirst,
+    // Depth-first order, where the child reached by the most training examples
+    // is visited first (and the condition of the node is negated if this child
+    // is the positive one). Equivalent to "kDepthFirst" if the model does not
+    // contain training statistics.
+    kHotPath,
+  };
+
+  // Layout of the nodes. Should be set before calling
+  // "GenericToSpecializedModel".
+  NodeLayout node_layout = NodeLayout::kHotPath;
 };
 
 struct ExampleSetModelManyNodes : ExampleSetModel<uint32_t> {};
@@ -374,6 +420,108 @@ struct GenericRandomForestMulticlassClassification
 using RandomForestMulticlassClassification =
     GenericRandomForestMulticlassClassification<>;
 
+// Encodings of the leaf values of
+// "GenericRandomForestMulticlassClassificationCompactLeaves". An encoding
+// defines the type used to store a value ("Storage"), a model-wide scaling
+// factor computed from the values ("ComputeScale"), and the conversions from
+// and to float.
+
+// IEEE 754 half-precision float. The relative error is less than 2^-11 for
+// values in [6.1e-5, 65504], and the absolute error is less than 2^-25 for
+// smaller values.
+struct Float16LeafValue {
+  using Storage = uint16_t;
+
+  static absl::Status ComputeScale(absl::Span<const float> values,
+                                   float* scale);
+
+  static Storage Encode(const float value, const float scale) {
+    // Re-bias the exponent (float32: 127, float16: 15) and round the mantissa
+    // to nearest even. Also handles the float16 subnormals.
+    const float clamped = std::max(-65504.f, std::min(65504.f, value));
+    const uint32_t bits = absl::bit_cast<uint32_t>(clamped * 0x1p-112f);
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+    const uint32_t rounding = 0x0FFF + ((magnitude >> 13) & 1);
+    return static_cast<Storage>(sign | ((magnitude + rounding) >> 13));
+  }
+
+  static float Decode(const Storage value, const float scale) {
+    const uint32_t bits = (static_cast<uint32_t>(value & 0x8000) << 16) |
+                          (static_cast<uint32_t>(value & 0x7FFF) << 13);
+    return absl::bit_cast<float>(bits) * 0x1p112f;
+  }
+};
+
+// bfloat16 i.e. the 16 most significant bits of a float32. The relative error
+// is less than 2^-9.
+struct BFloat16LeafValue {
+  using Storage = uint16_t;
+
+  static absl::Status ComputeScale(absl::Span<const float> values,
+                                   float* scale);
+
+  static Storage Encode(const float value, const float scale) {
+    const uint32_t bits = absl::bit_cast<uint32_t>(value);
+    const uint32_t rounding = 0x7FFF + ((bits >> 16) & 1);
+    return static_cast<Storage>((bits + rounding) >> 16);
+  }
+
+  static float Decode(const Storage value, const float scale) {
+    return absl::bit_cast<float>(static_cast<uint32_t>(value) << 16);
+  }
+};
+
+// Linear quantization on 8 bits: "value ~= stored_value * scale" with "scale =
+// max(values) / 255". The absolute error is less than "scale / 2". Only
+// supports non-negative values (e.g. the class probabilities of a Random
+// Forest).
+struct UInt8LeafValue {
+  using Storage = uint8_t;
+
+  static absl::Status ComputeScale(absl::Span<const float> values,
+                                   float* scale);
+
+  static Storage Encode(const float value, const float scale) {
+    return static_cast<Storage>(
+        std::min(255.f, std::max(0.f, std::round(value / scale))));
+  }
+
+  static float Decode(const Storage value, const float scale) {
+    return value * scale;
+  }
+};
+
+// Random Forest model for multi-class classification where the leaf values
+// are stored with a reduced precision. Leaf values are the dominant part of
+// the memory of multi-class models with many classes: The leaf values take 2x
+// ("Float16LeafValue", "BFloat16LeafValue") or 4x ("UInt8LeafValue") less
+// memory than with "GenericRandomForestMulticlassClassification". The decoded
+// leaf values are accumulated as floats.
+//
+// The predictions are an approximation of the predictions of
+// "GenericRandomForestMulticlassClassification". The ":compare_leaf_precision"
+// tool reports the prediction difference on a dataset.
+//
+// This engine is not registered as a generic engine (i.e. it is never selected
+// by "BuildFastEngine"). Instead, use it directly or through an
+// "ExampleSetModelWrapper".
+template <typename LeafValue, typename NodeOffsetRep = uint16_t>
+struct GenericRandomForestMulticlassClassificationCompactLeaves
+    : ExampleSetModel<NodeOffsetRep> {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+  int num_classes;
+
+  // Encoded leaf values. Replaces "label_buffer" (which is empty).
+  std::vector<typename LeafValue::Storage> compact_label_buffer;
+  // Scaling factor of "LeafValue".
+  float label_scale = 1.f;
+};
+template <typename LeafValue>
+using RandomForestMulticlassClassificationCompactLeaves =
+    GenericRandomForestMulticlassClassificationCompactLeaves<LeafValue>;
+
 // Random Forest model for regression.
 template <typename NodeOffsetRep = uint16_t>
 struct GenericRandomForestRegression : ExampleSetModel<NodeOffsetRep> {
@@ -390,6 +538,8 @@ struct GenericGradientBoostedTreesBinaryClassification
   // Output of the model before any tree is applied, and before the final
   // activation function.
   float initial_predictions = 0.f;
+  // Computed by "GenericToSpecializedModel".
+  RemainingOutputBounds remaining_output_bounds;
 };
 using GradientBoostedTreesBinaryClassification =
     GenericGradientBoostedTreesBinaryClassification<>;
@@ -434,6 +584,20 @@ template <typename Model>
 void Predict(const Model& model, const typename Model::ExampleSet& examples,
              int num_examples, std::vector<float>* predictions);
 
+template <typename LeafValue, typename NodeOffsetRep>
+absl::Status GenericToSpecializedModel(
+    const model::random_forest::RandomForestModel& src,
+    GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>* dst);
+
+template <typename LeafValue, typename NodeOffsetRep>
+void Predict(
+    const GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>& model,
+    const typename GenericRandomForestMulticlassClassificationCompactLeaves<
+        LeafValue, NodeOffsetRep>::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions);
+
 // Converts a generic model into a specialized model.
 //
 // Returns an error if the model is not compatible.
@@ -516,47 +680,47 @@ absl::Status GenericToSpecializedModel(
 // next to-do). This value of 5 is close to optimal.
 //
 void Predict(const RandomForestBinaryClassificationNumericalFeatures& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions);
 
 void Predict(
     const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 void Predict(const GradientBoostedTreesBinaryClassificationNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions);
 
 void Predict(
     const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 void Predict(const RandomForestRegressionNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions);
 
 void Predict(const RandomForestRegressionNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions);
 
 void Predict(const GradientBoostedTreesRegressionNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions);
 
 void Predict(const GradientBoostedTreesRegressionNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions);
 
 void Predict(const GradientBoostedTreesRankingNumericalOnly& model,
-             const std::vector<float>& examples, int num_examples,
+             absl::Span<const float> examples, int num_examples,
              std::vector<float>* predictions);
 
 void Predict(const GradientBoostedTreesRankingNumericalAndCategorical& model,
-             const std::vector<NumericalOrCategoricalValue>& examples,
+             absl::Span<const NumericalOrCategoricalValue> examples,
              int num_examples, std::vector<float>* predictions);
 
 template <typename Model>
@@ -567,64 +731,227 @@ void PredictWithExampleSet(const Model& model,
           predictions);
 }
 
+// Batched inference. Instead of evaluating the examples one after another,
+// "PredictBatched" walks blocks of 8 examples through each tree in lockstep.
+// The child selection is branch-free (the next node is "right_idx * condition"
+// with a step of 0 on leaves) so the evaluation of the examples in a block can
+// be vectorized (gather + compare) and the node accesses of different examples
+// overlap. Examples that reach a leaf early idle until the entire block is
+// done.
+// The remaining "num_examples % 8" examples are evaluated with "Predict".
+//
+// Produces the same predictions as "Predict". Most useful for large batches of
+// examples: With less than 8 examples, this is equivalent to "Predict".
+void PredictBatched(
+    const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions);
+
+void PredictBatched(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions);
+
+void PredictBatched(
+    const RandomForestRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions);
+
+void PredictBatched(
+    const GradientBoostedTreesRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions);
+
+void PredictBatched(
+    const GradientBoostedTreesRankingNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions);
+
+template <typename Model>
+void PredictWithExampleSetBatched(const Model& model,
+                                  const typename Model::ExampleSet& examples,
+                                  int num_examples,
+                                  std::vector<float>* predictions) {
+  PredictBatched(model, examples.InternalCategoricalAndNumericalValues(),
+                 num_examples, predictions);
+}
+
+// Tree-parallel inference. The trees of the model are partitioned into
+// contiguous ranges (using "root_offsets"; the model is not copied) evaluated
+// by different threads of "thread_pool" and by the calling thread. The partial
+// sums are reduced at the end. Reduces the latency of small batches of examples
+// on large models, where parallelizing over the examples does not help.
+//
+// Each partition contains at least "kMinNumTreesPerPartition" trees. If the
+// model is too small or if "thread_pool" is null, this is equivalent to
+// "Predict". The predictions can differ from "Predict" by floating point
+// rounding errors (the leaf values are summed in a different order), but are
+// deterministic.
+constexpr int kMinNumTreesPerPartition = 100;
+
+void PredictTreeParallel(
+    const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool);
+
+void PredictTreeParallel(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool);
+
+void PredictTreeParallel(
+    const RandomForestRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool);
+
+void PredictTreeParallel(
+    const GradientBoostedTreesRegressionNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool);
+
+void PredictTreeParallel(
+    const GradientBoostedTreesRankingNumericalAndCategorical& model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool);
+
+template <typename Model>
+void PredictWithExampleSetTreeParallel(
+    const Model& model, const typename Model::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictTreeParallel(model, examples.InternalCategoricalAndNumericalValues(),
+                      num_examples, predictions, thread_pool);
+}
+
+// Early-exit inference for binary classification GBTs.
+//
+// Filtering workloads only need to know if the probability of an example is
+// greater or equal to "threshold" (in ]0, 1[). The trees are evaluated in
+// order, and the evaluation of an example stops as soon as the remaining trees
+// cannot change the side of the threshold of its probability (see
+// "RemainingOutputBounds").
+//
+// The prediction of an example is its probability if all the trees were
+// evaluated. Otherwise, it is the bound of its probability that crossed the
+// threshold i.e. the predictions and the probabilities are always on the same
+// side of the threshold (up to floating point rounding errors).
+//
+// Usage example:
+//
+//   EarlyExitStats stats;
+//   CHECK_OK(PredictWithEarlyExit(model, examples, num_examples,
+//                                 /*threshold=*/0.8f, &predictions, &stats));
+//   LOG(INFO) << stats.AverageNumEvaluatedTrees() << " trees evaluated";
+//
+struct EarlyExitStats {
+  // Number of predicted examples.
+  int64_t num_examples = 0;
+  // Total number of trees evaluated on the examples.
+  int64_t num_evaluated_trees = 0;
+
+  // Average number of trees evaluated on an example.
+  double AverageNumEvaluatedTrees() const {
+    return num_examples == 0 ? 0.
+                             : static_cast<double>(num_evaluated_trees) /
+                                   num_examples;
+  }
+};
+
+// If "stats" is set, the statistics of the call are added to it. Returns an
+// error if "threshold" is not in ]0, 1[ or if the "remaining_output_bounds" of
+// the model do not match its trees.
+absl::Status PredictWithEarlyExit(
+    const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
+        model,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
+    float threshold, std::vector<float>* predictions,
+    EarlyExitStats* stats = nullptr);
+
+template <typename Model>
+absl::Status PredictWithExampleSetEarlyExit(
+    const Model& model, const typename Model::ExampleSet& examples,
+    int num_examples, float threshold, std::vector<float>* predictions,
+    EarlyExitStats* stats = nullptr) {
+  return PredictWithEarlyExit(model,
+                              examples.InternalCategoricalAndNumericalValues(),
+                              num_examples, threshold, predictions, stats);
+}
+
+// Specialized for "GenericGradientBoostedTreesBinaryClassification".
+template <typename Model>
+absl::Status PredictWithEarlyExit(const Model& model,
+                                  const typename Model::ExampleSet& examples,
+                                  int num_examples, float threshold,
+                                  std::vector<float>* predictions,
+                                  EarlyExitStats* stats = nullptr);
+
 // Note: Requires for the number of trees to be a multiple of 8.
 void PredictOptimizedV1(
     const RandomForestBinaryClassificationNumericalFeatures& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const RandomForestBinaryClassificationNumericalAndCategoricalFeatures&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const GradientBoostedTreesBinaryClassificationNumericalOnly& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const GradientBoostedTreesBinaryClassificationNumericalAndCategorical&
         model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 8.
 void PredictOptimizedV1(const RandomForestRegressionNumericalOnly& model,
-                        const std::vector<float>& examples, int num_examples,
+                        absl::Span<const float> examples, int num_examples,
                         std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const RandomForestRegressionNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const GradientBoostedTreesRegressionNumericalOnly& model,
-    const std::vector<float>& examples, int num_examples,
+    absl::Span<const float> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const GradientBoostedTreesRegressionNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(const GradientBoostedTreesRankingNumericalOnly& model,
-                        const std::vector<float>& examples, int num_examples,
+                        absl::Span<const float> examples, int num_examples,
                         std::vector<float>* predictions);
 
 // Note: Requires for the number of trees to be a multiple of 5.
 void PredictOptimizedV1(
     const GradientBoostedTreesRankingNumericalAndCategorical& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Loads a batch a examples from a vertical dataset (i.e. column major generic
@@ -34,11 +34,13 @@
 #include "yggdrasil_decision_forests/model/abstract_model.h"
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.pb.h"
+#include "yggdrasil_decision_forests/model/fast_engine_factory.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
 #include "yggdrasil_decision_forests/model/model_library.h"
 #include "yggdrasil_decision_forests/model/prediction.pb.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/quick_scorer_extended.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/csv.h"
 #include "yggdrasil_decision_forests/utils/distribution.pb.h"
 #include "yggdrasil_decision_forests/utils/filesystem.h"
@@ -250,6 +252,91 @@ INSTANTIATE_TEST_SUITE_P(
           absl::StrReplaceAll(info.param.dataset, {{".", "_"}, {"-", "_"}}));
     });
 
+// The multi-threaded inference returns the same predictions as the
+// single-threaded inference.
+TEST(FastEngine, MultiThreadedPredict) {
+  utils::concurrency::ThreadPool pool("inference", /*num_threads=*/4);
+  pool.StartWorkers();
+
+  for (const auto& model_and_dataset :
+       std::vector<std::pair<std::string, std::string>>{
+           {"adult_binary_class_gbdt", "adult_test.csv"},
+           {"iris_multi_class_gbdt", "iris.csv"}}) {
+    LOG(INFO) << "Model: " << model_and_dataset.first;
+    const auto model = LoadModel(model_and_dataset.first);
+    const auto dataset =
+        LoadDataset(model->data_spec(), model_and_dataset.second);
+    const auto engine = model->BuildFastEngine().value();
+    auto examples = engine->AllocateExamples(dataset.nrow());
+    CHECK_OK(CopyVerticalDatasetToAbstractExampleSet(
+        dataset, 0, dataset.nrow(), engine->features(), examples.get()));
+
+    std::vector<float> expected_predictions;
+    engine->Predict(*examples, dataset.nrow(), &expected_predictions);
+
+    // Repeated calls re-use the working memory of the previous calls.
+    for (int repetition = 0; repetition < 2; repetition++) {
+      std::vector<float> predictions;
+      EXPECT_OK(engine->PredictWithThreadPool(*examples, dataset.nrow(),
+                                              &predictions, &pool));
+      EXPECT_EQ(predictions, expected_predictions);
+    }
+  }
+}
+
+// The name of the engine factories is their registration key.
+TEST(FastEngineFactory, NameMatchesRegistrationKey) {
+  for (const auto& key : model::FastEngineFactoryRegisterer::GetNames()) {
+    EXPECT_EQ(model::FastEngineFactoryRegisterer::Create(key).value()->name(),
+              key);
+  }
+}
+
+// Engines applied on example set views over an external buffer return the same
+// predictions as engines applied on allocated example sets.
+TEST(FastEngine, WrapExamples) {
+  for (const auto& model_and_dataset :
+       std::vector<std::pair<std::string, std::string>>{
+           {"adult_binary_class_gbdt", "adult_test.csv"},
+           {"iris_multi_class_gbdt", "iris.csv"}}) {
+    LOG(INFO) << "Model: " << model_and_dataset.first;
+    const auto model = LoadModel(model_and_dataset.first);
+    const auto dataset =
+        LoadDataset(model->data_spec(), model_and_dataset.second);
+    for (const auto& factory : model->ListCompatibleFastEngines()) {
+      LOG(INFO) << "Engine: " << factory->name();
+      const auto engine = factory->CreateEngine(model.get()).value();
+      auto examples = engine->AllocateExamples(dataset.nrow());
+      CHECK_OK(CopyVerticalDatasetToAbstractExampleSet(
+          dataset, 0, dataset.nrow(), engine->features(), examples.get()));
+      std::vector<float> expected_predictions;
+      engine->Predict(*examples, dataset.nrow(), &expected_predictions);
+
+      // Only one of the formats is supported by the engine.
+      int num_supported_formats = 0;
+      for (const auto format : {ExampleFormat::FORMAT_EXAMPLE_MAJOR,
+                                ExampleFormat::FORMAT_FEATURE_MAJOR}) {
+        std::vector<NumericalOrCategoricalValue> buffer;
+        CHECK_OK(LoadFlatBatchFromDataset(
+            dataset, 0, dataset.nrow(),
+            FeatureNames(engine->features().fixed_length_features()),
+            engine->features().fixed_length_na_replacement_values(), &buffer,
+            format));
+        const auto view =
+            engine->WrapExamples(buffer, dataset.nrow(), format);
+        if (!view.ok()) {
+          continue;
+        }
+        num_supported_formats++;
+        std::vector<float> predictions;
+        engine->Predict(*view.value(), dataset.nrow(), &predictions);
+        EXPECT_EQ(predictions, expected_predictions);
+      }
+      EXPECT_EQ(num_supported_formats, 1);
+    }
+  }
+}
+
 TEST(AdultBinaryClassGBDT, ManualGeneric) {
   const auto model = LoadModel("adult_binary_class_gbdt");
   const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
@@ -274,6 +361,153 @@ TEST(AdultBinaryClassGBDT, ManualNumCat32) {
       dataset, *model, engine);
 }
 
+TEST(AdultBinaryClassGBDT, ManualNumCat32Batched) {
+  const auto model = LoadModel("adult_binary_class_gbdt_32cat");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassificationNumericalAndCategorical engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+
+  utils::ExpectEqualPredictionsOldTemplate<decltype(engine), PredictBatched>(
+      dataset, *model, engine);
+}
+
+TEST(AdultBinaryClassGBDT, ManualNumCat32TreeParallel) {
+  const auto model = LoadModel("adult_binary_class_gbdt_32cat");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassificationNumericalAndCategorical engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+
+  // Makes the model large enough to be split into several partitions by
+  // repeating the trees.
+  const auto root_offsets = engine.root_offsets;
+  while (engine.root_offsets.size() < 4 * kMinNumTreesPerPartition) {
+    engine.root_offsets.insert(engine.root_offsets.end(), root_offsets.begin(),
+                               root_offsets.end());
+  }
+
+  const int num_examples = 5;
+  std::vector<NumericalOrCategoricalValue> examples;
+  CHECK_OK(LoadFlatBatchFromDataset(
+      dataset, 0, num_examples,
+      FeatureNames(engine.features().fixed_length_features()),
+      engine.features().fixed_length_na_replacement_values(), &examples));
+
+  std::vector<float> expected_predictions;
+  Predict(engine, examples, num_examples, &expected_predictions);
+
+  utils::concurrency::ThreadPool pool("inference", /*num_threads=*/3);
+  pool.StartWorkers();
+  std::vector<float> predictions;
+  PredictTreeParallel(engine, examples, num_examples, &predictions, &pool);
+  ASSERT_EQ(predictions.size(), num_examples);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    EXPECT_NEAR(predictions[example_idx], expected_predictions[example_idx],
+                1e-5f);
+  }
+}
+
+// Checks that the early-exit predictions are on the same side of "threshold"
+// as the exact predictions.
+void ExpectSameSideOfThreshold(const std::vector<float>& predictions,
+                               const std::vector<float>& expected_predictions,
+                               const float threshold) {
+  ASSERT_EQ(predictions.size(), expected_predictions.size());
+  for (int example_idx = 0; example_idx < predictions.size(); example_idx++) {
+    if (std::abs(expected_predictions[example_idx] - threshold) < 1e-4f) {
+      // Too close to the threshold to be robust to rounding errors.
+      continue;
+    }
+    EXPECT_EQ(predictions[example_idx] >= threshold,
+              expected_predictions[example_idx] >= threshold)
+        << "example_idx:" << example_idx << " threshold:" << threshold;
+  }
+}
+
+TEST(AdultBinaryClassGBDT, ManualNumCat32EarlyExit) {
+  const auto model = LoadModel("adult_binary_class_gbdt_32cat");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassificationNumericalAndCategorical engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+  const int num_trees = engine.root_offsets.size();
+  ASSERT_EQ(engine.remaining_output_bounds.min.size(), num_trees + 1);
+  EXPECT_LE(engine.remaining_output_bounds.min[0],
+            engine.remaining_output_bounds.max[0]);
+
+  std::vector<NumericalOrCategoricalValue> examples;
+  CHECK_OK(LoadFlatBatchFromDataset(
+      dataset, 0, dataset.nrow(),
+      FeatureNames(engine.features().fixed_length_features()),
+      engine.features().fixed_length_na_replacement_values(), &examples));
+  std::vector<float> expected_predictions;
+  Predict(engine, examples, dataset.nrow(), &expected_predictions);
+
+  for (const float threshold : {0.05f, 0.5f, 0.95f}) {
+    EarlyExitStats stats;
+    std::vector<float> predictions;
+    EXPECT_OK(PredictWithEarlyExit(engine, examples, dataset.nrow(), threshold,
+                                   &predictions, &stats));
+    ExpectSameSideOfThreshold(predictions, expected_predictions, threshold);
+    EXPECT_EQ(stats.num_examples, dataset.nrow());
+    EXPECT_LT(stats.AverageNumEvaluatedTrees(), num_trees);
+    LOG(INFO) << "threshold:" << threshold << " average number of trees:"
+              << stats.AverageNumEvaluatedTrees() << " / " << num_trees;
+  }
+}
+
+TEST(AdultBinaryClassGBDT, ManualGenericEarlyExit) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassification engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+
+  const auto examples = VerticalDatasetToExampleSet(dataset, engine).value();
+  std::vector<float> expected_predictions;
+  Predict(engine, examples, dataset.nrow(), &expected_predictions);
+
+  const float threshold = 0.5f;
+  EarlyExitStats stats;
+  std::vector<float> predictions;
+  EXPECT_OK(PredictWithEarlyExit(engine, examples, dataset.nrow(), threshold,
+                                 &predictions, &stats));
+  ExpectSameSideOfThreshold(predictions, expected_predictions, threshold);
+  EXPECT_LT(stats.AverageNumEvaluatedTrees(), engine.root_offsets.size());
+}
+
+TEST(AdultBinaryClassGBDT, EarlyExitInvalidArguments) {
+  const auto model = LoadModel("adult_binary_class_gbdt_32cat");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassificationNumericalAndCategorical engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+
+  const int num_examples = 5;
+  std::vector<NumericalOrCategoricalValue> examples;
+  CHECK_OK(LoadFlatBatchFromDataset(
+      dataset, 0, num_examples,
+      FeatureNames(engine.features().fixed_length_features()),
+      engine.features().fixed_length_na_replacement_values(), &examples));
+
+  std::vector<float> predictions;
+  EXPECT_FALSE(PredictWithEarlyExit(engine, examples, num_examples,
+                                    /*threshold=*/1.f, &predictions)
+                   .ok());
+
+  // The bounds do not match the trees.
+  engine.remaining_output_bounds.min.pop_back();
+  EXPECT_FALSE(PredictWithEarlyExit(engine, examples, num_examples,
+                                    /*threshold=*/0.5f, &predictions)
+                   .ok());
+}
+
 TEST(AdultBinaryClassGBDT, ManualNum) {
   const auto model = LoadModel("adult_binary_class_gbdt_only_num");
   const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
@@ -334,6 +568,140 @@ TEST(IrisMulticlassClassRF, ManualGeneric) {
       dataset, *model, engine);
 }
 
+TEST(CompactLeafValue, EncodeDecode) {
+  for (const float value : {0.f, 1.f, 0.5f, 0.01f, 1e-6f, 123.456f}) {
+    EXPECT_NEAR(
+        Float16LeafValue::Decode(Float16LeafValue::Encode(value, 1.f), 1.f),
+        value, value * 1e-3f + 1e-7f);
+    EXPECT_NEAR(
+        BFloat16LeafValue::Decode(BFloat16LeafValue::Encode(value, 1.f), 1.f),
+        value, value * 4e-3f);
+  }
+  EXPECT_EQ(Float16LeafValue::Encode(1.f, 1.f), 0x3C00);
+  EXPECT_EQ(Float16LeafValue::Encode(-2.f, 1.f), 0xC000);
+  EXPECT_EQ(BFloat16LeafValue::Encode(1.f, 1.f), 0x3F80);
+
+  const std::vector<float> values = {0.f, 0.5f, 1.f};
+  float scale;
+  CHECK_OK(UInt8LeafValue::ComputeScale(values, &scale));
+  EXPECT_NEAR(scale, 1.f / 255, 1e-7f);
+  EXPECT_EQ(UInt8LeafValue::Encode(1.f, scale), 255);
+  EXPECT_NEAR(
+      UInt8LeafValue::Decode(UInt8LeafValue::Encode(0.5f, scale), scale), 0.5f,
+      scale / 2);
+  EXPECT_EQ(UInt8LeafValue::Decode(0, scale), 0.f);
+  EXPECT_FALSE(UInt8LeafValue::ComputeScale({-1.f}, &scale).ok());
+}
+
+// The compact leaves engines return approximately the same predictions as the
+// full precision engine.
+TEST(IrisMulticlassClassRF, CompactLeaves) {
+  const auto model = LoadModel("iris_multi_class_rf");
+  const auto dataset = LoadDataset(model->data_spec(), "iris.csv", "csv");
+  auto* rf_model = dynamic_cast<RandomForestModel*>(model.get());
+
+  RandomForestMulticlassClassification engine;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &engine));
+  std::vector<float> expected_predictions;
+  Predict(engine, VerticalDatasetToExampleSet(dataset, engine).value(),
+          dataset.nrow(), &expected_predictions);
+
+  const auto check = [&](const auto& compact_engine, const float max_delta) {
+    EXPECT_TRUE(compact_engine.label_buffer.empty());
+    EXPECT_EQ(compact_engine.compact_label_buffer.size(),
+              engine.label_buffer.size());
+    std::vector<float> predictions;
+    Predict(compact_engine,
+            VerticalDatasetToExampleSet(dataset, compact_engine).value(),
+            dataset.nrow(), &predictions);
+    ASSERT_EQ(predictions.size(), expected_predictions.size());
+    for (int i = 0; i < predictions.size(); i++) {
+      EXPECT_NEAR(predictions[i], expected_predictions[i], max_delta);
+    }
+  };
+
+  RandomForestMulticlassClassificationCompactLeaves<Float16LeafValue>
+      float16_engine;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &float16_engine));
+  check(float16_engine, 1e-3f);
+
+  RandomForestMulticlassClassificationCompactLeaves<BFloat16LeafValue>
+      bfloat16_engine;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &bfloat16_engine));
+  check(bfloat16_engine, 4e-3f);
+
+  RandomForestMulticlassClassificationCompactLeaves<UInt8LeafValue>
+      uint8_engine;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &uint8_engine));
+  check(uint8_engine,
+        0.5f * uint8_engine.label_scale * rf_model->NumTrees() + 1e-6f);
+}
+
+// Number of nodes with a negated condition.
+template <typename Engine>
+int NumNegatedConditions(const Engine& engine) {
+  return std::count_if(engine.nodes.begin(), engine.nodes.end(),
+                       [](const auto& node) {
+                         return node.right_idx != 0 && node.negated_condition;
+                       });
+}
+
+// The hot-path layout negates some of the conditions, and returns the same
+// predictions as the depth-first layout.
+TEST(IrisMulticlassClassRF, HotPathLayout) {
+  const auto model = LoadModel("iris_multi_class_rf");
+  const auto dataset = LoadDataset(model->data_spec(), "iris.csv", "csv");
+  auto* rf_model = dynamic_cast<RandomForestModel*>(model.get());
+
+  RandomForestMulticlassClassification depth_first_engine;
+  depth_first_engine.node_layout =
+      RandomForestMulticlassClassification::NodeLayout::kDepthFirst;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &depth_first_engine));
+  EXPECT_EQ(NumNegatedConditions(depth_first_engine), 0);
+
+  RandomForestMulticlassClassification hot_path_engine;
+  CHECK_OK(GenericToSpecializedModel(*rf_model, &hot_path_engine));
+  EXPECT_GT(NumNegatedConditions(hot_path_engine), 0);
+  EXPECT_EQ(hot_path_engine.nodes.size(), depth_first_engine.nodes.size());
+
+  std::vector<float> depth_first_predictions;
+  Predict(depth_first_engine,
+          VerticalDatasetToExampleSet(dataset, depth_first_engine).value(),
+          dataset.nrow(), &depth_first_predictions);
+  std::vector<float> hot_path_predictions;
+  Predict(hot_path_engine,
+          VerticalDatasetToExampleSet(dataset, hot_path_engine).value(),
+          dataset.nrow(), &hot_path_predictions);
+  EXPECT_EQ(hot_path_predictions, depth_first_predictions);
+}
+
+// Same as above with categorical conditions.
+TEST(AdultBinaryClassGBDT, HotPathLayout) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv", "csv");
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+
+  GradientBoostedTreesBinaryClassification depth_first_engine;
+  depth_first_engine.node_layout =
+      GradientBoostedTreesBinaryClassification::NodeLayout::kDepthFirst;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &depth_first_engine));
+  EXPECT_EQ(NumNegatedConditions(depth_first_engine), 0);
+
+  GradientBoostedTreesBinaryClassification hot_path_engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &hot_path_engine));
+  EXPECT_GT(NumNegatedConditions(hot_path_engine), 0);
+
+  std::vector<float> depth_first_predictions;
+  Predict(depth_first_engine,
+          VerticalDatasetToExampleSet(dataset, depth_first_engine).value(),
+          dataset.nrow(), &depth_first_predictions);
+  std::vector<float> hot_path_predictions;
+  Predict(hot_path_engine,
+          VerticalDatasetToExampleSet(dataset, hot_path_engine).value(),
+          dataset.nrow(), &hot_path_predictions);
+  EXPECT_EQ(hot_path_predictions, depth_first_predictions);
+}
+
 void BuildFullTree(const int d, model::decision_tree::NodeWithChildren* node) {
   if (d <= 0) {
     node->mutable_node()->mutable_classifier()->set_top_value(1.f);
@@ -0,0 +1,1181 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Layout of an engine file:
+//
+//   FileHeader (includes the offset and size of each section)
+//   Section kDataSpec (aligned on kSectionAlignment bytes)
+//   Section kInputFeatures (aligned on kSectionAlignment bytes)
+//   ...
+//
+// The sections are raw arrays of values (e.g. the "nodes" section is the
+// in-memory representation of the nodes) except for "kDataSpec" (serialized
+// DataSpecification proto) and "kCategoricalMaskBuffer" (one byte per bit).
+// Each family of compiled models (flat node, quantized and QuickScorer) only
+// uses some of the sections. The other sections are empty.
+//
+// All the indices and offsets read from an engine file are checked when the
+// file is loaded, so a corrupted file is reported as an error instead of
+// causing out-of-bounds accesses during inference.
+//
+#include "yggdrasil_decision_forests/serving/decision_forest/engine_file.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/quantized_decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/quick_scorer_extended.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using QuickScorerModel = internal::QuickScorerExtendedModel;
+
+constexpr char kMagic[8] = {'Y', 'D', 'F', 'E', 'N', 'G', 'I', 'N'};
+
+// Written in the native byte order. Used to detect engine files created on a
+// platform with a different byte order.
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// Alignment (in bytes) of the beginning of each section in the file.
+constexpr uint64_t kSectionAlignment = 64;
+
+// Sections of an engine file.
+enum Section : int {
+  // All the models.
+  kDataSpec,
+  kInputFeatures,
+  kInitialPredictions,
+  // Flat node and quantized models.
+  kRootOffsets,
+  kNodes,
+  // Flat node models.
+  kCategoricalMaskBuffer,
+  kObliqueWeights,
+  kObliqueInternalFeatureIdxs,
+  kRemainingOutputBoundsMin,
+  kRemainingOutputBoundsMax,
+  // Quantized and QuickScorer models.
+  kLeafValues,
+  // Quantized models.
+  kThresholds,
+  kThresholdOffsets,
+  kNumClasses,
+  // QuickScorer models.
+  kQuickScorerShape,
+  kIsHigherConditions,
+  kIsHigherItems,
+  kContainsConditions,
+  kContainsItems,
+  kSparseContainsConditions,
+  kSparseContainsRanges,
+  kSparseContainsMasks,
+  kNumSections,
+};
+
+struct SectionEntry {
+  // Position of the section from the beginning of the file, in bytes.
+  uint64_t offset;
+  // Size of the section, in bytes.
+  uint64_t size;
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order_mark;
+  uint32_t model_type;
+  // "sizeof" of the nodes.
+  uint32_t node_size;
+  uint32_t num_sections;
+  uint32_t padding;
+  uint64_t file_size;
+  SectionEntry sections[kNumSections];
+};
+
+static_assert(std::is_trivially_copyable<FileHeader>::value,
+              "The header is written as raw bytes.");
+
+// Scalar fields of a QuickScorer model.
+struct QuickScorerShape {
+  int32_t num_trees;
+  int32_t max_num_leafs_per_tree;
+  int32_t num_leaf_masks_per_tree;
+  int32_t num_output_dimensions;
+};
+
+// A QuickScorer condition without its items. The items of all the conditions
+// of the same kind are stored one after the other in a separate section.
+struct QuickScorerCondition {
+  int32_t internal_feature_idx;
+  // Number of items. For sparse contains conditions, number of value ranges.
+  uint32_t num_items;
+  // Number of masks. Only used by sparse contains conditions.
+  uint32_t num_masks;
+};
+
+// Item of the "mask_buffer" of a QuickScorer sparse contains condition.
+struct QuickScorerSparseMask {
+  uint32_t leaf_mask_idx;
+  uint32_t padding;
+  QuickScorerModel::LeafMask leaf_mask;
+};
+
+// Families of compiled models. Models of the same family are stored in the
+// same sections.
+struct FlatNodeFamily {};
+struct QuantizedFamily {};
+struct QuickScorerFamily {};
+
+template <typename Model>
+struct FlatNodeModelTraits {
+  using Family = FlatNodeFamily;
+  static constexpr uint32_t kNodeSize = sizeof(typename Model::NodeType);
+};
+
+struct QuantizedModelTraits {
+  using Family = QuantizedFamily;
+  static constexpr uint32_t kNodeSize = sizeof(QuantizedNode);
+};
+
+struct QuickScorerModelTraits {
+  using Family = QuickScorerFamily;
+  static constexpr uint32_t kNodeSize = sizeof(QuickScorerModel::LeafMask);
+};
+
+// Type and family of the compiled models stored in engine files.
+template <typename Model>
+struct ModelTypeTraits;
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesBinaryClassification>
+    : FlatNodeModelTraits<GradientBoostedTreesBinaryClassification> {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesBinaryClassification;
+};
+
+template <>
+struct ModelTypeTraits<
+    GenericGradientBoostedTreesBinaryClassification<uint32_t>>
+    : FlatNodeModelTraits<
+          GenericGradientBoostedTreesBinaryClassification<uint32_t>> {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesBinaryClassificationManyNodes;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesMulticlassClassification>
+    : FlatNodeModelTraits<GradientBoostedTreesMulticlassClassification> {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesMulticlassClassification;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRegression>
+    : FlatNodeModelTraits<GradientBoostedTreesRegression> {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRegression;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRanking>
+    : FlatNodeModelTraits<GradientBoostedTreesRanking> {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRanking;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesBinaryClassificationQuantized>
+    : QuantizedModelTraits {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesBinaryClassificationQuantized;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesMulticlassClassificationQuantized>
+    : QuantizedModelTraits {
+  static constexpr EngineFileModelType kType = EngineFileModelType::
+      kGradientBoostedTreesMulticlassClassificationQuantized;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRegressionQuantized>
+    : QuantizedModelTraits {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRegressionQuantized;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRankingQuantized>
+    : QuantizedModelTraits {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRankingQuantized;
+};
+
+template <>
+struct ModelTypeTraits<
+    GradientBoostedTreesBinaryClassificationQuickScorerExtended>
+    : QuickScorerModelTraits {
+  static constexpr EngineFileModelType kType = EngineFileModelType::
+      kGradientBoostedTreesBinaryClassificationQuickScorer;
+};
+
+template <>
+struct ModelTypeTraits<
+    GradientBoostedTreesMulticlassClassificationQuickScorerExtended>
+    : QuickScorerModelTraits {
+  static constexpr EngineFileModelType kType = EngineFileModelType::
+      kGradientBoostedTreesMulticlassClassificationQuickScorer;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRegressionQuickScorerExtended>
+    : QuickScorerModelTraits {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRegressionQuickScorer;
+};
+
+template <>
+struct ModelTypeTraits<GradientBoostedTreesRankingQuickScorerExtended>
+    : QuickScorerModelTraits {
+  static constexpr EngineFileModelType kType =
+      EngineFileModelType::kGradientBoostedTreesRankingQuickScorer;
+};
+
+absl::Status CorruptedEngineFileError(const absl::string_view reason) {
+  return absl::InvalidArgumentError(
+      absl::StrCat("Corrupted engine file: ", reason, "."));
+}
+
+// Accumulates the content of the sections, and writes the engine file.
+class EngineFileWriter {
+ public:
+  // Sets the content of a section. "values" should outlive the writer.
+  template <typename T>
+  void Set(const Section section, const absl::Span<const T> values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Sections are written as raw bytes.");
+    contents_[section] =
+        absl::string_view(reinterpret_cast<const char*>(values.data()),
+                          values.size() * sizeof(T));
+  }
+
+  // Sets the content of a section owned by the writer.
+  void SetOwned(const Section section, std::string content) {
+    owned_contents_[section] = std::move(content);
+    contents_[section] = owned_contents_[section];
+  }
+
+  template <typename T>
+  void SetOwned(const Section section, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Sections are written as raw bytes.");
+    SetOwned(section,
+             std::string(reinterpret_cast<const char*>(values.data()),
+                         values.size() * sizeof(T)));
+  }
+
+  // Writes the header and the sections one after the other. The file is never
+  // entirely materialized in memory.
+  absl::Status Write(const EngineFileModelType model_type,
+                     const uint32_t node_size,
+                     const absl::string_view path) const {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kEngineFileVersion;
+    header.byte_order_mark = kByteOrderMark;
+    header.model_type = static_cast<uint32_t>(model_type);
+    header.node_size = node_size;
+    header.num_sections = kNumSections;
+
+    uint64_t offset = sizeof(FileHeader);
+    for (int section = 0; section < kNumSections; section++) {
+      offset = AlignOffset(offset);
+      header.sections[section] = {/*.offset =*/offset,
+                                  /*.size =*/contents_[section].size()};
+      offset += contents_[section].size();
+    }
+    header.file_size = offset;
+
+    ASSIGN_OR_RETURN(auto file_handle, file::OpenOutputFile(path));
+    file::OutputFileCloser closer(std::move(file_handle));
+    RETURN_IF_ERROR(closer.stream()->Write(absl::string_view(
+        reinterpret_cast<const char*>(&header), sizeof(header))));
+    static constexpr char kPadding[kSectionAlignment] = {};
+    uint64_t written = sizeof(header);
+    for (int section = 0; section < kNumSections; section++) {
+      const auto& entry = header.sections[section];
+      if (entry.offset > written) {
+        RETURN_IF_ERROR(closer.stream()->Write(
+            absl::string_view(kPadding, entry.offset - written)));
+      }
+      if (!contents_[section].empty()) {
+        RETURN_IF_ERROR(closer.stream()->Write(contents_[section]));
+      }
+      written = entry.offset + entry.size;
+    }
+    return closer.Close();
+  }
+
+ private:
+  static uint64_t AlignOffset(const uint64_t offset) {
+    return (offset + kSectionAlignment - 1) / kSectionAlignment *
+           kSectionAlignment;
+  }
+
+  std::array<absl::string_view, kNumSections> contents_;
+  std::array<std::string, kNumSections> owned_contents_;
+};
+
+// Read-only content of an engine file. Memory-mapped if possible.
+class MappedEngineFile {
+ public:
+  static utils::StatusOr<std::shared_ptr<const MappedEngineFile>> Open(
+      const absl::string_view path) {
+    auto file = std::shared_ptr<MappedEngineFile>(new MappedEngineFile());
+#ifndef _WIN32
+    const std::string path_str(path);
+    const int fd = open(path_str.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return absl::NotFoundError(
+          absl::StrCat("Cannot open the engine file \"", path, "\""));
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+      close(fd);
+      return absl::InternalError(
+          absl::StrCat("Cannot stat the engine file \"", path, "\""));
+    }
+    const size_t size = file_stat.st_size;
+    if (size > 0) {
+      void* const data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        return absl::InternalError(
+            absl::StrCat("Cannot memory-map the engine file \"", path, "\""));
+      }
+      file->mapped_data_ = data;
+      file->content_ = absl::string_view(static_cast<const char*>(data), size);
+    }
+    // The mapping remains valid after the file is closed.
+    close(fd);
+#else
+    // Memory-mapping is not supported. The file is read in memory instead.
+    ASSIGN_OR_RETURN(file->copied_content_, file::GetContent(path));
+    file->content_ = file->copied_content_;
+#endif
+    return std::shared_ptr<const MappedEngineFile>(std::move(file));
+  }
+
+  ~MappedEngineFile() {
+#ifndef _WIN32
+    if (mapped_data_ != nullptr) {
+      munmap(mapped_data_, content_.size());
+    }
+#endif
+  }
+
+  MappedEngineFile(const MappedEngineFile&) = delete;
+  MappedEngineFile& operator=(const MappedEngineFile&) = delete;
+
+  absl::string_view content() const { return content_; }
+
+ private:
+  MappedEngineFile() = default;
+
+  absl::string_view content_;
+  void* mapped_data_ = nullptr;
+  std::string copied_content_;
+};
+
+// Validated header and sections of an engine file.
+class EngineFileReader {
+ public:
+  static utils::StatusOr<EngineFileReader> Create(
+      const absl::string_view content) {
+    EngineFileReader reader;
+    reader.content_ = content;
+    if (content.size() < sizeof(FileHeader)) {
+      return absl::InvalidArgumentError("Not an engine file: File too small.");
+    }
+    auto& header = reader.header_;
+    std::memcpy(&header, content.data(), sizeof(FileHeader));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+      return absl::InvalidArgumentError("Not an engine file: Invalid magic.");
+    }
+    if (header.byte_order_mark != kByteOrderMark) {
+      return absl::InvalidArgumentError(
+          "The engine file was created on a platform with a different byte "
+          "order. Re-create the engine file from the original model.");
+    }
+    if (header.version != kEngineFileVersion) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unsupported engine file version ", header.version,
+          ". This binary only supports the version ", kEngineFileVersion,
+          ". Re-create the engine file from the original model."));
+    }
+    if (header.num_sections != kNumSections ||
+        header.file_size != content.size()) {
+      return CorruptedEngineFileError("invalid header");
+    }
+    for (const auto& section : header.sections) {
+      if (section.offset % kSectionAlignment != 0 ||
+          section.offset > content.size() ||
+          section.size > content.size() - section.offset) {
+        return CorruptedEngineFileError("section outside of the file");
+      }
+    }
+    return reader;
+  }
+
+  const FileHeader& header() const { return header_; }
+
+  EngineFileModelType model_type() const {
+    return static_cast<EngineFileModelType>(header_.model_type);
+  }
+
+  // Content of a section interpreted as an array of values.
+  template <typename T>
+  utils::StatusOr<absl::Span<const T>> Get(const Section section) const {
+    const auto& entry = header_.sections[section];
+    if (entry.size % sizeof(T) != 0) {
+      return CorruptedEngineFileError("invalid section size");
+    }
+    return absl::MakeConstSpan(
+        reinterpret_cast<const T*>(content_.data() + entry.offset),
+        entry.size / sizeof(T));
+  }
+
+  // Content of a section containing a single value.
+  template <typename T>
+  utils::StatusOr<T> GetScalar(const Section section) const {
+    ASSIGN_OR_RETURN(const auto values, Get<T>(section));
+    if (values.size() != 1) {
+      return CorruptedEngineFileError("invalid section size");
+    }
+    return values.front();
+  }
+
+  absl::string_view GetBytes(const Section section) const {
+    const auto& entry = header_.sections[section];
+    return content_.substr(entry.offset, entry.size);
+  }
+
+ private:
+  absl::string_view content_;
+  FileHeader header_;
+};
+
+// Number of unique values of the categorical features indexed by internal
+// feature index. 0 for the non-categorical features.
+std::vector<int64_t> InternalVocabularySizes(
+    const std::vector<FeatureDef>& features,
+    const dataset::proto::DataSpecification& data_spec) {
+  std::vector<int64_t> sizes(features.size(), 0);
+  for (const auto& feature : features) {
+    if (feature.internal_idx >= 0 && feature.internal_idx < sizes.size()) {
+      sizes[feature.internal_idx] = data_spec.columns(feature.spec_idx)
+                                        .categorical()
+                                        .number_of_unique_values();
+    }
+  }
+  return sizes;
+}
+
+absl::Status CheckFeatureIdx(const int64_t feature_idx,
+                             const int64_t num_features) {
+  if (feature_idx < 0 || feature_idx >= num_features) {
+    return CorruptedEngineFileError("invalid feature index");
+  }
+  return absl::OkStatus();
+}
+
+// Checks the tree structure of flat node and quantized models: Each root
+// starts a non-empty tree ending at the next root, and the positive child of
+// each non-leaf node is in the same tree as the node. The negative child is the
+// next node, and "right_idx" is positive, so every traversal stays in its tree.
+// "check_node(node)" is called on each node.
+template <typename Node, typename CheckNode>
+absl::Status CheckTrees(const absl::Span<const int32_t> root_offsets,
+                        const absl::Span<const Node> nodes,
+                        const CheckNode& check_node) {
+  for (size_t tree_idx = 0; tree_idx < root_offsets.size(); tree_idx++) {
+    const int64_t begin = root_offsets[tree_idx];
+    const int64_t end = tree_idx + 1 < root_offsets.size()
+                            ? root_offsets[tree_idx + 1]
+                            : static_cast<int64_t>(nodes.size());
+    if (begin < 0 || begin >= end || end > nodes.size()) {
+      return CorruptedEngineFileError("invalid root offset");
+    }
+    for (int64_t node_idx = begin; node_idx < end; node_idx++) {
+      const auto& node = nodes[node_idx];
+      if (node.right_idx != 0 && node_idx + node.right_idx >= end) {
+        return CorruptedEngineFileError("child node outside of its tree");
+      }
+      RETURN_IF_ERROR(check_node(node));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Sets / reads the features of the model.
+template <typename Model>
+absl::Status SetFeatureSections(const Model& model, EngineFileWriter* writer) {
+  // Note: The features definition is re-computed from the dataspec and the
+  // input features when the engine file is loaded.
+  std::string data_spec;
+  if (!model.features().data_spec().SerializeToString(&data_spec)) {
+    return absl::InternalError("Cannot serialize the dataspec.");
+  }
+  writer->SetOwned(kDataSpec, std::move(data_spec));
+
+  std::vector<int32_t> input_features;
+  for (const auto& feature : model.features().input_features()) {
+    input_features.push_back(feature.spec_idx);
+  }
+  std::sort(input_features.begin(), input_features.end());
+  writer->SetOwned(kInputFeatures, input_features);
+  return absl::OkStatus();
+}
+
+template <typename Model>
+absl::Status ReadFeatureSections(const EngineFileReader& reader,
+                                 Model* model) {
+  dataset::proto::DataSpecification data_spec;
+  const auto serialized_data_spec = reader.GetBytes(kDataSpec);
+  if (!data_spec.ParseFromArray(serialized_data_spec.data(),
+                                serialized_data_spec.size())) {
+    return CorruptedEngineFileError("invalid dataspec");
+  }
+  ASSIGN_OR_RETURN(const auto input_features,
+                   reader.Get<int32_t>(kInputFeatures));
+  for (const int32_t spec_feature_idx : input_features) {
+    RETURN_IF_ERROR(
+        CheckFeatureIdx(spec_feature_idx, data_spec.columns_size()));
+  }
+  return model->mutable_features()->Initialize(
+      std::vector<int>(input_features.begin(), input_features.end()),
+      data_spec);
+}
+
+// Sets / reads the fields specific to each task of the flat node models.
+template <typename NodeOffsetRep>
+void SetTaskSections(
+    const GenericGradientBoostedTreesBinaryClassification<NodeOffsetRep>& model,
+    EngineFileWriter* writer) {
+  writer->Set(kInitialPredictions,
+              absl::MakeConstSpan(&model.initial_predictions, 1));
+  writer->Set(kRemainingOutputBoundsMin,
+              absl::MakeConstSpan(model.remaining_output_bounds.min));
+  writer->Set(kRemainingOutputBoundsMax,
+              absl::MakeConstSpan(model.remaining_output_bounds.max));
+}
+
+template <typename NodeOffsetRep>
+absl::Status ReadTaskSections(
+    const EngineFileReader& reader,
+    GenericGradientBoostedTreesBinaryClassification<NodeOffsetRep>* model) {
+  ASSIGN_OR_RETURN(model->initial_predictions,
+                   reader.GetScalar<float>(kInitialPredictions));
+  ASSIGN_OR_RETURN(const auto min,
+                   reader.Get<float>(kRemainingOutputBoundsMin));
+  ASSIGN_OR_RETURN(const auto max,
+                   reader.Get<float>(kRemainingOutputBoundsMax));
+  // See "PredictWithEarlyExit".
+  if (min.size() != model->root_offsets.size() + 1 ||
+      max.size() != model->root_offsets.size() + 1) {
+    return CorruptedEngineFileError("invalid remaining output bounds");
+  }
+  model->remaining_output_bounds.min.assign(min.begin(), min.end());
+  model->remaining_output_bounds.max.assign(max.begin(), max.end());
+  return absl::OkStatus();
+}
+
+void SetTaskSections(const GradientBoostedTreesMulticlassClassification& model,
+                     EngineFileWriter* writer) {
+  writer->Set(kInitialPredictions,
+              absl::MakeConstSpan(model.initial_predictions));
+}
+
+absl::Status ReadTaskSections(
+    const EngineFileReader& reader,
+    GradientBoostedTreesMulticlassClassification* model) {
+  ASSIGN_OR_RETURN(const auto initial_predictions,
+                   reader.Get<float>(kInitialPredictions));
+  if (initial_predictions.empty()) {
+    return CorruptedEngineFileError("no classes");
+  }
+  model->initial_predictions.assign(initial_predictions.begin(),
+                                    initial_predictions.end());
+  model->num_classes = initial_predictions.size();
+  return absl::OkStatus();
+}
+
+// Regression and ranking.
+template <typename Model>
+void SetTaskSections(const Model& model, EngineFileWriter* writer) {
+  writer->Set(kInitialPredictions,
+              absl::MakeConstSpan(&model.initial_predictions, 1));
+}
+
+template <typename Model>
+absl::Status ReadTaskSections(const EngineFileReader& reader, Model* model) {
+  ASSIGN_OR_RETURN(model->initial_predictions,
+                   reader.GetScalar<float>(kInitialPredictions));
+  return absl::OkStatus();
+}
+
+// Sets / reads the flat node models (see "decision_forest.h").
+//
+// Note: The label buffer is not stored. The supported models store the leaf
+// values in the nodes.
+template <typename Model>
+absl::Status SetModelSections(const Model& model, EngineFileWriter* writer,
+                              FlatNodeFamily) {
+  writer->Set(kRootOffsets, absl::MakeConstSpan(model.root_offsets.data(),
+                                                model.root_offsets.size()));
+  writer->Set(kNodes,
+              absl::MakeConstSpan(model.nodes.data(), model.nodes.size()));
+
+  std::string categorical_mask_buffer(model.categorical_mask_buffer.size(),
+                                      '\0');
+  for (size_t i = 0; i < model.categorical_mask_buffer.size(); i++) {
+    categorical_mask_buffer[i] = model.categorical_mask_buffer[i];
+  }
+  writer->SetOwned(kCategoricalMaskBuffer, std::move(categorical_mask_buffer));
+
+  writer->Set(kObliqueWeights, absl::MakeConstSpan(model.oblique_weights));
+  writer->Set(kObliqueInternalFeatureIdxs,
+              absl::MakeConstSpan(model.oblique_internal_feature_idxs));
+
+  SetTaskSections(model, writer);
+  return absl::OkStatus();
+}
+
+template <typename Model>
+absl::Status ReadModelSections(
+    const EngineFileReader& reader,
+    const std::shared_ptr<const MappedEngineFile>& file, Model* model,
+    FlatNodeFamily) {
+  using Node = typename Model::NodeType;
+  using FeatureIdx = typename Node::FeatureIdx;
+
+  // Nodes. Those are not copied.
+  ASSIGN_OR_RETURN(const auto root_offsets, reader.Get<int32_t>(kRootOffsets));
+  ASSIGN_OR_RETURN(const auto nodes, reader.Get<Node>(kNodes));
+
+  // Buffers.
+  ASSIGN_OR_RETURN(const auto categorical_mask_buffer,
+                   reader.Get<uint8_t>(kCategoricalMaskBuffer));
+  ASSIGN_OR_RETURN(const auto oblique_weights,
+                   reader.Get<float>(kObliqueWeights));
+  ASSIGN_OR_RETURN(const auto oblique_internal_feature_idxs,
+                   reader.Get<FeatureIdx>(kObliqueInternalFeatureIdxs));
+
+  const auto& features = model->features();
+  const int64_t num_fixed_length_features =
+      features.fixed_length_features().size();
+  const int64_t num_categorical_set_features =
+      features.categorical_set_features().size();
+  const auto fixed_length_vocabulary_sizes = InternalVocabularySizes(
+      features.fixed_length_features(), features.data_spec());
+  const auto categorical_set_vocabulary_sizes = InternalVocabularySizes(
+      features.categorical_set_features(), features.data_spec());
+
+  for (const FeatureIdx feature_idx : oblique_internal_feature_idxs) {
+    RETURN_IF_ERROR(CheckFeatureIdx(feature_idx, num_fixed_length_features));
+  }
+
+  // See "EvalCondition" in "decision_forest.cc".
+  const auto check_node = [&](const Node& node) -> absl::Status {
+    if (node.right_idx == 0) {
+      // The leaf value is stored in the node.
+      return absl::OkStatus();
+    }
+    switch (node.type) {
+      case Node::Type::kNumericalIsHigher:
+      case Node::Type::kCategoricalContainsMask:
+        return CheckFeatureIdx(node.feature_idx, num_fixed_length_features);
+
+      case Node::Type::kCategoricalContainsBufferOffset: {
+        RETURN_IF_ERROR(
+            CheckFeatureIdx(node.feature_idx, num_fixed_length_features));
+        const uint64_t end = static_cast<uint64_t>(
+                                 node.categorical_contains_buffer_offset) +
+                             fixed_length_vocabulary_sizes[node.feature_idx];
+        if (end > categorical_mask_buffer.size()) {
+          return CorruptedEngineFileError("invalid categorical mask offset");
+        }
+        return absl::OkStatus();
+      }
+
+      case Node::Type::kCategoricalSetContainsBufferOffset: {
+        RETURN_IF_ERROR(
+            CheckFeatureIdx(node.feature_idx, num_categorical_set_features));
+        // The missing value (-1) is stored just before the mask.
+        const uint64_t end = static_cast<uint64_t>(
+                                 node.categorical_contains_buffer_offset) +
+                             categorical_set_vocabulary_sizes[node.feature_idx];
+        if (node.categorical_contains_buffer_offset < 1 ||
+            end > categorical_mask_buffer.size()) {
+          return CorruptedEngineFileError("invalid categorical mask offset");
+        }
+        return absl::OkStatus();
+      }
+
+      case Node::Type::kNumericalObliqueProjectionIsHigher: {
+        // The projection weights are followed by the threshold.
+        const uint64_t end =
+            static_cast<uint64_t>(node.oblique_projection_offset) +
+            node.num_oblique_projections;
+        if (node.num_oblique_projections < 0 ||
+            end >= oblique_weights.size() ||
+            end > oblique_internal_feature_idxs.size()) {
+          return CorruptedEngineFileError("invalid oblique projection offset");
+        }
+        return absl::OkStatus();
+      }
+
+      default:
+        return CorruptedEngineFileError("invalid condition type");
+    }
+  };
+  RETURN_IF_ERROR(CheckTrees(root_offsets, nodes, check_node));
+
+  model->root_offsets = MappableVector<int32_t>::Reference(root_offsets);
+  model->nodes = MappableVector<Node>::Reference(nodes);
+  model->referenced_buffer = file;
+  model->categorical_mask_buffer.assign(categorical_mask_buffer.begin(),
+                                        categorical_mask_buffer.end());
+  model->oblique_weights.assign(oblique_weights.begin(), oblique_weights.end());
+  model->oblique_internal_feature_idxs.assign(
+      oblique_internal_feature_idxs.begin(),
+      oblique_internal_feature_idxs.end());
+
+  return ReadTaskSections(reader, model);
+}
+
+// Sets / reads the quantized models (see "quantized_decision_forest.h").
+template <typename Model>
+absl::Status SetModelSections(const Model& model, EngineFileWriter* writer,
+                              QuantizedFamily) {
+  writer->Set(kRootOffsets, absl::MakeConstSpan(model.root_offsets));
+  writer->Set(kNodes, absl::MakeConstSpan(model.nodes));
+  writer->Set(kLeafValues, absl::MakeConstSpan(model.leaf_values));
+  writer->Set(kThresholds, absl::MakeConstSpan(model.thresholds));
+  writer->Set(kThresholdOffsets, absl::MakeConstSpan(model.threshold_offsets));
+  if constexpr (std::is_same<
+                    Model,
+                    GradientBoostedTreesMulticlassClassificationQuantized>::
+                    value) {
+    writer->SetOwned(kNumClasses, std::vector<int32_t>{model.num_classes});
+  } else {
+    writer->Set(kInitialPredictions,
+                absl::MakeConstSpan(&model.initial_prediction, 1));
+  }
+  return absl::OkStatus();
+}
+
+template <typename Model>
+absl::Status ReadModelSections(const EngineFileReader& reader,
+                               const std::shared_ptr<const MappedEngineFile>&,
+                               Model* model, QuantizedFamily) {
+  ASSIGN_OR_RETURN(const auto root_offsets, reader.Get<int32_t>(kRootOffsets));
+  ASSIGN_OR_RETURN(const auto nodes, reader.Get<QuantizedNode>(kNodes));
+  ASSIGN_OR_RETURN(const auto leaf_values, reader.Get<float>(kLeafValues));
+  ASSIGN_OR_RETURN(const auto thresholds, reader.Get<float>(kThresholds));
+  ASSIGN_OR_RETURN(const auto threshold_offsets,
+                   reader.Get<int32_t>(kThresholdOffsets));
+
+  // See "QuantizeExample" in "quantized_decision_forest.cc".
+  const int64_t num_features =
+      model->features().fixed_length_features().size();
+  if (threshold_offsets.size() != num_features + 1 ||
+      threshold_offsets.front() != 0 ||
+      threshold_offsets.back() != thresholds.size() ||
+      !std::is_sorted(threshold_offsets.begin(), threshold_offsets.end())) {
+    return CorruptedEngineFileError("invalid threshold offsets");
+  }
+
+  const auto check_node = [&](const QuantizedNode& node) -> absl::Status {
+    if (node.right_idx == 0) {
+      const uint32_t leaf_idx = static_cast<uint32_t>(node.feature_idx) |
+                                (static_cast<uint32_t>(node.threshold) << 16);
+      if (leaf_idx >= leaf_values.size()) {
+        return CorruptedEngineFileError("invalid leaf value index");
+      }
+      return absl::OkStatus();
+    }
+    // "feature_idx" indexes the bins and their negations.
+    return CheckFeatureIdx(node.feature_idx, 2 * num_features);
+  };
+  RETURN_IF_ERROR(CheckTrees(root_offsets, nodes, check_node));
+
+  model->root_offsets.assign(root_offsets.begin(), root_offsets.end());
+  model->nodes.assign(nodes.begin(), nodes.end());
+  model->leaf_values.assign(leaf_values.begin(), leaf_values.end());
+  model->thresholds.assign(thresholds.begin(), thresholds.end());
+  model->threshold_offsets.assign(threshold_offsets.begin(),
+                                  threshold_offsets.end());
+
+  if constexpr (std::is_same<
+                    Model,
+                    GradientBoostedTreesMulticlassClassificationQuantized>::
+                    value) {
+    ASSIGN_OR_RETURN(model->num_classes,
+                     reader.GetScalar<int32_t>(kNumClasses));
+    if (model->num_classes < 1) {
+      return CorruptedEngineFileError("no classes");
+    }
+  } else {
+    ASSIGN_OR_RETURN(model->initial_prediction,
+                     reader.GetScalar<float>(kInitialPredictions));
+  }
+  return absl::OkStatus();
+}
+
+// Sets / reads the QuickScorer models (see "quick_scorer_extended.h").
+//
+// The conditions are stored in flat arrays. The leaf masks themselves are not
+// validated: Like the thresholds, they are values and not offsets.
+template <typename Model>
+absl::Status SetModelSections(const Model& model, EngineFileWriter* writer,
+                              QuickScorerFamily) {
+  writer->SetOwned(kQuickScorerShape,
+                   std::vector<QuickScorerShape>{
+                       {/*.num_trees =*/model.num_trees,
+                        /*.max_num_leafs_per_tree =*/
+                        model.max_num_leafs_per_tree,
+                        /*.num_leaf_masks_per_tree =*/
+                        model.num_leaf_masks_per_tree,
+                        /*.num_output_dimensions =*/
+                        model.num_output_dimensions}});
+  writer->Set(kLeafValues, absl::MakeConstSpan(model.leaf_values));
+  writer->Set(kInitialPredictions,
+              absl::MakeConstSpan(&model.initial_prediction, 1));
+
+  std::vector<QuickScorerCondition> conditions;
+  std::vector<QuickScorerModel::IsHigherConditionItem> is_higher_items;
+  for (const auto& condition : model.is_higher_conditions) {
+    conditions.push_back({/*.internal_feature_idx =*/condition
+                              .internal_feature_idx,
+                          /*.num_items =*/
+                          static_cast<uint32_t>(condition.items.size()),
+                          /*.num_masks =*/0});
+    is_higher_items.insert(is_higher_items.end(), condition.items.begin(),
+                           condition.items.end());
+  }
+  writer->SetOwned(kIsHigherConditions, conditions);
+  writer->SetOwned(kIsHigherItems, is_higher_items);
+
+  conditions.clear();
+  std::vector<QuickScorerModel::LeafMask> contains_items;
+  for (const auto& condition : model.categorical_contains_conditions) {
+    conditions.push_back({/*.internal_feature_idx =*/condition
+                              .internal_feature_idx,
+                          /*.num_items =*/
+                          static_cast<uint32_t>(condition.items.size()),
+                          /*.num_masks =*/0});
+    contains_items.insert(contains_items.end(), condition.items.begin(),
+                          condition.items.end());
+  }
+  writer->SetOwned(kContainsConditions, conditions);
+  writer->SetOwned(kContainsItems, contains_items);
+
+  conditions.clear();
+  std::vector<int32_t> sparse_ranges;
+  std::vector<QuickScorerSparseMask> sparse_masks;
+  for (const auto& condition : model.categoricalset_contains_conditions) {
+    conditions.push_back(
+        {/*.internal_feature_idx =*/condition.internal_feature_idx,
+         /*.num_items =*/
+         static_cast<uint32_t>(condition.value_to_mask_range.size()),
+         /*.num_masks =*/static_cast<uint32_t>(condition.mask_buffer.size())});
+    for (const auto& range : condition.value_to_mask_range) {
+      sparse_ranges.push_back(range.first);
+      sparse_ranges.push_back(range.second);
+    }
+    for (const auto& mask : condition.mask_buffer) {
+      sparse_masks.push_back({/*.leaf_mask_idx =*/mask.first,
+                              /*.padding =*/0,
+                              /*.leaf_mask =*/mask.second});
+    }
+  }
+  writer->SetOwned(kSparseContainsConditions, conditions);
+  writer->SetOwned(kSparseContainsRanges, sparse_ranges);
+  writer->SetOwned(kSparseContainsMasks, sparse_masks);
+  return absl::OkStatus();
+}
+
+template <typename Model>
+absl::Status ReadModelSections(const EngineFileReader& reader,
+                               const std::shared_ptr<const MappedEngineFile>&,
+                               Model* model, QuickScorerFamily) {
+  ASSIGN_OR_RETURN(const auto shape,
+                   reader.GetScalar<QuickScorerShape>(kQuickScorerShape));
+  if (shape.num_trees < 0 || shape.num_leaf_masks_per_tree < 1 ||
+      shape.num_leaf_masks_per_tree >
+          QuickScorerModel::kMaxLeafMasksPerTree ||
+      shape.max_num_leafs_per_tree < 1 ||
+      shape.max_num_leafs_per_tree >
+          shape.num_leaf_masks_per_tree *
+              QuickScorerModel::kMaxLeafsPerLeafMask ||
+      static_cast<int64_t>(shape.num_trees) * shape.num_leaf_masks_per_tree >
+          std::numeric_limits<int32_t>::max() ||
+      shape.num_output_dimensions < 1) {
+    return CorruptedEngineFileError("invalid model shape");
+  }
+  model->num_trees = shape.num_trees;
+  model->max_num_leafs_per_tree = shape.max_num_leafs_per_tree;
+  model->num_leaf_masks_per_tree = shape.num_leaf_masks_per_tree;
+  model->num_output_dimensions = shape.num_output_dimensions;
+  using MulticlassModel =
+      GradientBoostedTreesMulticlassClassificationQuickScorerExtended;
+  if constexpr (std::is_same<Model, MulticlassModel>::value) {
+    model->num_classes = shape.num_output_dimensions;
+  }
+  model->simd_instruction_set = BestSimdInstructionSet();
+
+  // See "TreeLeafValueStride" in "quick_scorer_extended.cc".
+  ASSIGN_OR_RETURN(const auto leaf_values, reader.Get<float>(kLeafValues));
+  const int64_t num_values_per_leaf =
+      Model::kMultiDimensionalLeaves ? shape.num_output_dimensions : 1;
+  if (leaf_values.size() != static_cast<int64_t>(shape.num_trees) *
+                                shape.max_num_leafs_per_tree *
+                                num_values_per_leaf) {
+    return CorruptedEngineFileError("invalid number of leaf values");
+  }
+  model->leaf_values.assign(leaf_values.begin(), leaf_values.end());
+  ASSIGN_OR_RETURN(model->initial_prediction,
+                   reader.GetScalar<float>(kInitialPredictions));
+
+  const auto& features = model->features();
+  const int64_t num_fixed_length_features =
+      features.fixed_length_features().size();
+  const int64_t num_categorical_set_features =
+      features.categorical_set_features().size();
+  const auto fixed_length_vocabulary_sizes = InternalVocabularySizes(
+      features.fixed_length_features(), features.data_spec());
+  const auto categorical_set_vocabulary_sizes = InternalVocabularySizes(
+      features.categorical_set_features(), features.data_spec());
+  const int64_t num_leaf_masks = model->num_leaf_masks();
+  const auto check_leaf_mask_idx = [&](const int64_t leaf_mask_idx) {
+    if (leaf_mask_idx >= num_leaf_masks) {
+      return CorruptedEngineFileError("invalid leaf mask index");
+    }
+    return absl::OkStatus();
+  };
+
+  // Returns the next "num_items" items of "items", and advances "next_item".
+  const auto next_items = [](const auto items, const uint64_t num_items,
+                             uint64_t* next_item)
+      -> utils::StatusOr<std::remove_const_t<decltype(items)>> {
+    if (num_items > items.size() - *next_item) {
+      return CorruptedEngineFileError("invalid number of items");
+    }
+    const auto sub_items = items.subspan(*next_item, num_items);
+    *next_item += num_items;
+    return sub_items;
+  };
+
+  // "Is higher" conditions.
+  ASSIGN_OR_RETURN(const auto is_higher_conditions,
+                   reader.Get<QuickScorerCondition>(kIsHigherConditions));
+  ASSIGN_OR_RETURN(
+      const auto is_higher_items,
+      reader.Get<QuickScorerModel::IsHigherConditionItem>(kIsHigherItems));
+  uint64_t next_is_higher_item = 0;
+  model->is_higher_conditions.clear();
+  for (const auto& src : is_higher_conditions) {
+    RETURN_IF_ERROR(
+        CheckFeatureIdx(src.internal_feature_idx, num_fixed_length_features));
+    ASSIGN_OR_RETURN(const auto items, next_items(is_higher_items,
+                                                  src.num_items,
+                                                  &next_is_higher_item));
+    for (const auto& item : items) {
+      RETURN_IF_ERROR(check_leaf_mask_idx(item.leaf_mask_idx));
+    }
+    model->is_higher_conditions.push_back(
+        {/*.internal_feature_idx =*/src.internal_feature_idx,
+         /*.items =*/{items.begin(), items.end()}});
+  }
+
+  // Dense "contains" conditions. See "InitializeAccumulator" in
+  // "quick_scorer_extended.cc".
+  ASSIGN_OR_RETURN(const auto contains_conditions,
+                   reader.Get<QuickScorerCondition>(kContainsConditions));
+  ASSIGN_OR_RETURN(const auto contains_items,
+                   reader.Get<QuickScorerModel::LeafMask>(kContainsItems));
+  uint64_t next_contains_item = 0;
+  model->categorical_contains_conditions.clear();
+  for (const auto& src : contains_conditions) {
+    RETURN_IF_ERROR(
+        CheckFeatureIdx(src.internal_feature_idx, num_fixed_length_features));
+    if (src.num_items !=
+        num_leaf_masks *
+            fixed_length_vocabulary_sizes[src.internal_feature_idx]) {
+      return CorruptedEngineFileError("invalid number of items");
+    }
+    ASSIGN_OR_RETURN(const auto items, next_items(contains_items, src.num_items,
+                                                  &next_contains_item));
+    model->categorical_contains_conditions.push_back(
+        {/*.internal_feature_idx =*/src.internal_feature_idx,
+         /*.items =*/{items.begin(), items.end()}});
+  }
+
+  // Sparse "contains" conditions. The value "i" is stored at index "i+1" such
+  // that the missing value (-1) is at index 0.
+  ASSIGN_OR_RETURN(const auto sparse_conditions,
+                   reader.Get<QuickScorerCondition>(kSparseContainsConditions));
+  ASSIGN_OR_RETURN(const auto sparse_ranges,
+                   reader.Get<int32_t>(kSparseContainsRanges));
+  ASSIGN_OR_RETURN(const auto sparse_masks,
+                   reader.Get<QuickScorerSparseMask>(kSparseContainsMasks));
+  uint64_t next_sparse_range = 0;
+  uint64_t next_sparse_mask = 0;
+  model->categoricalset_contains_conditions.clear();
+  for (const auto& src : sparse_conditions) {
+    RETURN_IF_ERROR(CheckFeatureIdx(src.internal_feature_idx,
+                                    num_categorical_set_features));
+    if (src.num_items !=
+        categorical_set_vocabulary_sizes[src.internal_feature_idx] + 1) {
+      return CorruptedEngineFileError("invalid number of items");
+    }
+    ASSIGN_OR_RETURN(const auto ranges,
+                     next_items(sparse_ranges, 2 * uint64_t{src.num_items},
+                                &next_sparse_range));
+    ASSIGN_OR_RETURN(const auto masks, next_items(sparse_masks, src.num_masks,
+                                                  &next_sparse_mask));
+    QuickScorerModel::SparseContainsConditions condition;
+    condition.internal_feature_idx = src.internal_feature_idx;
+    for (size_t range_idx = 0; range_idx < src.num_items; range_idx++) {
+      const int32_t begin = ranges[2 * range_idx];
+      const int32_t end = ranges[2 * range_idx + 1];
+      if (begin < 0 || begin > end || end > masks.size()) {
+        return CorruptedEngineFileError("invalid mask range");
+      }
+      condition.value_to_mask_range.emplace_back(begin, end);
+    }
+    for (const auto& mask : masks) {
+      RETURN_IF_ERROR(check_leaf_mask_idx(mask.leaf_mask_idx));
+      condition.mask_buffer.emplace_back(mask.leaf_mask_idx, mask.leaf_mask);
+    }
+    model->categoricalset_contains_conditions.push_back(std::move(condition));
+  }
+
+  if (next_is_higher_item != is_higher_items.size() ||
+      next_contains_item != contains_items.size() ||
+      next_sparse_range != sparse_ranges.size() ||
+      next_sparse_mask != sparse_masks.size()) {
+    return CorruptedEngineFileError("invalid number of items");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+template <typename Model>
+absl::Status SaveEngineFile(const Model& model, const absl::string_view path) {
+  using Traits = ModelTypeTraits<Model>;
+  EngineFileWriter writer;
+  RETURN_IF_ERROR(SetFeatureSections(model, &writer));
+  RETURN_IF_ERROR(
+      SetModelSections(model, &writer, typename Traits::Family()));
+  return writer.Write(Traits::kType, Traits::kNodeSize, path);
+}
+
+template <typename Model>
+absl::Status LoadEngineFile(const absl::string_view path, Model* model) {
+  using Traits = ModelTypeTraits<Model>;
+  ASSIGN_OR_RETURN(const auto file, MappedEngineFile::Open(path));
+  ASSIGN_OR_RETURN(const auto reader,
+                   EngineFileReader::Create(file->content()));
+  if (reader.model_type() != Traits::kType) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "The engine file contains a model of type ", reader.header().model_type,
+        " while a model of type ", static_cast<uint32_t>(Traits::kType),
+        " was expected."));
+  }
+  if (reader.header().node_size != Traits::kNodeSize) {
+    return absl::InvalidArgumentError(
+        "The engine file was created with a different node layout. Re-create "
+        "the engine file from the original model.");
+  }
+  RETURN_IF_ERROR(ReadFeatureSections(reader, model));
+  return ReadModelSections(reader, file, model, typename Traits::Family());
+}
+
+utils::StatusOr<EngineFileModelType> ReadEngineFileModelType(
+    const absl::string_view path) {
+  ASSIGN_OR_RETURN(const auto file, MappedEngineFile::Open(path));
+  ASSIGN_OR_RETURN(const auto reader,
+                   EngineFileReader::Create(file->content()));
+  return reader.model_type();
+}
+
+#define INSTANTIATE_ENGINE_FILE(MODEL)                                     \
+  template absl::Status SaveEngineFile<MODEL>(const MODEL& model,          \
+                                              absl::string_view path);     \
+  template absl::Status LoadEngineFile<MODEL>(absl::string_view path,      \
+                                              MODEL* model);
+
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesBinaryClassification);
+INSTANTIATE_ENGINE_FILE(
+    GenericGradientBoostedTreesBinaryClassification<uint32_t>);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesMulticlassClassification);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRegression);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRanking);
+
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesBinaryClassificationQuantized);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesMulticlassClassificationQuantized);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRegressionQuantized);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRankingQuantized);
+
+INSTANTIATE_ENGINE_FILE(
+    GradientBoostedTreesBinaryClassificationQuickScorerExtended);
+INSTANTIATE_ENGINE_FILE(
+    GradientBoostedTreesMulticlassClassificationQuickScorerExtended);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRegressionQuickScorerExtended);
+INSTANTIATE_ENGINE_FILE(GradientBoostedTreesRankingQuickScorerExtended);
+
+#undef INSTANTIATE_ENGINE_FILE
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
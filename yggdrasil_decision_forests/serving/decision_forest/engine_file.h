@@ -0,0 +1,102 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Engine files are serialized compiled models that can be loaded without
+// parsing and compiling the original model. Flat node (see
+// "decision_forest.h"), quantized (see "quantized_decision_forest.h") and
+// QuickScorer (see "quick_scorer_extended.h") GBT models are supported.
+//
+// On POSIX systems, engine files are memory-mapped read-only: The nodes and
+// root offsets of the loaded flat node models are read directly from the
+// mapping (i.e. they are not copied), loading is almost instantaneous, and the
+// memory is shared by all the processes serving the same file. The other
+// models are copied from the mapping. Engine files should be on a local file
+// system.
+//
+// Loading an engine file checks all the indices and offsets it contains.
+//
+// An engine file is only readable by a binary with the same engine file format
+// version ("kEngineFileVersion"), byte order and node layout as the binary
+// that created it. Otherwise, the engine file should be re-created from the
+// original model.
+//
+// Usage example:
+//
+//   GradientBoostedTreesBinaryClassification engine;
+//   RETURN_IF_ERROR(GenericToSpecializedModel(gbt_model, &engine));
+//   RETURN_IF_ERROR(SaveEngineFile(engine, "/tmp/engine"));
+//
+//   // Possibly in another process.
+//   GradientBoostedTreesBinaryClassification loaded_engine;
+//   RETURN_IF_ERROR(LoadEngineFile("/tmp/engine", &loaded_engine));
+//
+// Engine files can also be created and loaded through the generic engine API
+// (see "FastEngine::SaveToFile" and "FastEngineFactory::CreateEngineFromFile").
+//
+#ifndef YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_ENGINE_FILE_H_
+#define YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_ENGINE_FILE_H_
+
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/utils/compatibility.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+
+// Version of the engine file format. Should be incremented for any change of
+// the format.
+constexpr uint32_t kEngineFileVersion = 3;
+
+// Type of the compiled model stored in an engine file. The values are stored
+// in the engine files and should not be changed.
+enum class EngineFileModelType : uint32_t {
+  kGradientBoostedTreesBinaryClassification = 1,
+  kGradientBoostedTreesBinaryClassificationManyNodes = 2,
+  kGradientBoostedTreesMulticlassClassification = 3,
+  kGradientBoostedTreesRegression = 4,
+  kGradientBoostedTreesRanking = 5,
+  kGradientBoostedTreesBinaryClassificationQuantized = 6,
+  kGradientBoostedTreesMulticlassClassificationQuantized = 7,
+  kGradientBoostedTreesRegressionQuantized = 8,
+  kGradientBoostedTreesRankingQuantized = 9,
+  kGradientBoostedTreesBinaryClassificationQuickScorer = 10,
+  kGradientBoostedTreesMulticlassClassificationQuickScorer = 11,
+  kGradientBoostedTreesRegressionQuickScorer = 12,
+  kGradientBoostedTreesRankingQuickScorer = 13,
+};
+
+// Saves a compiled model into an engine file.
+template <typename Model>
+absl::Status SaveEngineFile(const Model& model, absl::string_view path);
+
+// Loads a compiled model from an engine file. "model" keeps the engine file
+// memory-mapped until it is destroyed.
+template <typename Model>
+absl::Status LoadEngineFile(absl::string_view path, Model* model);
+
+// Reads the type of the compiled model stored in an engine file. Fails if the
+// file is not a valid engine file.
+utils::StatusOr<EngineFileModelType> ReadEngineFileModelType(
+    absl::string_view path);
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
+
+#endif  // YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_ENGINE_FILE_H_
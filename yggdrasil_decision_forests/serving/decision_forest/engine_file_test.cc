@@ -0,0 +1,318 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/decision_forest/engine_file.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/fast_engine_factory.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/quantized_decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/quick_scorer_extended.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/register_engines.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/test.h"
+#include "yggdrasil_decision_forests/utils/test_utils.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using model::gradient_boosted_trees::GradientBoostedTreesModel;
+using testing::HasSubstr;
+
+std::string TestDataDir() {
+  return file::JoinPath(test::DataRootDirectory(),
+                        "yggdrasil_decision_forests/test_data");
+}
+
+dataset::VerticalDataset LoadDataset(
+    const dataset::proto::DataSpecification& data_spec,
+    const absl::string_view dataset_filename) {
+  const std::string ds_typed_path = absl::StrCat(
+      "csv:", file::JoinPath(TestDataDir(), "dataset", dataset_filename));
+  dataset::VerticalDataset dataset;
+  CHECK_OK(LoadVerticalDataset(ds_typed_path, data_spec, &dataset));
+  return dataset;
+}
+
+std::unique_ptr<model::AbstractModel> LoadModel(
+    const absl::string_view model_dirname) {
+  const std::string model_dir =
+      file::JoinPath(TestDataDir(), "model", model_dirname);
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(model_dir, &model));
+  return model;
+}
+
+TEST(EngineFile, SaveAndLoad) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv");
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+
+  GradientBoostedTreesBinaryClassification engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "adult_binary_class_gbdt_engine");
+  CHECK_OK(SaveEngineFile(engine, path));
+  EXPECT_EQ(ReadEngineFileModelType(path).value(),
+            EngineFileModelType::kGradientBoostedTreesBinaryClassification);
+
+  GradientBoostedTreesBinaryClassification loaded_engine;
+  CHECK_OK(LoadEngineFile(path, &loaded_engine));
+#ifndef _WIN32
+  // The nodes are read from the memory-mapped file.
+  EXPECT_TRUE(loaded_engine.nodes.is_reference());
+  EXPECT_TRUE(loaded_engine.root_offsets.is_reference());
+#endif
+  EXPECT_EQ(loaded_engine.nodes.size(), engine.nodes.size());
+  EXPECT_EQ(loaded_engine.initial_predictions, engine.initial_predictions);
+  EXPECT_EQ(loaded_engine.remaining_output_bounds.min,
+            engine.remaining_output_bounds.min);
+  EXPECT_EQ(loaded_engine.remaining_output_bounds.max,
+            engine.remaining_output_bounds.max);
+
+  utils::ExpectEqualPredictionsTemplate<decltype(loaded_engine), Predict>(
+      dataset, *model, loaded_engine);
+}
+
+TEST(EngineFile, ModelTypeMismatch) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+
+  GradientBoostedTreesBinaryClassification engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "model_type_mismatch_engine");
+  CHECK_OK(SaveEngineFile(engine, path));
+
+  GradientBoostedTreesRegression loaded_engine;
+  EXPECT_THAT(LoadEngineFile(path, &loaded_engine).message(),
+              HasSubstr("type"));
+}
+
+TEST(EngineFile, InvalidFile) {
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "invalid_engine");
+  CHECK_OK(file::SetContent(path, std::string(1000, 'a')));
+  EXPECT_THAT(ReadEngineFileModelType(path).status().message(),
+              HasSubstr("Not an engine file"));
+}
+
+TEST(EngineFile, UnsupportedVersion) {
+  const auto model = LoadModel("abalone_regression_gbdt");
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+
+  GradientBoostedTreesRegression engine;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &engine));
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "unsupported_version_engine");
+  CHECK_OK(SaveEngineFile(engine, path));
+
+  // The version is stored just after the 8 bytes magic.
+  auto content = file::GetContent(path).value();
+  content[8] = static_cast<char>(kEngineFileVersion + 1);
+  CHECK_OK(file::SetContent(path, content));
+
+  GradientBoostedTreesRegression loaded_engine;
+  EXPECT_THAT(LoadEngineFile(path, &loaded_engine).message(),
+              HasSubstr("Unsupported engine file version"));
+}
+
+template <typename Model>
+void CompileModel(const absl::string_view model_dirname, Model* engine) {
+  const auto model = LoadModel(model_dirname);
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, engine));
+}
+
+// Saves "engine" and checks that loading it fails.
+template <typename Model>
+void ExpectCorruptedEngineFile(const Model& engine,
+                               const absl::string_view name) {
+  const std::string path = file::JoinPath(test::TmpDirectory(), name);
+  CHECK_OK(SaveEngineFile(engine, path));
+  Model loaded_engine;
+  EXPECT_THAT(LoadEngineFile(path, &loaded_engine).message(),
+              HasSubstr("Corrupted engine file"));
+}
+
+TEST(EngineFile, CorruptedFlatNodeModel) {
+  {
+    GradientBoostedTreesBinaryClassification engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    engine.nodes[engine.root_offsets[0]].right_idx =
+        engine.root_offsets[1] - engine.root_offsets[0];
+    ExpectCorruptedEngineFile(engine, "corrupted_right_idx_engine");
+  }
+  {
+    GradientBoostedTreesBinaryClassification engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    engine.nodes[engine.root_offsets[0]].feature_idx =
+        engine.features().fixed_length_features().size();
+    ExpectCorruptedEngineFile(engine, "corrupted_feature_idx_engine");
+  }
+  {
+    GradientBoostedTreesBinaryClassification engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    using Node = GradientBoostedTreesBinaryClassification::NodeType;
+    const auto node = std::find_if(
+        engine.nodes.begin(), engine.nodes.end(), [](const Node& node) {
+          return node.right_idx != 0 &&
+                 node.type == Node::Type::kCategoricalContainsBufferOffset;
+        });
+    ASSERT_NE(node, engine.nodes.end());
+    engine.nodes[node - engine.nodes.begin()]
+        .categorical_contains_buffer_offset =
+        engine.categorical_mask_buffer.size();
+    ExpectCorruptedEngineFile(engine, "corrupted_mask_offset_engine");
+  }
+  {
+    GradientBoostedTreesBinaryClassification engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    engine.remaining_output_bounds.max.pop_back();
+    ExpectCorruptedEngineFile(engine, "corrupted_bounds_engine");
+  }
+}
+
+TEST(EngineFile, CorruptedQuantizedModel) {
+  {
+    GradientBoostedTreesBinaryClassificationQuantized engine;
+    CompileModel("adult_binary_class_gbdt_only_num", &engine);
+    engine.nodes[engine.root_offsets[0]].feature_idx =
+        2 * engine.features().fixed_length_features().size();
+    ExpectCorruptedEngineFile(engine, "corrupted_quantized_feature_engine");
+  }
+  {
+    GradientBoostedTreesBinaryClassificationQuantized engine;
+    CompileModel("adult_binary_class_gbdt_only_num", &engine);
+    engine.leaf_values.pop_back();
+    ExpectCorruptedEngineFile(engine, "corrupted_quantized_leaf_engine");
+  }
+}
+
+TEST(EngineFile, CorruptedQuickScorerModel) {
+  {
+    GradientBoostedTreesBinaryClassificationQuickScorerExtended engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    engine.is_higher_conditions.front().items.front().leaf_mask_idx =
+        engine.num_leaf_masks();
+    ExpectCorruptedEngineFile(engine, "corrupted_leaf_mask_idx_engine");
+  }
+  {
+    GradientBoostedTreesBinaryClassificationQuickScorerExtended engine;
+    CompileModel("adult_binary_class_gbdt", &engine);
+    engine.categorical_contains_conditions.front().items.pop_back();
+    ExpectCorruptedEngineFile(engine, "corrupted_contains_engine");
+  }
+}
+
+struct FastEngineTestParams {
+  const std::string model;
+  const std::string dataset;
+  const std::string engine;
+};
+
+using FastEngineTest = testing::TestWithParam<FastEngineTestParams>;
+
+// Engines loaded from a file returns the same predictions as the original
+// model.
+TEST_P(FastEngineTest, CreateEngineFromFile) {
+  const auto model = LoadModel(GetParam().model);
+  const auto dataset = LoadDataset(model->data_spec(), GetParam().dataset);
+
+  const auto factory =
+      model::FastEngineFactoryRegisterer::Create(GetParam().engine).value();
+  if (!factory->IsCompatible(model.get())) {
+    GTEST_SKIP() << "The engine is not compatible with the model.";
+  }
+  const std::string path = file::JoinPath(
+      test::TmpDirectory(),
+      absl::StrCat(GetParam().model, "_", GetParam().engine, "_engine"));
+  {
+    const auto engine = factory->CreateEngine(model.get()).value();
+    CHECK_OK(engine->SaveToFile(path));
+  }
+
+  const auto loaded_engine = factory->CreateEngineFromFile(path).value();
+  utils::ExpectEqualPredictions(dataset, *model, *loaded_engine);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    FastEngineTests, FastEngineTest,
+    testing::ValuesIn<FastEngineTestParams>({
+        {"abalone_regression_gbdt", "abalone.csv",
+         gradient_boosted_trees::kGeneric},
+        {"abalone_regression_gbdt", "abalone.csv",
+         gradient_boosted_trees::kQuickScorerExtended},
+        {"adult_binary_class_gbdt", "adult_test.csv",
+         gradient_boosted_trees::kGeneric},
+        {"adult_binary_class_gbdt", "adult_test.csv",
+         gradient_boosted_trees::kQuickScorerExtended},
+        {"adult_binary_class_gbdt_only_num", "adult_test.csv",
+         gradient_boosted_trees::kQuantized},
+        {"iris_multi_class_gbdt", "iris.csv", gradient_boosted_trees::kGeneric},
+        {"iris_multi_class_gbdt", "iris.csv",
+         gradient_boosted_trees::kQuantized},
+        {"iris_multi_class_gbdt", "iris.csv",
+         gradient_boosted_trees::kQuickScorerExtended},
+        {"synthetic_ranking_gbdt", "synthetic_ranking_test.csv",
+         gradient_boosted_trees::kGeneric},
+        {"synthetic_ranking_gbdt", "synthetic_ranking_test.csv",
+         gradient_boosted_trees::kQuickScorerExtended},
+    }),
+    [](const testing::TestParamInfo<FastEngineTest::ParamType>& info) {
+      return absl::StrCat(info.param.model, "_", info.param.engine);
+    });
+
+// The engine selected by default can be saved.
+TEST(EngineFile, DefaultEngine) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  const auto engine = model->BuildFastEngine().value();
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "default_engine");
+  EXPECT_OK(engine->SaveToFile(path));
+}
+
+TEST(EngineFile, NonSupportedEngine) {
+  const auto model = LoadModel("abalone_regression_gbdt");
+  const auto factory =
+      model::FastEngineFactoryRegisterer::Create(
+          serving::gradient_boosted_trees::kOptPred)
+          .value();
+  const auto engine = factory->CreateEngine(model.get()).value();
+  const std::string path =
+      file::JoinPath(test::TmpDirectory(), "non_supported_engine");
+  EXPECT_EQ(engine->SaveToFile(path).code(), absl::StatusCode::kUnimplemented);
+  EXPECT_EQ(factory->CreateEngineFromFile(path).status().code(),
+            absl::StatusCode::kUnimplemented);
+}
+
+}  // namespace
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
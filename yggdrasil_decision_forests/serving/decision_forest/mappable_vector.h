@@ -0,0 +1,153 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Array of values that either owns its content (like a std::vector) or
+// references an external read-only buffer without copy (e.g. a memory-mapped
+// engine file; see "engine_file.h").
+//
+#ifndef YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MAPPABLE_VECTOR_H_
+#define YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MAPPABLE_VECTOR_H_
+
+#include <cstddef>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+
+// Array of trivially copyable values with the read-only interface of a
+// std::vector.
+//
+// A referencing array (see "Reference") does not own its values: The caller is
+// responsible for keeping the referenced buffer alive. Reading a referencing
+// array is as fast as reading an owning array. Modifying a referencing array
+// first copies the referenced values (i.e. the referenced buffer is never
+// modified).
+template <typename T>
+class MappableVector {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MappableVector only supports trivially copyable values.");
+
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using const_iterator = const T*;
+  using iterator = const T*;
+
+  MappableVector() = default;
+  MappableVector(std::initializer_list<T> values) : owned_(values) {}
+
+  // Creates an array referencing "values".
+  static MappableVector Reference(absl::Span<const T> values) {
+    MappableVector array;
+    array.external_ = values.data();
+    array.external_size_ = values.size();
+    return array;
+  }
+
+  // True if the array references an external buffer.
+  bool is_reference() const { return external_ != nullptr; }
+
+  size_t size() const {
+    return external_ != nullptr ? external_size_ : owned_.size();
+  }
+  bool empty() const { return size() == 0; }
+
+  const T* data() const {
+    return external_ != nullptr ? external_ : owned_.data();
+  }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size(); }
+
+  const T& operator[](size_t index) const { return data()[index]; }
+  T& operator[](size_t index) {
+    Materialize();
+    return owned_[index];
+  }
+
+  const T& back() const { return data()[size() - 1]; }
+  T& back() {
+    Materialize();
+    return owned_.back();
+  }
+
+  void push_back(const T& value) {
+    Materialize();
+    owned_.push_back(value);
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    Materialize();
+    return owned_.emplace_back(std::forward<Args>(args)...);
+  }
+
+  template <typename InputIt>
+  void insert(const T* position, InputIt first, InputIt last) {
+    const auto offset = position - data();
+    Materialize();
+    owned_.insert(owned_.begin() + offset, first, last);
+  }
+
+  void reserve(size_t capacity) {
+    Materialize();
+    owned_.reserve(capacity);
+  }
+
+  void resize(size_t size) {
+    Materialize();
+    owned_.resize(size);
+  }
+
+  void resize(size_t size, const T& value) {
+    Materialize();
+    owned_.resize(size, value);
+  }
+
+  void clear() {
+    external_ = nullptr;
+    external_size_ = 0;
+    owned_.clear();
+  }
+
+ private:
+  // Converts a referencing array into an owning array.
+  void Materialize() {
+    if (external_ == nullptr) {
+      return;
+    }
+    owned_.assign(external_, external_ + external_size_);
+    external_ = nullptr;
+    external_size_ = 0;
+  }
+
+  std::vector<T> owned_;
+  // Referenced buffer. If null, the values are stored in "owned_".
+  const T* external_ = nullptr;
+  size_t external_size_ = 0;
+};
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
+
+#endif  // YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MAPPABLE_VECTOR_H_
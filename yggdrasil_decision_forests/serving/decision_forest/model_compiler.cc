@@ -0,0 +1,674 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/decision_forest/model_compiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/substitute.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.pb.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/utils/bitmap.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using dataset::proto::ColumnType;
+using model::decision_tree::DecisionTree;
+using model::decision_tree::NodeWithChildren;
+using model::gradient_boosted_trees::GradientBoostedTreesModel;
+using model::gradient_boosted_trees::proto::Loss;
+using model::random_forest::RandomForestModel;
+using ConditionType = model::decision_tree::proto::Condition::TypeCase;
+
+// Computes the values added to the outputs by a leaf. "values" is
+// initialized with "num_outputs" zeros.
+using LeafValuesFn =
+    std::function<absl::Status(const model::decision_tree::proto::Node& node,
+                               int tree_idx, std::vector<float>* values)>;
+
+// Model specific part of the generated code.
+struct ForestSpec {
+  const std::vector<std::unique_ptr<DecisionTree>>* trees;
+  int num_outputs;
+  // Initial value of the outputs.
+  std::vector<float> initial_outputs;
+  LeafValuesFn leaf_values;
+  // Code applied on the "output" array, after the trees are evaluated.
+  std::string finalization;
+  // Human readable description of the output.
+  std::string output_description;
+};
+
+// C++ literal of a float value.
+std::string FloatLiteral(const float value) {
+  if (std::isnan(value)) {
+    return "std::numeric_limits<float>::quiet_NaN()";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "std::numeric_limits<float>::infinity()"
+                     : "-std::numeric_limits<float>::infinity()";
+  }
+  std::string literal = absl::StrFormat("%.9g", value);
+  if (literal.find_first_of(".e") == std::string::npos) {
+    absl::StrAppend(&literal, ".");
+  }
+  absl::StrAppend(&literal, "f");
+  return literal;
+}
+
+// C++ string literal.
+std::string StringLiteral(const absl::string_view value) {
+  return absl::StrCat("\"", absl::CEscape(value), "\"");
+}
+
+// Checks that "cpp_namespace" is a valid (possibly nested) C++ namespace.
+absl::Status CheckNamespace(const absl::string_view cpp_namespace) {
+  for (const auto part : absl::StrSplit(cpp_namespace, "::")) {
+    bool valid = !part.empty() && !absl::ascii_isdigit(part.front());
+    for (const char c : part) {
+      valid &= absl::ascii_isalnum(c) || c == '_';
+    }
+    if (!valid) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid C++ namespace \"", cpp_namespace, "\"."));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Header guard of the generated header e.g. "PATH_TO_MY_MODEL_H_" for
+// "path/to/my_model.h". The other characters than letters and digits are
+// replaced by "_". The guard does not start with "_" or a digit, and does not
+// contain consecutive "_" (e.g. for an absolute path) since such identifiers
+// are reserved in C++.
+std::string HeaderGuard(const absl::string_view header_include_path) {
+  std::string guard;
+  for (const char c : header_include_path) {
+    if (guard.empty() && !absl::ascii_isalpha(c)) {
+      continue;
+    }
+    if (absl::ascii_isalnum(c)) {
+      guard.push_back(absl::ascii_toupper(c));
+    } else if (guard.back() != '_') {
+      guard.push_back('_');
+    }
+  }
+  if (guard.empty()) {
+    guard = "COMPILED_MODEL_H";
+  }
+  if (guard.back() != '_') {
+    guard.push_back('_');
+  }
+  return guard;
+}
+
+// Generates the code of the trees.
+class ForestCodeGenerator {
+ public:
+  ForestCodeGenerator(const model::AbstractModel& model, const ForestSpec& spec)
+      : model_(model), spec_(spec) {
+    for (int feature_idx = 0; feature_idx < model.input_features().size();
+         feature_idx++) {
+      feature_positions_[model.input_features()[feature_idx]] = feature_idx;
+    }
+  }
+
+  // Generates the helper functions, constants and tree functions.
+  absl::Status Generate() {
+    for (int tree_idx = 0; tree_idx < spec_.trees->size(); tree_idx++) {
+      absl::SubstituteAndAppend(
+          &trees_, "\nvoid Tree$0(const float* const f, float* const o) {\n",
+          tree_idx);
+      RETURN_IF_ERROR(
+          GenerateNode((*spec_.trees)[tree_idx]->root(), tree_idx, 1));
+      absl::StrAppend(&trees_, "}\n");
+    }
+    return absl::OkStatus();
+  }
+
+  // Code of the helper functions and constants.
+  std::string Helpers() const {
+    std::string code;
+    if (uses_categorical_contains_) {
+      absl::StrAppend(&code, R"(
+// Tests if the categorical item "value" is set in "bitmap". Items outside of
+// the dictionary are treated as the out-of-dictionary item 0.
+inline bool CategoricalContains(const float value,
+                                const unsigned char* const bitmap,
+                                const int num_items, const bool na_value) {
+  if (std::isnan(value)) {
+    return na_value;
+  }
+  int item = static_cast<int>(value);
+  if (item < 0 || item >= num_items) {
+    item = 0;
+  }
+  return (bitmap[item / 8] >> (item % 8)) & 1;
+}
+)");
+    }
+    if (uses_oblique_) {
+      absl::StrAppend(&code, R"(
+// Tests if "sum_i f[attributes[i]] * weights[i] >= threshold".
+inline bool ObliqueIsHigher(const float* const f, const int* const attributes,
+                            const float* const weights,
+                            const int num_attributes, const float threshold,
+                            const bool na_value) {
+  float sum = 0.f;
+  for (int i = 0; i < num_attributes; i++) {
+    const float value = f[attributes[i]];
+    if (std::isnan(value)) {
+      return na_value;
+    }
+    sum += value * weights[i];
+  }
+  return sum >= threshold;
+}
+)");
+    }
+    if (!constants_.empty()) {
+      absl::StrAppend(&code, "\n", constants_);
+    }
+    return code;
+  }
+
+  // Code of the tree functions.
+  const std::string& Trees() const { return trees_; }
+
+ private:
+  absl::Status GenerateNode(const NodeWithChildren& node, const int tree_idx,
+                            const int depth) {
+    const std::string indent(2 * depth, ' ');
+    if (node.IsLeaf()) {
+      std::vector<float> values(spec_.num_outputs, 0.f);
+      RETURN_IF_ERROR(spec_.leaf_values(node.node(), tree_idx, &values));
+      for (int output_idx = 0; output_idx < values.size(); output_idx++) {
+        if (values[output_idx] != 0.f) {
+          absl::SubstituteAndAppend(&trees_, "$0o[$1] += $2;\n", indent,
+                                    output_idx,
+                                    FloatLiteral(values[output_idx]));
+        }
+      }
+      return absl::OkStatus();
+    }
+
+    ASSIGN_OR_RETURN(const auto condition,
+                     GenerateCondition(node.node().condition()));
+    absl::SubstituteAndAppend(&trees_, "$0if ($1) {\n", indent, condition);
+    RETURN_IF_ERROR(GenerateNode(*node.pos_child(), tree_idx, depth + 1));
+    absl::StrAppend(&trees_, indent, "} else {\n");
+    RETURN_IF_ERROR(GenerateNode(*node.neg_child(), tree_idx, depth + 1));
+    absl::StrAppend(&trees_, indent, "}\n");
+    return absl::OkStatus();
+  }
+
+  utils::StatusOr<int> FeaturePosition(const int attribute) const {
+    const auto it = feature_positions_.find(attribute);
+    if (it == feature_positions_.end()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("The attribute ", attribute,
+                       " is used in a condition but is not an input feature."));
+    }
+    return it->second;
+  }
+
+  // Expression "value >= threshold" where NaN values evaluate to "na_value".
+  static std::string IsHigher(const std::string& value, const float threshold,
+                              const bool na_value) {
+    if (na_value) {
+      return absl::StrCat("!(", value, " < ", FloatLiteral(threshold), ")");
+    } else {
+      return absl::StrCat(value, " >= ", FloatLiteral(threshold));
+    }
+  }
+
+  utils::StatusOr<std::string> GenerateCondition(
+      const model::decision_tree::proto::NodeCondition& node_condition) {
+    const auto& condition = node_condition.condition();
+    const bool na_value = node_condition.na_value();
+    const auto& attribute_spec =
+        model_.data_spec().columns(node_condition.attribute());
+    ASSIGN_OR_RETURN(const int position,
+                     FeaturePosition(node_condition.attribute()));
+    const std::string value = absl::StrCat("f[", position, "]");
+
+    switch (condition.type_case()) {
+      case ConditionType::kNaCondition:
+        return absl::StrCat("std::isnan(", value, ")");
+
+      case ConditionType::kHigherCondition:
+        return IsHigher(value, condition.higher_condition().threshold(),
+                        na_value);
+
+      case ConditionType::kTrueValueCondition:
+        return IsHigher(value, 0.5f, na_value);
+
+      case ConditionType::kDiscretizedHigherCondition: {
+        if (attribute_spec.type() != ColumnType::DISCRETIZED_NUMERICAL) {
+          return absl::InvalidArgumentError("Non supported condition.");
+        }
+        const auto threshold =
+            condition.discretized_higher_condition().threshold();
+        return IsHigher(
+            value,
+            attribute_spec.discretized_numerical().boundaries(threshold - 1),
+            na_value);
+      }
+
+      case ConditionType::kContainsCondition:
+      case ConditionType::kContainsBitmapCondition: {
+        if (attribute_spec.type() != ColumnType::CATEGORICAL) {
+          return absl::InvalidArgumentError(
+              "Only categorical features are supported in \"contains\" "
+              "conditions.");
+        }
+        const int num_items =
+            attribute_spec.categorical().number_of_unique_values();
+        std::vector<int> bitmap((num_items + 7) / 8, 0);
+        for (int item = 0; item < num_items; item++) {
+          bool contains;
+          if (condition.has_contains_condition()) {
+            const auto& elements = condition.contains_condition().elements();
+            contains = std::find(elements.begin(), elements.end(), item) !=
+                       elements.end();
+          } else {
+            contains = utils::bitmap::GetValueBit(
+                condition.contains_bitmap_condition().elements_bitmap(), item);
+          }
+          if (contains) {
+            bitmap[item / 8] |= 1 << (item % 8);
+          }
+        }
+        const std::string name = absl::StrCat("kBitmap", num_constants_++);
+        absl::SubstituteAndAppend(
+            &constants_, "constexpr unsigned char $0[] = {$1};\n", name,
+            absl::StrJoin(bitmap, ", "));
+        uses_categorical_contains_ = true;
+        return absl::Substitute("CategoricalContains($0, $1, $2, $3)", value,
+                                name, num_items, na_value ? "true" : "false");
+      }
+
+      case ConditionType::kObliqueCondition: {
+        const auto& oblique = condition.oblique_condition();
+        std::vector<int> positions;
+        std::vector<std::string> weights;
+        for (int item_idx = 0; item_idx < oblique.attributes_size();
+             item_idx++) {
+          ASSIGN_OR_RETURN(const int item_position,
+                           FeaturePosition(oblique.attributes(item_idx)));
+          positions.push_back(item_position);
+          weights.push_back(FloatLiteral(oblique.weights(item_idx)));
+        }
+        if (positions.empty()) {
+          return IsHigher("0.f", oblique.threshold(), false);
+        }
+        const int constant_idx = num_constants_++;
+        absl::SubstituteAndAppend(
+            &constants_,
+            "constexpr int kObliqueAttributes$0[] = {$1};\n"
+            "constexpr float kObliqueWeights$0[] = {$2};\n",
+            constant_idx, absl::StrJoin(positions, ", "),
+            absl::StrJoin(weights, ", "));
+        uses_oblique_ = true;
+        return absl::Substitute(
+            "ObliqueIsHigher(f, kObliqueAttributes$0, kObliqueWeights$0, $1, "
+            "$2, $3)",
+            constant_idx, positions.size(), FloatLiteral(oblique.threshold()),
+            na_value ? "true" : "false");
+      }
+
+      default:
+        return absl::InvalidArgumentError(
+            absl::StrCat("Non supported condition: ",
+                         node_condition.condition().DebugString()));
+    }
+  }
+
+  const model::AbstractModel& model_;
+  const ForestSpec& spec_;
+  std::unordered_map<int, int> feature_positions_;
+
+  std::string trees_;
+  std::string constants_;
+  int num_constants_ = 0;
+  bool uses_categorical_contains_ = false;
+  bool uses_oblique_ = false;
+};
+
+utils::StatusOr<ForestSpec> GradientBoostedTreesSpec(
+    const GradientBoostedTreesModel& model) {
+  ForestSpec spec;
+  spec.trees = &model.decision_trees();
+  switch (model.loss()) {
+    case Loss::BINOMIAL_LOG_LIKELIHOOD:
+      spec.num_outputs = 1;
+      spec.initial_outputs = {model.initial_predictions()[0]};
+      spec.finalization =
+          "  output[0] = 1.f / (1.f + std::exp(-output[0]));\n";
+      spec.output_description = "Probability of the positive class.";
+      break;
+    case Loss::SQUARED_ERROR:
+    case Loss::LAMBDA_MART_NDCG5:
+    case Loss::XE_NDCG_MART:
+      spec.num_outputs = 1;
+      spec.initial_outputs = {model.initial_predictions()[0]};
+      spec.output_description =
+          model.task() == model::proto::RANKING ? "Ranking score." : "Value.";
+      break;
+    case Loss::MULTINOMIAL_LOG_LIKELIHOOD:
+      spec.num_outputs = model.num_trees_per_iter();
+      // Note: The multinomial log likelihood loss does not use initial
+      // predictions.
+      spec.initial_outputs.assign(spec.num_outputs, 0.f);
+      spec.finalization = R"(  // Softmax.
+  float sum = 0.f;
+  for (int i = 0; i < kNumOutputs; i++) {
+    output[i] = std::exp(output[i]);
+    sum += output[i];
+  }
+  const float normalize = (sum > 0.f) ? (1.f / sum) : 0.f;
+  for (int i = 0; i < kNumOutputs; i++) {
+    output[i] *= normalize;
+  }
+)";
+      spec.output_description = "Probability of each class.";
+      break;
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Non supported GBT loss: ", Loss_Name(model.loss())));
+  }
+  const int num_outputs = spec.num_outputs;
+  spec.leaf_values = [num_outputs](
+                          const model::decision_tree::proto::Node& node,
+                          const int tree_idx, std::vector<float>* values) {
+    // Tree "i" contributes to the output "i % num_outputs".
+    (*values)[tree_idx % num_outputs] = node.regressor().top_value();
+    return absl::OkStatus();
+  };
+  return spec;
+}
+
+utils::StatusOr<ForestSpec> RandomForestSpec(const RandomForestModel& model) {
+  ForestSpec spec;
+  spec.trees = &model.decision_trees();
+  const float normalization = 1.f / model.NumTrees();
+  switch (model.task()) {
+    case model::proto::CLASSIFICATION: {
+      const int num_classes =
+          model.label_col_spec().categorical().number_of_unique_values() - 1;
+      // Binary classification models only output the probability of the
+      // positive class.
+      const bool binary = num_classes == 2;
+      const bool winner_take_all = model.winner_take_all_inference();
+      spec.num_outputs = binary ? 1 : num_classes;
+      spec.output_description = binary ? "Probability of the positive class."
+                                       : "Probability of each class.";
+      spec.leaf_values = [=](const model::decision_tree::proto::Node& node,
+                             const int tree_idx,
+                             std::vector<float>* values) -> absl::Status {
+        // Contribution of each class, including the out-of-dictionary one.
+        std::vector<float> class_values(num_classes + 1, 0.f);
+        if (winner_take_all) {
+          const int top_value = node.classifier().top_value();
+          if (top_value < 0 || top_value > num_classes) {
+            return absl::InvalidArgumentError("Invalid leaf value.");
+          }
+          class_values[top_value] = normalization;
+        } else {
+          const auto& distribution = node.classifier().distribution();
+          if (distribution.counts_size() != num_classes + 1) {
+            return absl::InvalidArgumentError(
+                "Unexpected number of classes in the leaf.");
+          }
+          for (int class_idx = 0; class_idx <= num_classes; class_idx++) {
+            class_values[class_idx] = static_cast<float>(
+                distribution.counts(class_idx) / distribution.sum() *
+                normalization);
+          }
+        }
+        if (binary) {
+          (*values)[0] = class_values[2];
+        } else {
+          for (int class_idx = 0; class_idx < num_classes; class_idx++) {
+            (*values)[class_idx] = class_values[class_idx + 1];
+          }
+        }
+        return absl::OkStatus();
+      };
+    } break;
+
+    case model::proto::REGRESSION:
+      spec.num_outputs = 1;
+      spec.output_description = "Value.";
+      spec.leaf_values = [normalization](
+                             const model::decision_tree::proto::Node& node,
+                             const int tree_idx, std::vector<float>* values) {
+        (*values)[0] = node.regressor().top_value() * normalization;
+        return absl::OkStatus();
+      };
+      break;
+
+    default:
+      return absl::InvalidArgumentError("Non supported RF task.");
+  }
+  spec.initial_outputs.assign(spec.num_outputs, 0.f);
+  return spec;
+}
+
+// Description of the expected value of each feature.
+utils::StatusOr<std::string> FeatureDescription(
+    const dataset::proto::Column& column) {
+  switch (column.type()) {
+    case ColumnType::NUMERICAL:
+    case ColumnType::DISCRETIZED_NUMERICAL:
+      return std::string("numerical");
+    case ColumnType::BOOLEAN:
+      return std::string("boolean (0 or 1)");
+    case ColumnType::CATEGORICAL: {
+      std::string description =
+          absl::StrCat("categorical with ",
+                       column.categorical().number_of_unique_values(),
+                       " items");
+      if (!column.categorical().is_already_integerized()) {
+        std::vector<std::pair<int64_t, std::string>> items;
+        for (const auto& item : column.categorical().items()) {
+          items.push_back({item.second.index(), item.first});
+        }
+        std::sort(items.begin(), items.end());
+        std::vector<std::string> item_descriptions;
+        for (const auto& item : items) {
+          item_descriptions.push_back(
+              absl::StrCat(item.first, ":", StringLiteral(item.second)));
+        }
+        if (item_descriptions.size() <= 10) {
+          absl::StrAppend(&description, " {",
+                          absl::StrJoin(item_descriptions, " "), "}");
+        }
+      }
+      return description;
+    }
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("The feature \"", column.name(), "\" has type ",
+                       dataset::proto::ColumnType_Name(column.type()),
+                       " which is not supported by the compiled model."));
+  }
+}
+
+}  // namespace
+
+utils::StatusOr<CompiledModelCpp> CompileModelToCpp(
+    const model::AbstractModel& model, const CompileModelOptions& options) {
+  RETURN_IF_ERROR(CheckNamespace(options.cpp_namespace));
+
+  ForestSpec spec;
+  if (const auto* gbt_model =
+          dynamic_cast<const GradientBoostedTreesModel*>(&model)) {
+    ASSIGN_OR_RETURN(spec, GradientBoostedTreesSpec(*gbt_model));
+  } else if (const auto* rf_model =
+                 dynamic_cast<const RandomForestModel*>(&model)) {
+    ASSIGN_OR_RETURN(spec, RandomForestSpec(*rf_model));
+  } else {
+    return absl::InvalidArgumentError(
+        "Only Random Forest and Gradient Boosted Trees models can be "
+        "compiled.");
+  }
+
+  ForestCodeGenerator generator(model, spec);
+  RETURN_IF_ERROR(generator.Generate());
+
+  // Input features.
+  std::string feature_names;
+  std::string feature_comments;
+  for (int feature_idx = 0; feature_idx < model.input_features().size();
+       feature_idx++) {
+    const auto& column =
+        model.data_spec().columns(model.input_features()[feature_idx]);
+    ASSIGN_OR_RETURN(const auto description, FeatureDescription(column));
+    absl::StrAppend(&feature_names, "    ", StringLiteral(column.name()),
+                    ",\n");
+    absl::SubstituteAndAppend(&feature_comments, "//   $0: \"$1\" $2\n",
+                              feature_idx, absl::CEscape(column.name()),
+                              description);
+  }
+
+  const std::string model_name = options.model_name.empty()
+                                     ? model.name()
+                                     : options.model_name;
+  const std::string banner = absl::StrCat(
+      "// Generated by the Yggdrasil Decision Forests model compiler from the "
+      "model\n// \"",
+      absl::CEscape(model_name), "\". Do not edit.\n");
+
+  CompiledModelCpp compiled;
+
+  // Header.
+  const std::string guard = HeaderGuard(options.header_include_path);
+  absl::SubstituteAndAppend(&compiled.header, R"($0
+#ifndef $1
+#define $1
+
+namespace $2 {
+
+// Number of input features.
+constexpr int kNumFeatures = $3;
+
+// Number of output values.
+constexpr int kNumOutputs = $4;
+
+// Names of the input features, in the order expected by "Predict".
+//
+// Input features:
+$5extern const char* const kFeatureNames[kNumFeatures];
+
+// Computes the prediction of an example.
+//
+// "features" contains the "kNumFeatures" input feature values in the order of
+// "kFeatureNames". Categorical features are represented by their item index.
+// Missing values are represented by NaN.
+//
+// "output" receives "kNumOutputs" values: $6
+void Predict(const float* features, float* output);
+)",
+                            banner, guard, options.cpp_namespace,
+                            model.input_features().size(), spec.num_outputs,
+                            feature_comments, spec.output_description);
+
+  if (spec.num_outputs == 1) {
+    absl::StrAppend(&compiled.header, R"(
+// Computes the prediction of an example with a single output value.
+float Predict(const float* features);
+)");
+  }
+
+  absl::SubstituteAndAppend(&compiled.header, R"(
+}  // namespace $0
+
+#endif  // $1
+)",
+                            options.cpp_namespace, guard);
+
+  // Source.
+  absl::SubstituteAndAppend(&compiled.source, R"($0
+#include "$1"
+
+#include <cmath>
+#include <limits>
+
+namespace $2 {
+
+const char* const kFeatureNames[kNumFeatures] = {
+$3};
+
+namespace {
+$4$5
+}  // namespace
+
+void Predict(const float* const features, float* const output) {
+)",
+                            banner, options.header_include_path,
+                            options.cpp_namespace, feature_names,
+                            generator.Helpers(), generator.Trees());
+
+  for (int output_idx = 0; output_idx < spec.num_outputs; output_idx++) {
+    absl::SubstituteAndAppend(&compiled.source, "  output[$0] = $1;\n",
+                              output_idx,
+                              FloatLiteral(spec.initial_outputs[output_idx]));
+  }
+  for (int tree_idx = 0; tree_idx < spec.trees->size(); tree_idx++) {
+    absl::SubstituteAndAppend(&compiled.source, "  Tree$0(features, output);\n",
+                              tree_idx);
+  }
+  absl::StrAppend(&compiled.source, spec.finalization, "}\n");
+
+  if (spec.num_outputs == 1) {
+    absl::StrAppend(&compiled.source, R"(
+float Predict(const float* const features) {
+  float output;
+  Predict(features, &output);
+  return output;
+}
+)");
+  }
+
+  absl::SubstituteAndAppend(&compiled.source, "\n}  // namespace $0\n",
+                            options.cpp_namespace);
+  return compiled;
+}
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Ahead-of-time compilation of a decision forest model into C++ code.
+//
+// The trees are unrolled into nested if/else statements. The generated code
+// only depends on the C++ standard library: It does not need to load the model
+// or to link the Yggdrasil Decision Forests library.
+//
+// The generated header exposes:
+//
+//   namespace <cpp_namespace> {
+//   constexpr int kNumFeatures = ...;
+//   constexpr int kNumOutputs = ...;
+//   extern const char* const kFeatureNames[kNumFeatures];
+//   void Predict(const float* features, float* output);
+//   float Predict(const float* features);  // Only if kNumOutputs == 1.
+//   }
+//
+// "features" contains one value per input feature, in the order of
+// "kFeatureNames": Numerical values for numerical and discretized numerical
+// features, 0 or 1 for boolean features, and the item index (as defined in the
+// dataspec) for categorical features. Missing values are represented by NaN.
+//
+// The output is the same as the "FastEngine" inference: Probability of the
+// positive class for binary classification, probability of each class for
+// multi-class classification, value for regression, and score for ranking.
+//
+// The compilation is available through the ":compile_model" cli and the
+// "cc_compiled_model" Bazel rule (see compiled_model.bzl).
+//
+// Usage example:
+//
+//   CompileModelOptions options;
+//   options.cpp_namespace = "my_model";
+//   options.header_include_path = "path/to/my_model.h";
+//   ASSIGN_OR_RETURN(const auto compiled, CompileModelToCpp(model, options));
+//   // Write "compiled.header" and "compiled.source".
+//
+#ifndef YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MODEL_COMPILER_H_
+#define YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MODEL_COMPILER_H_
+
+#include <string>
+
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/utils/compatibility.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+
+struct CompileModelOptions {
+  // C++ namespace of the generated code e.g. "my_project::my_model".
+  std::string cpp_namespace = "compiled_model";
+
+  // Path used by the generated source file to include the generated header.
+  std::string header_include_path = "compiled_model.h";
+
+  // Human readable name of the model, reported in the generated code.
+  std::string model_name;
+};
+
+// Generated C++ code.
+struct CompiledModelCpp {
+  std::string header;
+  std::string source;
+};
+
+// Generates the C++ code of a Random Forest or Gradient Boosted Trees model.
+utils::StatusOr<CompiledModelCpp> CompileModelToCpp(
+    const model::AbstractModel& model, const CompileModelOptions& options);
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
+
+#endif  // YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_MODEL_COMPILER_H_
@@ -0,0 +1,752 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/decision_forest/quantized_decision_forest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/utils.h"
+#include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
+#include "yggdrasil_decision_forests/utils/usage.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using dataset::proto::ColumnType;
+using dataset::proto::DataSpecification;
+using internal::QuantizedModel;
+using model::decision_tree::NodeWithChildren;
+using model::gradient_boosted_trees::GradientBoostedTreesModel;
+using model::gradient_boosted_trees::proto::Loss;
+using model::random_forest::RandomForestModel;
+
+// Computes the value of a leaf.
+using SetLeafValueFn = std::function<absl::Status(
+    const model::decision_tree::proto::Node& src_node, float* dst_value)>;
+
+// Largest number of thresholds for a single feature. The bin index of a
+// feature value is in [0, kMaxNumThresholds].
+constexpr int kMaxNumThresholds =
+    std::numeric_limits<QuantizedNode::Bin>::max() - 1;
+
+// Gets the threshold of a non-leaf node. The node condition is equivalent to
+// "value >= threshold".
+utils::StatusOr<float> GetNodeThreshold(const DataSpecification& data_spec,
+                                        const NodeWithChildren& src_node) {
+  const auto& condition = src_node.node().condition();
+  const auto& attribute_spec = data_spec.columns(condition.attribute());
+  if (condition.condition().has_higher_condition() &&
+      attribute_spec.type() == ColumnType::NUMERICAL) {
+    return condition.condition().higher_condition().threshold();
+  }
+  if (condition.condition().has_true_value_condition() &&
+      attribute_spec.type() == ColumnType::BOOLEAN) {
+    return 0.5f;
+  }
+  return absl::InvalidArgumentError(
+      "Unexpected condition. This inference engine only supports numerical "
+      "\"is higher\" and boolean \"is true\" conditions. Try another inference "
+      "engine in .../decision_forest.h.");
+}
+
+// Lists the thresholds used by the conditions of a (sub-)tree. "thresholds"
+// is indexed by internal feature index.
+absl::Status CollectThresholds(const DataSpecification& data_spec,
+                               const QuantizedModel& dst,
+                               const NodeWithChildren& src_node,
+                               std::vector<std::vector<float>>* thresholds) {
+  if (src_node.IsLeaf()) {
+    return absl::OkStatus();
+  }
+  ASSIGN_OR_RETURN(const float threshold,
+                   GetNodeThreshold(data_spec, src_node));
+  ASSIGN_OR_RETURN(
+      const auto feature,
+      FindFeatureDef(dst.features().fixed_length_features(),
+                     src_node.node().condition().attribute()));
+  (*thresholds)[feature.internal_idx].push_back(threshold);
+  RETURN_IF_ERROR(CollectThresholds(data_spec, dst, *src_node.neg_child(),
+                                    thresholds));
+  return CollectThresholds(data_spec, dst, *src_node.pos_child(), thresholds);
+}
+
+// Adds the nodes of a (sub-)tree to the model.
+absl::Status FillNodes(const DataSpecification& data_spec,
+                       const NodeWithChildren& src_node,
+                       const SetLeafValueFn& set_leaf_value,
+                       QuantizedModel* dst) {
+  const size_t node_idx = dst->nodes.size();
+  dst->nodes.emplace_back();
+
+  if (src_node.IsLeaf()) {
+    const size_t leaf_idx = dst->leaf_values.size();
+    if (leaf_idx > std::numeric_limits<uint32_t>::max()) {
+      return absl::InvalidArgumentError("Too many leaves.");
+    }
+    dst->leaf_values.emplace_back();
+    RETURN_IF_ERROR(set_leaf_value(src_node.node(), &dst->leaf_values.back()));
+    auto& dst_node = dst->nodes[node_idx];
+    dst_node.right_idx = 0;
+    dst_node.feature_idx = static_cast<uint16_t>(leaf_idx & 0xFFFF);
+    dst_node.threshold = static_cast<QuantizedNode::Bin>(leaf_idx >> 16);
+    return absl::OkStatus();
+  }
+
+  ASSIGN_OR_RETURN(const float threshold,
+                   GetNodeThreshold(data_spec, src_node));
+  ASSIGN_OR_RETURN(
+      const auto feature,
+      FindFeatureDef(dst->features().fixed_length_features(),
+                     src_node.node().condition().attribute()));
+  const auto begin_thresholds =
+      dst->thresholds.begin() + dst->threshold_offsets[feature.internal_idx];
+  const auto end_thresholds =
+      dst->thresholds.begin() +
+      dst->threshold_offsets[feature.internal_idx + 1];
+  const auto threshold_idx =
+      std::lower_bound(begin_thresholds, end_thresholds, threshold) -
+      begin_thresholds;
+  const int num_features = dst->threshold_offsets.size() - 1;
+
+  // If true, the positive child is stored right after the node, and the
+  // condition is inverted.
+  const bool positive_first =
+      dst->node_layout == QuantizedModel::NodeLayout::kHotPath &&
+      IsPositiveChildMoreFrequent(src_node);
+  const auto& first_child =
+      positive_first ? *src_node.pos_child() : *src_node.neg_child();
+  const auto& second_child =
+      positive_first ? *src_node.neg_child() : *src_node.pos_child();
+
+  RETURN_IF_ERROR(FillNodes(data_spec, first_child, set_leaf_value, dst));
+
+  const size_t right_idx = dst->nodes.size() - node_idx;
+  if (right_idx > std::numeric_limits<QuantizedNode::NodeOffset>::max()) {
+    return absl::InvalidArgumentError(
+        "Tree too large for this inference engine.");
+  }
+  auto& dst_node = dst->nodes[node_idx];
+  dst_node.right_idx = static_cast<QuantizedNode::NodeOffset>(right_idx);
+  if (positive_first) {
+    // "bin < threshold_idx + 1" is equivalent to
+    // "~bin >= ~(threshold_idx + 1) + 1".
+    dst_node.feature_idx =
+        static_cast<uint16_t>(num_features + feature.internal_idx);
+    dst_node.threshold = static_cast<QuantizedNode::Bin>(
+        static_cast<QuantizedNode::Bin>(~(threshold_idx + 1)) + 1);
+  } else {
+    dst_node.feature_idx = static_cast<uint16_t>(feature.internal_idx);
+    dst_node.threshold = static_cast<QuantizedNode::Bin>(threshold_idx + 1);
+  }
+
+  return FillNodes(data_spec, second_child, set_leaf_value, dst);
+}
+
+template <typename AbstractModel, typename CompiledModel>
+absl::Status BaseGenericToSpecializedModel(const AbstractModel& src,
+                                           const SetLeafValueFn& set_leaf_value,
+                                           CompiledModel* dst) {
+  if (src.task() != CompiledModel::kTask) {
+    return absl::InvalidArgumentError("Wrong model class.");
+  }
+
+  // List the model input features.
+  std::vector<int> all_input_features;
+  RETURN_IF_ERROR(GetInputFeatures(src, &all_input_features, nullptr));
+  RETURN_IF_ERROR(
+      dst->mutable_features()->Initialize(all_input_features, src.data_spec()));
+
+  const int num_features = dst->features().fixed_length_features().size();
+  // Note: The bins and the negated bins are indexed with 16 bits.
+  if (2 * num_features > std::numeric_limits<uint16_t>::max()) {
+    return absl::InvalidArgumentError(
+        "Too many input features for this inference engine.");
+  }
+
+  // Index the unique thresholds of each feature.
+  std::vector<std::vector<float>> thresholds_per_feature(num_features);
+  for (const auto& src_tree : src.decision_trees()) {
+    RETURN_IF_ERROR(CollectThresholds(src.data_spec(), *dst, src_tree->root(),
+                                      &thresholds_per_feature));
+  }
+  dst->thresholds.clear();
+  dst->threshold_offsets.assign(1, 0);
+  for (auto& feature_thresholds : thresholds_per_feature) {
+    std::sort(feature_thresholds.begin(), feature_thresholds.end());
+    feature_thresholds.erase(
+        std::unique(feature_thresholds.begin(), feature_thresholds.end()),
+        feature_thresholds.end());
+    if (static_cast<int>(feature_thresholds.size()) > kMaxNumThresholds) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Too many unique thresholds (", feature_thresholds.size(),
+          ") for a single feature. This inference engine supports at most ",
+          kMaxNumThresholds, " unique thresholds per feature."));
+    }
+    dst->thresholds.insert(dst->thresholds.end(), feature_thresholds.begin(),
+                           feature_thresholds.end());
+    dst->threshold_offsets.push_back(dst->thresholds.size());
+  }
+
+  // Compile the trees.
+  dst->nodes.clear();
+  dst->root_offsets.clear();
+  dst->leaf_values.clear();
+  for (const auto& src_tree : src.decision_trees()) {
+    dst->root_offsets.push_back(dst->nodes.size());
+    RETURN_IF_ERROR(
+        FillNodes(src.data_spec(), src_tree->root(), set_leaf_value, dst));
+  }
+  return absl::OkStatus();
+}
+
+// Compiles a GBDT. Each leaf contains a single value.
+template <typename CompiledModel>
+absl::Status GradientBoostedTreesToSpecializedModel(
+    const GradientBoostedTreesModel& src, CompiledModel* dst) {
+  const auto set_leaf_value =
+      [](const model::decision_tree::proto::Node& src_node,
+         float* dst_value) -> absl::Status {
+    *dst_value = src_node.regressor().top_value();
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
+}
+
+// Quantizes the fixed-length features of an example. "bins[i]" is the number
+// of thresholds of the i-th feature smaller or equal to the feature value, and
+// "bins[num_features + i]" is its bitwise negation. "bins" should contain
+// "2 * num_features" values.
+inline void QuantizeExample(const QuantizedModel& model,
+                            const NumericalOrCategoricalValue* example,
+                            QuantizedNode::Bin* bins) {
+  const int num_features = model.threshold_offsets.size() - 1;
+  const float* const thresholds = model.thresholds.data();
+  for (int feature_idx = 0; feature_idx < num_features; feature_idx++) {
+    const float* const begin =
+        thresholds + model.threshold_offsets[feature_idx];
+    const float* const end =
+        thresholds + model.threshold_offsets[feature_idx + 1];
+    const auto bin = static_cast<QuantizedNode::Bin>(
+        std::upper_bound(begin, end, example[feature_idx].numerical_value) -
+        begin);
+    bins[feature_idx] = bin;
+    bins[num_features + feature_idx] = static_cast<QuantizedNode::Bin>(~bin);
+  }
+}
+
+// Number of examples going down the trees in lockstep (see "AddLeafValues").
+constexpr int kExampleBatchSize = 8;
+
+// Value of the leaf "node".
+inline float LeafValue(const QuantizedModel& model, const QuantizedNode& node) {
+  return model.leaf_values[static_cast<uint32_t>(node.feature_idx) |
+                           (static_cast<uint32_t>(node.threshold) << 16)];
+}
+
+// Gets the leaf value reached by an example in the tree starting at
+// "root_offset".
+inline float GetLeafValue(const QuantizedModel& model, const int root_offset,
+                          const QuantizedNode::Bin* bins) {
+  const QuantizedNode* node = &model.nodes[root_offset];
+  while (node->right_idx) {
+    node += (bins[node->feature_idx] >= node->threshold) ? node->right_idx : 1;
+  }
+  return LeafValue(model, *node);
+}
+
+// Adds to "outputs[i]" the values of the leaves of the trees "[begin_tree_idx,
+// end_tree_idx)" reached by the "i-th" example. "bins" contains the quantized
+// values of the "num_examples" examples (see "QuantizeExample").
+//
+// Blocks of "kExampleBatchSize" examples go down each tree in lockstep. The
+// child selection is branch-free, so the loop over the examples of a block
+// does not contain data-dependent branches and can be vectorized by the
+// compiler. The remaining examples go down the trees one at a time.
+inline void AddLeafValues(const QuantizedModel& model,
+                          const QuantizedNode::Bin* bins,
+                          const int num_examples, const int begin_tree_idx,
+                          const int end_tree_idx, float* outputs) {
+  const int num_bins_per_example = 2 * (model.threshold_offsets.size() - 1);
+  const QuantizedNode* const nodes = model.nodes.data();
+
+  int example_idx = 0;
+  if (num_bins_per_example > 0) {
+    // Index of the current node of each example in the block.
+    uint32_t node_idxs[kExampleBatchSize];
+    for (; example_idx + kExampleBatchSize <= num_examples;
+         example_idx += kExampleBatchSize) {
+      const QuantizedNode::Bin* const block_bins =
+          bins + example_idx * num_bins_per_example;
+      for (int tree_idx = begin_tree_idx; tree_idx < end_tree_idx;
+           tree_idx++) {
+        std::fill(node_idxs, node_idxs + kExampleBatchSize,
+                  model.root_offsets[tree_idx]);
+        // An example that reached a leaf stays on it (i.e. its step is zero)
+        // until all the examples of the block have reached a leaf.
+        uint32_t any_step;
+        do {
+          any_step = 0;
+          for (int lane = 0; lane < kExampleBatchSize; lane++) {
+            const QuantizedNode& node = nodes[node_idxs[lane]];
+            const uint32_t right_idx = node.right_idx;
+            // 1 for a non-leaf node, 0 for a leaf. The "feature_idx" of a leaf
+            // is not a feature index, so the first bin is tested instead.
+            const uint32_t is_internal = right_idx != 0;
+            const uint32_t feature_idx = node.feature_idx & (0u - is_internal);
+            const uint32_t condition =
+                block_bins[lane * num_bins_per_example + feature_idx] >=
+                node.threshold;
+            // "right_idx" if the condition is true, 1 if the condition is
+            // false, and 0 if the node is a leaf.
+            const uint32_t step =
+                condition * right_idx + ((1 - condition) & is_internal);
+            node_idxs[lane] += step;
+            any_step |= step;
+          }
+        } while (any_step);
+
+        for (int lane = 0; lane < kExampleBatchSize; lane++) {
+          outputs[example_idx + lane] +=
+              LeafValue(model, nodes[node_idxs[lane]]);
+        }
+      }
+    }
+  }
+
+  // Remaining examples.
+  for (; example_idx < num_examples; example_idx++) {
+    const QuantizedNode::Bin* const example_bins =
+        bins + example_idx * num_bins_per_example;
+    float output = 0.f;
+    for (int tree_idx = begin_tree_idx; tree_idx < end_tree_idx; tree_idx++) {
+      output += GetLeafValue(model, model.root_offsets[tree_idx], example_bins);
+    }
+    outputs[example_idx] += output;
+  }
+}
+
+// Computes the sum of the leaf values of all the trees, and applies an
+// activation function.
+template <typename Model, float (*Activation)(const Model&, float)>
+void PredictSingleDimension(const Model& model,
+                            const typename Model::ExampleSet& examples,
+                            const int num_examples,
+                            std::vector<float>* predictions) {
+  utils::usage::OnInference(num_examples);
+  predictions->resize(num_examples);
+  const int num_features = model.features().fixed_length_features().size();
+  const int num_trees = model.root_offsets.size();
+  const auto& values = examples.InternalCategoricalAndNumericalValues();
+
+  // Quantized values and outputs of a block of examples.
+  std::vector<QuantizedNode::Bin> bins(kExampleBatchSize * 2 * num_features);
+  float outputs[kExampleBatchSize];
+
+  for (int begin_example_idx = 0; begin_example_idx < num_examples;
+       begin_example_idx += kExampleBatchSize) {
+    const int block_size =
+        std::min(kExampleBatchSize, num_examples - begin_example_idx);
+    for (int lane = 0; lane < block_size; lane++) {
+      QuantizeExample(model,
+                      &values[(begin_example_idx + lane) * num_features],
+                      &bins[lane * 2 * num_features]);
+    }
+    std::fill(outputs, outputs + block_size, 0.f);
+    AddLeafValues(model, bins.data(), block_size, 0, num_trees, outputs);
+    for (int lane = 0; lane < block_size; lane++) {
+      (*predictions)[begin_example_idx + lane] =
+          Activation(model, outputs[lane]);
+    }
+  }
+}
+
+// Tree-parallel version of "PredictSingleDimension". The examples are
+// quantized once, and the trees are partitioned into contiguous ranges
+// evaluated by the threads of "thread_pool" and by the calling thread (see
+// "PredictTreeParallel" in "decision_forest.h").
+template <typename Model, float (*Activation)(const Model&, float)>
+void PredictSingleDimensionTreeParallel(
+    const Model& model, const typename Model::ExampleSet& examples,
+    const int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  const int num_trees = model.root_offsets.size();
+  int num_partitions = 1;
+  if (thread_pool) {
+    num_partitions = std::min(thread_pool->num_threads() + 1,
+                              num_trees / kMinNumTreesPerPartition);
+  }
+  if (num_partitions <= 1) {
+    PredictSingleDimension<Model, Activation>(model, examples, num_examples,
+                                              predictions);
+    return;
+  }
+
+  utils::usage::OnInference(num_examples);
+  predictions->resize(num_examples);
+  const int num_features = model.features().fixed_length_features().size();
+  const int num_trees_per_partition =
+      (num_trees + num_partitions - 1) / num_partitions;
+  num_partitions =
+      (num_trees + num_trees_per_partition - 1) / num_trees_per_partition;
+
+  const auto& values = examples.InternalCategoricalAndNumericalValues();
+  std::vector<QuantizedNode::Bin> bins(
+      static_cast<size_t>(num_examples) * 2 * num_features);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    QuantizeExample(model, &values[example_idx * num_features],
+                    &bins[example_idx * 2 * num_features]);
+  }
+
+  // "partial_outputs[i + j * num_examples]" is the sum of the leaf values of
+  // the "j-th" partition of trees for the "i-th" example.
+  std::vector<float> partial_outputs(num_partitions * num_examples, 0.f);
+  const auto run_partition = [&](const int partition_idx) {
+    const int begin_tree_idx = partition_idx * num_trees_per_partition;
+    const int end_tree_idx =
+        std::min(begin_tree_idx + num_trees_per_partition, num_trees);
+    AddLeafValues(model, bins.data(), num_examples, begin_tree_idx,
+                  end_tree_idx, &partial_outputs[partition_idx * num_examples]);
+  };
+
+  // The first partition is evaluated by the calling thread.
+  absl::BlockingCounter pending_partitions(num_partitions - 1);
+  for (int partition_idx = 1; partition_idx < num_partitions;
+       partition_idx++) {
+    thread_pool->Schedule([&, partition_idx]() {
+      run_partition(partition_idx);
+      pending_partitions.DecrementCount();
+    });
+  }
+  run_partition(0);
+  pending_partitions.Wait();
+
+  // The partitions are always reduced in the same order, so the predictions
+  // are deterministic.
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    float output = 0.f;
+    for (int partition_idx = 0; partition_idx < num_partitions;
+         partition_idx++) {
+      output += partial_outputs[partition_idx * num_examples + example_idx];
+    }
+    (*predictions)[example_idx] = Activation(model, output);
+  }
+}
+
+template <typename Model>
+float ActivationAddInitialPrediction(const Model& model, const float value) {
+  return value + model.initial_prediction;
+}
+
+template <typename Model>
+float ActivationBinomialLogLikelihood(const Model& model, const float value) {
+  return utils::clamp(
+      1.f / (1.f + std::exp(-(value + model.initial_prediction))), 0.f, 1.f);
+}
+
+template <typename Model>
+float ActivationClamp01(const Model& model, const float value) {
+  return utils::clamp(value, 0.f, 1.f);
+}
+
+template <typename Model>
+float ActivationIdentity(const Model& model, const float value) {
+  return value;
+}
+
+}  // namespace
+
+template <>
+void Predict(
+    const GradientBoostedTreesBinaryClassificationQuantized& model,
+    const typename GradientBoostedTreesBinaryClassificationQuantized::
+        ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions) {
+  PredictSingleDimension<
+      GradientBoostedTreesBinaryClassificationQuantized,
+      ActivationBinomialLogLikelihood<
+          GradientBoostedTreesBinaryClassificationQuantized>>(
+      model, examples, num_examples, predictions);
+}
+
+template <>
+void Predict(const GradientBoostedTreesRegressionQuantized& model,
+             const typename GradientBoostedTreesRegressionQuantized::ExampleSet&
+                 examples,
+             int num_examples, std::vector<float>* predictions) {
+  PredictSingleDimension<GradientBoostedTreesRegressionQuantized,
+                         ActivationAddInitialPrediction<
+                             GradientBoostedTreesRegressionQuantized>>(
+      model, examples, num_examples, predictions);
+}
+
+template <>
+void Predict(const GradientBoostedTreesRankingQuantized& model,
+             const typename GradientBoostedTreesRankingQuantized::ExampleSet&
+                 examples,
+             int num_examples, std::vector<float>* predictions) {
+  PredictSingleDimension<
+      GradientBoostedTreesRankingQuantized,
+      ActivationAddInitialPrediction<GradientBoostedTreesRankingQuantized>>(
+      model, examples, num_examples, predictions);
+}
+
+template <>
+void Predict(
+    const GradientBoostedTreesMulticlassClassificationQuantized& model,
+    const typename GradientBoostedTreesMulticlassClassificationQuantized::
+        ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions) {
+  utils::usage::OnInference(num_examples);
+  const int num_classes = model.num_classes;
+  predictions->assign(static_cast<size_t>(num_examples) * num_classes, 0.f);
+  const int num_features = model.features().fixed_length_features().size();
+  std::vector<QuantizedNode::Bin> bins(2 * num_features);
+  const auto& values = examples.InternalCategoricalAndNumericalValues();
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    QuantizeExample(model, &values[example_idx * num_features], bins.data());
+    float* const output = &(*predictions)[example_idx * num_classes];
+    for (int tree_idx = 0; tree_idx < model.root_offsets.size(); tree_idx++) {
+      output[tree_idx % num_classes] +=
+          GetLeafValue(model, model.root_offsets[tree_idx], bins.data());
+    }
+
+    // Softmax.
+    float sum = 0.f;
+    for (int class_idx = 0; class_idx < num_classes; class_idx++) {
+      output[class_idx] = std::exp(output[class_idx]);
+      sum += output[class_idx];
+    }
+    const float normalize = 1.f / sum;
+    for (int class_idx = 0; class_idx < num_classes; class_idx++) {
+      output[class_idx] *= normalize;
+    }
+  }
+}
+
+template <>
+void Predict(
+    const RandomForestBinaryClassificationQuantized& model,
+    const typename RandomForestBinaryClassificationQuantized::ExampleSet&
+        examples,
+    int num_examples, std::vector<float>* predictions) {
+  PredictSingleDimension<
+      RandomForestBinaryClassificationQuantized,
+      ActivationClamp01<RandomForestBinaryClassificationQuantized>>(
+      model, examples, num_examples, predictions);
+}
+
+template <>
+void Predict(
+    const RandomForestRegressionQuantized& model,
+    const typename RandomForestRegressionQuantized::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions) {
+  PredictSingleDimension<
+      RandomForestRegressionQuantized,
+      ActivationIdentity<RandomForestRegressionQuantized>>(
+      model, examples, num_examples, predictions);
+}
+
+template <>
+void PredictTreeParallel(
+    const GradientBoostedTreesBinaryClassificationQuantized& model,
+    const typename GradientBoostedTreesBinaryClassificationQuantized::
+        ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictSingleDimensionTreeParallel<
+      GradientBoostedTreesBinaryClassificationQuantized,
+      ActivationBinomialLogLikelihood<
+          GradientBoostedTreesBinaryClassificationQuantized>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+template <>
+void PredictTreeParallel(
+    const GradientBoostedTreesRegressionQuantized& model,
+    const typename GradientBoostedTreesRegressionQuantized::ExampleSet&
+        examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictSingleDimensionTreeParallel<
+      GradientBoostedTreesRegressionQuantized,
+      ActivationAddInitialPrediction<GradientBoostedTreesRegressionQuantized>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+template <>
+void PredictTreeParallel(
+    const GradientBoostedTreesRankingQuantized& model,
+    const typename GradientBoostedTreesRankingQuantized::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictSingleDimensionTreeParallel<
+      GradientBoostedTreesRankingQuantized,
+      ActivationAddInitialPrediction<GradientBoostedTreesRankingQuantized>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+template <>
+void PredictTreeParallel(
+    const RandomForestBinaryClassificationQuantized& model,
+    const typename RandomForestBinaryClassificationQuantized::ExampleSet&
+        examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictSingleDimensionTreeParallel<
+      RandomForestBinaryClassificationQuantized,
+      ActivationClamp01<RandomForestBinaryClassificationQuantized>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+template <>
+void PredictTreeParallel(
+    const RandomForestRegressionQuantized& model,
+    const typename RandomForestRegressionQuantized::ExampleSet& examples,
+    int num_examples, std::vector<float>* predictions,
+    utils::concurrency::ThreadPool* thread_pool) {
+  PredictSingleDimensionTreeParallel<
+      RandomForestRegressionQuantized,
+      ActivationIdentity<RandomForestRegressionQuantized>>(
+      model, examples, num_examples, predictions, thread_pool);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const GradientBoostedTreesModel& src,
+    GradientBoostedTreesBinaryClassificationQuantized* dst) {
+  if (src.loss() != Loss::BINOMIAL_LOG_LIKELIHOOD ||
+      src.initial_predictions().size() != 1) {
+    return absl::InvalidArgumentError(
+        "The GBDT is not trained for binary classification with binomial log "
+        "likelihood loss.");
+  }
+  RETURN_IF_ERROR(GradientBoostedTreesToSpecializedModel(src, dst));
+  dst->initial_prediction = src.initial_predictions()[0];
+  return absl::OkStatus();
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const GradientBoostedTreesModel& src,
+    GradientBoostedTreesRegressionQuantized* dst) {
+  if (src.loss() != Loss::SQUARED_ERROR) {
+    return absl::InvalidArgumentError(
+        "The GBDT is not trained for regression with squared error loss.");
+  }
+  RETURN_IF_ERROR(GradientBoostedTreesToSpecializedModel(src, dst));
+  dst->initial_prediction = src.initial_predictions()[0];
+  return absl::OkStatus();
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const GradientBoostedTreesModel& src,
+    GradientBoostedTreesRankingQuantized* dst) {
+  if (src.loss() != Loss::LAMBDA_MART_NDCG5 &&
+      src.loss() != Loss::XE_NDCG_MART) {
+    return absl::InvalidArgumentError(
+        "The GBDT is not trained for ranking with ranking loss.");
+  }
+  RETURN_IF_ERROR(GradientBoostedTreesToSpecializedModel(src, dst));
+  dst->initial_prediction = src.initial_predictions()[0];
+  return absl::OkStatus();
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const GradientBoostedTreesModel& src,
+    GradientBoostedTreesMulticlassClassificationQuantized* dst) {
+  if (src.loss() != Loss::MULTINOMIAL_LOG_LIKELIHOOD) {
+    return absl::InvalidArgumentError(
+        "The GBDT is not trained for multi-class classification with "
+        "multinomial log likelihood loss.");
+  }
+  dst->num_classes =
+      src.label_col_spec().categorical().number_of_unique_values() - 1;
+  if (dst->num_classes != src.num_trees_per_iter()) {
+    return absl::InvalidArgumentError(
+        "The number of trees per iteration does not match the number of "
+        "classes.");
+  }
+  // Note: The multinomial log likelihood loss does not use initial
+  // predictions.
+  return GradientBoostedTreesToSpecializedModel(src, dst);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const RandomForestModel& src,
+    RandomForestBinaryClassificationQuantized* dst) {
+  if (src.label_col_spec().categorical().number_of_unique_values() != 3) {
+    return absl::InvalidArgumentError(
+        "The RF is not trained for binary classification.");
+  }
+  const float normalization = 1.f / src.NumTrees();
+  const bool winner_take_all = src.winner_take_all_inference();
+  // Probability of the positive class, divided by the number of trees.
+  const auto set_leaf_value =
+      [&](const model::decision_tree::proto::Node& src_node,
+          float* dst_value) -> absl::Status {
+    if (winner_take_all) {
+      const int32_t vote = src_node.classifier().top_value();
+      if (vote == dataset::kOutOfDictionaryItemIndex) {
+        return absl::InvalidArgumentError(
+            "This inference engine optimized for speed only supports model "
+            "outputting out-of-bag values.");
+      }
+      *dst_value = (vote == 2) ? normalization : 0.f;
+    } else {
+      const auto& distribution = src_node.classifier().distribution();
+      if (distribution.counts_size() != 3) {
+        return absl::InvalidArgumentError("The RF is not a binary classifier.");
+      }
+      *dst_value = static_cast<float>(distribution.counts(2) /
+                                      distribution.sum() * normalization);
+    }
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(const RandomForestModel& src,
+                                       RandomForestRegressionQuantized* dst) {
+  const float normalization = 1.f / src.NumTrees();
+  const auto set_leaf_value =
+      [&](const model::decision_tree::proto::Node& src_node,
+          float* dst_value) -> absl::Status {
+    *dst_value = src_node.regressor().top_value() * normalization;
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
+}
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
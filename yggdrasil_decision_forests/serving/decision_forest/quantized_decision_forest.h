@@ -0,0 +1,212 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Inference of decision forests with quantized thresholds and compact nodes.
+//
+// The thresholds of the conditions are replaced by bin indices. The bins of a
+// numerical feature are defined by the sorted set of unique thresholds used by
+// the model on this feature: The bin of a feature value "x" is the number of
+// thresholds smaller or equal to "x". The condition "x >= thresholds[i]" is
+// then equivalent to "bin(x) >= i + 1". The feature values of an example are
+// quantized once (one binary search per feature), and the trees are evaluated
+// on the bin indices.
+//
+// Because a bin index and a feature index fit in 16 bits each, a node takes 6
+// bytes (instead of 12-16 bytes for "GenericNode"). This reduces the memory
+// footprint of large models (e.g. 1000s of trees), and therefore the cache
+// misses, while producing the same predictions as the generic engine.
+//
+// Except for multi-class classification, blocks of 8 examples go down each tree
+// in lockstep with a branch-free child selection (see
+// "PredictWithExampleSetBatched" in "decision_forest.h").
+//
+// By default, the nodes are stored in "hot path" order: The child reached by
+// the most training examples (see the "num_*_training_examples_without_weight"
+// fields of "NodeCondition") is stored right after its parent, so that the
+// most likely path reads contiguous memory. When this child is the positive
+// one, the condition is inverted: "b < t" is evaluated as "~b >= ~t + 1" on
+// the bitwise negated bin "~b", which is computed along with the bins.
+//
+// The current implementation support:
+//   - GBDTs for regression, ranking, binary classification and multi-class
+//     classification.
+//   - Random Forests for regression and binary classification.
+//   - Numerical "is higher" conditions and boolean "is true" conditions, with
+//     less than 65535 unique thresholds per feature.
+//   - Trees with less than 65535 nodes, and less than 32768 input features.
+//   - Missing values are replaced by the global imputation.
+//
+// Usage example:
+//
+//   GradientBoostedTreesBinaryClassificationQuantized compiled_model;
+//   CHECK_OK(GenericToSpecializedModel(generic_model, &compiled_model));
+//   GradientBoostedTreesBinaryClassificationQuantized::ExampleSet examples(
+//     5, compiled_model);
+//   ...
+//   std::vector<float> predictions;
+//   Predict(compiled_model, examples, 5, &predictions);
+//
+#ifndef YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_QUANTIZED_DECISION_FOREST_H_
+#define YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_QUANTIZED_DECISION_FOREST_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "yggdrasil_decision_forests/model/abstract_model.pb.h"
+#include "yggdrasil_decision_forests/serving/example_set.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+
+// Node of a quantized decision tree.
+struct QuantizedNode {
+  using NodeOffset = uint16_t;
+  using Bin = uint16_t;
+
+  // Offset to the child node reached when the condition is true. The child
+  // reached when the condition is false is the next node. 0 if is leaf.
+  NodeOffset right_idx;
+  // If the node is not a leaf, the condition is:
+  //   bins[feature_idx] >= threshold
+  // where "bins" are the quantized feature values of the example followed by
+  // their bitwise negations (i.e. "bins[num_features + i] = ~bins[i]").
+  //
+  // If the node is a leaf, "feature_idx | (threshold << 16)" is the index of
+  // the leaf value in "leaf_values".
+  uint16_t feature_idx;
+  Bin threshold;
+};
+
+static_assert(sizeof(QuantizedNode) == 6, "Unexpected size of QuantizedNode");
+
+namespace internal {
+
+// Base model representation compatible with the quantized inference.
+struct QuantizedModel {
+  using ExampleSet =
+      ExampleSetNumericalOrCategoricalFlat<QuantizedModel,
+                                           ExampleFormat::FORMAT_EXAMPLE_MAJOR>;
+
+  const ExampleSet::FeaturesDefinition& features() const {
+    return internal_features;
+  }
+
+  ExampleSet::FeaturesDefinition* mutable_features() {
+    return &internal_features;
+  }
+
+  // Order of the nodes of a tree.
+  enum class NodeLayout {
+    // Depth-first <node, negative child, positive child> order.
+    kDepthFirst,
+    // Depth-first order, where the child reached by the most training examples
+    // is visited first. Equivalent to "kDepthFirst" if the model does not
+    // contain training statistics.
+    kHotPath,
+  };
+
+  // Layout of the nodes. Should be set before calling
+  // "GenericToSpecializedModel".
+  NodeLayout node_layout = NodeLayout::kHotPath;
+
+  // The list of nodes in the model, ordered according to "node_layout".
+  std::vector<QuantizedNode> nodes;
+  // The indices (in "nodes") of the root nodes.
+  std::vector<int32_t> root_offsets;
+  // Value (i.e. prediction) of each leaf.
+  std::vector<float> leaf_values;
+
+  // Sorted unique thresholds of each fixed-length feature.
+  // "thresholds[threshold_offsets[i], threshold_offsets[i+1])" are the
+  // thresholds of the feature with internal index "i". Features without
+  // conditions (e.g. unused categorical features) have no thresholds and a
+  // bin index of 0.
+  std::vector<float> thresholds;
+  std::vector<int32_t> threshold_offsets;
+
+  ExampleSet::FeaturesDefinition internal_features;
+};
+
+}  // namespace internal
+
+// Specialization of the quantized model for GBDT binary classification.
+struct GradientBoostedTreesBinaryClassificationQuantized
+    : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+  float initial_prediction = 0.f;
+};
+
+// Specialization of the quantized model for GBDT multi-class classification.
+// The "j-th" tree contributes to the "j % num_classes"-th class.
+struct GradientBoostedTreesMulticlassClassificationQuantized
+    : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+  int num_classes;
+};
+
+// Specialization of the quantized model for GBDT regression.
+struct GradientBoostedTreesRegressionQuantized : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask = model::proto::Task::REGRESSION;
+  float initial_prediction = 0.f;
+};
+
+// Specialization of the quantized model for GBDT ranking.
+struct GradientBoostedTreesRankingQuantized : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask = model::proto::Task::RANKING;
+  float initial_prediction = 0.f;
+};
+
+// Specialization of the quantized model for Random Forest binary
+// classification.
+struct RandomForestBinaryClassificationQuantized : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+};
+
+// Specialization of the quantized model for Random Forest regression.
+struct RandomForestRegressionQuantized : internal::QuantizedModel {
+  static constexpr model::proto::Task kTask = model::proto::Task::REGRESSION;
+};
+
+// Converts a generic GradientBoostedTreesModel or RandomForestModel into a
+// quantized model.
+template <typename AbstractModel, typename CompiledModel>
+absl::Status GenericToSpecializedModel(const AbstractModel& src,
+                                       CompiledModel* dst);
+
+// Computes the predictions of a set of examples.
+template <typename Model>
+void Predict(const Model& model, const typename Model::ExampleSet& examples,
+             int num_examples, std::vector<float>* predictions);
+
+// Tree-parallel version of "Predict" for small sets of examples on large
+// models (see "PredictTreeParallel" in "decision_forest.h"). Not available for
+// multi-class classification.
+template <typename Model>
+void PredictTreeParallel(const Model& model,
+                         const typename Model::ExampleSet& examples,
+                         int num_examples, std::vector<float>* predictions,
+                         utils::concurrency::ThreadPool* thread_pool);
+
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
+
+#endif  // YGGDRASIL_DECISION_FORESTS_SERVING_DECISION_FOREST_QUANTIZED_DECISION_FOREST_H_
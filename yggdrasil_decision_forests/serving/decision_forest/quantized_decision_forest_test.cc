@@ -0,0 +1,431 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/decision_forest/quantized_decision_forest.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
+#include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/model/prediction.pb.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/register_engines.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+#include "yggdrasil_decision_forests/utils/test.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace decision_forest {
+namespace {
+
+using model::decision_tree::DecisionTree;
+using model::decision_tree::NodeWithChildren;
+using model::gradient_boosted_trees::GradientBoostedTreesModel;
+using model::gradient_boosted_trees::proto::Loss;
+using model::random_forest::RandomForestModel;
+using testing::ElementsAre;
+
+std::string TestDataDir() {
+  return file::JoinPath(test::DataRootDirectory(),
+                        "yggdrasil_decision_forests/test_data");
+}
+
+// Splits a node on a numerical or boolean feature.
+void SetCondition(const int attribute, const float threshold,
+                  const bool is_boolean, NodeWithChildren* node) {
+  node->CreateChildren();
+  auto* condition = node->mutable_node()->mutable_condition();
+  condition->set_attribute(attribute);
+  if (is_boolean) {
+    condition->mutable_condition()->mutable_true_value_condition();
+  } else {
+    condition->mutable_condition()->mutable_higher_condition()->set_threshold(
+        threshold);
+  }
+}
+
+void SetLeaf(const float value, NodeWithChildren* node) {
+  node->mutable_node()->mutable_regressor()->set_top_value(value);
+}
+
+// Builds a GBT regression model with a numerical ("a") and a boolean ("b")
+// feature:
+//   Tree 1: a>=1 ? (a>=3 ? 1 : 2) : (b ? 3 : 4)
+//   Tree 2: a>=3 ? 10 : (a>=2 ? 20 : 30)
+void BuildToyModel(GradientBoostedTreesModel* model) {
+  const dataset::proto::DataSpecification dataspec = PARSE_TEST_PROTO(R"pb(
+    columns { type: NUMERICAL name: "l" }
+    columns { type: NUMERICAL name: "a" numerical { mean: 0 } }
+    columns {
+      type: BOOLEAN
+      name: "b"
+      boolean { count_true: 1 count_false: 2 }
+    }
+  )pb");
+
+  model->set_task(model::proto::Task::REGRESSION);
+  model->set_label_col_idx(0);
+  model->set_data_spec(dataspec);
+  model->set_loss(Loss::SQUARED_ERROR);
+  model->mutable_initial_predictions()->push_back(100.f);
+
+  {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    auto* root = tree->mutable_root();
+    SetCondition(1, 1.f, false, root);
+    SetCondition(1, 3.f, false, root->mutable_pos_child());
+    SetLeaf(1.f, root->mutable_pos_child()->mutable_pos_child());
+    SetLeaf(2.f, root->mutable_pos_child()->mutable_neg_child());
+    SetCondition(2, 0.f, true, root->mutable_neg_child());
+    SetLeaf(3.f, root->mutable_neg_child()->mutable_pos_child());
+    SetLeaf(4.f, root->mutable_neg_child()->mutable_neg_child());
+    model->mutable_decision_trees()->push_back(std::move(tree));
+  }
+
+  {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    auto* root = tree->mutable_root();
+    SetCondition(1, 3.f, false, root);
+    SetLeaf(10.f, root->mutable_pos_child());
+    SetCondition(1, 2.f, false, root->mutable_neg_child());
+    SetLeaf(20.f, root->mutable_neg_child()->mutable_pos_child());
+    SetLeaf(30.f, root->mutable_neg_child()->mutable_neg_child());
+    model->mutable_decision_trees()->push_back(std::move(tree));
+  }
+}
+
+TEST(QuantizedDecisionForest, Compilation) {
+  GradientBoostedTreesModel model;
+  BuildToyModel(&model);
+
+  GradientBoostedTreesRegressionQuantized quantized_model;
+  CHECK_OK(GenericToSpecializedModel(model, &quantized_model));
+
+  EXPECT_EQ(quantized_model.features().input_features().size(), 2);
+  EXPECT_THAT(quantized_model.thresholds, ElementsAre(1.f, 2.f, 3.f, 0.5f));
+  EXPECT_THAT(quantized_model.threshold_offsets, ElementsAre(0, 3, 4));
+  EXPECT_THAT(quantized_model.root_offsets, ElementsAre(0, 7));
+  EXPECT_EQ(quantized_model.nodes.size(), 12);
+  EXPECT_EQ(quantized_model.leaf_values.size(), 7);
+  EXPECT_EQ(quantized_model.initial_prediction, 100.f);
+
+  using ExampleSet = GradientBoostedTreesRegressionQuantized::ExampleSet;
+  const int num_examples = 6;
+  ExampleSet examples(num_examples, quantized_model);
+  examples.FillMissing(quantized_model);
+  const auto feature_a =
+      ExampleSet::GetNumericalFeatureId("a", quantized_model).value();
+  const auto feature_b =
+      ExampleSet::GetBooleanFeatureId("b", quantized_model).value();
+
+  // The feature values equal to a threshold check the "greater or equal"
+  // semantic. The last example only contains missing values.
+  const std::vector<float> values_a = {0.f, 1.f, 2.f, 3.f, 0.5f};
+  const std::vector<bool> values_b = {false, true, true, false, true};
+  for (int example_idx = 0; example_idx < values_a.size(); example_idx++) {
+    examples.SetNumerical(example_idx, feature_a, values_a[example_idx],
+                          quantized_model);
+    examples.SetBoolean(example_idx, feature_b, values_b[example_idx],
+                        quantized_model);
+  }
+
+  std::vector<float> predictions;
+  Predict(quantized_model, examples, num_examples, &predictions);
+  EXPECT_THAT(predictions, ElementsAre(134.f, 132.f, 122.f, 111.f, 133.f,
+                                       134.f));
+}
+
+TEST(QuantizedDecisionForest, HotPathLayout) {
+  GradientBoostedTreesModel model;
+  BuildToyModel(&model);
+  // Most of the training examples reached the positive branch of the root of
+  // the first tree.
+  auto* root_condition = model.mutable_decision_trees()
+                             ->front()
+                             ->mutable_root()
+                             ->mutable_node()
+                             ->mutable_condition();
+  root_condition->set_num_training_examples_without_weight(10);
+  root_condition->set_num_pos_training_examples_without_weight(7);
+
+  GradientBoostedTreesRegressionQuantized depth_first_model;
+  depth_first_model.node_layout =
+      GradientBoostedTreesRegressionQuantized::NodeLayout::kDepthFirst;
+  CHECK_OK(GenericToSpecializedModel(model, &depth_first_model));
+
+  GradientBoostedTreesRegressionQuantized hot_path_model;
+  CHECK_OK(GenericToSpecializedModel(model, &hot_path_model));
+
+  // The root condition "a>=1" i.e. "bin(a) >= 1" is inverted into
+  // "~bin(a) >= 0xFFFF" (i.e. "bin(a) < 1"), and the positive child "a>=3" is
+  // stored right after the root.
+  EXPECT_EQ(hot_path_model.nodes.size(), depth_first_model.nodes.size());
+  EXPECT_EQ(hot_path_model.nodes[0].feature_idx, 2);
+  EXPECT_EQ(hot_path_model.nodes[0].threshold, 0xFFFF);
+  EXPECT_EQ(hot_path_model.nodes[0].right_idx, 4);
+  EXPECT_EQ(hot_path_model.nodes[1].feature_idx, 0);
+  EXPECT_EQ(hot_path_model.nodes[1].threshold, 3);
+  EXPECT_EQ(depth_first_model.nodes[0].feature_idx, 0);
+  EXPECT_EQ(depth_first_model.nodes[0].threshold, 1);
+
+  using ExampleSet = GradientBoostedTreesRegressionQuantized::ExampleSet;
+  const std::vector<float> values_a = {0.f, 0.5f, 1.f, 2.f, 3.f, 4.f};
+  const int num_examples = values_a.size();
+  ExampleSet examples(num_examples, hot_path_model);
+  examples.FillMissing(hot_path_model);
+  const auto feature_a =
+      ExampleSet::GetNumericalFeatureId("a", hot_path_model).value();
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    examples.SetNumerical(example_idx, feature_a, values_a[example_idx],
+                          hot_path_model);
+  }
+
+  std::vector<float> depth_first_predictions;
+  Predict(depth_first_model, examples, num_examples, &depth_first_predictions);
+  std::vector<float> hot_path_predictions;
+  Predict(hot_path_model, examples, num_examples, &hot_path_predictions);
+  EXPECT_EQ(hot_path_predictions, depth_first_predictions);
+  EXPECT_THAT(hot_path_predictions,
+              ElementsAre(134.f, 134.f, 132.f, 122.f, 111.f, 111.f));
+}
+
+TEST(QuantizedDecisionForest, NonSupportedCondition) {
+  GradientBoostedTreesModel model;
+  BuildToyModel(&model);
+  model.mutable_decision_trees()
+      ->front()
+      ->mutable_root()
+      ->mutable_node()
+      ->mutable_condition()
+      ->mutable_condition()
+      ->mutable_contains_condition()
+      ->add_elements(1);
+
+  GradientBoostedTreesRegressionQuantized quantized_model;
+  EXPECT_FALSE(GenericToSpecializedModel(model, &quantized_model).ok());
+}
+
+TEST(QuantizedDecisionForest, RandomForest) {
+  const dataset::proto::DataSpecification dataspec = PARSE_TEST_PROTO(R"pb(
+    columns {
+      type: CATEGORICAL
+      name: "l"
+      categorical { is_already_integerized: true number_of_unique_values: 3 }
+    }
+    columns { type: NUMERICAL name: "a" }
+  )pb");
+
+  // Two stumps on "a" with different thresholds. The leaves contain the class
+  // distributions (the first element is the out-of-dictionary class) and the
+  // majority class.
+  RandomForestModel model;
+  model.set_label_col_idx(0);
+  model.set_data_spec(dataspec);
+  const std::vector<float> thresholds = {1.f, 2.f};
+  const std::vector<std::vector<float>> leaf_counts = {
+      {0.f, 3.f, 1.f}, {0.f, 1.f, 3.f}, {0.f, 1.f, 2.f}, {0.f, 2.f, 1.f}};
+  for (int tree_idx = 0; tree_idx < thresholds.size(); tree_idx++) {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    auto* root = tree->mutable_root();
+    SetCondition(1, thresholds[tree_idx], false, root);
+    for (int child_idx = 0; child_idx < 2; child_idx++) {
+      const auto& counts = leaf_counts[2 * tree_idx + child_idx];
+      auto* leaf =
+          child_idx ? root->mutable_pos_child() : root->mutable_neg_child();
+      auto* classifier = leaf->mutable_node()->mutable_classifier();
+      for (const float count : counts) {
+        classifier->mutable_distribution()->add_counts(count);
+      }
+      classifier->mutable_distribution()->set_sum(counts[1] + counts[2]);
+      classifier->set_top_value(counts[2] > counts[1] ? 2 : 1);
+    }
+    model.mutable_decision_trees()->push_back(std::move(tree));
+  }
+
+  const std::vector<float> feature_values = {0.5f, 1.f, 1.5f, 2.f, 2.5f};
+  const int num_examples = feature_values.size();
+
+  const auto check_predictions = [&](const auto& quantized_model,
+                                     const auto get_expected_prediction) {
+    using ExampleSet =
+        typename std::remove_reference_t<decltype(quantized_model)>::ExampleSet;
+    ExampleSet examples(num_examples, quantized_model);
+    examples.FillMissing(quantized_model);
+    const auto feature =
+        ExampleSet::GetNumericalFeatureId("a", quantized_model).value();
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      examples.SetNumerical(example_idx, feature, feature_values[example_idx],
+                            quantized_model);
+    }
+    std::vector<float> predictions;
+    Predict(quantized_model, examples, num_examples, &predictions);
+    ASSERT_EQ(predictions.size(), num_examples);
+
+    // Compares the predictions with the generic engine.
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      dataset::proto::Example example;
+      example.add_attributes();
+      example.add_attributes()->set_numerical(feature_values[example_idx]);
+      model::proto::Prediction prediction;
+      model.Predict(example, &prediction);
+      EXPECT_NEAR(predictions[example_idx], get_expected_prediction(prediction),
+                  1e-6f);
+    }
+  };
+
+  model.set_task(model::proto::Task::CLASSIFICATION);
+  for (const bool winner_take_all : {true, false}) {
+    LOG(INFO) << "Winner take all: " << winner_take_all;
+    model.set_winner_take_all_inference(winner_take_all);
+    RandomForestBinaryClassificationQuantized quantized_model;
+    CHECK_OK(GenericToSpecializedModel(model, &quantized_model));
+    check_predictions(quantized_model,
+                      [](const model::proto::Prediction& prediction) {
+                        const auto& distribution =
+                            prediction.classification().distribution();
+                        return distribution.counts(2) / distribution.sum();
+                      });
+  }
+
+  // Replace the class distributions with regression values.
+  model.set_task(model::proto::Task::REGRESSION);
+  for (auto& tree : *model.mutable_decision_trees()) {
+    tree->IterateOnMutableNodes(
+        [](NodeWithChildren* node, const int depth) {
+          if (node->IsLeaf()) {
+            SetLeaf(node->node().classifier().distribution().counts(2), node);
+          }
+        });
+  }
+  RandomForestRegressionQuantized quantized_model;
+  CHECK_OK(GenericToSpecializedModel(model, &quantized_model));
+  check_predictions(quantized_model,
+                    [](const model::proto::Prediction& prediction) {
+                      return prediction.regression().value();
+                    });
+}
+
+// The quantized engine returns the same predictions as the generic engine.
+TEST(QuantizedDecisionForest, SameAsGenericEngine) {
+  for (const auto& model_and_dataset :
+       std::vector<std::pair<std::string, std::string>>{
+           {"adult_binary_class_gbdt_only_num", "adult_test.csv"},
+           {"iris_multi_class_gbdt", "iris.csv"}}) {
+    LOG(INFO) << "Model: " << model_and_dataset.first;
+    std::unique_ptr<model::AbstractModel> model;
+    CHECK_OK(model::LoadModel(
+        file::JoinPath(TestDataDir(), "model", model_and_dataset.first),
+        &model));
+    dataset::VerticalDataset dataset;
+    CHECK_OK(LoadVerticalDataset(
+        absl::StrCat("csv:", file::JoinPath(TestDataDir(), "dataset",
+                                            model_and_dataset.second)),
+        model->data_spec(), &dataset));
+
+    std::unique_ptr<FastEngine> generic_engine;
+    std::unique_ptr<FastEngine> quantized_engine;
+    for (const auto& factory : model->ListCompatibleFastEngines()) {
+      if (factory->name() == gradient_boosted_trees::kGeneric) {
+        generic_engine = factory->CreateEngine(model.get()).value();
+      } else if (factory->name() == gradient_boosted_trees::kQuantized) {
+        quantized_engine = factory->CreateEngine(model.get()).value();
+      }
+    }
+    ASSERT_TRUE(generic_engine);
+    ASSERT_TRUE(quantized_engine);
+
+    const auto predict = [&](const FastEngine& engine) {
+      auto examples = engine.AllocateExamples(dataset.nrow());
+      CHECK_OK(CopyVerticalDatasetToAbstractExampleSet(
+          dataset, 0, dataset.nrow(), engine.features(), examples.get()));
+      std::vector<float> predictions;
+      engine.Predict(*examples, dataset.nrow(), &predictions);
+      return predictions;
+    };
+    EXPECT_EQ(predict(*quantized_engine), predict(*generic_engine));
+  }
+}
+
+// The tree-parallel inference returns the same predictions as the sequential
+// inference.
+TEST(QuantizedDecisionForest, TreeParallel) {
+  std::unique_ptr<model::AbstractModel> model;
+  CHECK_OK(model::LoadModel(file::JoinPath(TestDataDir(), "model",
+                                           "adult_binary_class_gbdt_only_num"),
+                            &model));
+  dataset::VerticalDataset dataset;
+  CHECK_OK(LoadVerticalDataset(
+      absl::StrCat("csv:",
+                   file::JoinPath(TestDataDir(), "dataset", "adult_test.csv")),
+      model->data_spec(), &dataset));
+
+  auto* gbt_model = dynamic_cast<GradientBoostedTreesModel*>(model.get());
+  GradientBoostedTreesBinaryClassificationQuantized quantized_model;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &quantized_model));
+
+  // Makes the model large enough to be split into several partitions by
+  // repeating the trees.
+  const auto root_offsets = quantized_model.root_offsets;
+  while (quantized_model.root_offsets.size() < 4 * kMinNumTreesPerPartition) {
+    quantized_model.root_offsets.insert(quantized_model.root_offsets.end(),
+                                        root_offsets.begin(),
+                                        root_offsets.end());
+  }
+
+  // Not a multiple of the size of the blocks of examples.
+  const int num_examples = 13;
+  GradientBoostedTreesBinaryClassificationQuantized::ExampleSet examples(
+      num_examples, quantized_model);
+  CHECK_OK(CopyVerticalDatasetToAbstractExampleSet(
+      dataset, 0, num_examples, quantized_model.features(), &examples));
+
+  std::vector<float> expected_predictions;
+  Predict(quantized_model, examples, num_examples, &expected_predictions);
+
+  utils::concurrency::ThreadPool pool("inference", /*num_threads=*/3);
+  pool.StartWorkers();
+  std::vector<float> predictions;
+  PredictTreeParallel(quantized_model, examples, num_examples, &predictions,
+                      &pool);
+  ASSERT_EQ(predictions.size(), num_examples);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    EXPECT_NEAR(predictions[example_idx], expected_predictions[example_idx],
+                1e-5f);
+  }
+}
+
+}  // namespace
+}  // namespace decision_forest
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
@@ -17,9 +17,34 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
 #include "absl/status/status.h"
 
+// The SIMD kernels of all the instruction sets are compiled with function
+// attributes and selected at runtime according to the CPU. This is supported
+// by GCC and Clang on x86-64. Other compilers only use the instruction sets
+// enabled at compile time (e.g. "/arch:AVX2" for MSVC).
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define YDF_QUICK_SCORER_RUNTIME_DISPATCH
+#define YDF_QUICK_SCORER_TARGET(isa) __attribute__((target(isa)))
+#define YDF_QUICK_SCORER_SSE41
+#define YDF_QUICK_SCORER_AVX2
+#define YDF_QUICK_SCORER_AVX512
+#else
+#define YDF_QUICK_SCORER_TARGET(isa)
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+#define YDF_QUICK_SCORER_AVX512
+#endif
 #ifdef __AVX2__
+#define YDF_QUICK_SCORER_SSE41
+#define YDF_QUICK_SCORER_AVX2
+#endif
+#endif
+
+#if defined(YDF_QUICK_SCORER_SSE41) || defined(YDF_QUICK_SCORER_AVX512)
 #include <immintrin.h>
 #endif
 
@@ -27,6 +52,7 @@
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.pb.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
 #include "yggdrasil_decision_forests/utils/bitmap.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
 #include "yggdrasil_decision_forests/utils/usage.h"
@@ -48,7 +74,6 @@ namespace {
 constexpr size_t kMaxStackUsageInBytes = 16 * 1024;
 
 namespace portable {
-#ifdef __AVX2__
 void* aligned_alloc(std::size_t alignment, std::size_t size) {
 #if defined(_WIN32)
   // Visual Studio
@@ -65,7 +90,6 @@ void aligned_free(void* mem) {
   free(mem);
 #endif
 }
-#endif
 }  // namespace portable
 
 // Returns the number of trailing 0-bits in x, starting at the least significant
@@ -74,6 +98,58 @@ int FindLSBSetNonZero64(uint64_t n) {
   return utils::CountTrailingZeroesNonzero64(n);
 }
 
+// Returns the index of the first active leaf of a tree. "leaf_masks" points to
+// the first leaf mask of the tree, and "stride" is the distance between two
+// consecutive leaf masks of this tree. At least one leaf should be active.
+int FindFirstActiveLeaf(const LeafMask* leaf_masks, const int stride) {
+  int leaf_offset = 0;
+  while (*leaf_masks == 0) {
+    leaf_masks += stride;
+    leaf_offset += internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask;
+  }
+  return leaf_offset + FindLSBSetNonZero64(*leaf_masks);
+}
+
+// Computes the leaf mask (i.e. the bitmap that hides the leaves) over the
+// leaves "[begin_leaf_idx, end_leaf_idx)" for each of the leaf masks of a tree
+// overlapping this range. Leaf masks that do not overlap the range are not
+// listed. "first_leaf_mask_idx" is the leaf mask index of the first leaf mask
+// of the tree.
+//
+// Example:
+// If begin_leaf_idx=2 and end_leaf_idx = 5, the single output mask will be:
+//   "1100011111" + 54 * "1" (lower bit on the left).
+std::vector<std::pair<internal::QuickScorerExtendedModel::TreeIdx, LeafMask>>
+ComputeLeafMasks(const int first_leaf_mask_idx, const int begin_leaf_idx,
+                 const int end_leaf_idx) {
+  constexpr int kMaxLeafsPerLeafMask =
+      internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask;
+  std::vector<std::pair<internal::QuickScorerExtendedModel::TreeIdx, LeafMask>>
+      masks;
+  if (begin_leaf_idx >= end_leaf_idx) {
+    return masks;
+  }
+  const int begin_mask_idx = begin_leaf_idx / kMaxLeafsPerLeafMask;
+  const int end_mask_idx = (end_leaf_idx - 1) / kMaxLeafsPerLeafMask + 1;
+  for (int mask_idx = begin_mask_idx; mask_idx < end_mask_idx; mask_idx++) {
+    // Range of leaves to hide, relative to the current leaf mask.
+    const int begin_bit =
+        std::max(begin_leaf_idx - mask_idx * kMaxLeafsPerLeafMask, 0);
+    const int end_bit = std::min(end_leaf_idx - mask_idx * kMaxLeafsPerLeafMask,
+                                 kMaxLeafsPerLeafMask);
+    const auto start_leaf_mask =
+        (internal::QuickScorerExtendedModel::kOneLeafMask << begin_bit) - 1;
+    const auto after_neg_mask =
+        (end_bit == kMaxLeafsPerLeafMask)
+            ? ~internal::QuickScorerExtendedModel::kZeroLeafMask
+            : (internal::QuickScorerExtendedModel::kOneLeafMask << end_bit) -
+                  1;
+    masks.push_back({first_leaf_mask_idx + mask_idx,
+                     ~(after_neg_mask ^ start_leaf_mask)});
+  }
+  return masks;
+}
+
 // Activation function for binary classification GBDT trained with Binomial
 // LogLikelihood loss.
 float ActivationBinomialLogLikelihood(const float value) {
@@ -83,6 +159,26 @@ float ActivationBinomialLogLikelihood(const float value) {
 // Identity activation function.
 float ActivationIdentity(const float value) { return value; }
 
+// Clamps the value in [0, 1]. Used to remove numerical errors on probabilities.
+float ActivationClamp01(const float value) {
+  return utils::clamp(value, 0.f, 1.f);
+}
+
+// Activation function for multi-class classification GBDT trained with
+// Multinomial LogLikelihood loss i.e. softmax.
+void ActivationMultinomialLogLikelihood(float* const values,
+                                        const int num_values) {
+  float sum = 0;
+  for (int i = 0; i < num_values; i++) {
+    values[i] = std::exp(values[i]);
+    sum += values[i];
+  }
+  const float normalize = (sum > 0) ? (1.f / sum) : 0.f;
+  for (int i = 0; i < num_values; i++) {
+    values[i] *= normalize;
+  }
+}
+
 // Initialize the accumulator used to construct the quick scorer model
 // representation.
 //
@@ -102,7 +198,7 @@ absl::Status InitializeAccumulator(
             accumulator->categorical_contains_conditions[feature.spec_idx];
         feature_acc.internal_feature_idx = feature.internal_idx;
         feature_acc.items.assign(
-            src.NumTrees() *
+            dst.num_leaf_masks() *
                 feature_spec.categorical().number_of_unique_values(),
             ~internal::QuickScorerExtendedModel::kZeroLeafMask);
       } break;
@@ -194,13 +290,19 @@ absl::Status FinalizeModel(
   return absl::OkStatus();
 }
 
+// Sets the "num_values_per_leaf" values of a leaf in the quick scorer model
+// from the leaf of a generic model.
+using SetLeafValueFn = std::function<absl::Status(
+    const model::decision_tree::proto::Node& src_node, float* dst_values)>;
+
 // Adds the content of a node (and its children i.e. recursive visit) to the
 // quick scorer tree structure.
 template <typename AbstractModel>
 absl::Status FillQuickScorerNode(
     const AbstractModel& src,
     const internal::QuickScorerExtendedModel::TreeIdx tree_idx,
-    const NodeWithChildren& src_node, internal::QuickScorerExtendedModel* dst,
+    const NodeWithChildren& src_node, const SetLeafValueFn& set_leaf_value,
+    const int num_values_per_leaf, internal::QuickScorerExtendedModel* dst,
     int* leaf_idx, int* non_leaf_idx,
     internal::QuickScorerExtendedModel::BuildingAccumulator* accumulator) {
   if (src_node.IsLeaf()) {
@@ -212,40 +314,33 @@ absl::Status FillQuickScorerNode(
       return absl::InternalError("Leaf idx too large");
     }
     const auto leaf_value_idx =
-        *leaf_idx + tree_idx * dst->max_num_leafs_per_tree;
-    if (leaf_value_idx >= dst->leaf_values.size()) {
+        (*leaf_idx + tree_idx * dst->max_num_leafs_per_tree) *
+        num_values_per_leaf;
+    if (leaf_value_idx + num_values_per_leaf > dst->leaf_values.size()) {
       return absl::InternalError("Leaf value idx too large");
     }
-    dst->leaf_values[leaf_value_idx] = src_node.node().regressor().top_value();
+    RETURN_IF_ERROR(
+        set_leaf_value(src_node.node(), &dst->leaf_values[leaf_value_idx]));
     (*leaf_idx)++;
   } else {
     // Index of the first leaf in the negative branch.
     const auto begin_neg_leaf_idx = *leaf_idx;
 
     // Parse the negative branch.
-    RETURN_IF_ERROR(FillQuickScorerNode(src, tree_idx, *src_node.neg_child(),
-                                        dst, leaf_idx, non_leaf_idx,
-                                        accumulator));
+    RETURN_IF_ERROR(FillQuickScorerNode(
+        src, tree_idx, *src_node.neg_child(), set_leaf_value,
+        num_values_per_leaf, dst, leaf_idx, non_leaf_idx, accumulator));
 
     // Index of the feature used by the node.
     const int spec_feature_idx = src_node.node().condition().attribute();
 
-    // Compute the bitmap mask i.e. the bitmap that hide the leafs of the
+    // Compute the bitmap masks i.e. the bitmaps that hide the leafs of the
     // negative branch.
-    //
-    // Example:
-    // If begin_neg_leaf_idx=2 and end_neg_leaf_idx = 5, the mask will be:
-    //   "1100011111" + 54 * "1" (lower bit on the left).
     const auto end_neg_leaf_idx = *leaf_idx;
-    const auto start_leaf_mask =
-        (internal::QuickScorerExtendedModel::kOneLeafMask
-         << begin_neg_leaf_idx) -
-        1;
-    const auto after_neg_mask =
-        (internal::QuickScorerExtendedModel::kOneLeafMask << end_neg_leaf_idx) -
-        1;
-    internal::QuickScorerExtendedModel::LeafMask mask =
-        ~(after_neg_mask ^ start_leaf_mask);
+    const auto masks =
+        ComputeLeafMasks(tree_idx * dst->num_leaf_masks_per_tree,
+                         begin_neg_leaf_idx, end_neg_leaf_idx);
+    const int num_leaf_masks = dst->num_leaf_masks();
 
     const auto& condition = src_node.node().condition().condition();
     // Branch to take is case of missing value. Can be ignored in the case of
@@ -255,34 +350,48 @@ absl::Status FillQuickScorerNode(
     const auto& attribute_spec =
         src.data_spec().columns(src_node.node().condition().attribute());
 
-    auto set_numerical_higher = [&]() {
-      const auto threshold = condition.higher_condition().threshold();
-      accumulator->is_higher_conditions[spec_feature_idx].items.push_back(
-          {/*.threshold =*/threshold, /*.tree_idx =*/tree_idx,
-           /*.leaf_mask =*/mask});
+    auto add_is_higher = [&](const float threshold) {
+      for (const auto& mask : masks) {
+        accumulator->is_higher_conditions[spec_feature_idx].items.push_back(
+            {/*.threshold =*/threshold, /*.leaf_mask_idx =*/mask.first,
+             /*.leaf_mask =*/mask.second});
+      }
     };
 
-    auto set_boolean_is_true = [&]() {
-      accumulator->is_higher_conditions[spec_feature_idx].items.push_back(
-          {/*.threshold =*/0.5f, /*.tree_idx =*/tree_idx,
-           /*.leaf_mask =*/mask});
+    auto and_categorical_contains = [&](const int feature_value) {
+      for (const auto& mask : masks) {
+        accumulator->categorical_contains_conditions[spec_feature_idx]
+            .items[mask.first + feature_value * num_leaf_masks] &= mask.second;
+      }
     };
 
+    auto and_categoricalset_contains = [&](const int value_idx) {
+      for (const auto& mask : masks) {
+        internal::AndMaskMap(
+            mask.first, mask.second,
+            &accumulator->categoricalset_contains_conditions[spec_feature_idx]
+                 .masks[value_idx]);
+      }
+    };
+
+    auto set_numerical_higher = [&]() {
+      add_is_higher(condition.higher_condition().threshold());
+    };
+
+    auto set_boolean_is_true = [&]() { add_is_higher(0.5f); };
+
     auto set_discretized_numerical_higher = [&]() {
       const auto discretized_threshold =
           condition.discretized_higher_condition().threshold();
       const float threshold = attribute_spec.discretized_numerical().boundaries(
           discretized_threshold - 1);
-      accumulator->is_higher_conditions[spec_feature_idx].items.push_back(
-          {/*.threshold = */ threshold, /*.tree_idx =*/tree_idx,
-           /*.leaf_mask =*/mask});
+      add_is_higher(threshold);
     };
 
     auto set_categorical_contains = [&]() {
       const auto elements = condition.contains_condition().elements();
       for (const auto feature_value : elements) {
-        accumulator->categorical_contains_conditions[spec_feature_idx]
-            .items[tree_idx + feature_value * dst->num_trees] &= mask;
+        and_categorical_contains(feature_value);
       }
     };
 
@@ -294,8 +403,7 @@ absl::Status FillQuickScorerNode(
       for (int feature_value = 0; feature_value < num_unique_values;
            ++feature_value) {
         if (utils::bitmap::GetValueBit(bitmap, feature_value)) {
-          accumulator->categorical_contains_conditions[spec_feature_idx]
-              .items[tree_idx + feature_value * dst->num_trees] &= mask;
+          and_categorical_contains(feature_value);
         }
       }
     };
@@ -303,25 +411,16 @@ absl::Status FillQuickScorerNode(
     auto set_categoricalset_contains = [&]() {
       const auto elements = condition.contains_condition().elements();
       if (na_value) {
-        internal::AndMaskMap(
-            tree_idx, mask,
-            &accumulator->categoricalset_contains_conditions[spec_feature_idx]
-                 .masks[0]);
+        and_categoricalset_contains(0);
       }
       for (const auto feature_value : elements) {
-        internal::AndMaskMap(
-            tree_idx, mask,
-            &accumulator->categoricalset_contains_conditions[spec_feature_idx]
-                 .masks[feature_value + 1]);
+        and_categoricalset_contains(feature_value + 1);
       }
     };
 
     auto set_categoricalset_bitmap_contains = [&]() {
       if (na_value) {
-        internal::AndMaskMap(
-            tree_idx, mask,
-            &accumulator->categoricalset_contains_conditions[spec_feature_idx]
-                 .masks[0]);
+        and_categoricalset_contains(0);
       }
       const auto bitmap =
           condition.contains_bitmap_condition().elements_bitmap();
@@ -330,10 +429,7 @@ absl::Status FillQuickScorerNode(
       for (int feature_value = 0; feature_value < num_unique_values;
            ++feature_value) {
         if (utils::bitmap::GetValueBit(bitmap, feature_value)) {
-          internal::AndMaskMap(
-              tree_idx, mask,
-              &accumulator->categoricalset_contains_conditions[spec_feature_idx]
-                   .masks[feature_value + 1]);
+          and_categoricalset_contains(feature_value + 1);
         }
       }
     };
@@ -381,27 +477,23 @@ absl::Status FillQuickScorerNode(
 
     ++(*non_leaf_idx);
 
-    RETURN_IF_ERROR(FillQuickScorerNode(src, tree_idx, *src_node.pos_child(),
-                                        dst, leaf_idx, non_leaf_idx,
-                                        accumulator));
+    RETURN_IF_ERROR(FillQuickScorerNode(
+        src, tree_idx, *src_node.pos_child(), set_leaf_value,
+        num_values_per_leaf, dst, leaf_idx, non_leaf_idx, accumulator));
   }
   return absl::OkStatus();
 }
 
 // Adds the content of the tree structures to the quick scorer structure.
+//
+// "num_values_per_leaf" is the number of values in each leaf i.e. 1 or
+// "num_output_dimensions" (see "kMultiDimensionalLeaves").
 template <typename AbstractModel>
 absl::Status FillQuickScorer(
-    const AbstractModel& src, internal::QuickScorerExtendedModel* dst,
+    const AbstractModel& src, const SetLeafValueFn& set_leaf_value,
+    const int num_values_per_leaf, internal::QuickScorerExtendedModel* dst,
     internal::QuickScorerExtendedModel::BuildingAccumulator* accumulator) {
-  RETURN_IF_ERROR(InitializeAccumulator(src, *dst, accumulator));
-
-  dst->initial_prediction = src.initial_predictions()[0];
   dst->num_trees = src.NumTrees();
-  if (dst->num_trees > internal::QuickScorerExtendedModel::kMaxTrees) {
-    return absl::InvalidArgumentError(
-        absl::Substitute("The model contains trees with more than $0 trees",
-                         internal::QuickScorerExtendedModel::kMaxTrees));
-  }
 
   // Get the maximum number of leafs per trees.
   dst->max_num_leafs_per_tree = 0;
@@ -421,36 +513,80 @@ absl::Status FillQuickScorer(
                          internal::QuickScorerExtendedModel::kMaxLeafs));
   }
 
-  dst->leaf_values.assign(dst->max_num_leafs_per_tree * dst->num_trees, 0.f);
+  constexpr int kMaxLeafsPerLeafMask =
+      internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask;
+  dst->num_leaf_masks_per_tree = std::max(
+      1, (dst->max_num_leafs_per_tree + kMaxLeafsPerLeafMask - 1) /
+             kMaxLeafsPerLeafMask);
+  if (static_cast<size_t>(dst->num_trees) * dst->num_leaf_masks_per_tree >
+      internal::QuickScorerExtendedModel::kMaxTrees) {
+    return absl::InvalidArgumentError(
+        absl::Substitute("The model contains more than $0 trees",
+                         internal::QuickScorerExtendedModel::kMaxTrees));
+  }
+
+  RETURN_IF_ERROR(InitializeAccumulator(src, *dst, accumulator));
+
+  dst->leaf_values.assign(
+      dst->max_num_leafs_per_tree * dst->num_trees * num_values_per_leaf, 0.f);
 
   for (internal::QuickScorerExtendedModel::TreeIdx tree_idx = 0;
        tree_idx < src.decision_trees().size(); ++tree_idx) {
     const auto& src_tree = src.decision_trees()[tree_idx];
     int leaf_idx = 0;
     int non_leaf_idx = 0;
-    RETURN_IF_ERROR(FillQuickScorerNode(src, tree_idx, src_tree->root(), dst,
-                                        &leaf_idx, &non_leaf_idx, accumulator));
+    RETURN_IF_ERROR(FillQuickScorerNode(
+        src, tree_idx, src_tree->root(), set_leaf_value, num_values_per_leaf,
+        dst, &leaf_idx, &non_leaf_idx, accumulator));
   }
 
   RETURN_IF_ERROR(FinalizeModel(*accumulator, dst));
   return absl::OkStatus();
 }
 
+// Adds the value(s) of the "leaf_idx"-th leaf of a tree to the outputs of an
+// example. "leaf_values" are the leaf values of the tree. If the leaves are
+// multi-dimensional, the leaf contributes to all the outputs. Otherwise, the
+// leaf only contributes to the "output_idx"-th output.
+template <typename Model>
+inline void AddLeafValue(const float* leaf_values, const int leaf_idx,
+                         const int num_output_dimensions, const int output_idx,
+                         float* output) {
+  if (Model::kMultiDimensionalLeaves) {
+    const float* leaf_value = &leaf_values[leaf_idx * num_output_dimensions];
+    for (int dim_idx = 0; dim_idx < num_output_dimensions; ++dim_idx) {
+      output[dim_idx] += leaf_value[dim_idx];
+    }
+  } else {
+    output[output_idx] += leaf_values[leaf_idx];
+  }
+}
+
+// Number of values between the leaves of two consecutive trees in
+// "leaf_values".
+template <typename Model>
+int TreeLeafValueStride(const Model& model) {
+  return model.max_num_leafs_per_tree *
+         (Model::kMultiDimensionalLeaves ? model.num_output_dimensions : 1);
+}
+
 // Tree inference without SIMD i.e. one example at a time.
 // This method is used for the examples outside of the SIMD batch.
 //
-// "active_leaf_buffer" is a pre-allocated buffer of at least "num-trees"
-// elements.
+// "active_leaf_buffer" is a pre-allocated buffer of at least
+// "num_leaf_masks()" elements.
 template <typename Model, float (*Activation)(float)>
 void PredictQuickScorerSequential(
     const Model& model,
-    const std::vector<NumericalOrCategoricalValue>& fixed_length_features,
+    absl::Span<const NumericalOrCategoricalValue> fixed_length_features,
     const std::vector<Rangei32>& categorical_set_begins_and_ends,
     const std::vector<int32_t>& categorical_item_buffer,
     const int begin_example_idx, const int end_example_idx,
     const int major_feature_offset, std::vector<float>* predictions,
     internal::QuickScorerExtendedModel::LeafMask* active_leaf_buffer) {
-  const size_t active_leaf_buffer_size = model.num_trees * sizeof(LeafMask);
+  const int num_leaf_masks = model.num_leaf_masks();
+  const size_t active_leaf_buffer_size = num_leaf_masks * sizeof(LeafMask);
+  const int num_output_dimensions = model.num_output_dimensions;
 
   const auto index = [&major_feature_offset](const int feature_idx,
                                              const int example_idx) -> int {
@@ -473,7 +609,7 @@ void PredictQuickScorerSequential(
         if (item.threshold > feature_value) {
           break;
         }
-        active_leaf_buffer[item.tree_idx] &= item.leaf_mask;
+        active_leaf_buffer[item.leaf_mask_idx] &= item.leaf_mask;
       }
     }
 
@@ -484,12 +620,13 @@ void PredictQuickScorerSequential(
           fixed_length_features[index(contains_condition.internal_feature_idx,
                                       example_idx)]
               .categorical_value;
-      DCHECK_LE(model.num_trees * (feature_value + 1),
+      DCHECK_LE(num_leaf_masks * (feature_value + 1),
                 contains_condition.items.size());
       const auto* leaf_mask_stream =
-          &contains_condition.items[model.num_trees * feature_value];
-      for (int tree_idx = 0; tree_idx < model.num_trees; ++tree_idx) {
-        active_leaf_buffer[tree_idx] &= *(leaf_mask_stream++);
+          &contains_condition.items[num_leaf_masks * feature_value];
+      for (int leaf_mask_idx = 0; leaf_mask_idx < num_leaf_masks;
+           ++leaf_mask_idx) {
+        active_leaf_buffer[leaf_mask_idx] &= *(leaf_mask_stream++);
       }
     }
 
@@ -512,21 +649,323 @@ void PredictQuickScorerSequential(
     }
 
     // Get the active leaf.
+    float* output = &(*predictions)[example_idx * num_output_dimensions];
+    std::fill(output, output + num_output_dimensions,
+              model.initial_prediction);
+    auto* leaf_reader = &model.leaf_values[0];
+    const int leaf_reader_stride = TreeLeafValueStride(model);
+    int output_idx = 0;
+    for (int tree_idx = 0; tree_idx < model.num_trees; ++tree_idx) {
+      const auto node_idx = FindFirstActiveLeaf(
+          &active_leaf_buffer[tree_idx * model.num_leaf_masks_per_tree],
+          /*stride=*/1);
+      AddLeafValue<Model>(leaf_reader, node_idx, num_output_dimensions,
+                          output_idx, output);
+      leaf_reader += leaf_reader_stride;
+      if (++output_idx == num_output_dimensions) {
+        output_idx = 0;
+      }
+    }
+
+    for (int output_idx = 0; output_idx < num_output_dimensions;
+         ++output_idx) {
+      output[output_idx] = Activation(output[output_idx]);
+    }
+  }
+}
+
+// SIMD implementations of the "is higher" conditions. Each function applies the
+// conditions of a single feature on a batch of examples. "feature_values" are
+// the feature values of the examples in the batch, and "active_leaf_buffer"
+// is the active leaf bitmap of the batch, where
+// "active_leaf_buffer[leaf_mask_idx * num_parallel_examples + sub_example_idx]"
+// is the "leaf_mask_idx"-th leaf mask of the "sub_example_idx"-th example.
+using ApplyIsHigherConditionsFn = void (*)(
+    const internal::QuickScorerExtendedModel::IsHigherConditions& condition,
+    const float* feature_values, LeafMask* active_leaf_buffer);
+
+#ifdef YDF_QUICK_SCORER_SSE41
+// Processes 4 examples at a time.
+YDF_QUICK_SCORER_TARGET("sse4.1")
+void ApplyIsHigherConditionsSSE41(
+    const internal::QuickScorerExtendedModel::IsHigherConditions& condition,
+    const float* feature_values, LeafMask* active_leaf_buffer) {
+  const auto values = _mm_loadu_ps(feature_values);
+  for (const auto& item : condition.items) {
+    const auto threshold = _mm_set1_ps(item.threshold);
+    const auto comparison = _mm_castps_si128(_mm_cmpge_ps(values, threshold));
+    if (_mm_test_all_zeros(comparison, comparison)) {
+      break;
+    }
+    const auto mask = _mm_set1_epi64x(item.leaf_mask);
+    auto* active_si128 = reinterpret_cast<__m128i*>(
+        &active_leaf_buffer[item.leaf_mask_idx * 4]);
+    // Expand the comparison of the first and last two examples to 8 bytes.
+    const auto comparison_low = _mm_cvtepi32_epi64(comparison);
+    const auto comparison_high =
+        _mm_cvtepi32_epi64(_mm_unpackhi_epi64(comparison, comparison));
+    _mm_store_si128(
+        active_si128,
+        _mm_andnot_si128(_mm_andnot_si128(mask, comparison_low),
+                         _mm_load_si128(active_si128)));
+    _mm_store_si128(
+        active_si128 + 1,
+        _mm_andnot_si128(_mm_andnot_si128(mask, comparison_high),
+                         _mm_load_si128(active_si128 + 1)));
+  }
+}
+#endif
+
+#ifdef YDF_QUICK_SCORER_AVX2
+// Processes 4 examples at a time.
+YDF_QUICK_SCORER_TARGET("avx2")
+void ApplyIsHigherConditionsAVX2(
+    const internal::QuickScorerExtendedModel::IsHigherConditions& condition,
+    const float* feature_values, LeafMask* active_leaf_buffer) {
+  const auto values = _mm_loadu_ps(feature_values);
+  for (const auto& item : condition.items) {
+    const auto threshold = _mm_set1_ps(item.threshold);
+
+    const auto comparison = _mm_castps_si128(_mm_cmpge_ps(values, threshold));
+    // Note: "comparison" is either 0x00000000 or 0xFFFFFFFF depending on
+    // the node condition value.
+    if (_mm_test_all_zeros(comparison, comparison)) {
+      break;
+    }
+    // The mask attached to the condition i.e. the mask to apply on the
+    // active node bitmap iif. the condition is true.
+    const auto mask = _mm256_set1_epi64x(item.leaf_mask);
+    auto* active_si256 = reinterpret_cast<__m256i*>(
+        &active_leaf_buffer[item.leaf_mask_idx * 4]);
+    const auto active = _mm256_load_si256(active_si256);
+
+    // Expand the comparison to 8 bytes.
+    const auto pd_comparison = _mm256_cvtepi32_epi64(comparison);
+    const auto mask_update = _mm256_andnot_si256(mask, pd_comparison);
+    const auto new_active = _mm256_andnot_si256(mask_update, active);
+    // new_active = (mask v not comparison) ^ active
+    // is equivalent to:
+    // new_active = not (not mask ^ comparison) ^ active
+
+    _mm256_store_si256(active_si256, new_active);
+  }
+}
+#endif
+
+#ifdef YDF_QUICK_SCORER_AVX512
+// Processes 8 examples at a time.
+YDF_QUICK_SCORER_TARGET("avx512f,avx512vl")
+void ApplyIsHigherConditionsAVX512(
+    const internal::QuickScorerExtendedModel::IsHigherConditions& condition,
+    const float* feature_values, LeafMask* active_leaf_buffer) {
+  const auto values = _mm256_loadu_ps(feature_values);
+  for (const auto& item : condition.items) {
+    const auto threshold = _mm256_set1_ps(item.threshold);
+    // Note: The "i-th" bit of "comparison" is set iif. the condition is true
+    // for the "i-th" example.
+    const __mmask8 comparison =
+        _mm256_cmp_ps_mask(values, threshold, _CMP_GE_OQ);
+    if (comparison == 0) {
+      break;
+    }
+    auto* active_si512 = reinterpret_cast<__m512i*>(
+        &active_leaf_buffer[item.leaf_mask_idx * 8]);
+    const auto active = _mm512_load_si512(active_si512);
+    const auto new_active = _mm512_mask_and_epi64(
+        active, comparison, active, _mm512_set1_epi64(item.leaf_mask));
+    _mm512_store_si512(active_si512, new_active);
+  }
+}
+#endif
+
+// Tree inference on sub-batches of "kNumParallelExamples" examples at a time,
+// using "ApplyIsHigherConditions" for the "is higher" conditions. Returns the
+// number of processed examples (i.e. the largest multiple of
+// "kNumParallelExamples" smaller or equal to "num_examples"). The remaining
+// examples should be processed with "PredictQuickScorerSequential".
+//
+// "active_leaf_buffer" is a pre-allocated buffer of at least "num_leaf_masks()
+// * kNumParallelExamples" elements, aligned for the SIMD instructions used in
+// "ApplyIsHigherConditions".
+template <typename Model, float (*Activation)(float), int kNumParallelExamples,
+          ApplyIsHigherConditionsFn ApplyIsHigherConditions>
+int PredictQuickScorerParallel(
+    const Model& model,
+    absl::Span<const NumericalOrCategoricalValue> fixed_length_features,
+    const std::vector<Rangei32>& categorical_set_begins_and_ends,
+    const std::vector<int32_t>& categorical_item_buffer, const int num_examples,
+    const int major_feature_offset, std::vector<float>* predictions,
+    LeafMask* active_leaf_buffer) {
+  const int num_leaf_masks = model.num_leaf_masks();
+  const size_t active_leaf_buffer_size =
+      num_leaf_masks * kNumParallelExamples * sizeof(LeafMask);
+  const int num_output_dimensions = model.num_output_dimensions;
+
+  auto* sample_reader = fixed_length_features.data();
+  float* prediction_reader = &(*predictions)[0];
+  int example_idx = 0;
+
+  int num_remaining_iters = num_examples / kNumParallelExamples;
+  while (num_remaining_iters--) {
+    // Reset active node buffer.
+    std::memset(active_leaf_buffer, 0xFF, active_leaf_buffer_size);
+
+    // Is higher conditions.
+    for (const auto& is_higher_condition : model.is_higher_conditions) {
+      const float* begin_example =
+          &sample_reader[0].numerical_value +
+          is_higher_condition.internal_feature_idx * major_feature_offset;
+      ApplyIsHigherConditions(is_higher_condition, begin_example,
+                              active_leaf_buffer);
+    }
+
+    // Dense contains conditions.
+    for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
+         ++sub_example_idx) {
+      for (const auto& contains_condition :
+           model.categorical_contains_conditions) {
+        const auto feature_value =
+            sample_reader[contains_condition.internal_feature_idx *
+                              major_feature_offset +
+                          sub_example_idx]
+                .categorical_value;
+        const auto* leaf_mask_stream =
+            &contains_condition.items[num_leaf_masks * feature_value];
+        for (int leaf_mask_idx = 0; leaf_mask_idx < num_leaf_masks;
+             ++leaf_mask_idx) {
+          active_leaf_buffer[leaf_mask_idx * kNumParallelExamples +
+                             sub_example_idx] &= *(leaf_mask_stream++);
+        }
+      }
+    }
+
+    // Sparse contains conditions.
+    for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
+         ++sub_example_idx) {
+      for (const auto& contains_condition :
+           model.categoricalset_contains_conditions) {
+        const auto& range_values = categorical_set_begins_and_ends
+            [contains_condition.internal_feature_idx * major_feature_offset +
+             sub_example_idx + example_idx];
+        for (int value_idx = range_values.begin; value_idx < range_values.end;
+             value_idx++) {
+          const auto value = categorical_item_buffer[value_idx] + 1;
+          const auto& range_masks =
+              contains_condition.value_to_mask_range[value];
+          for (int mask_idx = range_masks.first; mask_idx < range_masks.second;
+               mask_idx++) {
+            const auto& mask = contains_condition.mask_buffer[mask_idx];
+            active_leaf_buffer[mask.first * kNumParallelExamples +
+                               sub_example_idx] &= mask.second;
+          }
+        }
+      }
+    }
+
+    // Note: "prediction_reader[sub_example_idx * num_output_dimensions +
+    // output_idx]" is the "output_idx"-th output of the "sub_example_idx"-th
+    // example in the sub-batch.
+    std::fill(prediction_reader,
+              prediction_reader + kNumParallelExamples * num_output_dimensions,
+              model.initial_prediction);
+
     auto* leaf_reader = &model.leaf_values[0];
-    float output = model.initial_prediction;
+    const int leaf_reader_stride = TreeLeafValueStride(model);
+    int output_idx = 0;
     for (int tree_idx = 0; tree_idx < model.num_trees; ++tree_idx) {
-      const auto shift_mask = active_leaf_buffer[tree_idx];
-      const auto node_idx = FindLSBSetNonZero64(shift_mask);
-      output += leaf_reader[node_idx];
-      leaf_reader += model.max_num_leafs_per_tree;
+#pragma loop unroll(full)
+      for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
+           ++sub_example_idx) {
+        const auto node_idx = FindFirstActiveLeaf(
+            &active_leaf_buffer[tree_idx * model.num_leaf_masks_per_tree *
+                                    kNumParallelExamples +
+                                sub_example_idx],
+            /*stride=*/kNumParallelExamples);
+        AddLeafValue<Model>(
+            leaf_reader, node_idx, num_output_dimensions, output_idx,
+            &prediction_reader[sub_example_idx * num_output_dimensions]);
+      }
+      leaf_reader += leaf_reader_stride;
+      if (++output_idx == num_output_dimensions) {
+        output_idx = 0;
+      }
     }
 
-    (*predictions)[example_idx] = Activation(output);
+// Note: The compiler should be able to remove the following loop when
+// Activation == Identity. Tested with gcc9 and clang9.
+    for (int value_idx = 0;
+         value_idx < kNumParallelExamples * num_output_dimensions;
+         ++value_idx) {
+      prediction_reader[value_idx] = Activation(prediction_reader[value_idx]);
+    }
+
+    sample_reader += kNumParallelExamples;
+    prediction_reader += kNumParallelExamples * num_output_dimensions;
+    example_idx += kNumParallelExamples;
   }
+  return example_idx;
+}
+
+// Number of examples processed in parallel by the SIMD instructions.
+int NumParallelExamples(const SimdInstructionSet instruction_set) {
+  switch (instruction_set) {
+    case SimdInstructionSet::kNone:
+      return 1;
+    case SimdInstructionSet::kSSE41:
+    case SimdInstructionSet::kAVX2:
+      return 4;
+    case SimdInstructionSet::kAVX512:
+      return 8;
+  }
+  return 1;
+}
+
+SimdInstructionSet DetectSimdInstructionSet() {
+#ifdef YDF_QUICK_SCORER_RUNTIME_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")) {
+    return SimdInstructionSet::kAVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdInstructionSet::kAVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdInstructionSet::kSSE41;
+  }
+  return SimdInstructionSet::kNone;
+#elif defined(YDF_QUICK_SCORER_AVX512)
+  // The instruction set is selected at compile time.
+  return SimdInstructionSet::kAVX512;
+#elif defined(YDF_QUICK_SCORER_AVX2)
+  return SimdInstructionSet::kAVX2;
+#elif defined(YDF_QUICK_SCORER_SSE41)
+  return SimdInstructionSet::kSSE41;
+#else
+  return SimdInstructionSet::kNone;
+#endif
 }
 
 }  // namespace
 
+SimdInstructionSet BestSimdInstructionSet() {
+  static const SimdInstructionSet instruction_set = DetectSimdInstructionSet();
+  return instruction_set;
+}
+
+std::string SimdInstructionSetName(const SimdInstructionSet instruction_set) {
+  switch (instruction_set) {
+    case SimdInstructionSet::kNone:
+      return "NONE";
+    case SimdInstructionSet::kSSE41:
+      return "SSE4.1";
+    case SimdInstructionSet::kAVX2:
+      return "AVX2";
+    case SimdInstructionSet::kAVX512:
+      return "AVX512";
+  }
+  return "UNKNOWN";
+}
+
 // Apply the quick scorer algorithm.
 //
 // The examples are represented in the arguments "fixed_length_features",
@@ -541,22 +980,26 @@ void PredictQuickScorerSequential(
 template <typename Model, float (*Activation)(float) = ActivationIdentity>
 void PredictQuickScorerMajorFeatureOffset(
     const Model& model,
-    const std::vector<NumericalOrCategoricalValue>& fixed_length_features,
+    absl::Span<const NumericalOrCategoricalValue> fixed_length_features,
     const std::vector<Rangei32>& categorical_set_begins_and_ends,
     const std::vector<int32_t>& categorical_item_buffer, const int num_examples,
     const int major_feature_offset, std::vector<float>* predictions) {
   utils::usage::OnInference(num_examples);
-  predictions->resize(num_examples);
+  const int num_output_dimensions = model.num_output_dimensions;
+  predictions->resize(num_examples * num_output_dimensions);
 
-  // "kNumParallelExamples" examples are treated in parallel using SIMD
+  // "num_parallel_examples" examples are treated in parallel using SIMD
   // instructions. If the number of examples is not a multiple of
-  // "kNumParallelExamples", the remaining examples are treated with
+  // "num_parallel_examples", the remaining examples are treated with
   // "PredictQuickScorerSequential".
-  constexpr int kNumParallelExamples = 4;
+  const int num_parallel_examples =
+      NumParallelExamples(model.simd_instruction_set);
 
   const size_t active_leaf_buffer_size =
-      model.num_trees * kNumParallelExamples * sizeof(LeafMask);
-  const size_t alignment = 32 * 8;
+      model.num_leaf_masks() * num_parallel_examples * sizeof(LeafMask);
+  // Alignment, in bytes, of the active leaf buffer. Large enough for the
+  // _mm512 class of SIMD instructions (intrinsics).
+  const size_t alignment = 64;
 
   // Make sure the allocated chunk of memory is a multiple of "alignment".
   size_t rounded_up_active_leaf_buffer_size = active_leaf_buffer_size;
@@ -567,168 +1010,61 @@ void PredictQuickScorerMajorFeatureOffset(
 
   // Note: Alloca was measured to be faster and more consistent (in terms of
   // speed) than malloc or pre-allocated caches.
-  //
-  // The buffer must be aligned on a 32-byte boundary to work with _mm256
-  // class of SIMD instructions (intrinsics).
   LeafMask* active_leaf_buffer;
   const bool active_leaf_buffer_uses_stack =
       active_leaf_buffer_size <= kMaxStackUsageInBytes;
 
   if (active_leaf_buffer_uses_stack) {
-#ifdef __AVX2__
-
 #if defined(_WIN32)
     void* non_aligned = alloca(rounded_up_active_leaf_buffer_size + alignment);
     std::size_t space = rounded_up_active_leaf_buffer_size + alignment;
     void* aligned = std::align(alignment, 1, non_aligned, space);
 #else
+    // Note: The alignment of "__builtin_alloca_with_align" is in bits.
     void* aligned = __builtin_alloca_with_align(
-        rounded_up_active_leaf_buffer_size, alignment);
+        rounded_up_active_leaf_buffer_size, alignment * 8);
 #endif
     active_leaf_buffer = reinterpret_cast<LeafMask*>(aligned);
-
-#else
-    active_leaf_buffer =
-        reinterpret_cast<LeafMask*>(alloca(rounded_up_active_leaf_buffer_size));
-#endif
   } else {
-#ifdef __AVX2__
     active_leaf_buffer = reinterpret_cast<LeafMask*>(
         portable::aligned_alloc(alignment, rounded_up_active_leaf_buffer_size));
-#else
-    active_leaf_buffer = reinterpret_cast<LeafMask*>(
-        std::malloc(rounded_up_active_leaf_buffer_size));
-#endif
   }
 
   int example_idx = 0;
-
-#ifdef __AVX2__
-  if (model.cpu_supports_avx2) {
-    auto* sample_reader = &fixed_length_features[0];
-    float* prediction_reader = &(*predictions)[0];
-
-    // First run on sub-batches of kNumParallelExamples at a time. The
-    // remaining will be done sequentially below.
-    int num_remaining_iters = num_examples / kNumParallelExamples;
-    while (num_remaining_iters--) {
-      // Reset active node buffer.
-      std::memset(active_leaf_buffer, 0xFF, active_leaf_buffer_size);
-
-      // Is higher conditions.
-      for (const auto& is_higher_condition : model.is_higher_conditions) {
-        const float* begin_example =
-            &sample_reader[0].numerical_value +
-            is_higher_condition.internal_feature_idx * major_feature_offset;
-
-        const auto feature_values = _mm_loadu_ps(begin_example);
-        for (const auto& item : is_higher_condition.items) {
-          const auto threshold = _mm_set1_ps(item.threshold);
-
-          const auto comparison =
-              _mm_castps_si128(_mm_cmpge_ps(feature_values, threshold));
-          // Note: "comparison" is either 0x00000000 or 0xFFFFFFFF depending on
-          // the node condition value.
-          if (!_mm_test_all_zeros(comparison, comparison)) {
-            // The mask attached to the condition i.e. the mask to apply on the
-            // active node bitmap iif. the condition is true.
-            const auto mask = _mm256_set1_epi64x(item.leaf_mask);
-            auto* active_si256 = reinterpret_cast<__m256i*>(
-                &active_leaf_buffer[item.tree_idx * kNumParallelExamples]);
-            const auto active = _mm256_load_si256(active_si256);
-
-            // Expand the comparison to 8 bytes.
-            const auto pd_comparison = _mm256_cvtepi32_epi64(comparison);
-            const auto mask_update = _mm256_andnot_si256(mask, pd_comparison);
-            const auto new_active = _mm256_andnot_si256(mask_update, active);
-            // new_active = (mask v not comparison) ^ active
-            // is equivalent to:
-            // new_active = not (not mask ^ comparison) ^ active
-
-            _mm256_store_si256(active_si256, new_active);
-          } else {
-            break;
-          }
-        }
-      }
-
-      // Dense contains conditions.
-      for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
-           ++sub_example_idx) {
-        for (const auto& contains_condition :
-             model.categorical_contains_conditions) {
-          const auto feature_value =
-              sample_reader[contains_condition.internal_feature_idx *
-                                major_feature_offset +
-                            sub_example_idx]
-                  .categorical_value;
-          const auto* leaf_mask_stream =
-              &contains_condition.items[model.num_trees * feature_value];
-          for (int tree_idx = 0; tree_idx < model.num_trees; ++tree_idx) {
-            active_leaf_buffer[tree_idx * kNumParallelExamples +
-                               sub_example_idx] &= *(leaf_mask_stream++);
-          }
-        }
-      }
-
-      // Sparse contains conditions.
-      for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
-           ++sub_example_idx) {
-        for (const auto& contains_condition :
-             model.categoricalset_contains_conditions) {
-          const auto& range_values = categorical_set_begins_and_ends
-              [contains_condition.internal_feature_idx * major_feature_offset +
-               sub_example_idx + example_idx];
-          for (int value_idx = range_values.begin; value_idx < range_values.end;
-               value_idx++) {
-            const auto value = categorical_item_buffer[value_idx] + 1;
-            const auto& range_masks =
-                contains_condition.value_to_mask_range[value];
-            for (int mask_idx = range_masks.first;
-                 mask_idx < range_masks.second; mask_idx++) {
-              const auto& mask = contains_condition.mask_buffer[mask_idx];
-              active_leaf_buffer[mask.first * kNumParallelExamples +
-                                 sub_example_idx] &= mask.second;
-            }
-          }
-        }
-      }
-
-#pragma loop unroll(full)
-      for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
-           ++sub_example_idx) {
-        prediction_reader[sub_example_idx] = model.initial_prediction;
-      }
-
-      auto* leaf_reader = &model.leaf_values[0];
-      for (int tree_idx = 0; tree_idx < model.num_trees; ++tree_idx) {
-#pragma loop unroll(full)
-        for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
-             ++sub_example_idx) {
-          const auto shift_mask =
-              active_leaf_buffer[tree_idx * kNumParallelExamples +
-                                 sub_example_idx];
-          const auto node_idx = FindLSBSetNonZero64(shift_mask);
-          prediction_reader[sub_example_idx] += leaf_reader[node_idx];
-        }
-        leaf_reader += model.max_num_leafs_per_tree;
-      }
-
-// Note: The compiler should be able to remove the following loop when
-// Activation == Identity. Tested with gcc9 and clang9.
-#pragma loop unroll(full)
-      for (int sub_example_idx = 0; sub_example_idx < kNumParallelExamples;
-           ++sub_example_idx) {
-        prediction_reader[sub_example_idx] =
-            Activation(prediction_reader[sub_example_idx]);
-      }
-
-      sample_reader += kNumParallelExamples;
-      prediction_reader += kNumParallelExamples;
-      example_idx += kNumParallelExamples;
-    }
-  }
+  switch (model.simd_instruction_set) {
+#ifdef YDF_QUICK_SCORER_SSE41
+    case SimdInstructionSet::kSSE41:
+      example_idx =
+          PredictQuickScorerParallel<Model, Activation, 4,
+                                     ApplyIsHigherConditionsSSE41>(
+              model, fixed_length_features, categorical_set_begins_and_ends,
+              categorical_item_buffer, num_examples, major_feature_offset,
+              predictions, active_leaf_buffer);
+      break;
+#endif
+#ifdef YDF_QUICK_SCORER_AVX2
+    case SimdInstructionSet::kAVX2:
+      example_idx =
+          PredictQuickScorerParallel<Model, Activation, 4,
+                                     ApplyIsHigherConditionsAVX2>(
+              model, fixed_length_features, categorical_set_begins_and_ends,
+              categorical_item_buffer, num_examples, major_feature_offset,
+              predictions, active_leaf_buffer);
+      break;
+#endif
+#ifdef YDF_QUICK_SCORER_AVX512
+    case SimdInstructionSet::kAVX512:
+      example_idx =
+          PredictQuickScorerParallel<Model, Activation, 8,
+                                     ApplyIsHigherConditionsAVX512>(
+              model, fixed_length_features, categorical_set_begins_and_ends,
+              categorical_item_buffer, num_examples, major_feature_offset,
+              predictions, active_leaf_buffer);
+      break;
 #endif
+    default:
+      break;
+  }
 
   PredictQuickScorerSequential<Model, Activation>(
       model, fixed_length_features, categorical_set_begins_and_ends,
@@ -736,18 +1072,14 @@ void PredictQuickScorerMajorFeatureOffset(
       predictions, active_leaf_buffer);
 
   if (!active_leaf_buffer_uses_stack) {
-#ifdef __AVX2__
     portable::aligned_free(active_leaf_buffer);
-#else
-    free(active_leaf_buffer);
-#endif
   }
 }
 
 template <typename Model>
 void PredictQuickScorer(
     const Model& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions) {
   PredictQuickScorerMajorFeatureOffset(model, examples, {}, {}, num_examples,
                                        num_examples, predictions);
@@ -767,7 +1099,7 @@ void Predict(const Model& model, const typename Model::ExampleSet& examples,
 template void
 PredictQuickScorer<GradientBoostedTreesRegressionQuickScorerExtended>(
     const GradientBoostedTreesRegressionQuickScorerExtended& model,
-    const std::vector<NumericalOrCategoricalValue>& examples,
+    absl::Span<const NumericalOrCategoricalValue> examples,
     const int num_examples, std::vector<float>* predictions);
 
 template void Predict<GradientBoostedTreesRegressionQuickScorerExtended>(
@@ -796,23 +1128,64 @@ void Predict(
       examples.NumberOfExamples(), predictions);
 }
 
+template <>
+void Predict(
+    const GradientBoostedTreesMulticlassClassificationQuickScorerExtended&
+        model,
+    const GradientBoostedTreesMulticlassClassificationQuickScorerExtended::
+        ExampleSet& examples,
+    const int num_examples, std::vector<float>* predictions) {
+  // Accumulates the raw per-class outputs, and then applies the softmax.
+  PredictQuickScorerMajorFeatureOffset(
+      model, examples.InternalCategoricalAndNumericalValues(),
+      examples.InternalCategoricalSetBeginAndEnds(),
+      examples.InternalCategoricalItemBuffer(), num_examples,
+      examples.NumberOfExamples(), predictions);
+  for (int example_idx = 0; example_idx < num_examples; ++example_idx) {
+    ActivationMultinomialLogLikelihood(
+        &(*predictions)[example_idx * model.num_classes], model.num_classes);
+  }
+}
+
+template <>
+void Predict(
+    const RandomForestBinaryClassificationQuickScorerExtended& model,
+    const RandomForestBinaryClassificationQuickScorerExtended::ExampleSet&
+        examples,
+    const int num_examples, std::vector<float>* predictions) {
+  PredictQuickScorerMajorFeatureOffset<
+      RandomForestBinaryClassificationQuickScorerExtended, ActivationClamp01>(
+      model, examples.InternalCategoricalAndNumericalValues(),
+      examples.InternalCategoricalSetBeginAndEnds(),
+      examples.InternalCategoricalItemBuffer(), num_examples,
+      examples.NumberOfExamples(), predictions);
+}
+
+template <>
+void Predict(
+    const RandomForestMulticlassClassificationQuickScorerExtended& model,
+    const RandomForestMulticlassClassificationQuickScorerExtended::ExampleSet&
+        examples,
+    const int num_examples, std::vector<float>* predictions) {
+  PredictQuickScorerMajorFeatureOffset<
+      RandomForestMulticlassClassificationQuickScorerExtended,
+      ActivationClamp01>(
+      model, examples.InternalCategoricalAndNumericalValues(),
+      examples.InternalCategoricalSetBeginAndEnds(),
+      examples.InternalCategoricalItemBuffer(), num_examples,
+      examples.NumberOfExamples(), predictions);
+}
+
+template void Predict<RandomForestRegressionQuickScorerExtended>(
+    const RandomForestRegressionQuickScorerExtended& model,
+    const RandomForestRegressionQuickScorerExtended::ExampleSet& examples,
+    const int num_examples, std::vector<float>* predictions);
+
 template <typename AbstractModel, typename CompiledModel>
 absl::Status BaseGenericToSpecializedModel(const AbstractModel& src,
+                                           const SetLeafValueFn& set_leaf_value,
                                            CompiledModel* dst) {
-#ifdef __AVX2__
-#if ABSL_HAVE_BUILTIN(__builtin_cpu_supports)
-  dst->cpu_supports_avx2 = __builtin_cpu_supports("avx2");
-#else
-  // We cannot detect if the CPU supports AVX2 instructions. If it does not,
-  // a fatal error will be raised.
-  dst->cpu_supports_avx2 = true;
-#endif
-#elif ABSL_HAVE_BUILTIN(__builtin_cpu_supports)
-  if (__builtin_cpu_supports("avx2")) {
-    LOG(INFO) << "The binary was compiled without AVX2 support, but your CPU"
-                 "supports it. Enable it for faster model inference.";
-  }
-#endif
+  dst->simd_instruction_set = BestSimdInstructionSet();
 
   if (src.task() != CompiledModel::kTask) {
     return absl::InvalidArgumentError("Wrong model class.");
@@ -828,11 +1201,44 @@ absl::Status BaseGenericToSpecializedModel(const AbstractModel& src,
       dst->mutable_features()->Initialize(all_input_features, src.data_spec()));
 
   // Compile the model.
-  RETURN_IF_ERROR(FillQuickScorer(src, dst, &accumulator));
+  const int num_values_per_leaf =
+      CompiledModel::kMultiDimensionalLeaves ? dst->num_output_dimensions : 1;
+  RETURN_IF_ERROR(FillQuickScorer(src, set_leaf_value, num_values_per_leaf,
+                                  dst, &accumulator));
 
   return absl::OkStatus();
 }
 
+// Compiles a GBDT. Each leaf contains a single value.
+template <typename CompiledModel>
+absl::Status GradientBoostedTreesToSpecializedModel(
+    const model::gradient_boosted_trees::GradientBoostedTreesModel& src,
+    CompiledModel* dst) {
+  const auto set_leaf_value =
+      [](const model::decision_tree::proto::Node& src_node,
+         float* dst_values) -> absl::Status {
+    dst_values[0] = src_node.regressor().top_value();
+    return absl::OkStatus();
+  };
+  RETURN_IF_ERROR(BaseGenericToSpecializedModel(src, set_leaf_value, dst));
+  dst->initial_prediction = src.initial_predictions()[0];
+  return absl::OkStatus();
+}
+
+// Gets the winner-take-all vote of a Random Forest classification leaf.
+utils::StatusOr<int> RandomForestLeafVote(
+    const model::decision_tree::proto::Node& src_node) {
+  const int32_t vote = src_node.classifier().top_value();
+  if (vote == dataset::kOutOfDictionaryItemIndex) {
+    return absl::InvalidArgumentError(
+        "This inference engine optimized for speed only supports model "
+        "outputting out-of-bag values. This can be caused by rare label "
+        "values (by default <10 on the entire training dataset) and not "
+        "setting \"min_vocab_frequency\" appropriately.");
+  }
+  return vote;
+}
+
 template <>
 absl::Status GenericToSpecializedModel(
     const model::gradient_boosted_trees::GradientBoostedTreesModel& src,
@@ -841,7 +1247,7 @@ absl::Status GenericToSpecializedModel(
     return absl::InvalidArgumentError(
         "The GBDT is not trained for regression with squared error loss.");
   }
-  return BaseGenericToSpecializedModel(src, dst);
+  return GradientBoostedTreesToSpecializedModel(src, dst);
 }
 
 template <>
@@ -853,7 +1259,7 @@ absl::Status GenericToSpecializedModel(
     return absl::InvalidArgumentError(
         "The GBDT is not trained for ranking with ranking loss.");
   }
-  return BaseGenericToSpecializedModel(src, dst);
+  return GradientBoostedTreesToSpecializedModel(src, dst);
 }
 
 template <>
@@ -866,7 +1272,112 @@ absl::Status GenericToSpecializedModel(
         "The GBDT is not trained for binary classification with binomial log "
         "likelihood loss.");
   }
-  return BaseGenericToSpecializedModel(src, dst);
+  return GradientBoostedTreesToSpecializedModel(src, dst);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const model::gradient_boosted_trees::GradientBoostedTreesModel& src,
+    GradientBoostedTreesMulticlassClassificationQuickScorerExtended* dst) {
+  if (src.loss() != Loss::MULTINOMIAL_LOG_LIKELIHOOD) {
+    return absl::InvalidArgumentError(
+        "The GBDT is not trained for multi-class classification with "
+        "multinomial log likelihood loss.");
+  }
+  dst->num_classes =
+      src.label_col_spec().categorical().number_of_unique_values() - 1;
+  if (dst->num_classes != src.num_trees_per_iter()) {
+    return absl::InvalidArgumentError(
+        "The number of trees per iteration does not match the number of "
+        "classes.");
+  }
+  dst->num_output_dimensions = dst->num_classes;
+  RETURN_IF_ERROR(GradientBoostedTreesToSpecializedModel(src, dst));
+  // Note: The multinomial log likelihood loss does not use initial
+  // predictions.
+  dst->initial_prediction = 0.f;
+  return absl::OkStatus();
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const model::random_forest::RandomForestModel& src,
+    RandomForestBinaryClassificationQuickScorerExtended* dst) {
+  if (src.label_col_spec().categorical().number_of_unique_values() != 3) {
+    return absl::InvalidArgumentError(
+        "The RF is not trained for binary classification.");
+  }
+  const float normalization = 1.f / src.NumTrees();
+  const bool winner_take_all = src.winner_take_all_inference();
+  // Probability of the positive class, divided by the number of trees.
+  const auto set_leaf_value =
+      [&](const model::decision_tree::proto::Node& src_node,
+          float* dst_values) -> absl::Status {
+    if (winner_take_all) {
+      ASSIGN_OR_RETURN(const int vote, RandomForestLeafVote(src_node));
+      dst_values[0] = (vote == 2) ? normalization : 0.f;
+    } else {
+      const auto& distribution = src_node.classifier().distribution();
+      if (distribution.counts_size() != 3) {
+        return absl::InvalidArgumentError("The RF is not a binary classifier.");
+      }
+      dst_values[0] = static_cast<float>(
+          distribution.counts(2) / distribution.sum() * normalization);
+    }
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const model::random_forest::RandomForestModel& src,
+    RandomForestMulticlassClassificationQuickScorerExtended* dst) {
+  dst->num_classes =
+      src.label_col_spec().categorical().number_of_unique_values() - 1;
+  dst->num_output_dimensions = dst->num_classes;
+  const int num_classes = dst->num_classes;
+  const float normalization = 1.f / src.NumTrees();
+  const bool winner_take_all = src.winner_take_all_inference();
+  // Probability of each class, divided by the number of trees.
+  const auto set_leaf_value =
+      [&](const model::decision_tree::proto::Node& src_node,
+          float* dst_values) -> absl::Status {
+    if (winner_take_all) {
+      ASSIGN_OR_RETURN(const int vote, RandomForestLeafVote(src_node));
+      if (vote > num_classes) {
+        return absl::InvalidArgumentError("Invalid vote.");
+      }
+      dst_values[vote - 1] = normalization;
+    } else {
+      const auto& distribution = src_node.classifier().distribution();
+      if (distribution.counts_size() != num_classes + 1) {
+        return absl::InvalidArgumentError(
+            "Unexpected number of classes in the leaf.");
+      }
+      for (int class_idx = 0; class_idx < num_classes; class_idx++) {
+        dst_values[class_idx] =
+            static_cast<float>(distribution.counts(class_idx + 1) /
+                               distribution.sum() * normalization);
+      }
+    }
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
+}
+
+template <>
+absl::Status GenericToSpecializedModel(
+    const model::random_forest::RandomForestModel& src,
+    RandomForestRegressionQuickScorerExtended* dst) {
+  const float normalization = 1.f / src.NumTrees();
+  const auto set_leaf_value =
+      [&](const model::decision_tree::proto::Node& src_node,
+          float* dst_values) -> absl::Status {
+    dst_values[0] = src_node.regressor().top_value() * normalization;
+    return absl::OkStatus();
+  };
+  return BaseGenericToSpecializedModel(src, set_leaf_value, dst);
 }
 
 template <typename CompiledModel>
@@ -891,8 +1402,14 @@ std::string DescribeQuickScorer(const Model& model, const bool detailed) {
                             model.max_num_leafs_per_tree);
   absl::SubstituteAndAppend(&structure, "Number of trees: $0\n",
                             model.num_trees);
+  absl::SubstituteAndAppend(&structure, "Number of leaf masks per trees: $0\n",
+                            model.num_leaf_masks_per_tree);
   absl::SubstituteAndAppend(&structure, "Initial prediction: $0\n",
                             model.initial_prediction);
+  absl::SubstituteAndAppend(&structure, "Number of output dimensions: $0\n",
+                            model.num_output_dimensions);
+  absl::SubstituteAndAppend(&structure, "SIMD instruction set: $0\n",
+                            SimdInstructionSetName(model.simd_instruction_set));
 
   // List of input features.
   absl::StrAppend(&structure, "Features (and missing replacement value):\n");
@@ -955,10 +1472,11 @@ std::string DescribeQuickScorer(const Model& model, const bool detailed) {
             std::string(
                 reinterpret_cast<const char* const>(&item.items[item_idx]),
                 sizeof(LeafMask)),
-            internal::QuickScorerExtendedModel::kMaxLeafs);
+            internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask);
         absl::SubstituteAndAppend(
-            &structure, "\t\ttree:$0 value:$1 mask : $2\n",
-            item_idx % model.num_trees, item_idx / model.num_trees,
+            &structure, "\t\tleaf mask:$0 value:$1 mask : $2\n",
+            item_idx % model.num_leaf_masks(),
+            item_idx / model.num_leaf_masks(),
             bitmap_representation);
       }
     }
@@ -980,7 +1498,7 @@ std::string DescribeQuickScorer(const Model& model, const bool detailed) {
         item.value_to_mask_range.size(), item.mask_buffer.size(),
         static_cast<float>(item.mask_buffer.size()) /
             item.value_to_mask_range.size(),
-        model.num_trees);
+        model.num_leaf_masks());
     if (detailed) {
       for (int value = 0; value < item.value_to_mask_range.size(); value++) {
         absl::SubstituteAndAppend(&structure, "\tValue: $0:\n", value);
@@ -990,8 +1508,8 @@ std::string DescribeQuickScorer(const Model& model, const bool detailed) {
           const auto bitmap_representation = ToStringBit(
               std::string(reinterpret_cast<const char* const>(&mask.second),
                           sizeof(LeafMask)),
-              internal::QuickScorerExtendedModel::kMaxLeafs);
-          absl::SubstituteAndAppend(&structure, "\t\ttree:$0 mask : $1\n",
+              internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask);
+          absl::SubstituteAndAppend(&structure, "\t\tleaf mask:$0 mask : $1\n",
                                     mask.first, bitmap_representation);
         }
       }
@@ -1029,11 +1547,11 @@ std::string DescribeQuickScorer(const Model& model, const bool detailed) {
             std::string(
                 reinterpret_cast<const char* const>(&sub_item.leaf_mask),
                 sizeof(LeafMask)),
-            internal::QuickScorerExtendedModel::kMaxLeafs);
+            internal::QuickScorerExtendedModel::kMaxLeafsPerLeafMask);
         absl::SubstituteAndAppend(&structure,
-                                  "\t\tmask:$0 = $1 thre:$2 tree:$3\n",
+                                  "\t\tmask:$0 = $1 thre:$2 leaf mask:$3\n",
                                   sub_item.leaf_mask, bitmap_representation,
-                                  sub_item.threshold, sub_item.tree_idx);
+                                  sub_item.threshold, sub_item.leaf_mask_idx);
       }
     }
   }
@@ -1052,6 +1570,31 @@ template std::string DescribeQuickScorer<
     const GradientBoostedTreesBinaryClassificationQuickScorerExtended& model,
     bool detailed);
 
+template std::string DescribeQuickScorer<
+    GradientBoostedTreesMulticlassClassificationQuickScorerExtended>(
+    const GradientBoostedTreesMulticlassClassificationQuickScorerExtended&
+        model,
+    bool detailed);
+
+template std::string
+DescribeQuickScorer<GradientBoostedTreesRankingQuickScorerExtended>(
+    const GradientBoostedTreesRankingQuickScorerExtended& model,
+    bool detailed);
+
+template std::string
+DescribeQuickScorer<RandomForestBinaryClassificationQuickScorerExtended>(
+    const RandomForestBinaryClassificationQuickScorerExtended& model,
+    bool detailed);
+
+template std::string
+DescribeQuickScorer<RandomForestMulticlassClassificationQuickScorerExtended>(
+    const RandomForestMulticlassClassificationQuickScorerExtended& model,
+    bool detailed);
+
+template std::string
+DescribeQuickScorer<RandomForestRegressionQuickScorerExtended>(
+    const RandomForestRegressionQuickScorerExtended& model, bool detailed);
+
 }  // namespace decision_forest
 }  // namespace serving
 }  // namespace yggdrasil_decision_forests
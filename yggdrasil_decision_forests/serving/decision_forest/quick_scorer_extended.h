@@ -29,24 +29,31 @@
 // applied, the "first" active leaf (i.e. the leaf corresponding to the first
 // non-zero bitmap value) is returned.
 //
-// The SIMD instructions are used to process multiple examples at the sametime.
+// The active leaf bitmap of a tree is stored in one or several 64 bits words
+// (called "leaf masks" in the code). Trees with at most 64 leaves use a single
+// word. Larger trees use multiple consecutive words, and a condition only
+// updates the words containing the leaves it deactivates (similarly to the
+// "blocked" bitmap of RapidScorer).
 //
-// Important: This library works faster if AVX2 is enabled at computation:
-//   Add "--copt=-mavx2" to the build call.
-//   Add "requirements = {constraints = cpu_features.require(['avx2'])}" to your
-//     borgcfg.
-//   Add a "tricorder > builder > copt: '-mavx2'", in your METADATA for your
-//     forge tests.
+// The SIMD instructions are used to process multiple examples at the sametime.
 //
-// Note: Adding 'copts = ["-mavx2"],' to your binary configuration wont work as
-// it will only be used to compile your main target.
+// The SIMD instruction set (SSE4.1, AVX2 or AVX-512) is selected when the
+// model is compiled (i.e. "GenericToSpecializedModel") according to the CPU
+// running the binary. With GCC and Clang on x86-64, the SIMD code of all the
+// instruction sets is always compiled, and no specific build flag (e.g.
+// "-mavx2") is necessary. With other compilers, only the instruction sets
+// enabled at compile time (e.g. "/arch:AVX2") are available.
 //
 // The current implementation support:
-//   - Regressive GBDTs.
+//   - GBDTs for regression, ranking, binary classification and multi-class
+//     classification.
+//   - Random Forests for regression, binary classification and multi-class
+//     classification (with or without winner-take-all inference).
 //
 // With the following constraints:
 //   - Maximum of 65k trees.
-//   - Maximum of 128 nodes per trees (e.g. max depth = 6).
+//   - Maximum of 1024 leaves per trees (e.g. max depth = 10). Trees with more
+//     than 64 leaves use a multi-word active leaf bitmap.
 //   - Maximum of 65k unique input features.
 //   - Support categorical and numerical features.
 //
@@ -64,7 +71,7 @@
 //
 // The code can be benchmarked using the following command:
 //
-//   bazel run -c opt --copt=-mavx2 :benchmark_nogpu -- \
+//   bazel run -c opt :benchmark_nogpu -- \
 //    --alsologtostderr \
 //    --mtc=GRADIENT_BOOSTED_TREES_REGRESSION_NUMERICAL_AND_CATEGORICAL_32_ATTRIBUTES
 //
@@ -91,9 +98,11 @@
 
 #include <stdlib.h>
 
+#include <string>
 #include <unordered_map>
 
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/utils.h"
 #include "yggdrasil_decision_forests/serving/example_set.h"
 
@@ -101,6 +110,22 @@ namespace yggdrasil_decision_forests {
 namespace serving {
 namespace decision_forest {
 
+// SIMD instruction sets available to the QuickScorer inference. Each
+// instruction set implies the support of the previous ones.
+enum class SimdInstructionSet {
+  kNone,
+  kSSE41,
+  kAVX2,
+  kAVX512,
+};
+
+// Best SIMD instruction set supported by both the binary and the CPU. The CPU
+// capabilities are detected the first time this function is called.
+SimdInstructionSet BestSimdInstructionSet();
+
+// Human readable name of a SIMD instruction set e.g. "AVX2".
+std::string SimdInstructionSetName(SimdInstructionSet instruction_set);
+
 namespace internal {
 
 // Base model representation compatible with the QuickScorer algorithm.
@@ -138,14 +163,28 @@ struct QuickScorerExtendedModel {
 
   // Maximum number of trees and number of leafs per trees.
   static constexpr size_t kMaxTrees = std::numeric_limits<TreeIdx>::max();
-  static constexpr size_t kMaxLeafs = sizeof(LeafMask) * 8;
+  static constexpr size_t kMaxLeafsPerLeafMask = sizeof(LeafMask) * 8;
+  static constexpr size_t kMaxLeafMasksPerTree = 16;
+  static constexpr size_t kMaxLeafs =
+      kMaxLeafsPerLeafMask * kMaxLeafMasksPerTree;
 
   // Maximum number of leafs in each tree.
   int max_num_leafs_per_tree;
 
+  // Number of leaf masks (i.e. words of the active leaf bitmap) for each tree.
+  // The "k-th" leaf mask of the "j-th" tree covers the leaves "[k * 64, (k+1) *
+  // 64)" and it is indexed "j * num_leaf_masks_per_tree + k" (called "leaf mask
+  // index" in the code).
+  int num_leaf_masks_per_tree = 1;
+
+  // Total number of leaf masks in the model.
+  int num_leaf_masks() const { return num_trees * num_leaf_masks_per_tree; }
+
   // Value (i.e. prediction) of each leaf.
   // "leaf_values[i + j * max_num_leafs_per_tree]" is the value of the "i-th"
-  // leaf in the "j-th" tree.
+  // leaf in the "j-th" tree. With multi-dimensional leaves, "leaf_values[(i + j
+  // * max_num_leafs_per_tree) * num_output_dimensions + k]" is the "k-th" value
+  // of this leaf.
   std::vector<LeafOutput> leaf_values;
 
   // Number of trees in the model.
@@ -154,16 +193,27 @@ struct QuickScorerExtendedModel {
   // Initial prediction / bias of the model.
   float initial_prediction = 0.f;
 
-#ifdef __AVX2__
-  // This flag is set during the compilation of the model and indicates if the
-  // CPU supports AVX2 instructions
-  bool cpu_supports_avx2 = true;
-#endif
+  // Number of output dimensions of the model. Only multi-class classification
+  // models have more than one output (one accumulator per class).
+  //
+  // If "kMultiDimensionalLeaves" is false, each leaf contains a single value
+  // and the trees are assigned to the outputs in a round-robin fashion i.e. the
+  // "j-th" tree contributes to the "j % num_output_dimensions"-th output (e.g.
+  // multi-class GBDT). If "kMultiDimensionalLeaves" is true, each leaf contains
+  // "num_output_dimensions" values and each tree contributes to all the outputs
+  // (e.g. multi-class Random Forest).
+  int num_output_dimensions = 1;
+  static constexpr bool kMultiDimensionalLeaves = false;
+
+  // SIMD instruction set used for the inference. Set during the compilation
+  // of the model to "BestSimdInstructionSet()".
+  SimdInstructionSet simd_instruction_set = SimdInstructionSet::kNone;
 
   // Data for "IsHigher" conditions i.e. condition of the form "feature >= t".
   struct IsHigherConditionItem {
     float threshold;
-    TreeIdx tree_idx;
+    // Leaf mask index. See "num_leaf_masks_per_tree".
+    TreeIdx leaf_mask_idx;
     LeafMask leaf_mask;
   };
 
@@ -183,8 +233,9 @@ struct QuickScorerExtendedModel {
     int internal_feature_idx;
 
     // "Contains" type condition for each feature value.
-    // items[tree_idx + feature_value * num_trees] is the mask to apply on tree
-    // "tree_idx" when the feature value is "feature_value".
+    // items[leaf_mask_idx + feature_value * num_leaf_masks()] is the mask to
+    // apply on the leaf mask "leaf_mask_idx" when the feature value is
+    // "feature_value".
     std::vector<LeafMask> items;
   };
 
@@ -195,7 +246,8 @@ struct QuickScorerExtendedModel {
     int internal_feature_idx;
 
     // The "i-th" feature value maps to the masks "mask_buffer[j]" for "j" in
-    // "[value_to_mask_range[i).first, value_to_mask_range[i].second[".
+    // "[value_to_mask_range[i).first, value_to_mask_range[i].second[". Masks
+    // are indexed by leaf mask index.
     std::vector<std::pair<int, int>> value_to_mask_range;
     std::vector<std::pair<TreeIdx, LeafMask>> mask_buffer;
   };
@@ -212,7 +264,7 @@ struct QuickScorerExtendedModel {
       int internal_feature_idx;
 
       // "masks[i][j]" is the mask for the "i-th" feature value on the "j-th"
-      // tree;
+      // leaf mask;
       std::vector<std::unordered_map<TreeIdx, LeafMask>> masks;
     };
 
@@ -255,12 +307,46 @@ struct GradientBoostedTreesBinaryClassificationQuickScorerExtended
       model::proto::Task::CLASSIFICATION;
 };
 
+// Specialization of quick scorer for GBDT multi-class classification model.
+struct GradientBoostedTreesMulticlassClassificationQuickScorerExtended
+    : internal::QuickScorerExtendedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+  // Number of classes. Same as "num_output_dimensions".
+  int num_classes;
+};
+
 // Specialization of quick scorer for GBDT ranking model.
 struct GradientBoostedTreesRankingQuickScorerExtended
     : internal::QuickScorerExtendedModel {
   static constexpr model::proto::Task kTask = model::proto::Task::RANKING;
 };
 
+// Specialization of quick scorer for Random Forest binary classification
+// model. The prediction is the probability of the positive class.
+struct RandomForestBinaryClassificationQuickScorerExtended
+    : internal::QuickScorerExtendedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+};
+
+// Specialization of quick scorer for Random Forest multi-class classification
+// model. The predictions are the probabilities of each class.
+struct RandomForestMulticlassClassificationQuickScorerExtended
+    : internal::QuickScorerExtendedModel {
+  static constexpr model::proto::Task kTask =
+      model::proto::Task::CLASSIFICATION;
+  static constexpr bool kMultiDimensionalLeaves = true;
+  // Number of classes. Same as "num_output_dimensions".
+  int num_classes;
+};
+
+// Specialization of quick scorer for Random Forest regression model.
+struct RandomForestRegressionQuickScorerExtended
+    : internal::QuickScorerExtendedModel {
+  static constexpr model::proto::Task kTask = model::proto::Task::REGRESSION;
+};
+
 // Computes the model's prediction on a batch of examples.
 //
 // This method is thread safe.
@@ -274,13 +360,15 @@ struct GradientBoostedTreesRankingQuickScorerExtended
 //     "GenericToSpecializedModel".
 //   - examples: A batch of examples. The examples are stored FEATURE-WISE.
 //   - num_examples: Number of examples in the batch.
-//   - predictions: Output predictions. Does not need to be pre-allocated.
+//   - predictions: Output predictions. Does not need to be pre-allocated. For
+//     multi-class classification models, "predictions[i * num_classes + j]" is
+//     the probability of the "j-th" class for the "i-th" example.
 //
 
 template <typename Model>
 void PredictQuickScorer(
     const Model& model,
-    const std::vector<NumericalOrCategoricalValue>& examples, int num_examples,
+    absl::Span<const NumericalOrCategoricalValue> examples, int num_examples,
     std::vector<float>* predictions);
 
 // Version of PredictQuickScorer compatible with the ExampleSet signature.
@@ -288,7 +376,7 @@ template <typename Model>
 void Predict(const Model& model, const typename Model::ExampleSet& examples,
              int num_examples, std::vector<float>* predictions);
 
-// Converts a generic GradientBoostedTreesModel with regression loss into a
+// Converts a generic GradientBoostedTreesModel or RandomForestModel into a
 // quick scorer compatible model.
 //
 // This method checks that the model inference (i.e. PredictQuickScorer) won't
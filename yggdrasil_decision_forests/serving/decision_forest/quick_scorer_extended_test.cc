@@ -13,10 +13,16 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
+#include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
 #include "yggdrasil_decision_forests/utils/test.h"
 
 #include "yggdrasil_decision_forests/serving/decision_forest/quick_scorer_extended.h"
@@ -31,7 +37,9 @@ using model::decision_tree::NodeWithChildren;
 using model::decision_tree::proto::Condition;
 using model::gradient_boosted_trees::GradientBoostedTreesModel;
 using model::gradient_boosted_trees::proto::Loss;
+using model::random_forest::RandomForestModel;
 using testing::ElementsAre;
+using testing::ElementsAreArray;
 
 void BuildToyModelAndToyDataset(const model::proto::Task task,
                                 const bool use_cateset_feature,
@@ -390,6 +398,303 @@ TEST(QuickScorer, ExceedStackBuffer) {
                   (1 + 1 + 10 + 300 + 2000 + 20000) * duplicate_factor));
 }
 
+TEST(QuickScorer, MulticlassClassification) {
+  dataset::proto::DataSpecification dataspec = PARSE_TEST_PROTO(R"pb(
+    columns {
+      type: CATEGORICAL
+      name: "l"
+      categorical { is_already_integerized: true number_of_unique_values: 4 }
+    }
+    columns { type: NUMERICAL name: "a" }
+  )pb");
+
+  // Two iterations of three trees (one per class). Each tree is a stump on
+  // "a" with threshold 1.
+  GradientBoostedTreesModel model;
+  model.set_task(model::proto::Task::CLASSIFICATION);
+  model.set_label_col_idx(0);
+  model.set_data_spec(dataspec);
+  model.set_loss(Loss::MULTINOMIAL_LOG_LIKELIHOOD);
+  model.set_num_trees_per_iter(3);
+  model.mutable_initial_predictions()->assign({0.f, 0.f, 0.f});
+
+  const std::vector<std::pair<float, float>> neg_and_pos_leaf_values = {
+      {1.f, 0.f}, {0.f, 1.f}, {0.f, 0.f}, {1.f, 0.f}, {0.f, 2.f}, {0.5f, 0.f}};
+  for (const auto& leaf_values : neg_and_pos_leaf_values) {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    auto* root = tree->mutable_root();
+    root->CreateChildren();
+    root->mutable_node()->mutable_condition()->set_attribute(1);
+    root->mutable_node()
+        ->mutable_condition()
+        ->mutable_condition()
+        ->mutable_higher_condition()
+        ->set_threshold(1.0f);
+    root->mutable_neg_child()
+        ->mutable_node()
+        ->mutable_regressor()
+        ->set_top_value(leaf_values.first);
+    root->mutable_pos_child()
+        ->mutable_node()
+        ->mutable_regressor()
+        ->set_top_value(leaf_values.second);
+    model.mutable_decision_trees()->push_back(std::move(tree));
+  }
+
+  GradientBoostedTreesMulticlassClassificationQuickScorerExtended
+      quick_scorer_model;
+  CHECK_OK(GenericToSpecializedModel(model, &quick_scorer_model));
+  EXPECT_EQ(quick_scorer_model.num_classes, 3);
+
+  // Five examples to cover both the parallel and the sequential inference.
+  const std::vector<float> feature_values = {0.5f, 1.5f, 0.5f, 1.5f, 1.5f};
+  const int num_examples = feature_values.size();
+  GradientBoostedTreesMulticlassClassificationQuickScorerExtended::ExampleSet
+      examples(num_examples, quick_scorer_model);
+  examples.FillMissing(quick_scorer_model);
+  const auto feature =
+      GradientBoostedTreesMulticlassClassificationQuickScorerExtended::
+          ExampleSet::GetNumericalFeatureId("a", quick_scorer_model)
+              .value();
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    examples.SetNumerical(example_idx, feature, feature_values[example_idx],
+                          quick_scorer_model);
+  }
+
+  std::vector<float> predictions;
+  Predict(quick_scorer_model, examples, num_examples, &predictions);
+  ASSERT_EQ(predictions.size(), num_examples * 3);
+
+  // Softmax of the per-class accumulators.
+  const auto softmax = [](const std::vector<float>& logits) {
+    std::vector<float> probas;
+    float sum = 0;
+    for (const float logit : logits) {
+      probas.push_back(std::exp(logit));
+      sum += probas.back();
+    }
+    for (auto& proba : probas) {
+      proba /= sum;
+    }
+    return probas;
+  };
+  const auto expected_neg = softmax({2.f, 0.f, 0.5f});
+  const auto expected_pos = softmax({0.f, 3.f, 0.f});
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    const auto& expected =
+        feature_values[example_idx] >= 1.0f ? expected_pos : expected_neg;
+    for (int class_idx = 0; class_idx < 3; class_idx++) {
+      EXPECT_NEAR(predictions[example_idx * 3 + class_idx], expected[class_idx],
+                  1e-5f);
+    }
+  }
+}
+
+// Trees with more than 64 leaves use a multi-word active leaf bitmap.
+TEST(QuickScorer, LargeTrees) {
+  dataset::proto::DataSpecification dataspec = PARSE_TEST_PROTO(R"pb(
+    columns { type: NUMERICAL name: "l" }
+    columns { type: NUMERICAL name: "a" }
+    columns { type: NUMERICAL name: "b" }
+    columns {
+      type: CATEGORICAL
+      name: "c"
+      categorical { is_already_integerized: true number_of_unique_values: 4 }
+    }
+  )pb");
+
+  GradientBoostedTreesModel model;
+  model.set_task(model::proto::Task::REGRESSION);
+  model.set_label_col_idx(0);
+  model.set_data_spec(dataspec);
+  model.set_loss(Loss::SQUARED_ERROR);
+  model.set_num_trees_per_iter(1);
+  model.mutable_initial_predictions()->push_back(0.5f);
+
+  // Complete trees of depth 7, 8 and 10 (i.e. 128, 256 and 1024 leaves) with
+  // random conditions.
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<float> unif_01;
+  float next_leaf_value = 0;
+  std::function<void(int, NodeWithChildren*)> grow_node =
+      [&](const int remaining_depth, NodeWithChildren* node) {
+        if (remaining_depth == 0) {
+          node->mutable_node()->mutable_regressor()->set_top_value(
+              next_leaf_value++);
+          return;
+        }
+        node->CreateChildren();
+        auto* condition = node->mutable_node()->mutable_condition();
+        const int attribute = 1 + random() % 3;
+        condition->set_attribute(attribute);
+        if (attribute == 3) {
+          auto* elements = condition->mutable_condition()
+                               ->mutable_contains_condition()
+                               ->mutable_elements();
+          for (int value = 0; value < 4; value++) {
+            if (random() % 2) {
+              elements->Add(value);
+            }
+          }
+        } else {
+          condition->mutable_condition()
+              ->mutable_higher_condition()
+              ->set_threshold(unif_01(random));
+        }
+        grow_node(remaining_depth - 1, node->mutable_neg_child());
+        grow_node(remaining_depth - 1, node->mutable_pos_child());
+      };
+  for (const int depth : {7, 8, 10}) {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    grow_node(depth, tree->mutable_root());
+    model.mutable_decision_trees()->push_back(std::move(tree));
+  }
+
+  GradientBoostedTreesRegressionQuickScorerExtended quick_scorer_model;
+  CHECK_OK(GenericToSpecializedModel(model, &quick_scorer_model));
+  EXPECT_EQ(quick_scorer_model.num_leaf_masks_per_tree, 16);
+
+  // Compares the predictions with the generic engine.
+  const int num_examples = 50;
+  using ExampleSet =
+      GradientBoostedTreesRegressionQuickScorerExtended::ExampleSet;
+  ExampleSet examples(num_examples, quick_scorer_model);
+  examples.FillMissing(quick_scorer_model);
+  const auto feature_a =
+      ExampleSet::GetNumericalFeatureId("a", quick_scorer_model).value();
+  const auto feature_b =
+      ExampleSet::GetNumericalFeatureId("b", quick_scorer_model).value();
+  const auto feature_c =
+      ExampleSet::GetCategoricalFeatureId("c", quick_scorer_model).value();
+
+  std::vector<float> expected_predictions;
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    dataset::proto::Example example;
+    example.add_attributes();
+    const float a = unif_01(random);
+    const float b = unif_01(random);
+    const int c = random() % 4;
+    example.add_attributes()->set_numerical(a);
+    example.add_attributes()->set_numerical(b);
+    example.add_attributes()->set_categorical(c);
+    examples.SetNumerical(example_idx, feature_a, a, quick_scorer_model);
+    examples.SetNumerical(example_idx, feature_b, b, quick_scorer_model);
+    examples.SetCategorical(example_idx, feature_c, c, quick_scorer_model);
+
+    model::proto::Prediction prediction;
+    model.Predict(example, &prediction);
+    expected_predictions.push_back(prediction.regression().value());
+  }
+
+  // Test all the SIMD instruction sets supported by the CPU.
+  for (const auto instruction_set :
+       {SimdInstructionSet::kNone, SimdInstructionSet::kSSE41,
+        SimdInstructionSet::kAVX2, SimdInstructionSet::kAVX512}) {
+    if (instruction_set > BestSimdInstructionSet()) {
+      continue;
+    }
+    LOG(INFO) << "Instruction set: " << SimdInstructionSetName(instruction_set);
+    quick_scorer_model.simd_instruction_set = instruction_set;
+    std::vector<float> predictions;
+    Predict(quick_scorer_model, examples, num_examples, &predictions);
+    EXPECT_THAT(predictions, ElementsAreArray(expected_predictions));
+  }
+}
+
+TEST(QuickScorer, RandomForestMulticlassClassification) {
+  dataset::proto::DataSpecification dataspec = PARSE_TEST_PROTO(R"pb(
+    columns {
+      type: CATEGORICAL
+      name: "l"
+      categorical { is_already_integerized: true number_of_unique_values: 4 }
+    }
+    columns { type: NUMERICAL name: "a" }
+  )pb");
+
+  RandomForestModel model;
+  model.set_task(model::proto::Task::CLASSIFICATION);
+  model.set_label_col_idx(0);
+  model.set_data_spec(dataspec);
+
+  // Two stumps on "a". The leaves contain the class distributions (the first
+  // element is the out-of-dictionary class) and the majority class.
+  const std::vector<std::pair<std::vector<float>, std::vector<float>>>
+      neg_and_pos_leaf_counts = {{{0.f, 3.f, 1.f, 0.f}, {0.f, 1.f, 1.f, 2.f}},
+                                 {{0.f, 1.f, 2.f, 1.f}, {0.f, 0.f, 1.f, 3.f}}};
+  const auto set_leaf = [](const std::vector<float>& counts,
+                           NodeWithChildren* node) {
+    auto* classifier = node->mutable_node()->mutable_classifier();
+    float sum = 0;
+    for (const float count : counts) {
+      classifier->mutable_distribution()->add_counts(count);
+      sum += count;
+    }
+    classifier->mutable_distribution()->set_sum(sum);
+    classifier->set_top_value(
+        std::max_element(counts.begin(), counts.end()) - counts.begin());
+  };
+  for (const auto& leaf_counts : neg_and_pos_leaf_counts) {
+    auto tree = absl::make_unique<DecisionTree>();
+    tree->CreateRoot();
+    auto* root = tree->mutable_root();
+    root->CreateChildren();
+    root->mutable_node()->mutable_condition()->set_attribute(1);
+    root->mutable_node()
+        ->mutable_condition()
+        ->mutable_condition()
+        ->mutable_higher_condition()
+        ->set_threshold(1.0f);
+    set_leaf(leaf_counts.first, root->mutable_neg_child());
+    set_leaf(leaf_counts.second, root->mutable_pos_child());
+    model.mutable_decision_trees()->push_back(std::move(tree));
+  }
+
+  // Five examples to cover both the parallel and the sequential inference.
+  const std::vector<float> feature_values = {0.5f, 1.5f, 0.5f, 1.5f, 1.5f};
+  const int num_examples = feature_values.size();
+
+  for (const bool winner_take_all : {true, false}) {
+    LOG(INFO) << "Winner take all: " << winner_take_all;
+    model.set_winner_take_all_inference(winner_take_all);
+
+    RandomForestMulticlassClassificationQuickScorerExtended quick_scorer_model;
+    CHECK_OK(GenericToSpecializedModel(model, &quick_scorer_model));
+    EXPECT_EQ(quick_scorer_model.num_classes, 3);
+
+    using ExampleSet =
+        RandomForestMulticlassClassificationQuickScorerExtended::ExampleSet;
+    ExampleSet examples(num_examples, quick_scorer_model);
+    examples.FillMissing(quick_scorer_model);
+    const auto feature =
+        ExampleSet::GetNumericalFeatureId("a", quick_scorer_model).value();
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      examples.SetNumerical(example_idx, feature, feature_values[example_idx],
+                            quick_scorer_model);
+    }
+
+    std::vector<float> predictions;
+    Predict(quick_scorer_model, examples, num_examples, &predictions);
+    ASSERT_EQ(predictions.size(), num_examples * 3);
+
+    // Compares the predictions with the generic engine.
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      dataset::proto::Example example;
+      example.add_attributes();
+      example.add_attributes()->set_numerical(feature_values[example_idx]);
+      model::proto::Prediction prediction;
+      model.Predict(example, &prediction);
+      const auto& distribution = prediction.classification().distribution();
+      for (int class_idx = 0; class_idx < 3; class_idx++) {
+        EXPECT_NEAR(predictions[example_idx * 3 + class_idx],
+                    distribution.counts(class_idx + 1) / distribution.sum(),
+                    1e-5f);
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace decision_forest
 }  // namespace serving
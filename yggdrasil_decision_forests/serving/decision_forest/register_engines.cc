@@ -17,11 +17,16 @@
 //
 #include "yggdrasil_decision_forests/serving/decision_forest/register_engines.h"
 
+#include <algorithm>
+
+#include "absl/strings/string_view.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/model/abstract_model.h"
 #include "yggdrasil_decision_forests/model/fast_engine_factory.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/engine_file.h"
+#include "yggdrasil_decision_forests/serving/decision_forest/quantized_decision_forest.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/quick_scorer_extended.h"
 #include "yggdrasil_decision_forests/serving/example_set_model_wrapper.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
@@ -139,6 +144,61 @@ bool AllConditionsCompatibleQuickScorerExtendedModels(
   return CheckAllConditions(decision_trees, check_condition);
 }
 
+// Checks that the number of leaves and leaf masks of the trees are supported
+// by "QuickScorerExtended" type models.
+bool LeafMasksCompatibleQuickScorerExtendedModels(
+    const std::vector<std::unique_ptr<decision_tree::DecisionTree>>&
+        decision_trees) {
+  // Follow "FillQuickScorer" in
+  // serving/decision_forest/quick_scorer_extended.cc.
+  using QuickScorerExtendedModel =
+      serving::decision_forest::internal::QuickScorerExtendedModel;
+  constexpr size_t kMaxLeafsPerLeafMask =
+      QuickScorerExtendedModel::kMaxLeafsPerLeafMask;
+  size_t max_num_leafs_per_tree = 0;
+  for (const auto& src_tree : decision_trees) {
+    max_num_leafs_per_tree = std::max<size_t>(max_num_leafs_per_tree,
+                                              src_tree->NumLeafs());
+  }
+  if (max_num_leafs_per_tree > QuickScorerExtendedModel::kMaxLeafs) {
+    return false;
+  }
+  const size_t num_leaf_masks_per_tree = std::max<size_t>(
+      1, (max_num_leafs_per_tree + kMaxLeafsPerLeafMask - 1) /
+             kMaxLeafsPerLeafMask);
+  return decision_trees.size() * num_leaf_masks_per_tree <=
+         QuickScorerExtendedModel::kMaxTrees;
+}
+
+// Checks that all the conditions are compatible for "Quantized" type models.
+bool AllConditionsCompatibleQuantizedModels(
+    const std::vector<std::unique_ptr<decision_tree::DecisionTree>>&
+        decision_trees) {
+  // Follow "GetNodeThreshold" in
+  // serving/decision_forest/quantized_decision_forest.cc.
+  const auto check_condition =
+      [](const model::decision_tree::proto::Condition& condition) {
+        switch (condition.type_case()) {
+          case model::decision_tree::proto::Condition::kHigherCondition:
+          case model::decision_tree::proto::Condition::kTrueValueCondition:
+            return true;
+          default:
+            return false;
+        }
+      };
+  return CheckAllConditions(decision_trees, check_condition);
+}
+
+// Loads an engine (a "serving::ExampleSetModelWrapper") from an engine file.
+template <typename Engine>
+utils::StatusOr<std::unique_ptr<serving::FastEngine>> LoadEngineFromFile(
+    const absl::string_view path) {
+  auto engine = absl::make_unique<Engine>();
+  RETURN_IF_ERROR(serving::decision_forest::LoadEngineFile(
+      path, engine->mutable_model()));
+  return engine;
+}
+
 }  // namespace
 
 class GradientBoostedTreesGenericFastEngineFactory : public FastEngineFactory {
@@ -173,7 +233,6 @@ class GradientBoostedTreesGenericFastEngineFactory : public FastEngineFactory {
     // More than 65k nodes in a single tree is a likely indication of a problem
     // with the model.
 
-    std::unique_ptr<serving::FastEngine> engine;
     switch (gbt_model->task()) {
       case proto::CLASSIFICATION:
         if (gbt_model->label_col_spec()
@@ -181,50 +240,81 @@ class GradientBoostedTreesGenericFastEngineFactory : public FastEngineFactory {
                 .number_of_unique_values() == 3) {
           // Binary classification.
           if (need_uint32_node_index) {
-            auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+            return CreateGenericEngine<
                 serving::decision_forest::
-                    GenericGradientBoostedTreesBinaryClassification<uint32_t>,
-                serving::decision_forest::Predict>>();
-            RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
-            return engine;
+                    GenericGradientBoostedTreesBinaryClassification<uint32_t>>(
+                *gbt_model);
           } else {
-            auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+            return CreateGenericEngine<
                 serving::decision_forest::
-                    GradientBoostedTreesBinaryClassification,
-                serving::decision_forest::Predict>>();
-            RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
-            return engine;
+                    GradientBoostedTreesBinaryClassification>(*gbt_model);
           }
         } else {
           // Multi-class classification.
-          auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+          return CreateGenericEngine<
               serving::decision_forest::
-                  GradientBoostedTreesMulticlassClassification,
-              serving::decision_forest::Predict>>();
-          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
-          return engine;
+                  GradientBoostedTreesMulticlassClassification>(*gbt_model);
         }
 
-      case proto::REGRESSION: {
-        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
-            serving::decision_forest::GradientBoostedTreesRegression,
-            serving::decision_forest::Predict>>();
-        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
-        return engine;
-      }
+      case proto::REGRESSION:
+        return CreateGenericEngine<
+            serving::decision_forest::GradientBoostedTreesRegression>(
+            *gbt_model);
 
-      case proto::RANKING: {
-        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
-            serving::decision_forest::GradientBoostedTreesRanking,
-            serving::decision_forest::Predict>>();
-        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
-        return engine;
-      }
+      case proto::RANKING:
+        return CreateGenericEngine<
+            serving::decision_forest::GradientBoostedTreesRanking>(*gbt_model);
 
       default:
         return absl::InvalidArgumentError("Non supported GBDT model");
     }
   }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngineFromFile(
+      const absl::string_view path) const override {
+    using serving::decision_forest::EngineFileModelType;
+    ASSIGN_OR_RETURN(const auto model_type,
+                     serving::decision_forest::ReadEngineFileModelType(path));
+    switch (model_type) {
+      case EngineFileModelType::kGradientBoostedTreesBinaryClassification:
+        return LoadEngineFromFile<GenericEngine<serving::decision_forest::
+                GradientBoostedTreesBinaryClassification>>(path);
+      case EngineFileModelType::
+          kGradientBoostedTreesBinaryClassificationManyNodes:
+        return LoadEngineFromFile<
+            GenericEngine<serving::decision_forest::
+                              GenericGradientBoostedTreesBinaryClassification<
+                                  uint32_t>>>(path);
+      case EngineFileModelType::kGradientBoostedTreesMulticlassClassification:
+        return LoadEngineFromFile<GenericEngine<
+            serving::decision_forest::
+                GradientBoostedTreesMulticlassClassification>>(path);
+      case EngineFileModelType::kGradientBoostedTreesRegression:
+        return LoadEngineFromFile<GenericEngine<
+            serving::decision_forest::GradientBoostedTreesRegression>>(path);
+      case EngineFileModelType::kGradientBoostedTreesRanking:
+        return LoadEngineFromFile<GenericEngine<
+            serving::decision_forest::GradientBoostedTreesRanking>>(path);
+      default:
+        return absl::InvalidArgumentError(
+            "Non supported model type in the engine file.");
+    }
+  }
+
+ private:
+  // Engine for the compiled model "Model". Can be saved to an engine file.
+  template <typename Model>
+  using GenericEngine = serving::ExampleSetModelWrapper<
+      Model, serving::decision_forest::Predict, nullptr,
+      serving::decision_forest::SaveEngineFile<Model>>;
+
+  template <typename Model>
+  static utils::StatusOr<std::unique_ptr<serving::FastEngine>>
+  CreateGenericEngine(const SourceModel& gbt_model) {
+    auto engine = absl::make_unique<GenericEngine<Model>>();
+    RETURN_IF_ERROR(engine->template LoadModel<SourceModel>(gbt_model));
+    return engine;
+  }
 };
 
 REGISTER_FastEngineFactory(GradientBoostedTreesGenericFastEngineFactory,
@@ -235,6 +325,9 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
  public:
   using SourceModel = gradient_boosted_trees::GradientBoostedTreesModel;
 
+  // Note: The SIMD instruction set used by the engine is selected at runtime
+  // (see "serving::decision_forest::BestSimdInstructionSet") and is not part of
+  // the name so that the name matches the registration key.
   std::string name() const override {
     return serving::gradient_boosted_trees::kQuickScorerExtended;
   }
@@ -249,18 +342,11 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
       return false;
     }
 
-    if (gbt_model->NumTrees() > serving::decision_forest::internal::
-                                    QuickScorerExtendedModel::kMaxTrees) {
+    if (!LeafMasksCompatibleQuickScorerExtendedModels(
+            gbt_model->decision_trees())) {
       return false;
     }
 
-    for (const auto& src_tree : gbt_model->decision_trees()) {
-      if (src_tree->NumLeafs() > serving::decision_forest::internal::
-                                     QuickScorerExtendedModel::kMaxLeafs) {
-        return false;
-      }
-    }
-
     if (!AllConditionsCompatibleQuickScorerExtendedModels(
             gbt_model->decision_trees())) {
       return false;
@@ -268,9 +354,6 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
 
     switch (gbt_model->task()) {
       case proto::CLASSIFICATION:
-        return gbt_model->label_col_spec()
-                   .categorical()
-                   .number_of_unique_values() == 3;
       case proto::REGRESSION:
       case proto::RANKING:
         return true;
@@ -281,7 +364,8 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
 
   std::vector<std::string> IsBetterThan() const override {
     return {serving::gradient_boosted_trees::kGeneric,
-            serving::gradient_boosted_trees::kOptPred};
+            serving::gradient_boosted_trees::kOptPred,
+            serving::gradient_boosted_trees::kQuantized};
   }
 
   utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngine(
@@ -297,30 +381,30 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
                 .categorical()
                 .number_of_unique_values() == 3) {
           // Binary classification.
-          auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+          auto engine = absl::make_unique<Engine<
               serving::decision_forest::
-                  GradientBoostedTreesBinaryClassificationQuickScorerExtended,
-              serving::decision_forest::Predict>>();
+                  GradientBoostedTreesBinaryClassificationQuickScorerExtended>>();
           RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
           return engine;
         } else {
-          return absl::InvalidArgumentError("Non supported GBDT model");
+          // Multi-class classification.
+          auto engine = absl::make_unique<Engine<
+              serving::decision_forest::
+                  GradientBoostedTreesMulticlassClassificationQuickScorerExtended>>();
+          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
+          return engine;
         }
 
       case proto::REGRESSION: {
-        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
-            serving::decision_forest::
-                GradientBoostedTreesRegressionQuickScorerExtended,
-            serving::decision_forest::Predict>>();
+        auto engine = absl::make_unique<Engine<serving::decision_forest::
+                GradientBoostedTreesRegressionQuickScorerExtended>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
         return engine;
       }
 
       case proto::RANKING: {
-        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
-            serving::decision_forest::
-                GradientBoostedTreesRankingQuickScorerExtended,
-            serving::decision_forest::Predict>>();
+        auto engine = absl::make_unique<Engine<serving::decision_forest::
+                GradientBoostedTreesRankingQuickScorerExtended>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
         return engine;
       }
@@ -329,6 +413,43 @@ class GradientBoostedTreesQuickScorerFastEngineFactory
         return absl::InvalidArgumentError("Non supported GBDT model");
     }
   }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngineFromFile(
+      const absl::string_view path) const override {
+    using serving::decision_forest::EngineFileModelType;
+    ASSIGN_OR_RETURN(const auto model_type,
+                     serving::decision_forest::ReadEngineFileModelType(path));
+    switch (model_type) {
+      case EngineFileModelType::
+          kGradientBoostedTreesBinaryClassificationQuickScorer:
+        return LoadEngineFromFile<Engine<
+            serving::decision_forest::
+                GradientBoostedTreesBinaryClassificationQuickScorerExtended>>(
+            path);
+      case EngineFileModelType::
+          kGradientBoostedTreesMulticlassClassificationQuickScorer:
+        return LoadEngineFromFile<Engine<
+            serving::decision_forest::
+                GradientBoostedTreesMulticlassClassificationQuickScorerExtended>>(
+            path);
+      case EngineFileModelType::kGradientBoostedTreesRegressionQuickScorer:
+        return LoadEngineFromFile<Engine<serving::decision_forest::
+                GradientBoostedTreesRegressionQuickScorerExtended>>(path);
+      case EngineFileModelType::kGradientBoostedTreesRankingQuickScorer:
+        return LoadEngineFromFile<Engine<serving::decision_forest::
+                GradientBoostedTreesRankingQuickScorerExtended>>(path);
+      default:
+        return absl::InvalidArgumentError(
+            "Non supported model type in the engine file.");
+    }
+  }
+
+ private:
+  // Engine for the compiled model "Model". Can be saved to an engine file.
+  template <typename Model>
+  using Engine = serving::ExampleSetModelWrapper<
+      Model, serving::decision_forest::Predict, nullptr,
+      serving::decision_forest::SaveEngineFile<Model>>;
 };
 
 REGISTER_FastEngineFactory(
@@ -400,7 +521,8 @@ class GradientBoostedTreesOptPredFastEngineFactory : public FastEngineFactory {
           auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
               serving::decision_forest::
                   GradientBoostedTreesBinaryClassificationNumericalAndCategorical,
-              serving::decision_forest::PredictWithExampleSet>>();
+              serving::decision_forest::PredictWithExampleSetBatched,
+              serving::decision_forest::PredictWithExampleSetTreeParallel>>();
           RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
           return engine;
         } else {
@@ -411,7 +533,8 @@ class GradientBoostedTreesOptPredFastEngineFactory : public FastEngineFactory {
         auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
             serving::decision_forest::
                 GradientBoostedTreesRegressionNumericalAndCategorical,
-            serving::decision_forest::PredictWithExampleSet>>();
+            serving::decision_forest::PredictWithExampleSetBatched,
+            serving::decision_forest::PredictWithExampleSetTreeParallel>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
         return engine;
       }
@@ -420,7 +543,8 @@ class GradientBoostedTreesOptPredFastEngineFactory : public FastEngineFactory {
         auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
             serving::decision_forest::
                 GradientBoostedTreesRankingNumericalAndCategorical,
-            serving::decision_forest::PredictWithExampleSet>>();
+            serving::decision_forest::PredictWithExampleSetBatched,
+            serving::decision_forest::PredictWithExampleSetTreeParallel>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
         return engine;
       }
@@ -434,6 +558,141 @@ class GradientBoostedTreesOptPredFastEngineFactory : public FastEngineFactory {
 REGISTER_FastEngineFactory(GradientBoostedTreesOptPredFastEngineFactory,
                            serving::gradient_boosted_trees::kOptPred);
 
+class GradientBoostedTreesQuantizedFastEngineFactory
+    : public FastEngineFactory {
+ public:
+  using SourceModel = gradient_boosted_trees::GradientBoostedTreesModel;
+
+  std::string name() const override {
+    return serving::gradient_boosted_trees::kQuantized;
+  }
+
+  bool IsCompatible(const AbstractModel* const model) const override {
+    auto* gbt_model = dynamic_cast<const SourceModel*>(model);
+    if (gbt_model == nullptr) {
+      return false;
+    }
+
+    if (!gbt_model->IsMissingValueConditionResultFollowGlobalImputation()) {
+      return false;
+    }
+
+    if (MaxNumberOfNodesPerTree(gbt_model->decision_trees()) >=
+        std::numeric_limits<uint16_t>::max()) {
+      return false;
+    }
+
+    if (!AllConditionsCompatibleQuantizedModels(gbt_model->decision_trees())) {
+      return false;
+    }
+
+    switch (gbt_model->task()) {
+      case proto::CLASSIFICATION:
+      case proto::REGRESSION:
+      case proto::RANKING:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  std::vector<std::string> IsBetterThan() const override {
+    return {serving::gradient_boosted_trees::kGeneric,
+            serving::gradient_boosted_trees::kOptPred};
+  }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngine(
+      const AbstractModel* const model) const override {
+    auto* gbt_model = dynamic_cast<const SourceModel*>(model);
+    if (!gbt_model) {
+      return absl::InvalidArgumentError("The model is not a GBDT.");
+    }
+
+    switch (gbt_model->task()) {
+      case proto::CLASSIFICATION:
+        if (gbt_model->label_col_spec()
+                .categorical()
+                .number_of_unique_values() == 3) {
+          // Binary classification.
+          auto engine = absl::make_unique<Engine<
+              serving::decision_forest::
+                  GradientBoostedTreesBinaryClassificationQuantized>>();
+          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
+          return engine;
+        } else {
+          // Multi-class classification.
+          auto engine = absl::make_unique<MulticlassEngine>();
+          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
+          return engine;
+        }
+
+      case proto::REGRESSION: {
+        auto engine = absl::make_unique<Engine<serving::decision_forest::
+                GradientBoostedTreesRegressionQuantized>>();
+        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
+        return engine;
+      }
+
+      case proto::RANKING: {
+        auto engine = absl::make_unique<Engine<
+            serving::decision_forest::GradientBoostedTreesRankingQuantized>>();
+        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*gbt_model));
+        return engine;
+      }
+
+      default:
+        return absl::InvalidArgumentError("Non supported GBDT model");
+    }
+  }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngineFromFile(
+      const absl::string_view path) const override {
+    using serving::decision_forest::EngineFileModelType;
+    ASSIGN_OR_RETURN(const auto model_type,
+                     serving::decision_forest::ReadEngineFileModelType(path));
+    switch (model_type) {
+      case EngineFileModelType::
+          kGradientBoostedTreesBinaryClassificationQuantized:
+        return LoadEngineFromFile<Engine<serving::decision_forest::
+                GradientBoostedTreesBinaryClassificationQuantized>>(path);
+      case EngineFileModelType::
+          kGradientBoostedTreesMulticlassClassificationQuantized:
+        return LoadEngineFromFile<MulticlassEngine>(path);
+      case EngineFileModelType::kGradientBoostedTreesRegressionQuantized:
+        return LoadEngineFromFile<Engine<
+            serving::decision_forest::GradientBoostedTreesRegressionQuantized>>(
+            path);
+      case EngineFileModelType::kGradientBoostedTreesRankingQuantized:
+        return LoadEngineFromFile<Engine<
+            serving::decision_forest::GradientBoostedTreesRankingQuantized>>(
+            path);
+      default:
+        return absl::InvalidArgumentError(
+            "Non supported model type in the engine file.");
+    }
+  }
+
+ private:
+  // Engine for the compiled model "Model". Can be saved to an engine file.
+  template <typename Model>
+  using Engine = serving::ExampleSetModelWrapper<
+      Model, serving::decision_forest::Predict,
+      serving::decision_forest::PredictTreeParallel,
+      serving::decision_forest::SaveEngineFile<Model>>;
+
+  // The multi-class engine does not support tree-parallel predictions.
+  using MulticlassEngine = serving::ExampleSetModelWrapper<
+      serving::decision_forest::
+          GradientBoostedTreesMulticlassClassificationQuantized,
+      serving::decision_forest::Predict, nullptr,
+      serving::decision_forest::SaveEngineFile<
+          serving::decision_forest::
+              GradientBoostedTreesMulticlassClassificationQuantized>>;
+};
+
+REGISTER_FastEngineFactory(GradientBoostedTreesQuantizedFastEngineFactory,
+                           serving::gradient_boosted_trees::kQuantized);
+
 class RandomForestGenericFastEngineFactory : public model::FastEngineFactory {
  public:
   using SourceModel = random_forest::RandomForestModel;
@@ -585,7 +844,8 @@ class RandomForestOptPredFastEngineFactory : public model::FastEngineFactory {
         auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
             serving::decision_forest::
                 RandomForestBinaryClassificationNumericalAndCategoricalFeatures,
-            serving::decision_forest::PredictWithExampleSet>>();
+            serving::decision_forest::PredictWithExampleSetBatched,
+            serving::decision_forest::PredictWithExampleSetTreeParallel>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
         return engine;
       }
@@ -594,7 +854,8 @@ class RandomForestOptPredFastEngineFactory : public model::FastEngineFactory {
         auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
             serving::decision_forest::
                 RandomForestRegressionNumericalAndCategorical,
-            serving::decision_forest::PredictWithExampleSet>>();
+            serving::decision_forest::PredictWithExampleSetBatched,
+            serving::decision_forest::PredictWithExampleSetTreeParallel>>();
         RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
         return engine;
       }
@@ -608,5 +869,176 @@ class RandomForestOptPredFastEngineFactory : public model::FastEngineFactory {
 REGISTER_FastEngineFactory(RandomForestOptPredFastEngineFactory,
                            serving::random_forest::kOptPred);
 
+class RandomForestQuickScorerFastEngineFactory
+    : public model::FastEngineFactory {
+ public:
+  using SourceModel = random_forest::RandomForestModel;
+
+  // Note: The SIMD instruction set is not part of the name (see
+  // "GradientBoostedTreesQuickScorerFastEngineFactory").
+  std::string name() const override {
+    return serving::random_forest::kQuickScorerExtended;
+  }
+
+  bool IsCompatible(const AbstractModel* const model) const override {
+    auto* rf_model = dynamic_cast<const SourceModel*>(model);
+    if (rf_model == nullptr) {
+      return false;
+    }
+
+    if (!rf_model->IsMissingValueConditionResultFollowGlobalImputation()) {
+      return false;
+    }
+
+    if (!LeafMasksCompatibleQuickScorerExtendedModels(
+            rf_model->decision_trees())) {
+      return false;
+    }
+
+    if (!AllConditionsCompatibleQuickScorerExtendedModels(
+            rf_model->decision_trees())) {
+      return false;
+    }
+
+    switch (rf_model->task()) {
+      case proto::CLASSIFICATION:
+      case proto::REGRESSION:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  std::vector<std::string> IsBetterThan() const override {
+    return {serving::random_forest::kGeneric,
+            serving::random_forest::kOptPred,
+            serving::random_forest::kQuantized};
+  }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngine(
+      const AbstractModel* const model) const override {
+    auto* rf_model = dynamic_cast<const SourceModel*>(model);
+    if (!rf_model) {
+      return absl::InvalidArgumentError("The model is not a RF.");
+    }
+
+    switch (rf_model->task()) {
+      case proto::CLASSIFICATION:
+        if (rf_model->label_col_spec()
+                .categorical()
+                .number_of_unique_values() == 3) {
+          // Binary classification.
+          auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+              serving::decision_forest::
+                  RandomForestBinaryClassificationQuickScorerExtended,
+              serving::decision_forest::Predict>>();
+          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
+          return engine;
+        } else {
+          // Multi-class classification.
+          auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+              serving::decision_forest::
+                  RandomForestMulticlassClassificationQuickScorerExtended,
+              serving::decision_forest::Predict>>();
+          RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
+          return engine;
+        }
+
+      case proto::REGRESSION: {
+        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+            serving::decision_forest::RandomForestRegressionQuickScorerExtended,
+            serving::decision_forest::Predict>>();
+        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
+        return engine;
+      }
+
+      default:
+        return absl::InvalidArgumentError("Non supported RF model");
+    }
+  }
+};
+
+REGISTER_FastEngineFactory(RandomForestQuickScorerFastEngineFactory,
+                           serving::random_forest::kQuickScorerExtended);
+
+class RandomForestQuantizedFastEngineFactory : public model::FastEngineFactory {
+ public:
+  using SourceModel = random_forest::RandomForestModel;
+
+  std::string name() const override {
+    return serving::random_forest::kQuantized;
+  }
+
+  bool IsCompatible(const AbstractModel* const model) const override {
+    auto* rf_model = dynamic_cast<const SourceModel*>(model);
+    if (rf_model == nullptr) {
+      return false;
+    }
+
+    if (!rf_model->IsMissingValueConditionResultFollowGlobalImputation()) {
+      return false;
+    }
+
+    if (MaxNumberOfNodesPerTree(rf_model->decision_trees()) >=
+        std::numeric_limits<uint16_t>::max()) {
+      return false;
+    }
+
+    if (!AllConditionsCompatibleQuantizedModels(rf_model->decision_trees())) {
+      return false;
+    }
+
+    switch (rf_model->task()) {
+      case proto::CLASSIFICATION:
+        return rf_model->label_col_spec()
+                   .categorical()
+                   .number_of_unique_values() == 3;
+      case proto::REGRESSION:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  std::vector<std::string> IsBetterThan() const override {
+    return {serving::random_forest::kGeneric,
+            serving::random_forest::kOptPred};
+  }
+
+  utils::StatusOr<std::unique_ptr<serving::FastEngine>> CreateEngine(
+      const AbstractModel* const model) const override {
+    auto* rf_model = dynamic_cast<const SourceModel*>(model);
+    if (!rf_model) {
+      return absl::InvalidArgumentError("The model is not a RF.");
+    }
+
+    switch (rf_model->task()) {
+      case proto::CLASSIFICATION: {
+        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+            serving::decision_forest::RandomForestBinaryClassificationQuantized,
+            serving::decision_forest::Predict,
+            serving::decision_forest::PredictTreeParallel>>();
+        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
+        return engine;
+      }
+
+      case proto::REGRESSION: {
+        auto engine = absl::make_unique<serving::ExampleSetModelWrapper<
+            serving::decision_forest::RandomForestRegressionQuantized,
+            serving::decision_forest::Predict,
+            serving::decision_forest::PredictTreeParallel>>();
+        RETURN_IF_ERROR(engine->LoadModel<SourceModel>(*rf_model));
+        return engine;
+      }
+
+      default:
+        return absl::InvalidArgumentError("Non supported RF model");
+    }
+  }
+};
+
+REGISTER_FastEngineFactory(RandomForestQuantizedFastEngineFactory,
+                           serving::random_forest::kQuantized);
+
 }  // namespace model
 }  // namespace yggdrasil_decision_forests
@@ -29,11 +29,14 @@ constexpr char kGeneric[] = "GradientBoostedTreesGeneric";
 constexpr char kQuickScorerExtended[] =
     "GradientBoostedTreesQuickScorerExtended";
 constexpr char kOptPred[] = "GradientBoostedTreesOptPred";
+constexpr char kQuantized[] = "GradientBoostedTreesQuantized";
 }  // namespace gradient_boosted_trees
 
 namespace random_forest {
 constexpr char kGeneric[] = "RandomForestGeneric";
+constexpr char kQuickScorerExtended[] = "RandomForestQuickScorerExtended";
 constexpr char kOptPred[] = "RandomForestOptPred";
+constexpr char kQuantized[] = "RandomForestQuantized";
 }  // namespace random_forest
 
 }  // namespace serving
@@ -18,6 +18,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 #include "yggdrasil_decision_forests/model/gradient_boosted_trees/gradient_boosted_trees.h"
 #include "yggdrasil_decision_forests/model/random_forest/random_forest.h"
 
@@ -87,6 +88,19 @@ std::vector<NumericalOrCategoricalValue> FloatToValue(
   return result;
 }
 
+bool IsPositiveChildMoreFrequent(
+    const model::decision_tree::NodeWithChildren& node) {
+  const auto& condition = node.node().condition();
+  if (!condition.has_num_training_examples_without_weight() ||
+      !condition.has_num_pos_training_examples_without_weight()) {
+    return false;
+  }
+  const int64_t num_pos = condition.num_pos_training_examples_without_weight();
+  const int64_t num_neg =
+      condition.num_training_examples_without_weight() - num_pos;
+  return num_pos > num_neg;
+}
+
 }  // namespace decision_forest
 }  // namespace serving
 }  // namespace yggdrasil_decision_forests
@@ -21,6 +21,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/decision_tree/decision_tree.h"
 
 namespace yggdrasil_decision_forests {
 namespace serving {
@@ -38,6 +39,12 @@ absl::Status GetInputFeatures(
     std::vector<int>* input_features_idxs,
     std::vector<int>* feature_idx_to_local_feature_idx);
 
+// Tests if more training examples reached the positive child than the negative
+// child of a non-leaf node. Returns false if the training statistics are not
+// available.
+bool IsPositiveChildMoreFrequent(
+    const model::decision_tree::NodeWithChildren& node);
+
 // Converts a feature name into the model's internal feature index. Returns "-1"
 // if the model does not use this feature.
 template <typename SpecializedModel>
@@ -15,8 +15,14 @@
 
 #include "yggdrasil_decision_forests/serving/example_set.h"
 
+#include <algorithm>
+
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
 #include "yggdrasil_decision_forests/utils/status_macros.h"
 
 namespace yggdrasil_decision_forests {
@@ -112,6 +118,60 @@ FeaturesDefinitionNumericalOrCategoricalFlat::unstacked_features() const {
   return unstacked_features_;
 }
 
+utils::StatusOr<std::vector<int>>
+FeaturesDefinitionNumericalOrCategoricalFlat::GetFixedLengthFeatureRemapping(
+    const std::vector<std::string>& column_names) const {
+  std::vector<int> remapping(column_names.size(), -1);
+  std::vector<bool> covered_features(fixed_length_features_.size(), false);
+  for (int column_idx = 0; column_idx < column_names.size(); column_idx++) {
+    for (const auto& feature : fixed_length_features_) {
+      if (feature.name == column_names[column_idx]) {
+        if (covered_features[feature.internal_idx]) {
+          return absl::InvalidArgumentError(absl::Substitute(
+              "The column \"$0\" is defined multiple times.", feature.name));
+        }
+        covered_features[feature.internal_idx] = true;
+        remapping[column_idx] = feature.internal_idx;
+        break;
+      }
+    }
+  }
+  for (const auto& feature : fixed_length_features_) {
+    if (!covered_features[feature.internal_idx]) {
+      return absl::InvalidArgumentError(absl::Substitute(
+          "The input feature \"$0\" is not defined in the columns.",
+          feature.name));
+    }
+  }
+  return remapping;
+}
+
+CategoricalStringDictionary::CategoricalStringDictionary(
+    const dataset::proto::Column& col_spec)
+    : column_name_(col_spec.name()),
+      is_already_integerized_(col_spec.categorical().is_already_integerized()),
+      number_of_unique_values_(
+          col_spec.categorical().number_of_unique_values()) {
+  if (is_already_integerized_) {
+    return;
+  }
+  items_.reserve(col_spec.categorical().items_size());
+  for (const auto& item : col_spec.categorical().items()) {
+    items_[item.first] = item.second.index();
+  }
+}
+
+int32_t CategoricalStringDictionary::IntegerizedValueToIndex(
+    const absl::string_view value) const {
+  int32_t int_value;
+  CHECK(absl::SimpleAtoi(value, &int_value))
+      << "Cannot parse the string \"" << value
+      << "\" as an integer for columns \"" << column_name_ << "\".";
+  CHECK_GE(int_value, 0);
+  CHECK_LT(int_value, number_of_unique_values_);
+  return int_value;
+}
+
 bool FeaturesDefinitionNumericalOrCategoricalFlat::HasInputFeature(
     const absl::string_view name) const {
   return feature_def_cache_.find(name) != feature_def_cache_.end() ||
@@ -135,6 +195,20 @@ absl::Status FeaturesDefinitionNumericalOrCategoricalFlat::Initialize(
     feature_def_cache_[feature_def.name] = &feature_def;
   }
 
+  // Index the dictionaries of the categorical features.
+  fixed_length_dictionaries_.resize(fixed_length_features().size());
+  for (const auto& feature_def : fixed_length_features()) {
+    if (feature_def.type == ColumnType::CATEGORICAL) {
+      fixed_length_dictionaries_[feature_def.internal_idx] =
+          CategoricalStringDictionary(data_spec_.columns(feature_def.spec_idx));
+    }
+  }
+  categorical_set_dictionaries_.reserve(categorical_set_features().size());
+  for (const auto& feature_def : categorical_set_features()) {
+    categorical_set_dictionaries_.emplace_back(
+        data_spec_.columns(feature_def.spec_idx));
+  }
+
   return absl::OkStatus();
 }
 
@@ -187,60 +261,103 @@ absl::Status
 FeaturesDefinitionNumericalOrCategoricalFlat::InitializeUnstackedFeatures(
     const std::vector<int>& input_features, const DataSpecification& dataspec) {
   // List the sub-set of input features which are unstacked.
-  std::vector<int> unstacked_input_features;
+  absl::flat_hash_set<int> unstacked_input_features;
   for (const int spec_feature_idx : input_features) {
     const auto& col_spec = data_spec_.columns(spec_feature_idx);
     if (col_spec.is_unstacked()) {
-      unstacked_input_features.push_back(spec_feature_idx);
+      unstacked_input_features.insert(spec_feature_idx);
     }
   }
 
   // Index the unstacked features.
   for (const auto& unstacked : data_spec_.unstackeds()) {
-    // Check if the unstacked is used by the model.
-    const bool used =
-        std::find_if(unstacked_input_features.begin(),
-                     unstacked_input_features.end(),
-                     [&](const int feature_idx) {
-                       return feature_idx >= unstacked.begin_column_idx() &&
-                              feature_idx < unstacked.begin_column_idx() +
-                                                unstacked.size();
-                     }) != unstacked_input_features.end();
-    if (!used) {
-      continue;
-    }
-
-    // Index the unstacking information.
+    // Internal index of the used unstacked units.
     const int begin_internal_idx = fixed_length_features_.size();
-    const int unstacked_index = unstacked_features_.size();
-    indexed_unstacked_features_[unstacked.original_name()] = unstacked_index;
-    unstacked_features_.push_back(
-        {/*.begin_internal_idx =*/begin_internal_idx,
-         /*.begin_spec_idx =*/unstacked.begin_column_idx(),
-         /*.size =*/unstacked.size(),
-         /*.unstacked_index =*/unstacked_index});
-
-    // Index the unstacked units.
+    std::vector<int> internal_idxs(unstacked.size(), -1);
     for (int dim_idx = 0; dim_idx < unstacked.size(); dim_idx++) {
       const int spec_feature_idx = unstacked.begin_column_idx() + dim_idx;
+      if (!unstacked_input_features.contains(spec_feature_idx)) {
+        // This unit is not tested by the model.
+        continue;
+      }
       const auto& col_spec = data_spec_.columns(spec_feature_idx);
       if (!col_spec.is_unstacked()) {
         return absl::InternalError("Unexpected non-unstacked feature.");
       }
+      internal_idxs[dim_idx] = fixed_length_features_.size();
       fixed_length_features_.push_back(
           {/*.name =*/col_spec.name(),
            /*.type =*/col_spec.type(),
            /*.spec_idx =*/spec_feature_idx,
-           /*.internal_idx =*/begin_internal_idx + dim_idx});
+           /*.internal_idx =*/internal_idxs[dim_idx]});
       ASSIGN_OR_RETURN(auto default_value,
                        GetDefaultValue<NumericalOrCategoricalValue>(col_spec));
       fixed_length_feature_missing_values_.push_back(default_value);
     }
+
+    if (fixed_length_features_.size() == begin_internal_idx) {
+      // The unstacked is not used by the model.
+      continue;
+    }
+
+    // Index the unstacking information.
+    const int unstacked_index = unstacked_features_.size();
+    indexed_unstacked_features_[unstacked.original_name()] = unstacked_index;
+    unstacked_features_.push_back(
+        {/*.begin_internal_idx =*/begin_internal_idx,
+         /*.begin_spec_idx =*/unstacked.begin_column_idx(),
+         /*.size =*/unstacked.size(),
+         /*.unstacked_index =*/unstacked_index,
+         /*.internal_idxs =*/std::move(internal_idxs)});
+  }
+
+  return absl::OkStatus();
+}
+
+namespace internal {
+
+absl::Status ParallelForExampleRanges(
+    const int num_examples, utils::concurrency::ThreadPool* thread_pool,
+    const std::function<absl::Status(int begin, int end)>& callback) {
+  int num_ranges = 1;
+  if (thread_pool) {
+    num_ranges = std::min(thread_pool->num_threads() + 1,
+                          num_examples / kMinNumExamplesPerThread);
+  }
+  if (num_ranges <= 1) {
+    return callback(0, num_examples);
   }
+  const int num_examples_per_range =
+      (num_examples + num_ranges - 1) / num_ranges;
+  num_ranges =
+      (num_examples + num_examples_per_range - 1) / num_examples_per_range;
+
+  std::vector<absl::Status> statuses(num_ranges);
+  const auto run_range = [&](const int range_idx) {
+    const int begin = range_idx * num_examples_per_range;
+    const int end = std::min(begin + num_examples_per_range, num_examples);
+    statuses[range_idx] = callback(begin, end);
+  };
 
+  // The first range is processed by the calling thread.
+  absl::BlockingCounter pending_ranges(num_ranges - 1);
+  for (int range_idx = 1; range_idx < num_ranges; range_idx++) {
+    thread_pool->Schedule([&, range_idx]() {
+      run_range(range_idx);
+      pending_ranges.DecrementCount();
+    });
+  }
+  run_range(0);
+  pending_ranges.Wait();
+
+  for (const auto& status : statuses) {
+    RETURN_IF_ERROR(status);
+  }
   return absl::OkStatus();
 }
 
+}  // namespace internal
+
 std::ostream& operator<<(std::ostream& os, const FeatureDef& feature) {
   os << "\"" << feature.name << "\" type:" << ColumnType_Name(feature.type)
      << " spec_idx:" << feature.spec_idx
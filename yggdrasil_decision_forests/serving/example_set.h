@@ -59,13 +59,25 @@
 #ifndef YGGDRASIL_DECISION_FORESTS_SERVING_EXAMPLE_SET_H_
 #define YGGDRASIL_DECISION_FORESTS_SERVING_EXAMPLE_SET_H_
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "absl/strings/substitute.h"
+#include "absl/types/span.h"
+#include "yggdrasil_decision_forests/dataset/data_spec.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
 #include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/status_macros.h"
 
 namespace yggdrasil_decision_forests {
@@ -153,8 +165,14 @@ struct FeatureDef {
 
 // Definition about the unstacked features (accessible as multi dimensional
 // features).
+//
+// Only the dimensions tested by the model are allocated in the example set. For
+// instance, if the model only uses the dimensions 2 and 5 of a 3000 dimensions
+// embedding, only two fixed-length features are created, and the other values
+// are ignored when set.
 struct UnstackedFeature {
-  // Internal index of the first unstacked feature.
+  // Internal index of the first used unstacked feature. The used unstacked
+  // features have consecutive internal indices.
   int begin_internal_idx;
   // Dataspec column index of the first unstacked feature.
   int begin_spec_idx;
@@ -163,6 +181,9 @@ struct UnstackedFeature {
   // Index of this struct in "unstacked_features_" i.e. the dense index of
   // unstacked feature used by the model.
   int unstacked_index;
+  // Internal index of each of the "size" unstacked features. -1 for the
+  // unstacked features not used by the model.
+  std::vector<int> internal_idxs;
 };
 
 std::ostream& operator<<(std::ostream& os, const FeatureDef& feature);
@@ -175,6 +196,38 @@ const FeatureDef* FindFeatureDefFromInternalIndex(
 
 std::vector<std::string> FeatureNames(const std::vector<FeatureDef>& defs);
 
+// Dictionary of the string values of a categorical or categorical-set feature.
+//
+// "ValueToIndex" is equivalent to "dataset::CategoricalStringToValue", but the
+// items are indexed in a flat hash map once (instead of looked up in the
+// dataspec's proto map), and the lookups take "absl::string_view" keys (i.e.
+// no temporary string allocation).
+class CategoricalStringDictionary {
+ public:
+  CategoricalStringDictionary() = default;
+  explicit CategoricalStringDictionary(const dataset::proto::Column& col_spec);
+
+  // Integer representation of a string value. Out-of-dictionary values are
+  // mapped to "dataset::kOutOfDictionaryItemIndex". Integerized features
+  // expect the string representation of the integer value.
+  int32_t ValueToIndex(absl::string_view value) const {
+    if (is_already_integerized_) {
+      return IntegerizedValueToIndex(value);
+    }
+    const auto it = items_.find(value);
+    return it == items_.end() ? dataset::kOutOfDictionaryItemIndex
+                              : it->second;
+  }
+
+ private:
+  int32_t IntegerizedValueToIndex(absl::string_view value) const;
+
+  std::string column_name_;
+  bool is_already_integerized_ = false;
+  int32_t number_of_unique_values_ = 0;
+  absl::flat_hash_map<std::string, int32_t> items_;
+};
+
 // Definition of the input features of a model. Used by an ExampleSet.
 class FeaturesDefinitionNumericalOrCategoricalFlat {
  public:
@@ -356,6 +409,30 @@ class FeaturesDefinitionNumericalOrCategoricalFlat {
     return categorical_set_features_;
   }
 
+  // Index, in "fixed_length_features()", of each of the "column_names"
+  // features. -1 for the columns not used by the model as fixed-length
+  // features. Returns an error if a fixed-length feature of the model is not in
+  // "column_names".
+  //
+  // Used to fill an external buffer of feature values wrapped by an example
+  // set view (see "ExampleSetNumericalOrCategoricalFlat::Wrap") e.g. the value
+  // of column "i" of example "j" is stored in the example-major buffer at
+  // "j * fixed_length_features().size() + remapping[i]".
+  utils::StatusOr<std::vector<int>> GetFixedLengthFeatureRemapping(
+      const std::vector<std::string>& column_names) const;
+
+  // Dictionary of a categorical feature.
+  const CategoricalStringDictionary& categorical_dictionary(
+      const CategoricalFeatureId feature_id) const {
+    return fixed_length_dictionaries_[feature_id.index];
+  }
+
+  // Dictionary of a categorical-set feature.
+  const CategoricalStringDictionary& categorical_set_dictionary(
+      const CategoricalSetFeatureId feature_id) const {
+    return categorical_set_dictionaries_[feature_id.index];
+  }
+
   // Specification of the features.
   const DataSpecification& data_spec() const { return data_spec_; }
 
@@ -392,6 +469,13 @@ class FeaturesDefinitionNumericalOrCategoricalFlat {
   // model.
   std::vector<FeatureDef> categorical_set_features_;
 
+  // Dictionaries of the categorical features, indexed by internal index. Empty
+  // for non-categorical fixed-length features.
+  std::vector<CategoricalStringDictionary> fixed_length_dictionaries_;
+
+  // Dictionaries of the categorical-set features, indexed by internal index.
+  std::vector<CategoricalStringDictionary> categorical_set_dictionaries_;
+
   // Data specification.
   DataSpecification data_spec_;
 
@@ -408,6 +492,22 @@ class FeaturesDefinitionNumericalOrCategoricalFlat {
 
 using FeaturesDefinition = FeaturesDefinitionNumericalOrCategoricalFlat;
 
+namespace internal {
+
+// Minimum number of examples parsed by each thread in the multi-threaded
+// "From*Examples" methods.
+constexpr int kMinNumExamplesPerThread = 64;
+
+// Splits "[0, num_examples)" into consecutive ranges, and calls
+// "callback(begin, end)" on each of them in parallel with the threads of
+// "thread_pool" and the calling thread. If "thread_pool" is null, "callback" is
+// called once on the whole range. Returns the first error.
+absl::Status ParallelForExampleRanges(
+    int num_examples, utils::concurrency::ThreadPool* thread_pool,
+    const std::function<absl::Status(int begin, int end)>& callback);
+
+}  // namespace internal
+
 class AbstractExampleSet {
   // Set of examples for fast model inference.
   //
@@ -437,6 +537,11 @@ class AbstractExampleSet {
       int example_idx, FeaturesDefinition::CategoricalFeatureId feature_id,
       const std::string& value, const FeaturesDefinition& features) = 0;
 
+  virtual void SetCategoricalColumn(
+      FeaturesDefinition::CategoricalFeatureId feature_id,
+      absl::Span<const absl::string_view> values,
+      const FeaturesDefinition& features) = 0;
+
   virtual void SetCategoricalSet(
       int example_idx, FeaturesDefinition::CategoricalSetFeatureId feature_id,
       std::vector<int>::const_iterator value_begin,
@@ -499,6 +604,16 @@ class AbstractExampleSet {
       const tensorflow::Example& src, const int example_idx,
       const FeaturesDefinition& features) = 0;
 
+  virtual absl::Status FromProtoExamples(
+      absl::Span<const dataset::proto::Example> src, int begin_example_idx,
+      const FeaturesDefinition& features,
+      utils::concurrency::ThreadPool* thread_pool) = 0;
+
+  virtual absl::Status FromTensorflowExamples(
+      absl::Span<const tensorflow::Example* const> src, int begin_example_idx,
+      const FeaturesDefinition& features,
+      utils::concurrency::ThreadPool* thread_pool) = 0;
+
   virtual void Clear() = 0;
 };
 
@@ -589,6 +704,56 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
             num_examples * model.features().categorical_set_features().size()) {
   }
 
+  // Creates an example set that reads the fixed-length feature values (i.e.
+  // numerical, boolean and categorical features) from the externally owned
+  // buffer "values" without copying it. "values" should remain valid and
+  // unchanged while the example set is used, and cannot be modified through
+  // the example set (i.e. calling the "Set*" and "FillMissing" methods on
+  // fixed-length features fails with a CHECK). Categorical-set features are
+  // stored in the example set as usual.
+  //
+  // "values" contains the "num_examples * features.fixed_length_features()
+  // .size()" values of the examples ordered according to "format" i.e.
+  // "values[example_idx * num_features + internal_idx]" for the example-major
+  // format, and "values[internal_idx * num_examples + example_idx]" for the
+  // feature-major format, where "internal_idx" is the index of the feature in
+  // "features.fixed_length_features()" (see
+  // "FeaturesDefinition::GetFixedLengthFeatureRemapping"). Numerical and
+  // boolean values are stored as "numerical_value", and categorical values as
+  // "categorical_value". Missing values should be replaced by the
+  // corresponding "features.fixed_length_na_replacement_values()".
+  static utils::StatusOr<std::unique_ptr<ExampleSetNumericalOrCategoricalFlat>>
+  Wrap(const absl::Span<const NumericalOrCategoricalValue> values,
+       const int num_examples, const FeaturesDefinition& features) {
+    const size_t expected_size =
+        static_cast<size_t>(num_examples) *
+        features.fixed_length_features().size();
+    if (values.size() != expected_size) {
+      return absl::InvalidArgumentError(absl::Substitute(
+          "The buffer contains $0 values while $1 values ($2 examples x $3 "
+          "fixed-length features) are expected.",
+          values.size(), expected_size, num_examples,
+          features.fixed_length_features().size()));
+    }
+    if (reinterpret_cast<uintptr_t>(values.data()) %
+            alignof(NumericalOrCategoricalValue) !=
+        0) {
+      return absl::InvalidArgumentError("The buffer is not aligned.");
+    }
+    return absl::WrapUnique(new ExampleSetNumericalOrCategoricalFlat(
+        values, num_examples, features));
+  }
+
+  static utils::StatusOr<std::unique_ptr<ExampleSetNumericalOrCategoricalFlat>>
+  Wrap(const absl::Span<const NumericalOrCategoricalValue> values,
+       const int num_examples, const Model& model) {
+    return Wrap(values, num_examples, model.features());
+  }
+
+  // Tests if the fixed-length feature values are read from an externally owned
+  // buffer (see "Wrap").
+  bool IsView() const { return is_view_; }
+
   // Empty the content of the example set. The example set still contains
   // "num_examples" examples but their values are undefined. This function
   // should be called before an ExampleSet object is re-used.
@@ -601,8 +766,7 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   void SetNumerical(const int example_idx, const NumericalFeatureId feature_id,
                     const float value,
                     const FeaturesDefinition& features) override {
-    fixed_length_features_[FixedLengthIndex(example_idx, feature_id.index,
-                                            features)]
+    MutableFixedLengthValue(example_idx, feature_id.index, features)
         .numerical_value = value;
   }
   void SetNumerical(const int example_idx, const NumericalFeatureId feature_id,
@@ -626,9 +790,8 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   // Get the value of a numerical feature.
   float GetNumerical(const int example_idx, const NumericalFeatureId feature_id,
                      const Model& model) const {
-    return fixed_length_features_[FixedLengthIndex(example_idx,
-                                                   feature_id.index,
-                                                   model.features())]
+    return FixedLengthValues()[FixedLengthIndex(example_idx, feature_id.index,
+                                                model.features())]
         .numerical_value;
   }
 
@@ -655,8 +818,7 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
     DCHECK_LT(value, spec.number_of_unique_values());
 #endif
 
-    fixed_length_features_[FixedLengthIndex(example_idx, feature_id.index,
-                                            features)]
+    MutableFixedLengthValue(example_idx, feature_id.index, features)
         .categorical_value = value;
   }
   void SetCategorical(const int example_idx,
@@ -669,9 +831,8 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   int GetCategoricalInt(const int example_idx,
                         const CategoricalFeatureId feature_id,
                         const Model& model) const {
-    return fixed_length_features_[FixedLengthIndex(example_idx,
-                                                   feature_id.index,
-                                                   model.features())]
+    return FixedLengthValues()[FixedLengthIndex(example_idx, feature_id.index,
+                                                model.features())]
         .categorical_value;
   }
 
@@ -691,13 +852,9 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
         << "\" should be passed as an integer";
 #endif
 
-    SetCategorical(
-        example_idx, feature_id,
-        dataset::CategoricalStringToValue(
-            value,
-            features.data_spec().columns(
-                features.fixed_length_features()[feature_id.index].spec_idx)),
-        features);
+    MutableFixedLengthValue(example_idx, feature_id.index, features)
+        .categorical_value =
+        features.categorical_dictionary(feature_id).ValueToIndex(value);
   }
 
   void SetCategorical(const int example_idx,
@@ -706,6 +863,34 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
     SetCategorical(example_idx, feature_id, value, model.features());
   }
 
+  // Set the value of a string categorical feature for the first
+  // "values.size()" examples. Equivalent to, but faster than, calling
+  // "SetCategorical" on each example: The dictionary of the feature is resolved
+  // once, and the values are not copied into temporary strings.
+  //
+  // Usage example:
+  //
+  //   // "country" is owned by the caller e.g. a parsed request.
+  //   std::vector<absl::string_view> country = {"FR", "CH", "US"};
+  //   examples.SetCategoricalColumn(feature_country, country, model);
+  //
+  void SetCategoricalColumn(const CategoricalFeatureId feature_id,
+                            const absl::Span<const absl::string_view> values,
+                            const FeaturesDefinition& features) override {
+    DCHECK_LE(values.size(), NumberOfExamples());
+    const auto& dictionary = features.categorical_dictionary(feature_id);
+    for (int example_idx = 0; example_idx < values.size(); example_idx++) {
+      MutableFixedLengthValue(example_idx, feature_id.index, features)
+          .categorical_value = dictionary.ValueToIndex(values[example_idx]);
+    }
+  }
+
+  void SetCategoricalColumn(const CategoricalFeatureId feature_id,
+                            const absl::Span<const absl::string_view> values,
+                            const Model& model) {
+    SetCategoricalColumn(feature_id, values, model.features());
+  }
+
   // Get the string representation of a categorical feature.
   std::string GetCategoricalString(const int example_idx,
                                    const CategoricalFeatureId feature_id,
@@ -755,12 +940,9 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
     auto& dst_range = categorical_set_begins_and_ends_[CategoricalSetIndex(
         example_idx, feature_id.index, features)];
     dst_range.begin = categorical_item_buffer_.size();
+    const auto& dictionary = features.categorical_set_dictionary(feature_id);
     for (const auto& value : values) {
-      const auto value_idx = dataset::CategoricalStringToValue(
-          value,
-          features.data_spec().columns(
-              features.categorical_set_features()[feature_id.index].spec_idx));
-      categorical_item_buffer_.push_back(value_idx);
+      categorical_item_buffer_.push_back(dictionary.ValueToIndex(value));
     }
     dst_range.end = categorical_item_buffer_.size();
   }
@@ -782,10 +964,12 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
       return absl::InvalidArgumentError("Wrong number of values.");
     }
     for (int dim_idx = 0; dim_idx < unstack_def.size; dim_idx++) {
-      fixed_length_features_[FixedLengthIndex(
-                                 example_idx,
-                                 unstack_def.begin_internal_idx + dim_idx,
-                                 features)]
+      const int internal_idx = unstack_def.internal_idxs[dim_idx];
+      if (internal_idx < 0) {
+        // Not used by the model.
+        continue;
+      }
+      MutableFixedLengthValue(example_idx, internal_idx, features)
           .numerical_value = values[dim_idx];
     }
     return absl::OkStatus();
@@ -803,8 +987,7 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   void SetMissingNumerical(const int example_idx,
                            const NumericalFeatureId feature_id,
                            const FeaturesDefinition& features) override {
-    fixed_length_features_[FixedLengthIndex(example_idx, feature_id.index,
-                                            features)] =
+    MutableFixedLengthValue(example_idx, feature_id.index, features) =
         features.fixed_length_na_replacement_values()[feature_id.index];
   }
   void SetMissingNumerical(const int example_idx,
@@ -831,8 +1014,7 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   void SetMissingCategorical(const int example_idx,
                              const CategoricalFeatureId feature_id,
                              const FeaturesDefinition& features) override {
-    fixed_length_features_[FixedLengthIndex(example_idx, feature_id.index,
-                                            features)] =
+    MutableFixedLengthValue(example_idx, feature_id.index, features) =
         features.fixed_length_na_replacement_values()[feature_id.index];
   }
   void SetMissingCategorical(const int example_idx,
@@ -863,11 +1045,13 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
       const FeaturesDefinition& features) override {
     const UnstackedFeature& unstack_def =
         features.unstacked_features()[feature_id.index];
-    for (int dim_idx = 0; dim_idx < unstack_def.size; dim_idx++) {
-      fixed_length_features_[FixedLengthIndex(
-          example_idx, unstack_def.begin_internal_idx + dim_idx, features)] =
-          features.fixed_length_na_replacement_values()
-              [unstack_def.begin_internal_idx + dim_idx];
+    for (const int internal_idx : unstack_def.internal_idxs) {
+      if (internal_idx < 0) {
+        // Not used by the model.
+        continue;
+      }
+      MutableFixedLengthValue(example_idx, internal_idx, features) =
+          features.fixed_length_na_replacement_values()[internal_idx];
     }
   }
 
@@ -946,15 +1130,66 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
       const tensorflow::Example& src, int example_idx,
       const FeaturesDefinition& features) override;
 
+  // Set the value of the examples "[begin_example_idx, begin_example_idx +
+  // src.size())" from a batch of proto::Examples. Equivalent to, but faster
+  // than, calling "FromProtoExample" on each example.
+  //
+  // If "thread_pool" is set and the batch is large enough, the batch is split
+  // and the fixed-length features (i.e. all the features except for the
+  // categorical-set ones) are parsed in parallel by the threads of
+  // "thread_pool" and the calling thread. The categorical-set features are
+  // always parsed by the calling thread.
+  absl::Status FromProtoExamples(
+      absl::Span<const dataset::proto::Example> src, int begin_example_idx,
+      const Model& model,
+      utils::concurrency::ThreadPool* thread_pool = nullptr) {
+    return FromProtoExamples(src, begin_example_idx, model.features(),
+                             thread_pool);
+  }
+
+  absl::Status FromProtoExamples(
+      absl::Span<const dataset::proto::Example> src, int begin_example_idx,
+      const FeaturesDefinition& features,
+      utils::concurrency::ThreadPool* thread_pool) override;
+
+  // Set the value of the examples "[begin_example_idx, begin_example_idx +
+  // src.size())" from a batch of tensorflow::Examples. Equivalent to, but
+  // faster than, calling "FromTensorflowExample" on each example: The feature
+  // names of the first example are resolved once, and reused for the following
+  // examples with the same features (checked with a string comparison instead
+  // of a lookup in the model features). See "FromProtoExamples" for the
+  // multi-threading.
+  //
+  // Usage example:
+  //
+  //   std::vector<const tensorflow::Example*> batch = ...;
+  //   ExampleSet examples(batch.size(), model);
+  //   examples.FillMissing(model);
+  //   RETURN_IF_ERROR(examples.FromTensorflowExamples(
+  //       batch, /*begin_example_idx=*/0, model, &thread_pool));
+  //
+  absl::Status FromTensorflowExamples(
+      absl::Span<const tensorflow::Example* const> src, int begin_example_idx,
+      const Model& model,
+      utils::concurrency::ThreadPool* thread_pool = nullptr) {
+    return FromTensorflowExamples(src, begin_example_idx, model.features(),
+                                  thread_pool);
+  }
+
+  absl::Status FromTensorflowExamples(
+      absl::Span<const tensorflow::Example* const> src, int begin_example_idx,
+      const FeaturesDefinition& features,
+      utils::concurrency::ThreadPool* thread_pool) override;
+
   // The following three methods ("CategoricalAndNumericalValues",
   // "InternalCategoricalSetBeginAndEnds", and
   // "InternalCategoricalSetBeginAndEnds") allow the access to raw content in an
   // ExampleSet. These methods are available for backward compatibility, should
   // be avoided when possible, and will be removed after the serving API V1 is
   // removed.
-  const std::vector<NumericalOrCategoricalValue>&
+  absl::Span<const NumericalOrCategoricalValue>
   InternalCategoricalAndNumericalValues() const {
-    return fixed_length_features_;
+    return FixedLengthValues();
   }
 
   const std::vector<Rangei32>& InternalCategoricalSetBeginAndEnds() const {
@@ -966,6 +1201,32 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
   }
 
  private:
+  // Creates a view over "values". See "Wrap".
+  ExampleSetNumericalOrCategoricalFlat(
+      const absl::Span<const NumericalOrCategoricalValue> values,
+      const int num_examples, const FeaturesDefinition& features)
+      : num_examples_(num_examples),
+        categorical_set_begins_and_ends_(
+            num_examples * features.categorical_set_features().size()),
+        is_view_(true),
+        external_fixed_length_features_(values) {}
+
+  // Fixed-length feature values, owned or not.
+  absl::Span<const NumericalOrCategoricalValue> FixedLengthValues() const {
+    if (is_view_) {
+      return external_fixed_length_features_;
+    }
+    return fixed_length_features_;
+  }
+
+  NumericalOrCategoricalValue& MutableFixedLengthValue(
+      const int example_idx, const int fixed_length_feature_idx,
+      const FeaturesDefinition& features) {
+    CHECK(!is_view_) << "The values of an example set view cannot be modified";
+    return fixed_length_features_[FixedLengthIndex(
+        example_idx, fixed_length_feature_idx, features)];
+  }
+
   // Index of a fixed-length feature in the fixed-length example buffer.
   int FixedLengthIndex(const int example_idx,
                        const int fixed_length_feature_idx,
@@ -986,6 +1247,47 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
     return example_idx + categorical_set_feature_idx * num_examples_;
   }
 
+  // Input feature of the model matching a feature name of a tf.Example. Both
+  // fields are null if the feature is not used by the model.
+  struct ResolvedTfFeature {
+    const FeatureDef* base = nullptr;
+    const UnstackedFeature* unstacked = nullptr;
+  };
+
+  // Features of a tf.Example resolved into input features of the model.
+  struct TfFeatureSchema {
+    // Resolved features, in the iteration order of the tf.Example features.
+    std::vector<std::pair<std::string, ResolvedTfFeature>> features;
+    // Index of the features in "features" by name.
+    absl::flat_hash_map<std::string, int> feature_idxs;
+  };
+
+  // Subset of the features parsed by the "From*ExampleHelper" methods.
+  enum class FeatureSubset { kAll, kFixedLength, kCategoricalSet };
+
+  static ResolvedTfFeature ResolveTfFeature(absl::string_view feature_name,
+                                            const FeaturesDefinition& features);
+
+  // Builds the schema of the features of "src".
+  static TfFeatureSchema BuildTfFeatureSchema(
+      const tensorflow::Example& src, const FeaturesDefinition& features);
+
+  // Parses the "subset" features of "src" into the "example_idx-th" example.
+  // The features of "src" are resolved with "schema" (with a string comparison
+  // if they are in the same order, and with a lookup otherwise), and resolved
+  // in "features" if they are not in "schema".
+  absl::Status FromTensorflowExampleHelper(const tensorflow::Example& src,
+                                           int example_idx,
+                                           const TfFeatureSchema& schema,
+                                           FeatureSubset subset,
+                                           const FeaturesDefinition& features);
+
+  // Parses the "input_features" of "src" into the "example_idx-th" example.
+  absl::Status FromProtoExampleHelper(
+      const dataset::proto::Example& src, int example_idx,
+      const std::vector<FeatureDef>& input_features,
+      const FeaturesDefinition& features);
+
   // Parses a single base feature.
   absl::Status ParseBaseFeatureFromTfExample(
       const int example_idx, const FeatureDef& feature_def,
@@ -1001,7 +1303,7 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
       const FeaturesDefinition& features);
 
   // Storage for 32bits fixed length values (currently, numerical and
-  // categorical) ordered according to the "format".
+  // categorical) ordered according to the "format". Empty if "is_view_".
   std::vector<NumericalOrCategoricalValue> fixed_length_features_;
 
   // Number of allocated examples.
@@ -1014,6 +1316,12 @@ class ExampleSetNumericalOrCategoricalFlat : public AbstractExampleSet {
 
   // Buffer of categorical values. Used to store categorical-set values.
   std::vector<int32_t> categorical_item_buffer_;
+
+  // If true, the fixed length values are read from
+  // "external_fixed_length_features_" instead of "fixed_length_features_".
+  bool is_view_ = false;
+  absl::Span<const NumericalOrCategoricalValue>
+      external_fixed_length_features_;
 };  // namespace serving
 
 // Empty model to use for unit testing.
@@ -1069,8 +1377,7 @@ void ExampleSetNumericalOrCategoricalFlat<Model, format>::FillMissing(
   for (int fixed_feature_idx = 0; fixed_feature_idx < num_fixed_features;
        fixed_feature_idx++) {
     for (int example_idx = 0; example_idx < num_examples_; example_idx++) {
-      fixed_length_features_[FixedLengthIndex(example_idx, fixed_feature_idx,
-                                              features)] =
+      MutableFixedLengthValue(example_idx, fixed_feature_idx, features) =
           features.fixed_length_na_replacement_values()[fixed_feature_idx];
     }
   }
@@ -1090,18 +1397,23 @@ absl::Status ExampleSetNumericalOrCategoricalFlat<Model, format>::Copy(
     return absl::OutOfRangeError(
         "The destination does not contain enough examples.");
   }
+  if (dst->IsView()) {
+    return absl::InvalidArgumentError(
+        "The destination cannot be an example set view.");
+  }
   dst->Clear();
 
   // Copy of the fixed-length features.
+  const auto src_values = FixedLengthValues();
   if constexpr (format == ExampleFormat::FORMAT_EXAMPLE_MAJOR) {
     const auto num_features = features.fixed_length_features().size();
-    std::copy(fixed_length_features_.begin() + begin * num_features,
-              fixed_length_features_.begin() + end * num_features,
+    std::copy(src_values.begin() + begin * num_features,
+              src_values.begin() + end * num_features,
               dst->fixed_length_features_.begin());
   } else if constexpr (format == ExampleFormat::FORMAT_FEATURE_MAJOR) {
     for (const auto& feature : features.fixed_length_features()) {
-      const auto it_src_feature = fixed_length_features_.begin() +
-                                  feature.internal_idx * NumberOfExamples();
+      const auto it_src_feature =
+          src_values.begin() + feature.internal_idx * NumberOfExamples();
       std::copy(it_src_feature + begin, it_src_feature + end,
                 dst->fixed_length_features_.begin() +
                     feature.internal_idx * dst->NumberOfExamples());
@@ -1132,25 +1444,128 @@ absl::Status
 ExampleSetNumericalOrCategoricalFlat<Model, format>::FromTensorflowExample(
     const tensorflow::Example& src, const int example_idx,
     const FeaturesDefinition& features) {
+  return FromTensorflowExampleHelper(src, example_idx, /*schema=*/{},
+                                     FeatureSubset::kAll, features);
+}
+
+template <typename Model, ExampleFormat format>
+absl::Status
+ExampleSetNumericalOrCategoricalFlat<Model, format>::FromTensorflowExamples(
+    const absl::Span<const tensorflow::Example* const> src,
+    const int begin_example_idx, const FeaturesDefinition& features,
+    utils::concurrency::ThreadPool* thread_pool) {
+  if (begin_example_idx < 0 ||
+      begin_example_idx + src.size() > NumberOfExamples()) {
+    return absl::OutOfRangeError(
+        "The example set does not contain enough examples.");
+  }
+  if (src.empty()) {
+    return absl::OkStatus();
+  }
+  const auto schema = BuildTfFeatureSchema(*src.front(), features);
+
+  const bool multi_threaded =
+      thread_pool != nullptr &&
+      src.size() >= 2 * internal::kMinNumExamplesPerThread;
+  // Without multi-threading, all the features are parsed in a single pass.
+  const auto subset =
+      multi_threaded ? FeatureSubset::kFixedLength : FeatureSubset::kAll;
+  RETURN_IF_ERROR(internal::ParallelForExampleRanges(
+      src.size(), multi_threaded ? thread_pool : nullptr,
+      [&](const int begin, const int end) -> absl::Status {
+        for (int src_idx = begin; src_idx < end; src_idx++) {
+          RETURN_IF_ERROR(FromTensorflowExampleHelper(
+              *src[src_idx], begin_example_idx + src_idx, schema, subset,
+              features));
+        }
+        return absl::OkStatus();
+      }));
+
+  if (multi_threaded && !features.categorical_set_features().empty()) {
+    for (int src_idx = 0; src_idx < src.size(); src_idx++) {
+      RETURN_IF_ERROR(FromTensorflowExampleHelper(
+          *src[src_idx], begin_example_idx + src_idx, schema,
+          FeatureSubset::kCategoricalSet, features));
+    }
+  }
+  return absl::OkStatus();
+}
+
+template <typename Model, ExampleFormat format>
+typename ExampleSetNumericalOrCategoricalFlat<Model, format>::ResolvedTfFeature
+ExampleSetNumericalOrCategoricalFlat<Model, format>::ResolveTfFeature(
+    const absl::string_view feature_name, const FeaturesDefinition& features) {
+  ResolvedTfFeature resolved;
+  const auto unstacked_feature_def =
+      features.FindUnstackedFeatureDefByName(feature_name);
+  if (unstacked_feature_def.ok()) {
+    resolved.unstacked = unstacked_feature_def.value();
+    return resolved;
+  }
+  const auto base_feature_def = features.FindFeatureDefByName(feature_name);
+  if (base_feature_def.ok()) {
+    resolved.base = base_feature_def.value();
+  }
+  return resolved;
+}
+
+template <typename Model, ExampleFormat format>
+typename ExampleSetNumericalOrCategoricalFlat<Model, format>::TfFeatureSchema
+ExampleSetNumericalOrCategoricalFlat<Model, format>::BuildTfFeatureSchema(
+    const tensorflow::Example& src, const FeaturesDefinition& features) {
+  TfFeatureSchema schema;
+  schema.features.reserve(src.features().feature_size());
+  for (const auto& fname_and_value : src.features().feature()) {
+    schema.feature_idxs[fname_and_value.first] = schema.features.size();
+    schema.features.emplace_back(
+        fname_and_value.first,
+        ResolveTfFeature(fname_and_value.first, features));
+  }
+  return schema;
+}
+
+template <typename Model, ExampleFormat format>
+absl::Status ExampleSetNumericalOrCategoricalFlat<Model, format>::
+    FromTensorflowExampleHelper(const tensorflow::Example& src,
+                                const int example_idx,
+                                const TfFeatureSchema& schema,
+                                const FeatureSubset subset,
+                                const FeaturesDefinition& features) {
+  // Index, in "schema.features", of the next expected feature.
+  int schema_feature_idx = 0;
   // Iterate over the source features.
   for (const auto& fname_and_value : src.features().feature()) {
     // If the feature is not used by any of the "Parse*" function, this
     // indicates that the feature is not used by the model and ignored.
-
-    const auto unstacked_feature_def =
-        features.FindUnstackedFeatureDefByName(fname_and_value.first);
-    if (unstacked_feature_def.ok()) {
-      // Parse the unstacked feature.
-      RETURN_IF_ERROR(ParseUnstackedFeatureFromTfExample(
-          example_idx, *unstacked_feature_def.value(), fname_and_value.first,
-          fname_and_value.second, features));
+    ResolvedTfFeature resolved;
+    if (schema_feature_idx < schema.features.size() &&
+        schema.features[schema_feature_idx].first == fname_and_value.first) {
+      resolved = schema.features[schema_feature_idx++].second;
     } else {
-      const auto base_feature_def =
-          features.FindFeatureDefByName(fname_and_value.first);
-      if (base_feature_def.ok()) {
+      const auto it = schema.feature_idxs.find(fname_and_value.first);
+      if (it != schema.feature_idxs.end()) {
+        resolved = schema.features[it->second].second;
+        schema_feature_idx = it->second + 1;
+      } else {
+        resolved = ResolveTfFeature(fname_and_value.first, features);
+      }
+    }
+
+    if (resolved.unstacked) {
+      if (subset != FeatureSubset::kCategoricalSet) {
+        // Parse the unstacked feature.
+        RETURN_IF_ERROR(ParseUnstackedFeatureFromTfExample(
+            example_idx, *resolved.unstacked, fname_and_value.first,
+            fname_and_value.second, features));
+      }
+    } else if (resolved.base) {
+      const bool is_categorical_set =
+          resolved.base->type == dataset::proto::ColumnType::CATEGORICAL_SET;
+      if (subset == FeatureSubset::kAll ||
+          is_categorical_set == (subset == FeatureSubset::kCategoricalSet)) {
         // Parse the base feature.
         RETURN_IF_ERROR(ParseBaseFeatureFromTfExample(
-            example_idx, *base_feature_def.value(), fname_and_value.first,
+            example_idx, *resolved.base, fname_and_value.first,
             fname_and_value.second, features));
       }
     }
@@ -1293,7 +1708,55 @@ absl::Status
 ExampleSetNumericalOrCategoricalFlat<Model, format>::FromProtoExample(
     const dataset::proto::Example& src, const int example_idx,
     const FeaturesDefinition& features) {
-  for (const auto& feature : features.input_features()) {
+  RETURN_IF_ERROR(FromProtoExampleHelper(
+      src, example_idx, features.fixed_length_features(), features));
+  return FromProtoExampleHelper(src, example_idx,
+                                features.categorical_set_features(), features);
+}
+
+template <typename Model, ExampleFormat format>
+absl::Status
+ExampleSetNumericalOrCategoricalFlat<Model, format>::FromProtoExamples(
+    const absl::Span<const dataset::proto::Example> src,
+    const int begin_example_idx, const FeaturesDefinition& features,
+    utils::concurrency::ThreadPool* thread_pool) {
+  if (begin_example_idx < 0 ||
+      begin_example_idx + src.size() > NumberOfExamples()) {
+    return absl::OutOfRangeError(
+        "The example set does not contain enough examples.");
+  }
+
+  const bool multi_threaded =
+      thread_pool != nullptr &&
+      src.size() >= 2 * internal::kMinNumExamplesPerThread;
+  RETURN_IF_ERROR(internal::ParallelForExampleRanges(
+      src.size(), multi_threaded ? thread_pool : nullptr,
+      [&](const int begin, const int end) -> absl::Status {
+        for (int src_idx = begin; src_idx < end; src_idx++) {
+          RETURN_IF_ERROR(FromProtoExampleHelper(
+              src[src_idx], begin_example_idx + src_idx,
+              features.fixed_length_features(), features));
+        }
+        return absl::OkStatus();
+      }));
+
+  if (!features.categorical_set_features().empty()) {
+    for (int src_idx = 0; src_idx < src.size(); src_idx++) {
+      RETURN_IF_ERROR(FromProtoExampleHelper(
+          src[src_idx], begin_example_idx + src_idx,
+          features.categorical_set_features(), features));
+    }
+  }
+  return absl::OkStatus();
+}
+
+template <typename Model, ExampleFormat format>
+absl::Status
+ExampleSetNumericalOrCategoricalFlat<Model, format>::FromProtoExampleHelper(
+    const dataset::proto::Example& src, const int example_idx,
+    const std::vector<FeatureDef>& input_features,
+    const FeaturesDefinition& features) {
+  for (const auto& feature : input_features) {
     const auto& attribute = src.attributes(feature.spec_idx);
     switch (feature.type) {
       case dataset::proto::ColumnType::NUMERICAL: {
@@ -1379,7 +1842,7 @@ ExampleSetNumericalOrCategoricalFlat<Model, format>::ExtractProtoExample(
   for (const auto& feature_id : features.fixed_length_features()) {
     const int buffer_idx =
         FixedLengthIndex(example_idx, feature_id.internal_idx, features);
-    const auto& src_value = fixed_length_features_[buffer_idx];
+    const auto& src_value = FixedLengthValues()[buffer_idx];
     const auto na_value =
         features.fixed_length_na_replacement_values()[feature_id.internal_idx];
     if (src_value == na_value) {
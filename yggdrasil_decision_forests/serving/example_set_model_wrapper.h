@@ -19,18 +19,40 @@
 #ifndef YGGDRASIL_DECISION_FORESTS_SERVING_EXAMPLE_SET_MODEL_WRAPPER_H_
 #define YGGDRASIL_DECISION_FORESTS_SERVING_EXAMPLE_SET_MODEL_WRAPPER_H_
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "absl/status/status.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/model/abstract_model.h"
 #include "yggdrasil_decision_forests/serving/example_set.h"
 #include "yggdrasil_decision_forests/serving/fast_engine.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
 
 namespace yggdrasil_decision_forests {
 namespace serving {
 
 // Utility class to wrap a fast ExampleSet model into a FastGenericEngine.
+//
+// If set, "PredictTreeParallelCall" is used by the multi-threaded "Predict" on
+// sets of examples too small to be split among threads (see
+// "PredictTreeParallel" in "decision_forest.h").
+//
+// If set, "SaveCall" is used by "SaveToFile" (see "SaveEngineFile" in
+// "decision_forest/engine_file.h").
 template <typename Model,
           void (*PredictCall)(const Model&, const typename Model::ExampleSet&,
-                              int, std::vector<float>*)>
+                              int, std::vector<float>*),
+          void (*PredictTreeParallelCall)(
+              const Model&, const typename Model::ExampleSet&, int,
+              std::vector<float>*, utils::concurrency::ThreadPool*) = nullptr,
+          absl::Status (*SaveCall)(const Model&, absl::string_view) = nullptr>
 class ExampleSetModelWrapper : public FastEngine {
  public:
   // Loads the model in the engine. The "src" model can be discarded after that.
@@ -39,11 +61,34 @@ class ExampleSetModelWrapper : public FastEngine {
     return GenericToSpecializedModel(src, &model_);
   }
 
+  // The compiled model. Can be used to load an already compiled model (e.g.
+  // from an engine file) instead of calling "LoadModel".
+  Model* mutable_model() { return &model_; }
+
+  absl::Status SaveToFile(const absl::string_view path) const override {
+    if constexpr (SaveCall != nullptr) {
+      return SaveCall(model_, path);
+    }
+    return FastEngine::SaveToFile(path);
+  }
+
   std::unique_ptr<AbstractExampleSet> AllocateExamples(
       int num_examples) const override {
     return absl::make_unique<typename Model::ExampleSet>(num_examples, model_);
   }
 
+  utils::StatusOr<std::unique_ptr<AbstractExampleSet>> WrapExamples(
+      const absl::Span<const NumericalOrCategoricalValue> values,
+      const int num_examples, const ExampleFormat format) const override {
+    if (format != Model::ExampleSet::kFormat) {
+      return absl::InvalidArgumentError(
+          "The format of the buffer does not match the format of the engine.");
+    }
+    ASSIGN_OR_RETURN(auto examples,
+                     Model::ExampleSet::Wrap(values, num_examples, model_));
+    return std::unique_ptr<AbstractExampleSet>(std::move(examples));
+  }
+
   void Predict(const AbstractExampleSet& examples, int num_examples,
                std::vector<float>* predictions) const override {
     const auto& casted_examples =
@@ -51,6 +96,72 @@ class ExampleSetModelWrapper : public FastEngine {
     PredictCall(model_, casted_examples, num_examples, predictions);
   }
 
+  absl::Status PredictWithThreadPool(
+      const AbstractExampleSet& examples, int num_examples,
+      std::vector<float>* predictions,
+      utils::concurrency::ThreadPool* thread_pool) const override {
+    int num_shards = 1;
+    if (thread_pool) {
+      num_shards = std::min(thread_pool->num_threads(),
+                            num_examples / kMinNumExamplesPerShard);
+    }
+    if (num_shards <= 1) {
+      if constexpr (PredictTreeParallelCall != nullptr) {
+        if (thread_pool) {
+          const auto& casted_examples =
+              dynamic_cast<const typename Model::ExampleSet&>(examples);
+          PredictTreeParallelCall(model_, casted_examples, num_examples,
+                                  predictions, thread_pool);
+          return absl::OkStatus();
+        }
+      }
+      Predict(examples, num_examples, predictions);
+      return absl::OkStatus();
+    }
+    const int num_examples_per_shard =
+        (num_examples + num_shards - 1) / num_shards;
+    num_shards =
+        (num_examples + num_examples_per_shard - 1) / num_examples_per_shard;
+
+    const auto& casted_examples =
+        dynamic_cast<const typename Model::ExampleSet&>(examples);
+    const int num_dimensions = NumPredictionDimension();
+    predictions->resize(num_examples * num_dimensions);
+
+    auto shards = AcquireShards(num_shards);
+    absl::BlockingCounter pending_shards(num_shards);
+    for (int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+      thread_pool->Schedule([&, shard_idx]() {
+        const int begin = shard_idx * num_examples_per_shard;
+        const int end = std::min(begin + num_examples_per_shard, num_examples);
+        auto& shard = (*shards)[shard_idx];
+        if (!shard.examples ||
+            shard.examples->NumberOfExamples() < end - begin) {
+          shard.examples = absl::make_unique<typename Model::ExampleSet>(
+              num_examples_per_shard, model_);
+        }
+        shard.status = casted_examples.Copy(begin, end, model_.features(),
+                                            shard.examples.get());
+        if (shard.status.ok()) {
+          PredictCall(model_, *shard.examples, end - begin,
+                      &shard.predictions);
+          std::copy(shard.predictions.begin(),
+                    shard.predictions.begin() + (end - begin) * num_dimensions,
+                    predictions->begin() + begin * num_dimensions);
+        }
+        pending_shards.DecrementCount();
+      });
+    }
+    pending_shards.Wait();
+
+    absl::Status status;
+    for (int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+      status.Update((*shards)[shard_idx].status);
+    }
+    ReleaseShards(std::move(shards));
+    return status;
+  }
+
   template <class...>
   using void_t = void;
 
@@ -73,7 +184,51 @@ class ExampleSetModelWrapper : public FastEngine {
   }
 
  private:
+  // Minimum number of examples evaluated by a thread in the multi-threaded
+  // "Predict". Smaller sets of examples are evaluated in the calling thread.
+  static constexpr int kMinNumExamplesPerShard = 64;
+
+  // Working memory of a thread in the multi-threaded "Predict".
+  struct Shard {
+    std::unique_ptr<typename Model::ExampleSet> examples;
+    std::vector<float> predictions;
+    // Status of the last evaluation of the shard.
+    absl::Status status;
+  };
+
+  // Gets a set of "num_shards" shards not used by any other "Predict" call.
+  // The shards are re-used among calls so that "Predict" does not allocate
+  // memory once warmed-up.
+  std::unique_ptr<std::vector<Shard>> AcquireShards(
+      const int num_shards) const {
+    std::unique_ptr<std::vector<Shard>> shards;
+    {
+      absl::MutexLock lock(&shards_mutex_);
+      if (!available_shards_.empty()) {
+        shards = std::move(available_shards_.back());
+        available_shards_.pop_back();
+      }
+    }
+    if (!shards) {
+      shards = absl::make_unique<std::vector<Shard>>();
+    }
+    if (static_cast<int>(shards->size()) < num_shards) {
+      shards->resize(num_shards);
+    }
+    return shards;
+  }
+
+  void ReleaseShards(std::unique_ptr<std::vector<Shard>> shards) const {
+    absl::MutexLock lock(&shards_mutex_);
+    available_shards_.push_back(std::move(shards));
+  }
+
   Model model_;
+
+  // Shards not currently used by a multi-threaded "Predict" call.
+  mutable absl::Mutex shards_mutex_;
+  mutable std::vector<std::unique_ptr<std::vector<Shard>>> available_shards_
+      ABSL_GUARDED_BY(shards_mutex_);
 };
 
 }  // namespace serving
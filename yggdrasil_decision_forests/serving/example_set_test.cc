@@ -14,11 +14,13 @@
  */
 
 #include <random>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "tensorflow/core/example/feature_util.h"
 #include "yggdrasil_decision_forests/dataset/example.pb.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/test.h"
 
 #include "yggdrasil_decision_forests/serving/example_set.h"
@@ -309,10 +311,40 @@ TEST(ExampleSet, HasFeature) {
   EXPECT_TRUE(ToyModel::ExampleSet::HasInputFeature("d", model));
   EXPECT_FALSE(ToyModel::ExampleSet::HasInputFeature("toto", model));
   EXPECT_TRUE(ToyModel::ExampleSet::HasInputFeature("g", model));
-  EXPECT_TRUE(ToyModel::ExampleSet::HasInputFeature("g_0", model));
+  EXPECT_FALSE(ToyModel::ExampleSet::HasInputFeature("g_0", model));
+  EXPECT_TRUE(ToyModel::ExampleSet::HasInputFeature("g_1", model));
   EXPECT_TRUE(ToyModel::ExampleSet::HasInputFeature("j", model));
 }
 
+TEST(ExampleSet, UnusedUnstackedFeaturesAreNotAllocated) {
+  ToyModel model;
+  // "a", "b", "c", "f", "j", "g_1", "g_2", "i_0" and "i_1". "g_0" and "h" are
+  // not used by the model.
+  EXPECT_EQ(model.features().fixed_length_features().size(), 9);
+  EXPECT_FALSE(ToyModel::ExampleSet::HasInputFeature("h", model));
+
+  const auto& unstacked_g = *model.features()
+                                 .FindUnstackedFeatureDefByName("g")
+                                 .value();
+  EXPECT_EQ(unstacked_g.size, 3);
+  EXPECT_EQ(unstacked_g.internal_idxs[0], -1);
+  EXPECT_EQ(unstacked_g.internal_idxs[1], unstacked_g.begin_internal_idx);
+  EXPECT_EQ(unstacked_g.internal_idxs[2], unstacked_g.begin_internal_idx + 1);
+
+  // The value of "g_0" is ignored.
+  ToyModel::ExampleSet example_set(1, model);
+  example_set.FillMissing(model);
+  const auto feature_g =
+      ToyModel::ExampleSet::GetMultiDimNumericalFeatureId("g", model).value();
+  CHECK_OK(example_set.SetMultiDimNumerical(0, feature_g, {4, 5, 6}, model));
+  const auto feature_g_1 =
+      ToyModel::ExampleSet::GetNumericalFeatureId("g_1", model).value();
+  const auto feature_g_2 =
+      ToyModel::ExampleSet::GetNumericalFeatureId("g_2", model).value();
+  EXPECT_EQ(example_set.GetNumerical(0, feature_g_1, model), 5);
+  EXPECT_EQ(example_set.GetNumerical(0, feature_g_2, model), 6);
+}
+
 TEST(ExampleSet, GetValueMissing) {
   ToyModel model;
   ToyModel::ExampleSet example_set(5, model);
@@ -420,7 +452,7 @@ TEST(ExampleSet, ExtractProtoManualExample) {
         attributes { categorical_set { values: 1 values: 2 } }
         attributes {}
         attributes { discretized_numerical: 2 }
-        attributes { numerical: 4 }
+        attributes {}
         attributes { numerical: 5 }
         attributes { numerical: 6 }
         attributes {}
@@ -468,7 +500,7 @@ TEST(ExampleSet, FromProtoExample) {
         attributes { categorical_set { values: 1 values: 2 } }
         attributes {}
         attributes { discretized_numerical: 2 }
-        attributes { numerical: 4 }
+        attributes {}
         attributes { numerical: 5 }
         attributes { numerical: 6 }
         attributes {}
@@ -507,7 +539,7 @@ TEST(ExampleSet, FromTensorflowExample) {
         attributes { categorical_set { values: 1 values: 2 } }
         attributes {}
         attributes { discretized_numerical: 2 }
-        attributes { numerical: 10 }
+        attributes {}
         attributes { numerical: 11 }
         attributes { numerical: 12 }
         attributes {}
@@ -531,7 +563,7 @@ TEST(ExampleSet, FromTensorflowExample) {
         attributes { categorical_set { values: 1 values: 2 } }
         attributes {}
         attributes { discretized_numerical: 2 }
-        attributes { numerical: 10 }
+        attributes {}
         attributes { numerical: 11 }
         attributes { numerical: 12 }
         attributes {}
@@ -568,6 +600,262 @@ TEST(ExampleSet, FromTensorflowExample) {
       StatusIs(absl::StatusCode::kInvalidArgument, "Wrong number of values."));
 }
 
+TEST(ExampleSet, FromProtoExamples) {
+  ToyModel model;
+  const dataset::proto::Example example = PARSE_TEST_PROTO(
+      R"(
+        attributes { numerical: 1.0 }
+        attributes { categorical: 1 }
+        attributes {}
+        attributes { categorical_set { values: 2 values: 3 } }
+        attributes { categorical_set { values: 1 values: 2 } }
+        attributes {}
+        attributes { discretized_numerical: 2 }
+        attributes {}
+        attributes { numerical: 5 }
+        attributes { numerical: 6 }
+        attributes {}
+        attributes {}
+        attributes {}
+        attributes { discretized_numerical: 2 }
+        attributes { boolean: true }
+      )");
+  // Each example has a different value of "a".
+  const int num_examples = 300;
+  std::vector<dataset::proto::Example> batch(num_examples, example);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    batch[example_idx].mutable_attributes(0)->set_numerical(example_idx);
+  }
+
+  utils::concurrency::ThreadPool pool("parsing", /*num_threads=*/3);
+  pool.StartWorkers();
+  for (auto* thread_pool : {static_cast<utils::concurrency::ThreadPool*>(
+                                nullptr),
+                            &pool}) {
+    ToyModel::ExampleSet example_set(num_examples + 1, model);
+    example_set.FillMissing(model);
+    EXPECT_OK(example_set.FromProtoExamples(batch, /*begin_example_idx=*/1,
+                                            model, thread_pool));
+    // The first example is not modified.
+    EXPECT_FALSE(example_set.ExtractProtoExample(0, model)
+                     .value()
+                     .attributes(0)
+                     .has_numerical());
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      EXPECT_THAT(example_set.ExtractProtoExample(example_idx + 1, model)
+                      .value(),
+                  EqualsProto(batch[example_idx]));
+    }
+  }
+
+  ToyModel::ExampleSet small_example_set(2, model);
+  EXPECT_THAT(small_example_set.FromProtoExamples(batch, 0, model),
+              StatusIs(absl::StatusCode::kOutOfRange));
+}
+
+TEST(ExampleSet, FromTensorflowExamples) {
+  ToyModel model;
+  tensorflow::Example example;
+  tensorflow::SetFeatureValues({"unused"}, "UNUSED_TF_FEATURE", &example);
+  tensorflow::SetFeatureValues<int64_t>({1}, "b", &example);
+  tensorflow::SetFeatureValues({"y_c"}, "c", &example);
+  tensorflow::SetFeatureValues<int64_t>({2, 3}, "d", &example);
+  tensorflow::SetFeatureValues({"y_d", "z_d"}, "e", &example);
+  tensorflow::SetFeatureValues({1.9}, "f", &example);
+  tensorflow::SetFeatureValues({10.f, 11.f, 12.f}, "g", &example);
+  tensorflow::SetFeatureValues({1.5f, 1.5f}, "i", &example);
+  tensorflow::SetFeatureValues({1.0f}, "j", &example);
+
+  // Each example has a different value of "a". Some examples have a different
+  // set of features than the first one.
+  const int num_examples = 300;
+  std::vector<tensorflow::Example> batch(num_examples, example);
+  std::vector<const tensorflow::Example*> batch_ptrs;
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    auto& item = batch[example_idx];
+    tensorflow::SetFeatureValues({static_cast<float>(example_idx)}, "a",
+                                 &item);
+    if (example_idx % 7 == 3) {
+      item.mutable_features()->mutable_feature()->erase("c");
+      tensorflow::SetFeatureValues({"other"}, "OTHER_UNUSED_FEATURE", &item);
+    }
+    batch_ptrs.push_back(&item);
+  }
+
+  // Expected values.
+  ToyModel::ExampleSet expected_example_set(num_examples, model);
+  expected_example_set.FillMissing(model);
+  for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+    EXPECT_OK(expected_example_set.FromTensorflowExample(batch[example_idx],
+                                                         example_idx, model));
+  }
+
+  utils::concurrency::ThreadPool pool("parsing", /*num_threads=*/3);
+  pool.StartWorkers();
+  for (auto* thread_pool : {static_cast<utils::concurrency::ThreadPool*>(
+                                nullptr),
+                            &pool}) {
+    ToyModel::ExampleSet example_set(num_examples, model);
+    example_set.FillMissing(model);
+    EXPECT_OK(example_set.FromTensorflowExamples(
+        batch_ptrs, /*begin_example_idx=*/0, model, thread_pool));
+    for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+      EXPECT_THAT(
+          example_set.ExtractProtoExample(example_idx, model).value(),
+          EqualsProto(
+              expected_example_set.ExtractProtoExample(example_idx, model)
+                  .value()));
+    }
+  }
+
+  // Errors are reported.
+  tensorflow::Example invalid_example = example;
+  tensorflow::SetFeatureValues({1.0f, 2.0f}, "a", &invalid_example);
+  batch_ptrs[200] = &invalid_example;
+  ToyModel::ExampleSet example_set(num_examples, model);
+  example_set.FillMissing(model);
+  EXPECT_THAT(example_set.FromTensorflowExamples(batch_ptrs, 0, model, &pool),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       "Too many values for feature: a"));
+}
+
+TEST(ExampleSet, WrapExternalBuffer) {
+  ToyModel model;
+  ToyModel::ExampleSet example_set(5, model);
+  SetToyValues(model, &example_set);
+
+  // The external buffer is a copy of the values of "example_set".
+  const auto src_values = example_set.InternalCategoricalAndNumericalValues();
+  const std::vector<NumericalOrCategoricalValue> buffer(src_values.begin(),
+                                                        src_values.end());
+  auto view = ToyModel::ExampleSet::Wrap(buffer, 5, model).value();
+  EXPECT_TRUE(view->IsView());
+  EXPECT_FALSE(example_set.IsView());
+  EXPECT_EQ(view->NumberOfExamples(), 5);
+  EXPECT_EQ(view->InternalCategoricalAndNumericalValues().data(),
+            buffer.data());
+
+  // Categorical-set values are stored in the view.
+  const auto feature_d =
+      ToyModel::ExampleSet::GetCategoricalSetFeatureId("d", model).value();
+  const auto feature_e =
+      ToyModel::ExampleSet::GetCategoricalSetFeatureId("e", model).value();
+  view->SetMissingCategoricalSet(0, feature_d, model);
+  view->SetMissingCategoricalSet(0, feature_e, model);
+  view->SetCategoricalSet(1, feature_d, {2, 3}, model);
+  view->SetCategoricalSet(1, feature_e, std::vector<std::string>{"y_d", "z_d"},
+                          model);
+  for (int example_idx = 2; example_idx < 5; example_idx++) {
+    view->SetMissingCategoricalSet(example_idx, feature_d, model);
+    view->SetMissingCategoricalSet(example_idx, feature_e, model);
+  }
+
+  const auto feature_a =
+      ToyModel::ExampleSet::GetNumericalFeatureId("a", model).value();
+  const auto feature_c =
+      ToyModel::ExampleSet::GetCategoricalFeatureId("c", model).value();
+  EXPECT_EQ(view->GetNumerical(1, feature_a, model), 1.0f);
+  EXPECT_EQ(view->GetCategoricalString(1, feature_c, model), "y_c");
+  const auto expected_example_1 =
+      example_set.ExtractProtoExample(1, model.features()).value();
+  EXPECT_THAT(view->ExtractProtoExample(1, model.features()).value(),
+              EqualsProto(expected_example_1));
+
+  // Copy from a view.
+  ToyModel::ExampleSet copy(2, model);
+  CHECK_OK(view->Copy(1, 3, model, &copy));
+  EXPECT_EQ(copy.GetNumerical(0, feature_a, model), 1.0f);
+  EXPECT_THAT(copy.ExtractProtoExample(0, model.features()).value(),
+              EqualsProto(expected_example_1));
+
+  // Copy to a view.
+  EXPECT_THAT(example_set.Copy(0, 2, model, view.get()),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  // Invalid buffer size.
+  EXPECT_THAT(ToyModel::ExampleSet::Wrap(buffer, 4, model).status(),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       "fixed-length features) are expected"));
+}
+
+TEST(ExampleSet, GetFixedLengthFeatureRemapping) {
+  ToyModel model;
+  const auto& features = model.features().fixed_length_features();
+  std::vector<std::string> column_names = {"UNUSED", "d"};
+  for (auto it = features.rbegin(); it != features.rend(); it++) {
+    column_names.push_back(it->name);
+  }
+  const auto remapping =
+      model.features().GetFixedLengthFeatureRemapping(column_names).value();
+  ASSERT_EQ(remapping.size(), column_names.size());
+  EXPECT_EQ(remapping[0], -1);
+  EXPECT_EQ(remapping[1], -1);
+  for (int feature_idx = 0; feature_idx < features.size(); feature_idx++) {
+    EXPECT_EQ(remapping[column_names.size() - 1 - feature_idx], feature_idx);
+  }
+
+  column_names.pop_back();
+  EXPECT_THAT(
+      model.features().GetFixedLengthFeatureRemapping(column_names).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument,
+               "is not defined in the columns"));
+}
+
+TEST(ExampleSet, CategoricalStringDictionary) {
+  ToyModel model;
+  const auto feature_b =
+      ToyModel::ExampleSet::GetCategoricalFeatureId("b", model).value();
+  const auto feature_c =
+      ToyModel::ExampleSet::GetCategoricalFeatureId("c", model).value();
+  const auto feature_e =
+      ToyModel::ExampleSet::GetCategoricalSetFeatureId("e", model).value();
+
+  const auto& dictionary_b = model.features().categorical_dictionary(feature_b);
+  EXPECT_EQ(dictionary_b.ValueToIndex("2"), 2);
+
+  const auto& dictionary_c = model.features().categorical_dictionary(feature_c);
+  const auto& spec_c = model.features().data_spec().columns(2);
+  for (const std::string value : {"x_c", "y_c", "z_c", "", "unknown"}) {
+    EXPECT_EQ(dictionary_c.ValueToIndex(value),
+              dataset::CategoricalStringToValue(value, spec_c));
+  }
+
+  const auto& dictionary_e =
+      model.features().categorical_set_dictionary(feature_e);
+  EXPECT_EQ(dictionary_e.ValueToIndex("z_d"), 2);
+  EXPECT_EQ(dictionary_e.ValueToIndex("z_c"),
+            dataset::kOutOfDictionaryItemIndex);
+}
+
+TEST(ExampleSet, SetCategoricalColumn) {
+  ToyModel model;
+  const auto feature_c =
+      ToyModel::ExampleSet::GetCategoricalFeatureId("c", model).value();
+  const std::vector<std::string> values = {"z_c", "unknown", "x_c", "y_c"};
+
+  ToyModel::ExampleSet expected_example_set(5, model);
+  expected_example_set.FillMissing(model);
+  for (int example_idx = 0; example_idx < values.size(); example_idx++) {
+    expected_example_set.SetCategorical(example_idx, feature_c,
+                                        values[example_idx], model);
+  }
+
+  ToyModel::ExampleSet example_set(5, model);
+  example_set.FillMissing(model);
+  const std::vector<absl::string_view> value_views(values.begin(),
+                                                   values.end());
+  example_set.SetCategoricalColumn(feature_c, value_views, model);
+
+  for (int example_idx = 0; example_idx < 5; example_idx++) {
+    EXPECT_EQ(example_set.GetCategoricalInt(example_idx, feature_c, model),
+              expected_example_set.GetCategoricalInt(example_idx, feature_c,
+                                                     model));
+  }
+  EXPECT_EQ(example_set.GetCategoricalString(0, feature_c, model), "z_c");
+  EXPECT_EQ(example_set.GetCategoricalInt(1, feature_c, model),
+            dataset::kOutOfDictionaryItemIndex);
+}
+
 }  // namespace
 }  // namespace serving
 }  // namespace yggdrasil_decision_forests
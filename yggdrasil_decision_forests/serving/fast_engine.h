@@ -27,11 +27,25 @@
 //   examples->SetNumericalFeature(...);
 //   std::vector<float> predictions;
 //   engine.Predict(examples, 1, &predictions);
+//
+//   // Or, for large sets of examples, using multiple threads:
+//   ThreadPool pool("inference", /*num_threads=*/32);
+//   pool.StartWorkers();
+//   CHECK_OK(engine.PredictWithThreadPool(examples, num_examples, &predictions,
+//                                         &pool));
 
 #ifndef YGGDRASIL_DECISION_FORESTS_SERVING_FAST_ENGINE_H_
 #define YGGDRASIL_DECISION_FORESTS_SERVING_FAST_ENGINE_H_
 
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/serving/example_set.h"
+#include "yggdrasil_decision_forests/utils/compatibility.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 
 namespace yggdrasil_decision_forests {
 namespace serving {
@@ -73,12 +87,55 @@ class FastEngine {
   virtual std::unique_ptr<AbstractExampleSet> AllocateExamples(
       int num_examples) const = 0;
 
+  // Creates a set of examples that reads the numerical, boolean and
+  // categorical feature values directly from the externally owned buffer
+  // "values" i.e. without copy. "format" is the layout of "values" and should
+  // match the layout expected by the engine. See
+  // "ExampleSetNumericalOrCategoricalFlat::Wrap" for the details.
+  // Returns an Unimplemented error if the engine does not support it.
+  //
+  // Example:
+  //   ASSIGN_OR_RETURN(const auto remapping,
+  //     engine->features().GetFixedLengthFeatureRemapping(column_names));
+  //   ... Fill "values" using "remapping".
+  //   ASSIGN_OR_RETURN(const auto examples,
+  //     engine->WrapExamples(values, num_examples, format));
+  //   engine->Predict(*examples, num_examples, &predictions);
+  virtual utils::StatusOr<std::unique_ptr<AbstractExampleSet>> WrapExamples(
+      absl::Span<const NumericalOrCategoricalValue> values, int num_examples,
+      ExampleFormat format) const {
+    return absl::UnimplementedError(
+        "This engine does not support wrapping external buffers.");
+  }
+
   // Applies the model on a set of examples.
   // After the function call, "predictions" will be of size "num_examples *
   // NumPredictionDimension()".
   virtual void Predict(const AbstractExampleSet& examples, int num_examples,
                        std::vector<float>* predictions) const = 0;
 
+  // Applies the model on a set of examples using the threads of
+  // "thread_pool". The examples are partitioned into contiguous ranges, and
+  // each range is evaluated by a different thread. The predictions are the same
+  // as with the single-threaded "Predict". Small sets of examples are evaluated
+  // in the calling thread i.e. the latency of small requests is not impacted.
+  //
+  // "thread_pool" should be started, can be shared among engines and calls, and
+  // should not be the pool running the caller (this method blocks until all
+  // the ranges are evaluated). If "thread_pool" is null or if the engine does
+  // not support parallel inference, this is equivalent to "Predict". Returns
+  // an error if the examples could not be dispatched to the threads.
+  //
+  // Note: This method is not an overload of "Predict" so that implementations
+  // of "Predict" do not hide it.
+  virtual absl::Status PredictWithThreadPool(
+      const AbstractExampleSet& examples, int num_examples,
+      std::vector<float>* predictions,
+      utils::concurrency::ThreadPool* thread_pool) const {
+    Predict(examples, num_examples, predictions);
+    return absl::OkStatus();
+  }
+
   // Number of dimensions of the output predictions.
   // 1 for regression, ranking and binary classification with compact format.
   // number of classes for classification.
@@ -86,6 +143,14 @@ class FastEngine {
 
   // List of features used by the model.
   virtual const serving::FeaturesDefinition& features() const = 0;
+
+  // Saves the compiled model in a file that can be loaded without re-compiling
+  // the model (see "model::FastEngineFactory::CreateEngineFromFile"). Returns
+  // an Unimplemented error if the engine does not support it.
+  virtual absl::Status SaveToFile(absl::string_view path) const {
+    return absl::UnimplementedError(
+        "This engine does not support being saved to a file.");
+  }
 };
 
 }  // namespace serving
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/model_registry.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/model/model_library.h"
+#include "yggdrasil_decision_forests/serving/fast_engine.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+#include "yggdrasil_decision_forests/utils/logging.h"
+#include "yggdrasil_decision_forests/utils/status_macros.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+
+struct ModelRegistry::Servable {
+  std::unique_ptr<FastEngine> engine;
+  std::unique_ptr<model::AbstractModel> model;
+  int64_t version;
+};
+
+// Reader counters of a shard. Aligned on a cache line to avoid false sharing
+// between the shards.
+struct alignas(64) ModelRegistry::ReaderShard {
+  std::atomic<int64_t> counters[2] = {{0}, {0}};
+};
+
+namespace {
+
+// Index of the reader shard used by the current thread.
+int ReaderShardIndex() {
+  static std::atomic<int> next_shard_idx{0};
+  thread_local const int shard_idx =
+      next_shard_idx.fetch_add(1, std::memory_order_relaxed) %
+      ModelRegistry::kNumReaderShards;
+  return shard_idx;
+}
+
+}  // namespace
+
+ModelRegistry::ServedEngine::ServedEngine(ServedEngine&& other)
+    : servable_(other.servable_), counter_(other.counter_) {
+  other.servable_ = nullptr;
+  other.counter_ = nullptr;
+}
+
+ModelRegistry::ServedEngine::~ServedEngine() {
+  if (counter_) {
+    counter_->fetch_sub(1);
+  }
+}
+
+const FastEngine& ModelRegistry::ServedEngine::engine() const {
+  DCHECK(servable_);
+  return *servable_->engine;
+}
+
+const model::AbstractModel* ModelRegistry::ServedEngine::model() const {
+  return servable_ ? servable_->model.get() : nullptr;
+}
+
+int64_t ModelRegistry::ServedEngine::version() const {
+  return servable_ ? servable_->version : 0;
+}
+
+ModelRegistry::ModelRegistry()
+    : reader_shards_(new ReaderShard[kNumReaderShards]) {
+  background_pool_ = absl::make_unique<utils::concurrency::ThreadPool>(
+      "ModelRegistry", /*num_threads=*/1);
+  background_pool_->StartWorkers();
+}
+
+ModelRegistry::~ModelRegistry() {
+  // Finishes the background loads.
+  background_pool_.reset();
+  delete current_.load();
+}
+
+ModelRegistry::ServedEngine ModelRegistry::Acquire() const {
+  // The reader counter is incremented before reading the engine. All the
+  // operations are sequentially consistent: If a publisher does not see the
+  // counter incremented, the reader sees the new engine (see "Synchronize").
+  const uint64_t epoch = epoch_.load();
+  auto* counter = &reader_shards_[ReaderShardIndex()].counters[epoch & 1];
+  counter->fetch_add(1);
+  return ServedEngine(current_.load(), counter);
+}
+
+int64_t ModelRegistry::version() const { return last_version_.load(); }
+
+int64_t ModelRegistry::Publish(std::unique_ptr<FastEngine> engine,
+                               std::unique_ptr<model::AbstractModel> model) {
+  absl::MutexLock lock(&publish_mutex_);
+  const int64_t version = last_version_.load() + 1;
+  auto* servable = new Servable{std::move(engine), std::move(model), version};
+  const Servable* previous = current_.exchange(servable);
+  last_version_.store(version);
+  Synchronize();
+  delete previous;
+  return version;
+}
+
+void ModelRegistry::Synchronize() {
+  // A reader still using the previous engine incremented the counter selected
+  // by an epoch equal or lower than the current epoch. Flipping the epoch twice
+  // and waiting for the counters of the previous parity to drain after each
+  // flip guarantees that both counters have been observed at zero since the
+  // publication. New readers only increment the counter of the new parity, so
+  // the wait is bounded by the longest in-flight request.
+  for (int flip = 0; flip < 2; flip++) {
+    const uint64_t previous_parity = epoch_.fetch_add(1) & 1;
+    for (int shard_idx = 0; shard_idx < kNumReaderShards; shard_idx++) {
+      const auto& counter = reader_shards_[shard_idx].counters[previous_parity];
+      while (counter.load() != 0) {
+        absl::SleepFor(absl::Microseconds(20));
+      }
+    }
+  }
+}
+
+absl::Status ModelRegistry::Load(const absl::string_view model_path) {
+  std::unique_ptr<model::AbstractModel> model;
+  RETURN_IF_ERROR(model::LoadModel(model_path, &model));
+  ASSIGN_OR_RETURN(auto engine, model->BuildFastEngine());
+  const auto version = Publish(std::move(engine), std::move(model));
+  LOG(INFO) << "Model \"" << model_path << "\" published with version "
+            << version;
+  return absl::OkStatus();
+}
+
+void ModelRegistry::LoadInBackground(const absl::string_view model_path) {
+  {
+    absl::MutexLock lock(&background_mutex_);
+    num_pending_background_loads_++;
+  }
+  background_pool_->Schedule([this, path = std::string(model_path)]() {
+    const auto status = Load(path);
+    if (!status.ok()) {
+      LOG(WARNING) << "Cannot load model \"" << path << "\": " << status;
+    }
+    absl::MutexLock lock(&background_mutex_);
+    last_background_status_ = status;
+    num_pending_background_loads_--;
+  });
+}
+
+absl::Status ModelRegistry::WaitForBackgroundLoads() {
+  absl::MutexLock lock(&background_mutex_);
+  background_mutex_.Await(absl::Condition(
+      +[](int* num_pending) { return *num_pending == 0; },
+      &num_pending_background_loads_));
+  return last_background_status_;
+}
+
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
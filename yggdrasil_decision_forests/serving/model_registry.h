@@ -0,0 +1,178 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Model registry for the hot-swapping of the model served by long running
+// servers.
+//
+// The registry holds the currently served fast engine. A new model can be
+// loaded, compiled and published while requests are being served: Requests
+// that started before the publication finish with the previous engine, and
+// requests that start after the publication use the new engine. The previous
+// engine is destroyed as soon as all the requests using it are done.
+//
+// Acquiring the served engine ("ModelRegistry::Acquire") does not lock, does
+// not allocate and does not wait for a publication to complete. Publications
+// (which are rare) are serialized and wait for the in-flight requests to
+// finish before destroying the previous engine. This is a read-copy-update
+// (RCU) scheme.
+//
+// Usage example:
+//
+//   ModelRegistry registry;
+//   RETURN_IF_ERROR(registry.Load("/path/to/model"));
+//
+//   // In the request threads.
+//   const auto served = registry.Acquire();
+//   const auto examples = served.engine().AllocateExamples(1);
+//   ...
+//   served.engine().Predict(*examples, 1, &predictions);
+//
+//   // Every hour, in a control thread.
+//   registry.LoadInBackground("/path/to/new_model");
+//
+#ifndef YGGDRASIL_DECISION_FORESTS_SERVING_MODEL_REGISTRY_H_
+#define YGGDRASIL_DECISION_FORESTS_SERVING_MODEL_REGISTRY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "yggdrasil_decision_forests/model/abstract_model.h"
+#include "yggdrasil_decision_forests/serving/fast_engine.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+
+class ModelRegistry {
+ private:
+  struct Servable;
+  struct ReaderShard;
+
+ public:
+  // Number of independent reader counters. Readers are spread over the shards
+  // to limit the cache line contention on the request path.
+  static constexpr int kNumReaderShards = 16;
+
+  // Reference to the served engine. The engine remains valid until the
+  // "ServedEngine" is destroyed, even if a new engine is published in the
+  // meantime. A "ServedEngine" should be short lived (e.g. the duration of a
+  // request) since it delays the destruction of the previous engines.
+  //
+  // A thread must not publish an engine (or wait for a background load) while
+  // holding a "ServedEngine" of the same registry: The publication would wait
+  // for this "ServedEngine" to be destroyed, and never complete.
+  class ServedEngine {
+   public:
+    ServedEngine(ServedEngine&& other);
+    ServedEngine(const ServedEngine&) = delete;
+    ServedEngine& operator=(const ServedEngine&) = delete;
+    ServedEngine& operator=(ServedEngine&&) = delete;
+    ~ServedEngine();
+
+    // True if an engine was published.
+    bool has_engine() const { return servable_ != nullptr; }
+
+    // Served engine. Should only be called if "has_engine()" is true.
+    const FastEngine& engine() const;
+
+    // Model of the served engine. Null if the engine was published without
+    // model.
+    const model::AbstractModel* model() const;
+
+    // Version of the served engine. Versions are assigned by the registry in
+    // the publication order, starting at 1. Zero if "has_engine()" is false.
+    int64_t version() const;
+
+   private:
+    ServedEngine(const Servable* servable, std::atomic<int64_t>* counter)
+        : servable_(servable), counter_(counter) {}
+
+    const Servable* servable_;
+    // Reader counter to release when the engine is not used anymore.
+    std::atomic<int64_t>* counter_;
+
+    friend class ModelRegistry;
+  };
+
+  ModelRegistry();
+  ~ModelRegistry();
+
+  ModelRegistry(const ModelRegistry&) = delete;
+  ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+  // Gets the served engine. Lock-free.
+  ServedEngine Acquire() const;
+
+  // Version of the last published engine. Zero if no engine was published.
+  int64_t version() const;
+
+  // Publishes a new engine and returns its version. Waits for the in-flight
+  // requests using the previous engine to complete, and destroys the previous
+  // engine. "model" is optional and is not used by the registry.
+  //
+  // Deadlocks if the calling thread holds a "ServedEngine" of this registry.
+  int64_t Publish(std::unique_ptr<FastEngine> engine,
+                  std::unique_ptr<model::AbstractModel> model = {});
+
+  // Loads a model, compiles it into a fast engine (see
+  // "AbstractModel::BuildFastEngine") and publishes it. Blocking. The served
+  // engine is not changed if the model cannot be loaded or compiled.
+  //
+  // Like "Publish", deadlocks if the calling thread holds a "ServedEngine".
+  absl::Status Load(absl::string_view model_path);
+
+  // Calls "Load" in a background thread. The loads are executed in the order
+  // of the calls.
+  void LoadInBackground(absl::string_view model_path);
+
+  // Waits for all the background loads to be done, and returns the status of
+  // the last one (or OK if no background load was run).
+  //
+  // Like "Publish", deadlocks if the calling thread holds a "ServedEngine".
+  absl::Status WaitForBackgroundLoads();
+
+ private:
+  // Waits until all the readers that acquired the engine before this call are
+  // done.
+  void Synchronize();
+
+  // Currently served engine. Owned by the registry.
+  std::atomic<const Servable*> current_{nullptr};
+
+  // Each reader increments a counter of its shard. The counter (0 or 1) is
+  // selected by the parity of "epoch_" at the time of the acquisition.
+  std::unique_ptr<ReaderShard[]> reader_shards_;
+  std::atomic<uint64_t> epoch_{0};
+
+  // Serializes the publications.
+  absl::Mutex publish_mutex_;
+  std::atomic<int64_t> last_version_{0};
+
+  // Background loads.
+  absl::Mutex background_mutex_;
+  int num_pending_background_loads_ ABSL_GUARDED_BY(background_mutex_) = 0;
+  absl::Status last_background_status_ ABSL_GUARDED_BY(background_mutex_);
+  std::unique_ptr<utils::concurrency::ThreadPool> background_pool_;
+};
+
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
+
+#endif  // YGGDRASIL_DECISION_FORESTS_SERVING_MODEL_REGISTRY_H_
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2021 Google LLC.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "yggdrasil_decision_forests/serving/model_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
+#include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
+#include "yggdrasil_decision_forests/serving/fast_engine.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
+#include "yggdrasil_decision_forests/utils/filesystem.h"
+#include "yggdrasil_decision_forests/utils/test.h"
+#include "yggdrasil_decision_forests/utils/test_utils.h"
+
+namespace yggdrasil_decision_forests {
+namespace serving {
+namespace {
+
+std::string TestDataDir() {
+  return file::JoinPath(test::DataRootDirectory(),
+                        "yggdrasil_decision_forests/test_data");
+}
+
+constexpr int kMaxVersions = 1000;
+
+// Liveness of the "VersionedEngine"s indexed by version.
+std::atomic<bool> live_engines[kMaxVersions + 1];
+
+// Engine whose content is entirely determined by its version. Used to detect
+// torn and destroyed engines.
+class VersionedEngine : public FastEngine {
+ public:
+  explicit VersionedEngine(int64_t version)
+      : version_(version), payload_(1024, version) {
+    live_engines[version_] = true;
+  }
+
+  ~VersionedEngine() override {
+    live_engines[version_] = false;
+    std::fill(payload_.begin(), payload_.end(), -1);
+  }
+
+  // Checks that the engine is alive and that its content matches "version".
+  bool IsValid(const int64_t version) const {
+    if (version != version_ || !live_engines[version]) {
+      return false;
+    }
+    for (const auto value : payload_) {
+      if (value != version) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::unique_ptr<AbstractExampleSet> AllocateExamples(
+      int num_examples) const override {
+    return {};
+  }
+
+  utils::StatusOr<std::unique_ptr<AbstractExampleSet>> WrapExamples(
+      absl::Span<const NumericalOrCategoricalValue> values, int num_examples,
+      ExampleFormat format) const override {
+    return absl::UnimplementedError("Not implemented");
+  }
+
+  void Predict(const AbstractExampleSet& examples, int num_examples,
+               std::vector<float>* predictions) const override {}
+
+  int NumPredictionDimension() const override { return 1; }
+
+  const serving::FeaturesDefinition& features() const override {
+    return features_;
+  }
+
+ private:
+  const int64_t version_;
+  std::vector<int64_t> payload_;
+  serving::FeaturesDefinition features_;
+};
+
+TEST(ModelRegistry, Empty) {
+  ModelRegistry registry;
+  EXPECT_EQ(registry.version(), 0);
+  const auto served = registry.Acquire();
+  EXPECT_FALSE(served.has_engine());
+  EXPECT_EQ(served.version(), 0);
+  EXPECT_EQ(served.model(), nullptr);
+}
+
+TEST(ModelRegistry, PublishWaitsForReaders) {
+  ModelRegistry registry;
+  EXPECT_EQ(registry.Publish(absl::make_unique<VersionedEngine>(1)), 1);
+
+  std::atomic<bool> published{false};
+  {
+    auto served = registry.Acquire();
+    utils::concurrency::Thread publisher([&]() {
+      EXPECT_EQ(registry.Publish(absl::make_unique<VersionedEngine>(2)), 2);
+      published = true;
+    });
+
+    // The new engine is visible to new readers while the previous engine is
+    // still in use.
+    while (registry.Acquire().version() != 2) {
+    }
+    absl::SleepFor(absl::Milliseconds(50));
+    EXPECT_FALSE(published);
+    EXPECT_TRUE(live_engines[1]);
+    EXPECT_TRUE(
+        dynamic_cast<const VersionedEngine&>(served.engine()).IsValid(1));
+
+    // Moving the reference does not release the engine.
+    auto moved_served = std::move(served);
+    absl::SleepFor(absl::Milliseconds(50));
+    EXPECT_FALSE(published);
+    EXPECT_EQ(moved_served.version(), 1);
+
+    // Releasing the reference unblocks the publisher.
+    { const auto released = std::move(moved_served); }
+    publisher.Join();
+  }
+  EXPECT_TRUE(published);
+  EXPECT_FALSE(live_engines[1]);
+  EXPECT_TRUE(live_engines[2]);
+}
+
+// Readers continuously acquire and check the engine while new engines are
+// published.
+TEST(ModelRegistry, Stress) {
+  const int kNumReaders = 8;
+  const int kNumPublications = 100;
+
+  ModelRegistry registry;
+  registry.Publish(absl::make_unique<VersionedEngine>(1));
+
+  std::atomic<bool> done{false};
+  std::atomic<int64_t> num_errors{0};
+  std::atomic<int64_t> num_reads{0};
+  std::vector<std::unique_ptr<utils::concurrency::Thread>> readers;
+  for (int reader_idx = 0; reader_idx < kNumReaders; reader_idx++) {
+    readers.push_back(absl::make_unique<utils::concurrency::Thread>([&]() {
+      int64_t last_version = 0;
+      while (!done) {
+        const auto served = registry.Acquire();
+        const auto& engine =
+            dynamic_cast<const VersionedEngine&>(served.engine());
+        // The served versions are increasing, and the engine is complete and
+        // alive during the entire read.
+        if (served.version() < last_version ||
+            !engine.IsValid(served.version()) ||
+            !engine.IsValid(served.version())) {
+          num_errors++;
+        }
+        last_version = served.version();
+        num_reads++;
+      }
+    }));
+  }
+
+  for (int version = 2; version <= kNumPublications; version++) {
+    // Lets the readers make progress between the publications.
+    const int64_t target_num_reads = num_reads + 100;
+    while (num_reads < target_num_reads) {
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(registry.Publish(absl::make_unique<VersionedEngine>(version)),
+              version);
+    // Only the served engine is alive.
+    EXPECT_FALSE(live_engines[version - 1]);
+  }
+
+  done = true;
+  for (auto& reader : readers) {
+    reader->Join();
+  }
+  EXPECT_EQ(num_errors, 0);
+  EXPECT_GT(num_reads, 0);
+  EXPECT_EQ(registry.version(), kNumPublications);
+}
+
+TEST(ModelRegistry, Load) {
+  const std::string model_dir =
+      file::JoinPath(TestDataDir(), "model", "iris_multi_class_gbdt");
+  dataset::VerticalDataset dataset;
+
+  ModelRegistry registry;
+  CHECK_OK(registry.Load(model_dir));
+  EXPECT_EQ(registry.version(), 1);
+  {
+    const auto served = registry.Acquire();
+    ASSERT_TRUE(served.has_engine());
+    ASSERT_NE(served.model(), nullptr);
+    CHECK_OK(LoadVerticalDataset(
+        absl::StrCat("csv:",
+                     file::JoinPath(TestDataDir(), "dataset", "iris.csv")),
+        served.model()->data_spec(), &dataset));
+    utils::ExpectEqualPredictions(dataset, *served.model(), served.engine());
+  }
+
+  // A failed load does not change the served engine.
+  EXPECT_FALSE(registry.Load(file::JoinPath(TestDataDir(), "model",
+                                            "non_existing_model"))
+                   .ok());
+  EXPECT_EQ(registry.version(), 1);
+  EXPECT_EQ(registry.Acquire().version(), 1);
+}
+
+TEST(ModelRegistry, LoadInBackground) {
+  ModelRegistry registry;
+  EXPECT_OK(registry.WaitForBackgroundLoads());
+
+  registry.LoadInBackground(
+      file::JoinPath(TestDataDir(), "model", "abalone_regression_gbdt"));
+  registry.LoadInBackground(
+      file::JoinPath(TestDataDir(), "model", "iris_multi_class_gbdt"));
+  EXPECT_OK(registry.WaitForBackgroundLoads());
+  EXPECT_EQ(registry.version(), 2);
+  {
+    const auto served = registry.Acquire();
+    EXPECT_EQ(served.engine().NumPredictionDimension(), 3);
+  }
+
+  registry.LoadInBackground(
+      file::JoinPath(TestDataDir(), "model", "non_existing_model"));
+  EXPECT_FALSE(registry.WaitForBackgroundLoads().ok());
+  EXPECT_EQ(registry.version(), 2);
+}
+
+}  // namespace
+}  // namespace serving
+}  // namespace yggdrasil_decision_forests
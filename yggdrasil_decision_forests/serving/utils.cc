@@ -15,8 +15,18 @@
 
 #include "yggdrasil_decision_forests/serving/utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
 
@@ -42,6 +52,45 @@ float OptionalOp(const float v1, const float v2, const bool has_v1,
   return op(v1, v2);
 }
 
+// Index of the shard used by the current thread.
+int ThreadShardIndex(const int num_shards) {
+  static std::atomic<int> next_thread_idx{0};
+  thread_local const int thread_idx =
+      next_thread_idx.fetch_add(1, std::memory_order_relaxed);
+  return thread_idx % num_shards;
+}
+
+// Lock-free accumulation operations on atomic floating point values.
+template <typename T>
+void AtomicAdd(std::atomic<T>* dst, const T value) {
+  T current = dst->load(std::memory_order_relaxed);
+  while (!dst->compare_exchange_weak(current, current + value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+template <typename T>
+void AtomicMin(std::atomic<T>* dst, const T value) {
+  T current = dst->load(std::memory_order_relaxed);
+  while (value < current && !dst->compare_exchange_weak(
+                                current, value, std::memory_order_relaxed)) {
+  }
+}
+
+template <typename T>
+void AtomicMax(std::atomic<T>* dst, const T value) {
+  T current = dst->load(std::memory_order_relaxed);
+  while (value > current && !dst->compare_exchange_weak(
+                                current, value, std::memory_order_relaxed)) {
+  }
+}
+
+// Multipliers of the hash functions of the count-min sketch rows.
+constexpr uint64_t kSketchHashMultipliers[] = {
+    0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+    0xD6E8FEB86659FD93ull, 0xFF51AFD7ED558CCDull, 0xC4CEB9FE1A85EC53ull,
+    0x94D049BB133111EBull, 0xBF58476D1CE4E5B9ull};
+
 }  // namespace
 
 FeatureStatistics::FeatureStatistics(
@@ -73,7 +122,7 @@ FeatureStatistics::FeatureStatistics(
 }
 
 void FeatureStatistics::Update(
-    const std::vector<NumericalOrCategoricalValue>& examples,
+    absl::Span<const NumericalOrCategoricalValue> examples,
     const int num_examples, const ExampleFormat format) {
   statistics_.set_num_examples(statistics_.num_examples() + num_examples);
 
@@ -339,5 +388,375 @@ std::string FeatureStatistics::BuildReport() const {
   return report;
 }
 
+// Values of a sketched categorical feature with the largest estimated counts.
+struct ConcurrentFeatureStatistics::HeavyHitters {
+  absl::Mutex mutex;
+  std::vector<int> values ABSL_GUARDED_BY(mutex);
+  // Lower bound of the estimated counts of "values". Since the estimates only
+  // grow, a value with a lower or equal estimate cannot replace any of them.
+  int64_t min_count ABSL_GUARDED_BY(mutex) = 0;
+};
+
+// Statistics accumulated by the threads assigned to the shard.
+struct ConcurrentFeatureStatistics::Shard {
+  struct Numerical {
+    std::atomic<double> sum{0};
+    std::atomic<double> sum_squared{0};
+    std::atomic<float> min{std::numeric_limits<float>::infinity()};
+    std::atomic<float> max{-std::numeric_limits<float>::infinity()};
+  };
+
+  Shard(const int num_features, const int num_numerical,
+        const size_t num_categorical_counters, const int num_sketched)
+      : num_non_missing(new std::atomic<int64_t>[num_features]()),
+        numerical(new Numerical[num_numerical]),
+        categorical_counters(
+            new std::atomic<int64_t>[num_categorical_counters]()),
+        heavy_hitters(new HeavyHitters[num_sketched]) {}
+
+  // Aligned to avoid false sharing with the other shards.
+  alignas(64) std::atomic<int64_t> num_examples{0};
+  // Indexed by feature.
+  std::unique_ptr<std::atomic<int64_t>[]> num_non_missing;
+  // Indexed by "FeatureAccumulator::numerical_idx".
+  std::unique_ptr<Numerical[]> numerical;
+  // Exact counts and count-min sketches of the categorical features.
+  std::unique_ptr<std::atomic<int64_t>[]> categorical_counters;
+  // Indexed by "FeatureAccumulator::sketch_idx".
+  std::unique_ptr<HeavyHitters[]> heavy_hitters;
+};
+
+ConcurrentFeatureStatistics::ConcurrentFeatureStatistics(
+    const dataset::proto::DataSpecification* data_spec,
+    std::vector<int> feature_indices,
+    std::vector<NumericalOrCategoricalValue> na_replacement_values,
+    const Options& options)
+    : data_spec_(data_spec),
+      feature_indices_(std::move(feature_indices)),
+      na_replacement_values_(std::move(na_replacement_values)),
+      options_(options) {
+  DCHECK_GE(options_.num_shards, 1);
+  DCHECK_GE(options_.sketch_depth, 1);
+  DCHECK_LE(options_.sketch_depth, std::size(kSketchHashMultipliers));
+  while ((1 << log2_sketch_width_) < options_.sketch_width) {
+    log2_sketch_width_++;
+  }
+  const size_t sketch_size =
+      static_cast<size_t>(options_.sketch_depth) << log2_sketch_width_;
+
+  accumulators_.resize(feature_indices_.size());
+  for (int feature_idx = 0; feature_idx < feature_indices_.size();
+       feature_idx++) {
+    const auto& col_spec = data_spec_->columns(feature_indices_[feature_idx]);
+    auto& accumulator = accumulators_[feature_idx];
+    accumulator.type = col_spec.type();
+    switch (col_spec.type()) {
+      case dataset::proto::ColumnType::NUMERICAL:
+        accumulator.numerical_idx = num_numerical_accumulators_++;
+        break;
+      case dataset::proto::ColumnType::CATEGORICAL:
+        accumulator.num_categorical_values =
+            col_spec.categorical().number_of_unique_values();
+        accumulator.use_sketch = accumulator.num_categorical_values >
+                                 options_.max_exact_categorical_values;
+        accumulator.categorical_offset = num_categorical_counters_;
+        if (accumulator.use_sketch) {
+          accumulator.sketch_idx = num_sketched_features_++;
+        }
+        num_categorical_counters_ += accumulator.use_sketch
+                                         ? sketch_size
+                                         : accumulator.num_categorical_values;
+        break;
+      default:
+        LOG(WARNING) << "Type of feature \"" << col_spec.name()
+                     << " is supported.";
+    }
+  }
+
+  shards_.reserve(options_.num_shards);
+  for (int shard_idx = 0; shard_idx < options_.num_shards; shard_idx++) {
+    shards_.push_back(absl::make_unique<Shard>(
+        feature_indices_.size(), num_numerical_accumulators_,
+        num_categorical_counters_, num_sketched_features_));
+  }
+}
+
+ConcurrentFeatureStatistics::~ConcurrentFeatureStatistics() = default;
+
+size_t ConcurrentFeatureStatistics::SketchIndex(const int row,
+                                                const int value) const {
+  const uint64_t hash =
+      (static_cast<uint64_t>(value) + 1) * kSketchHashMultipliers[row];
+  return (static_cast<size_t>(row) << log2_sketch_width_) +
+         (log2_sketch_width_ == 0 ? 0 : hash >> (64 - log2_sketch_width_));
+}
+
+template <typename Counter>
+int64_t ConcurrentFeatureStatistics::SketchCount(const Counter* counters,
+                                                 const int value) const {
+  int64_t count = std::numeric_limits<int64_t>::max();
+  for (int row = 0; row < options_.sketch_depth; row++) {
+    count = std::min<int64_t>(count, counters[SketchIndex(row, value)]);
+  }
+  return count;
+}
+
+void ConcurrentFeatureStatistics::OfferHeavyHitter(
+    const std::atomic<int64_t>* counters, const int value,
+    HeavyHitters* heavy_hitters) const {
+  auto& values = heavy_hitters->values;
+  if (std::find(values.begin(), values.end(), value) != values.end()) {
+    return;
+  }
+  if (values.size() < static_cast<size_t>(options_.max_sketched_values)) {
+    values.push_back(value);
+    return;
+  }
+  const int64_t count = SketchCount(counters, value);
+  if (count <= heavy_hitters->min_count) {
+    return;
+  }
+  // Replaces the tracked value with the smallest estimated count.
+  int min_idx = -1;
+  int64_t min_count = count;
+  for (int idx = 0; idx < values.size(); idx++) {
+    const int64_t candidate_count = SketchCount(counters, values[idx]);
+    if (candidate_count < min_count) {
+      min_idx = idx;
+      min_count = candidate_count;
+    }
+  }
+  if (min_idx != -1) {
+    values[min_idx] = value;
+  }
+  heavy_hitters->min_count = min_count;
+}
+
+void ConcurrentFeatureStatistics::Update(
+    absl::Span<const NumericalOrCategoricalValue> examples,
+    const int num_examples, const ExampleFormat format) {
+  auto& shard = *shards_[ThreadShardIndex(shards_.size())];
+  shard.num_examples.fetch_add(num_examples, std::memory_order_relaxed);
+
+  // Values of a categorical feature in the batch. Reused across the calls to
+  // avoid allocations on the serving path.
+  thread_local std::vector<int> categorical_values;
+
+  const int num_features = feature_indices_.size();
+  for (int feature_idx = 0; feature_idx < num_features; feature_idx++) {
+    const auto& accumulator = accumulators_[feature_idx];
+    const auto& na_replacement_value = na_replacement_values_[feature_idx];
+
+    // Position of the feature values in "examples".
+    int value_begin = 0;
+    int value_stride = 0;
+    switch (format) {
+      case ExampleFormat::FORMAT_FEATURE_MAJOR:
+        value_begin = feature_idx * num_examples;
+        value_stride = 1;
+        break;
+      case ExampleFormat::FORMAT_EXAMPLE_MAJOR:
+        value_begin = feature_idx;
+        value_stride = num_features;
+        break;
+      default:
+        break;
+    }
+    const NumericalOrCategoricalValue* values = examples.data() + value_begin;
+
+    int64_t num_non_missing = 0;
+    switch (accumulator.type) {
+      case dataset::proto::ColumnType::NUMERICAL: {
+        // Aggregate the batch locally.
+        double sum = 0;
+        double sum_squared = 0;
+        float min_value = std::numeric_limits<float>::infinity();
+        float max_value = -std::numeric_limits<float>::infinity();
+        for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+          const auto& value = values[example_idx * value_stride];
+          if (value == na_replacement_value) {
+            continue;
+          }
+          num_non_missing++;
+          const float numerical_value = value.numerical_value;
+          sum += numerical_value;
+          sum_squared += numerical_value * numerical_value;
+          min_value = std::min(min_value, numerical_value);
+          max_value = std::max(max_value, numerical_value);
+        }
+        if (num_non_missing > 0) {
+          auto& numerical = shard.numerical[accumulator.numerical_idx];
+          AtomicAdd(&numerical.sum, sum);
+          AtomicAdd(&numerical.sum_squared, sum_squared);
+          AtomicMin(&numerical.min, min_value);
+          AtomicMax(&numerical.max, max_value);
+        }
+      } break;
+
+      case dataset::proto::ColumnType::CATEGORICAL: {
+        // Aggregate the batch locally: The values are sorted so that each
+        // distinct value is added to the shared counters once.
+        categorical_values.clear();
+        for (int example_idx = 0; example_idx < num_examples; example_idx++) {
+          const auto& value = values[example_idx * value_stride];
+          if (!(value == na_replacement_value)) {
+            num_non_missing++;
+          }
+          int categorical_value = value.categorical_value;
+          if (categorical_value < 0 ||
+              categorical_value >= accumulator.num_categorical_values) {
+            // Out-of-vocabulary.
+            categorical_value = 0;
+          }
+          categorical_values.push_back(categorical_value);
+        }
+        std::sort(categorical_values.begin(), categorical_values.end());
+
+        auto* counters =
+            shard.categorical_counters.get() + accumulator.categorical_offset;
+        HeavyHitters* heavy_hitters = nullptr;
+        if (accumulator.use_sketch) {
+          heavy_hitters = &shard.heavy_hitters[accumulator.sketch_idx];
+          heavy_hitters->mutex.Lock();
+        }
+        auto run_begin = categorical_values.begin();
+        while (run_begin != categorical_values.end()) {
+          const int categorical_value = *run_begin;
+          const auto run_end = std::upper_bound(
+              run_begin, categorical_values.end(), categorical_value);
+          const int64_t count = run_end - run_begin;
+          if (accumulator.use_sketch) {
+            for (int row = 0; row < options_.sketch_depth; row++) {
+              counters[SketchIndex(row, categorical_value)].fetch_add(
+                  count, std::memory_order_relaxed);
+            }
+            OfferHeavyHitter(counters, categorical_value, heavy_hitters);
+          } else {
+            counters[categorical_value].fetch_add(count,
+                                                  std::memory_order_relaxed);
+          }
+          run_begin = run_end;
+        }
+        if (heavy_hitters) {
+          heavy_hitters->mutex.Unlock();
+        }
+      } break;
+
+      default:
+        // Note: Warning was generated at initialization time.
+        break;
+    }
+
+    if (num_non_missing > 0) {
+      shard.num_non_missing[feature_idx].fetch_add(num_non_missing,
+                                                   std::memory_order_relaxed);
+    }
+  }
+}
+
+proto::FeatureStatistics ConcurrentFeatureStatistics::Export() const {
+  proto::FeatureStatistics statistics;
+  int64_t num_examples = 0;
+  for (const auto& shard : shards_) {
+    num_examples += shard->num_examples.load(std::memory_order_relaxed);
+  }
+  if (num_examples > 0) {
+    statistics.set_num_examples(num_examples);
+  }
+
+  const size_t sketch_size = static_cast<size_t>(options_.sketch_depth)
+                             << log2_sketch_width_;
+  std::vector<int64_t> counters;
+  for (int feature_idx = 0; feature_idx < feature_indices_.size();
+       feature_idx++) {
+    const auto& accumulator = accumulators_[feature_idx];
+    auto& feature = *statistics.add_features();
+
+    int64_t num_non_missing = 0;
+    for (const auto& shard : shards_) {
+      num_non_missing +=
+          shard->num_non_missing[feature_idx].load(std::memory_order_relaxed);
+    }
+    if (num_non_missing > 0) {
+      feature.set_num_non_missing(num_non_missing);
+    }
+
+    switch (accumulator.type) {
+      case dataset::proto::ColumnType::NUMERICAL: {
+        auto& numerical = *feature.mutable_numerical();
+        if (num_non_missing == 0) {
+          break;
+        }
+        double sum = 0;
+        double sum_squared = 0;
+        float min_value = std::numeric_limits<float>::infinity();
+        float max_value = -std::numeric_limits<float>::infinity();
+        for (const auto& shard : shards_) {
+          const auto& src = shard->numerical[accumulator.numerical_idx];
+          sum += src.sum.load(std::memory_order_relaxed);
+          sum_squared += src.sum_squared.load(std::memory_order_relaxed);
+          min_value = std::min(min_value, src.min.load());
+          max_value = std::max(max_value, src.max.load());
+        }
+        numerical.set_sum(sum);
+        numerical.set_sum_squared(sum_squared);
+        numerical.set_min(min_value);
+        numerical.set_max(max_value);
+      } break;
+
+      case dataset::proto::ColumnType::CATEGORICAL: {
+        auto& count_per_value =
+            *feature.mutable_categorical()->mutable_count_per_value();
+        // Merge the counters of the shards.
+        counters.assign(accumulator.use_sketch
+                            ? sketch_size
+                            : accumulator.num_categorical_values,
+                        0);
+        for (const auto& shard : shards_) {
+          const auto* src = shard->categorical_counters.get() +
+                            accumulator.categorical_offset;
+          for (size_t counter_idx = 0; counter_idx < counters.size();
+               counter_idx++) {
+            counters[counter_idx] +=
+                src[counter_idx].load(std::memory_order_relaxed);
+          }
+        }
+        if (!accumulator.use_sketch) {
+          for (int value = 0; value < accumulator.num_categorical_values;
+               value++) {
+            if (counters[value] > 0) {
+              count_per_value[value] = counters[value];
+            }
+          }
+          break;
+        }
+        // Only the values tracked by the shards are exported. The other
+        // values might never have been observed.
+        for (const auto& shard : shards_) {
+          auto& heavy_hitters = shard->heavy_hitters[accumulator.sketch_idx];
+          absl::MutexLock lock(&heavy_hitters.mutex);
+          for (const int value : heavy_hitters.values) {
+            const int64_t count = SketchCount(counters.data(), value);
+            if (count > 0) {
+              count_per_value[value] = count;
+            }
+          }
+        }
+      } break;
+
+      default:
+        break;
+    }
+  }
+  return statistics;
+}
+
+std::string ConcurrentFeatureStatistics::BuildReport() const {
+  FeatureStatistics statistics(data_spec_, feature_indices_,
+                               na_replacement_values_);
+  CHECK_OK(statistics.ImportAndAggregate(Export()));
+  return statistics.BuildReport();
+}
+
 }  // namespace serving
 }  // namespace yggdrasil_decision_forests
@@ -18,8 +18,15 @@
 #ifndef YGGDRASIL_DECISION_FORESTS_SERVING_UTILS_H_
 #define YGGDRASIL_DECISION_FORESTS_SERVING_UTILS_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/model/abstract_model.h"
 #include "yggdrasil_decision_forests/serving/serving.pb.h"
 
@@ -87,7 +94,7 @@ class FeatureStatistics {
             model.features().fixed_length_na_replacement_values()) {}
 
   // Update the statistics from a new batch of examples.
-  void Update(const std::vector<NumericalOrCategoricalValue>& examples,
+  void Update(absl::Span<const NumericalOrCategoricalValue> examples,
               int num_examples, ExampleFormat format);
 
   // Update the statistics from a new batch of examples using the model api v2.
@@ -123,6 +130,166 @@ class FeatureStatistics {
   proto::FeatureStatistics statistics_;
 };
 
+// Accumulates the same statistics as "FeatureStatistics", but can be updated
+// concurrently from multiple threads. Designed to be fed by all the serving
+// threads for always-on drift monitoring.
+//
+// The statistics are accumulated in shards. Each thread updates (with relaxed
+// atomic operations) the shard assigned to it, and "Export" merges the shards.
+// The statistics of a batch of examples are aggregated locally before being
+// added to the shard i.e. the cost of the synchronization is amortized over
+// the batch.
+//
+// The memory usage is bounded and independent of the number of examples: The
+// values of categorical features with at most
+// "max_exact_categorical_values" possible values are counted exactly. The
+// values of categorical features with more possible values are counted with a
+// count-min sketch of "sketch_depth" x "sketch_width" counters. Each shard
+// also tracks the (at most) "max_sketched_values" values with the largest
+// estimated counts. Only those values are exported, and their exported counts
+// are upper bounds of the true counts. Tracking these values takes a per-shard
+// lock once per batch and per sketched feature; the other updates are
+// lock-free.
+//
+// This class is thread safe.
+//
+// Usage example:
+//
+//  ConcurrentFeatureStatistics stats(fast_model);
+//
+//  // In all the serving threads.
+//  stats.Update(examples, num_examples, ExampleFormat::FORMAT_EXAMPLE_MAJOR);
+//
+//  // Periodically, in a monitoring thread.
+//  LOG(INFO) << "Statistics:\n" << stats.BuildReport();
+//
+class ConcurrentFeatureStatistics {
+ public:
+  struct Options {
+    // Number of shards. Threads are assigned to the shards in a round robin
+    // manner. Should be close to the number of serving threads.
+    int num_shards = 16;
+
+    // Categorical features with at most this number of possible values are
+    // counted exactly.
+    int max_exact_categorical_values = 4096;
+
+    // Dimensions of the count-min sketch of the other categorical features.
+    // "sketch_width" is rounded up to a power of two.
+    int sketch_width = 1024;
+    int sketch_depth = 4;
+
+    // Maximum number of values of each sketched categorical feature tracked by
+    // each shard, and reported by "Export".
+    int max_sketched_values = 64;
+  };
+
+  // See the arguments of "FeatureStatistics".
+  ConcurrentFeatureStatistics(
+      const dataset::proto::DataSpecification* data_spec,
+      std::vector<int> feature_indices,
+      std::vector<NumericalOrCategoricalValue> na_replacement_values,
+      const Options& options);
+
+  ConcurrentFeatureStatistics(
+      const dataset::proto::DataSpecification* data_spec,
+      std::vector<int> feature_indices,
+      std::vector<NumericalOrCategoricalValue> na_replacement_values)
+      : ConcurrentFeatureStatistics(data_spec, std::move(feature_indices),
+                                    std::move(na_replacement_values),
+                                    Options()) {}
+
+  // Initialize the feature statistics using the fast model api v2.
+  //
+  // The "model" should outlive the "ConcurrentFeatureStatistics" object.
+  template <typename Model>
+  explicit ConcurrentFeatureStatistics(const Model& model,
+                                       const Options& options = Options())
+      : ConcurrentFeatureStatistics(
+            &model.features().data_spec(), ExtractIndices(model),
+            model.features().fixed_length_na_replacement_values(), options) {}
+
+  ~ConcurrentFeatureStatistics();
+
+  // Update the statistics from a new batch of examples. Can be called
+  // concurrently.
+  void Update(absl::Span<const NumericalOrCategoricalValue> examples,
+              int num_examples, ExampleFormat format);
+
+  // Update the statistics from a new batch of examples using the model api v2.
+  template <typename Model>
+  void Update(const typename Model::ExampleSet& examples, int num_examples,
+              const Model& model) {
+    Update(examples.InternalCategoricalAndNumericalValues(), num_examples,
+           Model::ExampleSet::kFormat);
+  }
+
+  // Merges the shards and exports the statistics in the format of
+  // "FeatureStatistics::Export". Can be called concurrently with "Update", in
+  // which case the updates in progress are partially exported.
+  proto::FeatureStatistics Export() const;
+
+  // Generates a human readable report about the statistics. See
+  // "FeatureStatistics::BuildReport".
+  std::string BuildReport() const;
+
+ private:
+  struct Shard;
+  struct HeavyHitters;
+
+  // How a feature is accumulated.
+  struct FeatureAccumulator {
+    dataset::proto::ColumnType type;
+    // Index of the feature in the numerical accumulators of the shards.
+    int numerical_idx = -1;
+    // Offset of the feature in the categorical counters of the shards.
+    size_t categorical_offset = 0;
+    // Number of possible categorical values.
+    int num_categorical_values = 0;
+    // If true, the categorical values are counted with a count-min sketch.
+    // Otherwise, each value has a counter.
+    bool use_sketch = false;
+    // Index of the feature in the heavy hitters of the shards. Only set if
+    // "use_sketch" is true.
+    int sketch_idx = -1;
+  };
+
+  template <typename Model>
+  static std::vector<int> ExtractIndices(const Model& model) {
+    std::vector<int> feature_indices;
+    feature_indices.reserve(model.features().fixed_length_features().size());
+    for (const auto& feature : model.features().fixed_length_features()) {
+      feature_indices.push_back(feature.spec_idx);
+    }
+    return feature_indices;
+  }
+
+  // Index of the sketch counter for "value" in row "row".
+  size_t SketchIndex(int row, int value) const;
+
+  // Count-min estimate of the count of "value" in the sketch "counters".
+  template <typename Counter>
+  int64_t SketchCount(const Counter* counters, int value) const;
+
+  // Adds "value" to the tracked values of a shard if its estimated count in
+  // the sketch "counters" of the shard is among the largest ones.
+  void OfferHeavyHitter(const std::atomic<int64_t>* counters, int value,
+                        HeavyHitters* heavy_hitters) const;
+
+  const dataset::proto::DataSpecification* data_spec_;
+  const std::vector<int> feature_indices_;
+  const std::vector<NumericalOrCategoricalValue> na_replacement_values_;
+  const Options options_;
+
+  std::vector<FeatureAccumulator> accumulators_;
+  int num_numerical_accumulators_ = 0;
+  int num_sketched_features_ = 0;
+  size_t num_categorical_counters_ = 0;
+  int log2_sketch_width_ = 0;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
 // =======================================
 //   Below are the template definitions.
 // =======================================
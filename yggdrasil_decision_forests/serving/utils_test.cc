@@ -18,6 +18,7 @@
 #include "yggdrasil_decision_forests/dataset/vertical_dataset_io.h"
 #include "yggdrasil_decision_forests/model/model_library.h"
 #include "yggdrasil_decision_forests/serving/decision_forest/decision_forest.h"
+#include "yggdrasil_decision_forests/utils/concurrency.h"
 #include "yggdrasil_decision_forests/utils/filesystem.h"
 #include "yggdrasil_decision_forests/utils/logging.h"
 #include "yggdrasil_decision_forests/utils/test.h"
@@ -232,6 +233,198 @@ TEST(FeatureStatistics, QKMS) {
   feature_statistics_adult(ExampleFormat::FORMAT_FEATURE_MAJOR);
 }
 
+TEST(ConcurrentFeatureStatistics, ToyExample) {
+  for (const auto format : {ExampleFormat::FORMAT_EXAMPLE_MAJOR,
+                            ExampleFormat::FORMAT_FEATURE_MAJOR}) {
+    dataset::VerticalDataset dataset;
+    *dataset.mutable_data_spec() = PARSE_TEST_PROTO(R"pb(
+      created_num_rows: 10
+      columns { type: NUMERICAL name: "a" }
+      columns { type: NUMERICAL name: "b" }
+      columns {
+        type: CATEGORICAL
+        name: "c"
+        categorical { is_already_integerized: true number_of_unique_values: 4 }
+      }
+    )pb");
+    CHECK_OK(dataset.CreateColumnsFromDataspec());
+    dataset.AppendExample({{"a", "1.0"}, {"b", "2.0"}, {"c", "1"}});
+    dataset.AppendExample({{"a", "2.0"}, {"b", "3.0"}, {"c", "2"}});
+    dataset.AppendExample({{"a", "3.0"}});
+
+    std::vector<NumericalOrCategoricalValue> replacement_values = {
+        NumericalOrCategoricalValue::Numerical(-1),
+        NumericalOrCategoricalValue::Numerical(-1),
+        NumericalOrCategoricalValue::Categorical(0)};
+    FeatureStatistics stats(&dataset.data_spec(), {0, 1, 2},
+                            replacement_values);
+    ConcurrentFeatureStatistics concurrent_stats(&dataset.data_spec(),
+                                                 {0, 1, 2}, replacement_values);
+    EXPECT_THAT(concurrent_stats.Export(), EqualsProto(stats.Export()));
+
+    std::vector<NumericalOrCategoricalValue> batch;
+    CHECK_OK(decision_forest::LoadFlatBatchFromDataset(
+        dataset, 0, 3, {"a", "b", "c"}, replacement_values, &batch, format));
+    for (int iteration = 0; iteration < 2; iteration++) {
+      stats.Update(batch, 3, format);
+      concurrent_stats.Update(batch, 3, format);
+      EXPECT_THAT(concurrent_stats.Export(), EqualsProto(stats.Export()));
+    }
+    EXPECT_EQ(concurrent_stats.BuildReport(), stats.BuildReport());
+  }
+}
+
+// Updates the statistics concurrently from multiple threads, and compares
+// them to the statistics computed sequentially.
+void concurrent_feature_statistics_adult(
+    const ConcurrentFeatureStatistics::Options& options,
+    const bool exact_categorical_counts) {
+  const auto model = LoadModel("adult_binary_class_gbdt");
+  const auto dataset = LoadDataset(model->data_spec(), "adult_test.csv");
+
+  auto* gbt_model =
+      dynamic_cast<model::gradient_boosted_trees::GradientBoostedTreesModel*>(
+          model.get());
+  decision_forest::GradientBoostedTreesBinaryClassification specialized_model;
+  CHECK_OK(GenericToSpecializedModel(*gbt_model, &specialized_model));
+
+  const auto format = ExampleFormat::FORMAT_EXAMPLE_MAJOR;
+  const int64_t batch_size = 10;
+  const int64_t num_batches = (dataset.nrow() + batch_size - 1) / batch_size;
+  std::vector<std::vector<NumericalOrCategoricalValue>> batches(num_batches);
+  std::vector<int> batch_sizes(num_batches);
+  FeatureStatistics expected_stats(specialized_model);
+  for (int64_t batch_idx = 0; batch_idx < num_batches; batch_idx++) {
+    const int64_t begin_example_idx = batch_idx * batch_size;
+    const int64_t end_example_idx =
+        std::min(begin_example_idx + batch_size, dataset.nrow());
+    batch_sizes[batch_idx] = end_example_idx - begin_example_idx;
+    CHECK_OK(decision_forest::LoadFlatBatchFromDataset(
+        dataset, begin_example_idx, end_example_idx,
+        FeatureNames(specialized_model.features().fixed_length_features()),
+        specialized_model.features().fixed_length_na_replacement_values(),
+        &batches[batch_idx], format));
+    expected_stats.Update(batches[batch_idx], batch_sizes[batch_idx], format);
+  }
+
+  ConcurrentFeatureStatistics stats(specialized_model, options);
+  {
+    utils::concurrency::ThreadPool pool("stats", /*num_threads=*/8);
+    pool.StartWorkers();
+    for (int64_t batch_idx = 0; batch_idx < num_batches; batch_idx++) {
+      pool.Schedule([&, batch_idx]() {
+        stats.Update(batches[batch_idx], batch_sizes[batch_idx], format);
+      });
+    }
+  }
+
+  const auto expected = expected_stats.Export();
+  const auto actual = stats.Export();
+  EXPECT_EQ(actual.num_examples(), dataset.nrow());
+  ASSERT_EQ(actual.features_size(), expected.features_size());
+  for (int feature_idx = 0; feature_idx < expected.features_size();
+       feature_idx++) {
+    const auto& expected_feature = expected.features(feature_idx);
+    const auto& actual_feature = actual.features(feature_idx);
+    EXPECT_EQ(actual_feature.num_non_missing(),
+              expected_feature.num_non_missing());
+    if (expected_feature.has_numerical()) {
+      const auto& expected_numerical = expected_feature.numerical();
+      const auto& actual_numerical = actual_feature.numerical();
+      EXPECT_NEAR(actual_numerical.sum(), expected_numerical.sum(),
+                  1e-6 * std::abs(expected_numerical.sum()));
+      EXPECT_NEAR(actual_numerical.sum_squared(),
+                  expected_numerical.sum_squared(),
+                  1e-6 * std::abs(expected_numerical.sum_squared()));
+      EXPECT_EQ(actual_numerical.min(), expected_numerical.min());
+      EXPECT_EQ(actual_numerical.max(), expected_numerical.max());
+    }
+    if (expected_feature.has_categorical()) {
+      const auto& expected_counts =
+          expected_feature.categorical().count_per_value();
+      const auto& actual_counts =
+          actual_feature.categorical().count_per_value();
+      for (const auto& expected_count : expected_counts) {
+        ASSERT_TRUE(actual_counts.contains(expected_count.first));
+        const auto actual_count = actual_counts.at(expected_count.first);
+        if (exact_categorical_counts) {
+          EXPECT_EQ(actual_count, expected_count.second);
+        } else {
+          // The count-min sketch never under-estimates the counts.
+          EXPECT_GE(actual_count, expected_count.second);
+          EXPECT_LE(actual_count, expected_count.second + dataset.nrow() / 100);
+        }
+      }
+      if (exact_categorical_counts) {
+        EXPECT_EQ(actual_counts.size(), expected_counts.size());
+      }
+    }
+  }
+}
+
+TEST(ConcurrentFeatureStatistics, Adult) {
+  concurrent_feature_statistics_adult({}, /*exact_categorical_counts=*/true);
+}
+
+TEST(ConcurrentFeatureStatistics, AdultWithSketch) {
+  ConcurrentFeatureStatistics::Options options;
+  options.num_shards = 3;
+  options.max_exact_categorical_values = 0;
+  options.sketch_width = 256;
+  concurrent_feature_statistics_adult(options,
+                                      /*exact_categorical_counts=*/false);
+}
+
+TEST(ConcurrentFeatureStatistics, SketchOnlyExportsObservedValues) {
+  dataset::proto::DataSpecification data_spec = PARSE_TEST_PROTO(R"pb(
+    columns {
+      type: CATEGORICAL
+      name: "a"
+      categorical {
+        is_already_integerized: true
+        number_of_unique_values: 100000
+      }
+    }
+  )pb");
+  const std::vector<NumericalOrCategoricalValue> replacement_values = {
+      NumericalOrCategoricalValue::Categorical(0)};
+  ConcurrentFeatureStatistics::Options options;
+  options.num_shards = 1;
+  options.sketch_width = 16;
+  options.sketch_depth = 2;
+  options.max_sketched_values = 2;
+  ConcurrentFeatureStatistics stats(&data_spec, {0}, replacement_values,
+                                    options);
+
+  // Value 1 is observed 100 times, value 2 50 times, and the values 3 to 12
+  // once. With a sketch of 16 counters per row, most of the vocabulary
+  // collides with an observed value.
+  std::vector<NumericalOrCategoricalValue> batch;
+  for (int i = 0; i < 100; i++) {
+    batch.push_back(NumericalOrCategoricalValue::Categorical(1));
+  }
+  for (int i = 0; i < 50; i++) {
+    batch.push_back(NumericalOrCategoricalValue::Categorical(2));
+  }
+  stats.Update(batch, batch.size(), ExampleFormat::FORMAT_EXAMPLE_MAJOR);
+  for (int value = 3; value <= 12; value++) {
+    const std::vector<NumericalOrCategoricalValue> single_batch = {
+        NumericalOrCategoricalValue::Categorical(value)};
+    stats.Update(single_batch, 1, ExampleFormat::FORMAT_EXAMPLE_MAJOR);
+  }
+
+  const auto statistics = stats.Export();
+  EXPECT_EQ(statistics.num_examples(), 160);
+  const auto& counts = statistics.features(0).categorical().count_per_value();
+  // Only the most frequent observed values are exported, with upper bounds of
+  // their counts.
+  EXPECT_EQ(counts.size(), 2);
+  ASSERT_TRUE(counts.contains(1));
+  ASSERT_TRUE(counts.contains(2));
+  EXPECT_GE(counts.at(1), 100);
+  EXPECT_GE(counts.at(2), 50);
+}
+
 }  // namespace
 }  // namespace serving
 }  // namespace yggdrasil_decision_forests
@@ -51,6 +51,9 @@ class ThreadPool {
   // Schedules a new job.
   void Schedule(std::function<void()> callback);
 
+  // Number of threads.
+  int num_threads() const { return num_threads_; }
+
  private:
   // Ensure all the jobs are done and all the threads have been joined.
   void JoinAllAndStopThreads();
@@ -47,6 +47,7 @@
 #include "gtest/gtest.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "yggdrasil_decision_forests/dataset/data_spec.pb.h"
 #include "yggdrasil_decision_forests/dataset/synthetic_dataset.pb.h"
 #include "yggdrasil_decision_forests/dataset/vertical_dataset.h"
@@ -190,7 +191,7 @@ void ExpectEqualPredictionsTemplate(const dataset::VerticalDataset& dataset,
 // generic engine.
 template <typename Engine,
           void (*PredictCall)(const Engine&,
-                              const std::vector<typename Engine::ValueType>&,
+                              absl::Span<const typename Engine::ValueType>,
                               int, std::vector<float>*)>
 void ExpectEqualPredictionsOldTemplate(
     const dataset::VerticalDataset& dataset, const model::AbstractModel& model,
@@ -238,7 +239,7 @@ void ExpectEqualPredictionsTemplate(const dataset::VerticalDataset& dataset,
 
 template <typename Engine,
           void (*PredictCall)(const Engine&,
-                              const std::vector<typename Engine::ValueType>&,
+                              absl::Span<const typename Engine::ValueType>,
                               int, std::vector<float>*)>
 void ExpectEqualPredictionsOldTemplate(
     const dataset::VerticalDataset& dataset, const model::AbstractModel& model,